@@ -0,0 +1,1045 @@
+#include "eaarlio/arrow.h"
+#include "eaarlio/error.h"
+#include "eaarlio/int_decode.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/pulse.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/units.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Arrow metadata is stored as flatbuffers. The few tables needed here are
+ * encoded by hand, front to back: each table is preceded by its vtable and
+ * followed by the strings, vectors, and tables it refers to. Flatbuffer
+ * offsets only point forward, so a reference is written as a placeholder and
+ * filled in once its target has been written.
+ *
+ * Field numbers and enum values below are from the Arrow format's Schema.fbs
+ * and Message.fbs.
+ */
+
+/* MetadataVersion V5 */
+#define _EAARLIO_ARROW_VERSION 4
+
+/* MessageHeader union */
+#define _EAARLIO_ARROW_HEADER_SCHEMA 1
+#define _EAARLIO_ARROW_HEADER_RECORD_BATCH 3
+
+/* Type union */
+#define _EAARLIO_ARROW_TYPE_INT 2
+#define _EAARLIO_ARROW_TYPE_FLOAT 3
+#define _EAARLIO_ARROW_TYPE_LIST 12
+#define _EAARLIO_ARROW_TYPE_FIXED_LIST 16
+
+/* Precision of FloatingPoint */
+#define _EAARLIO_ARROW_DOUBLE 2
+
+/* Marker at the start of each encapsulated message */
+#define _EAARLIO_ARROW_CONTINUATION 0xffffffffU
+
+/* Magic string at the start and end of the file format */
+#define _EAARLIO_ARROW_MAGIC "ARROW1\0\0"
+#define _EAARLIO_ARROW_MAGIC_SIZE 6
+
+/* Space reserved for a message's metadata. This is ample for the schema and
+ * for a record batch; the file footer also needs room for its blocks.
+ */
+#define _EAARLIO_ARROW_META_SIZE 8192U
+
+/* Size of an encoded Block struct in the file footer */
+#define _EAARLIO_ARROW_BLOCK_SIZE 24U
+
+/* List offsets are signed 32-bit values */
+#define _EAARLIO_ARROW_LIST_MAX 0x7fffffffU
+
+/* Most fields a table here has */
+#define _EAARLIO_ARROW_TABLE_FIELDS 6
+
+/**
+ * Data buffers of a record batch
+ *
+ * These are in the order the Arrow format lays them out: the fields in
+ * order, each followed by its children. Validity buffers are always empty,
+ * since no column has nulls, and are not stored.
+ */
+enum {
+    _EAARLIO_ARROW_COL_RASTER_NUMBER,
+    _EAARLIO_ARROW_COL_PULSE_NUMBER,
+    _EAARLIO_ARROW_COL_DIGITIZER,
+    _EAARLIO_ARROW_COL_TIME,
+    _EAARLIO_ARROW_COL_SCAN_ANGLE,
+    _EAARLIO_ARROW_COL_TIME_OFFSET,
+    _EAARLIO_ARROW_COL_SCAN_ANGLE_COUNTS,
+    _EAARLIO_ARROW_COL_RANGE,
+    _EAARLIO_ARROW_COL_RX_COUNT,
+    _EAARLIO_ARROW_COL_THRESH_TX,
+    _EAARLIO_ARROW_COL_THRESH_RX,
+    _EAARLIO_ARROW_COL_BIAS_TX,
+    _EAARLIO_ARROW_COL_BIAS_RX,
+    /** Offsets of each pulse's transmit waveform into TX */
+    _EAARLIO_ARROW_COL_TX_OFFSETS,
+    _EAARLIO_ARROW_COL_TX,
+    /** Offsets of each pulse's waveforms into RX_WAVEFORMS */
+    _EAARLIO_ARROW_COL_RX_OFFSETS,
+    /** Offsets of each waveform's samples into RX */
+    _EAARLIO_ARROW_COL_RX_WAVEFORMS,
+    _EAARLIO_ARROW_COL_RX,
+    _EAARLIO_ARROW_COLS
+};
+
+/* Buffers used when waveforms are not included */
+#define _EAARLIO_ARROW_COLS_NO_WAVEFORMS (_EAARLIO_ARROW_COL_BIAS_RX + 1)
+
+/**
+ * Description of a field in the schema
+ */
+struct _eaarlio_arrow_field {
+    /** Field name */
+    char const *name;
+    /** One of the _EAARLIO_ARROW_TYPE_ values */
+    uint8_t type;
+    /** Bit width for integers and floats; list size for fixed size lists */
+    int32_t param;
+    /** Is an integer signed? */
+    uint8_t is_signed;
+    /** Element field for lists, or NULL */
+    struct _eaarlio_arrow_field const *child;
+};
+
+static struct _eaarlio_arrow_field const _eaarlio_arrow_sample = {
+    "item", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL
+};
+
+static struct _eaarlio_arrow_field const _eaarlio_arrow_waveform = {
+    "item", _EAARLIO_ARROW_TYPE_LIST, 0, 0, &_eaarlio_arrow_sample
+};
+
+/* Top-level fields; the waveform fields must be last */
+static struct _eaarlio_arrow_field const _eaarlio_arrow_fields[] = {
+    { "raster_number", _EAARLIO_ARROW_TYPE_INT, 32, 0, NULL },
+    { "pulse_number", _EAARLIO_ARROW_TYPE_INT, 16, 0, NULL },
+    { "digitizer", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL },
+    { "time", _EAARLIO_ARROW_TYPE_FLOAT, 64, 0, NULL },
+    { "scan_angle", _EAARLIO_ARROW_TYPE_FLOAT, 64, 0, NULL },
+    { "time_offset", _EAARLIO_ARROW_TYPE_INT, 32, 0, NULL },
+    { "scan_angle_counts", _EAARLIO_ARROW_TYPE_INT, 16, 1, NULL },
+    { "range", _EAARLIO_ARROW_TYPE_INT, 16, 0, NULL },
+    { "rx_count", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL },
+    { "thresh_tx", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL },
+    { "thresh_rx", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL },
+    { "bias_tx", _EAARLIO_ARROW_TYPE_INT, 8, 0, NULL },
+    { "bias_rx", _EAARLIO_ARROW_TYPE_FIXED_LIST, EAARLIO_MAX_RX_COUNT, 0,
+        &_eaarlio_arrow_sample },
+    { "tx", _EAARLIO_ARROW_TYPE_LIST, 0, 0, &_eaarlio_arrow_sample },
+    { "rx", _EAARLIO_ARROW_TYPE_LIST, 0, 0, &_eaarlio_arrow_waveform },
+};
+
+#define _EAARLIO_ARROW_FIELDS                                                  \
+    (sizeof(_eaarlio_arrow_fields) / sizeof(_eaarlio_arrow_fields[0]))
+
+/* Fields used when waveforms are not included */
+#define _EAARLIO_ARROW_FIELDS_NO_WAVEFORMS (_EAARLIO_ARROW_FIELDS - 2)
+
+/**
+ * Growable byte buffer
+ */
+struct _eaarlio_arrow_buffer {
+    /** Data */
+    unsigned char *data;
+    /** Number of bytes of data */
+    uint64_t len;
+    /** Allocated size of #data */
+    uint64_t size;
+};
+
+/**
+ * Internal state for an Arrow writer
+ */
+struct _eaarlio_arrow_writer {
+    /** Data buffers of the pending record batch */
+    struct _eaarlio_arrow_buffer cols[_EAARLIO_ARROW_COLS];
+    /** Flatbuffer metadata of the message being written */
+    struct _eaarlio_arrow_buffer meta;
+    /** Encoded Block entries for the file footer */
+    struct _eaarlio_arrow_buffer blocks;
+    /** Number of top-level fields in use */
+    uint32_t field_count;
+    /** Number of entries of #cols in use */
+    uint32_t col_count;
+    /** Pulses in the pending record batch */
+    uint64_t rows;
+    /** A batch is written once it reaches this many pulses */
+    uint32_t batch_rows;
+    /** Bytes written so far */
+    int64_t position;
+    /** ::EAARLIO_ARROW_STREAM or ::EAARLIO_ARROW_FILE */
+    int format;
+};
+
+/**
+ * Table being encoded
+ */
+struct _eaarlio_arrow_table {
+    /** Position of the vtable */
+    uint64_t vtable;
+    /** Position of the table */
+    uint64_t start;
+    /** Number of fields */
+    uint16_t count;
+    /** Offset of each field from #start, or 0 if absent */
+    uint16_t offsets[_EAARLIO_ARROW_TABLE_FIELDS];
+};
+
+/**
+ * Walk of the fields to fill in a record batch's nodes and buffers
+ */
+struct _eaarlio_arrow_walk {
+    /** Writer whose batch is described */
+    struct _eaarlio_arrow_writer *aw;
+    /** Position of the FieldNode vector */
+    uint64_t nodes;
+    /** Position of the Buffer vector */
+    uint64_t buffers;
+    /** Next FieldNode */
+    uint32_t node;
+    /** Next Buffer */
+    uint32_t buffer;
+    /** Next entry of _eaarlio_arrow_writer::cols */
+    uint32_t col;
+    /** Offset into the body of the next buffer */
+    uint64_t body;
+};
+
+static eaarlio_error _eaarlio_arrow_reserve(struct eaarlio_memory *memory,
+    struct _eaarlio_arrow_buffer *buf,
+    uint64_t len)
+{
+    unsigned char *data;
+    uint64_t size;
+
+    if(buf->len + len <= buf->size)
+        return EAARLIO_SUCCESS;
+
+    size = buf->size ? buf->size : 4096;
+    while(size < buf->len + len)
+        size *= 2;
+    if(size > SIZE_MAX)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    data = memory->realloc(memory, buf->data, (size_t)size);
+    if(!data)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    buf->data = data;
+    buf->size = size;
+    return EAARLIO_SUCCESS;
+}
+
+/* Append a little-endian value; space must already be reserved */
+static void _eaarlio_arrow_put(struct _eaarlio_arrow_buffer *buf,
+    uint64_t val,
+    int width)
+{
+    int i;
+
+    assert(buf->len + width <= buf->size);
+    for(i = 0; i < width; i++) {
+        buf->data[buf->len++] = (unsigned char)(val & 0xff);
+        val >>= 8;
+    }
+}
+
+static void _eaarlio_arrow_put_bytes(struct _eaarlio_arrow_buffer *buf,
+    unsigned char const *src,
+    uint64_t len)
+{
+    assert(buf->len + len <= buf->size);
+    if(len)
+        memcpy(buf->data + buf->len, src, (size_t)len);
+    buf->len += len;
+}
+
+static void _eaarlio_arrow_put_double(struct _eaarlio_arrow_buffer *buf,
+    double val)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &val, sizeof(bits));
+    _eaarlio_arrow_put(buf, bits, 8);
+}
+
+/* Overwrite a little-endian value at an earlier position */
+static void _eaarlio_arrow_set(struct _eaarlio_arrow_buffer *buf,
+    uint64_t at,
+    uint64_t val,
+    int width)
+{
+    int i;
+
+    assert(at + width <= buf->len);
+    for(i = 0; i < width; i++) {
+        buf->data[at + i] = (unsigned char)(val & 0xff);
+        val >>= 8;
+    }
+}
+
+static void _eaarlio_arrow_pad(struct _eaarlio_arrow_buffer *buf,
+    uint32_t align)
+{
+    while(buf->len % align)
+        _eaarlio_arrow_put(buf, 0, 1);
+}
+
+/* Point the placeholder reference at @p at to @p target */
+static void _eaarlio_arrow_link(struct _eaarlio_arrow_buffer *buf,
+    uint64_t at,
+    uint64_t target)
+{
+    assert(target > at);
+    _eaarlio_arrow_set(buf, at, target - at, 4);
+}
+
+/* Start a table with @p count fields; returns the table's position */
+static uint64_t _eaarlio_arrow_table_start(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_table *table,
+    uint16_t count)
+{
+    uint32_t vsize = 4 + 2 * count;
+    uint32_t i;
+
+    assert(count <= _EAARLIO_ARROW_TABLE_FIELDS);
+
+    /* The table follows its vtable and is aligned for 8-byte fields */
+    _eaarlio_arrow_pad(buf, 2);
+    while((buf->len + vsize) % 8)
+        _eaarlio_arrow_put(buf, 0, 1);
+
+    table->vtable = buf->len;
+    for(i = 0; i < vsize; i += 2)
+        _eaarlio_arrow_put(buf, 0, 2);
+
+    table->start = buf->len;
+    table->count = count;
+    memset(table->offsets, 0, sizeof(table->offsets));
+
+    /* Distance back to the vtable */
+    _eaarlio_arrow_put(buf, vsize, 4);
+
+    return table->start;
+}
+
+static void _eaarlio_arrow_table_scalar(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_table *table,
+    uint16_t field,
+    uint64_t val,
+    int width)
+{
+    _eaarlio_arrow_pad(buf, width);
+    table->offsets[field] = (uint16_t)(buf->len - table->start);
+    _eaarlio_arrow_put(buf, val, width);
+}
+
+/* Add a reference field; returns its position for _eaarlio_arrow_link */
+static uint64_t _eaarlio_arrow_table_ref(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_table *table,
+    uint16_t field)
+{
+    uint64_t at;
+
+    _eaarlio_arrow_pad(buf, 4);
+    at = buf->len;
+    table->offsets[field] = (uint16_t)(at - table->start);
+    _eaarlio_arrow_put(buf, 0, 4);
+
+    return at;
+}
+
+static void _eaarlio_arrow_table_end(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_table *table)
+{
+    uint16_t i;
+
+    _eaarlio_arrow_set(buf, table->vtable, 4 + 2 * table->count, 2);
+    _eaarlio_arrow_set(buf, table->vtable + 2, buf->len - table->start, 2);
+    for(i = 0; i < table->count; i++)
+        _eaarlio_arrow_set(
+            buf, table->vtable + 4 + 2 * i, table->offsets[i], 2);
+}
+
+/* Add a zero-filled vector; returns its position. Elements start 4 bytes in.
+ */
+static uint64_t _eaarlio_arrow_vector(struct _eaarlio_arrow_buffer *buf,
+    uint32_t count,
+    uint32_t elem_size,
+    uint32_t align)
+{
+    uint64_t at;
+    uint64_t i;
+
+    _eaarlio_arrow_pad(buf, 4);
+    while((buf->len + 4) % align)
+        _eaarlio_arrow_put(buf, 0, 1);
+
+    at = buf->len;
+    _eaarlio_arrow_put(buf, count, 4);
+    for(i = 0; i < (uint64_t)count * elem_size; i++)
+        _eaarlio_arrow_put(buf, 0, 1);
+
+    return at;
+}
+
+static uint64_t _eaarlio_arrow_string(struct _eaarlio_arrow_buffer *buf,
+    char const *str)
+{
+    uint64_t at;
+    size_t len = strlen(str);
+
+    _eaarlio_arrow_pad(buf, 4);
+    at = buf->len;
+    _eaarlio_arrow_put(buf, len, 4);
+    _eaarlio_arrow_put_bytes(buf, (unsigned char const *)str, len);
+    _eaarlio_arrow_put(buf, 0, 1);
+
+    return at;
+}
+
+static uint64_t _eaarlio_arrow_encode_type(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_field const *field)
+{
+    struct _eaarlio_arrow_table table;
+    uint64_t start;
+
+    switch(field->type) {
+        case _EAARLIO_ARROW_TYPE_INT:
+            start = _eaarlio_arrow_table_start(buf, &table, 2);
+            _eaarlio_arrow_table_scalar(buf, &table, 0, field->param, 4);
+            _eaarlio_arrow_table_scalar(buf, &table, 1, field->is_signed, 1);
+            break;
+        case _EAARLIO_ARROW_TYPE_FLOAT:
+            start = _eaarlio_arrow_table_start(buf, &table, 1);
+            _eaarlio_arrow_table_scalar(
+                buf, &table, 0, _EAARLIO_ARROW_DOUBLE, 2);
+            break;
+        case _EAARLIO_ARROW_TYPE_FIXED_LIST:
+            start = _eaarlio_arrow_table_start(buf, &table, 1);
+            _eaarlio_arrow_table_scalar(buf, &table, 0, field->param, 4);
+            break;
+        default:
+            start = _eaarlio_arrow_table_start(buf, &table, 0);
+            break;
+    }
+    _eaarlio_arrow_table_end(buf, &table);
+
+    return start;
+}
+
+static uint64_t _eaarlio_arrow_encode_field(struct _eaarlio_arrow_buffer *buf,
+    struct _eaarlio_arrow_field const *field)
+{
+    struct _eaarlio_arrow_table table;
+    uint64_t start, name, type, children, vector;
+
+    /* Field: name, nullable, type_type, type, dictionary, children */
+    start = _eaarlio_arrow_table_start(buf, &table, 6);
+    name = _eaarlio_arrow_table_ref(buf, &table, 0);
+    type = _eaarlio_arrow_table_ref(buf, &table, 3);
+    children = _eaarlio_arrow_table_ref(buf, &table, 5);
+    _eaarlio_arrow_table_scalar(buf, &table, 1, 0, 1);
+    _eaarlio_arrow_table_scalar(buf, &table, 2, field->type, 1);
+    _eaarlio_arrow_table_end(buf, &table);
+
+    _eaarlio_arrow_link(buf, name, _eaarlio_arrow_string(buf, field->name));
+    _eaarlio_arrow_link(buf, type, _eaarlio_arrow_encode_type(buf, field));
+
+    /* Readers expect a children vector even when it is empty */
+    vector = _eaarlio_arrow_vector(buf, field->child ? 1 : 0, 4, 4);
+    _eaarlio_arrow_link(buf, children, vector);
+    if(field->child)
+        _eaarlio_arrow_link(buf, vector + 4,
+            _eaarlio_arrow_encode_field(buf, field->child));
+
+    return start;
+}
+
+static uint64_t _eaarlio_arrow_encode_schema(
+    struct _eaarlio_arrow_buffer *buf,
+    uint32_t field_count)
+{
+    struct _eaarlio_arrow_table table;
+    uint64_t start, fields, vector;
+    uint32_t i;
+
+    /* Schema: endianness, fields */
+    start = _eaarlio_arrow_table_start(buf, &table, 2);
+    _eaarlio_arrow_table_scalar(buf, &table, 0, 0, 2);
+    fields = _eaarlio_arrow_table_ref(buf, &table, 1);
+    _eaarlio_arrow_table_end(buf, &table);
+
+    vector = _eaarlio_arrow_vector(buf, field_count, 4, 4);
+    _eaarlio_arrow_link(buf, fields, vector);
+    for(i = 0; i < field_count; i++)
+        _eaarlio_arrow_link(buf, vector + 4 + 4 * i,
+            _eaarlio_arrow_encode_field(buf, &_eaarlio_arrow_fields[i]));
+
+    return start;
+}
+
+/* Start a Message at the beginning of @p buf; returns the position of the
+ * header reference
+ */
+static uint64_t _eaarlio_arrow_encode_message(
+    struct _eaarlio_arrow_buffer *buf,
+    uint8_t header_type,
+    uint64_t body_len)
+{
+    struct _eaarlio_arrow_table table;
+    uint64_t root, start, header;
+
+    buf->len = 0;
+    root = buf->len;
+    _eaarlio_arrow_put(buf, 0, 4);
+
+    /* Message: version, header_type, header, bodyLength */
+    start = _eaarlio_arrow_table_start(buf, &table, 4);
+    _eaarlio_arrow_table_scalar(buf, &table, 0, _EAARLIO_ARROW_VERSION, 2);
+    _eaarlio_arrow_table_scalar(buf, &table, 1, header_type, 1);
+    header = _eaarlio_arrow_table_ref(buf, &table, 2);
+    _eaarlio_arrow_table_scalar(buf, &table, 3, body_len, 8);
+    _eaarlio_arrow_table_end(buf, &table);
+
+    _eaarlio_arrow_link(buf, root, start);
+
+    return header;
+}
+
+static void _eaarlio_arrow_count_field(
+    struct _eaarlio_arrow_field const *field,
+    uint32_t *nodes,
+    uint32_t *buffers)
+{
+    (*nodes)++;
+    /* Validity, plus data or offsets */
+    *buffers += field->type == _EAARLIO_ARROW_TYPE_FIXED_LIST ? 1 : 2;
+    if(field->child)
+        _eaarlio_arrow_count_field(field->child, nodes, buffers);
+}
+
+static void _eaarlio_arrow_walk_buffer(struct _eaarlio_arrow_walk *walk,
+    uint64_t len)
+{
+    struct _eaarlio_arrow_buffer *buf = &walk->aw->meta;
+    uint64_t at = walk->buffers + 4 + 16 * walk->buffer++;
+
+    _eaarlio_arrow_set(buf, at, walk->body, 8);
+    _eaarlio_arrow_set(buf, at + 8, len, 8);
+    walk->body += (len + 7) & ~(uint64_t)7;
+}
+
+static void _eaarlio_arrow_walk_field(struct _eaarlio_arrow_walk *walk,
+    struct _eaarlio_arrow_field const *field,
+    uint64_t length)
+{
+    struct _eaarlio_arrow_buffer *buf = &walk->aw->meta;
+    struct _eaarlio_arrow_buffer *col;
+    uint64_t at = walk->nodes + 4 + 16 * walk->node++;
+
+    /* FieldNode: length, null_count */
+    _eaarlio_arrow_set(buf, at, length, 8);
+    _eaarlio_arrow_set(buf, at + 8, 0, 8);
+
+    /* No nulls, so no validity bitmap */
+    _eaarlio_arrow_walk_buffer(walk, 0);
+
+    switch(field->type) {
+        case _EAARLIO_ARROW_TYPE_FIXED_LIST:
+            _eaarlio_arrow_walk_field(
+                walk, field->child, length * field->param);
+            break;
+        case _EAARLIO_ARROW_TYPE_LIST:
+            /* The last offset is the number of child elements */
+            col = &walk->aw->cols[walk->col++];
+            _eaarlio_arrow_walk_buffer(walk, col->len);
+            _eaarlio_arrow_walk_field(walk, field->child,
+                eaarlio_int_decode_uint32(col->data + col->len - 4));
+            break;
+        default:
+            col = &walk->aw->cols[walk->col++];
+            _eaarlio_arrow_walk_buffer(walk, col->len);
+            break;
+    }
+}
+
+static uint64_t _eaarlio_arrow_encode_batch(struct _eaarlio_arrow_writer *aw)
+{
+    struct _eaarlio_arrow_buffer *buf = &aw->meta;
+    struct _eaarlio_arrow_table table;
+    struct _eaarlio_arrow_walk walk;
+    uint64_t start, nodes, buffers;
+    uint32_t node_count = 0;
+    uint32_t buffer_count = 0;
+    uint32_t i;
+
+    for(i = 0; i < aw->field_count; i++)
+        _eaarlio_arrow_count_field(
+            &_eaarlio_arrow_fields[i], &node_count, &buffer_count);
+
+    /* RecordBatch: length, nodes, buffers */
+    start = _eaarlio_arrow_table_start(buf, &table, 3);
+    _eaarlio_arrow_table_scalar(buf, &table, 0, aw->rows, 8);
+    nodes = _eaarlio_arrow_table_ref(buf, &table, 1);
+    buffers = _eaarlio_arrow_table_ref(buf, &table, 2);
+    _eaarlio_arrow_table_end(buf, &table);
+
+    walk.aw = aw;
+    walk.nodes = _eaarlio_arrow_vector(buf, node_count, 16, 8);
+    walk.buffers = _eaarlio_arrow_vector(buf, buffer_count, 16, 8);
+    walk.node = 0;
+    walk.buffer = 0;
+    walk.col = 0;
+    walk.body = 0;
+    _eaarlio_arrow_link(buf, nodes, walk.nodes);
+    _eaarlio_arrow_link(buf, buffers, walk.buffers);
+
+    for(i = 0; i < aw->field_count; i++)
+        _eaarlio_arrow_walk_field(&walk, &_eaarlio_arrow_fields[i], aw->rows);
+
+    assert(walk.node == node_count);
+    assert(walk.buffer == buffer_count);
+    assert(walk.col == aw->col_count);
+
+    return start;
+}
+
+static eaarlio_error _eaarlio_arrow_write(struct eaarlio_arrow_writer *writer,
+    unsigned char const *data,
+    uint64_t len)
+{
+    struct _eaarlio_arrow_writer *aw =
+        (struct _eaarlio_arrow_writer *)writer->internal;
+
+    aw->position += len;
+    return writer->stream->write(writer->stream, len, data);
+}
+
+/* Write the metadata in _eaarlio_arrow_writer::meta as a message */
+static eaarlio_error _eaarlio_arrow_write_meta(
+    struct eaarlio_arrow_writer *writer)
+{
+    struct _eaarlio_arrow_writer *aw =
+        (struct _eaarlio_arrow_writer *)writer->internal;
+    struct _eaarlio_arrow_buffer prefix;
+    unsigned char prefix_data[8];
+    eaarlio_error err;
+
+    _eaarlio_arrow_pad(&aw->meta, 8);
+
+    prefix.data = prefix_data;
+    prefix.len = 0;
+    prefix.size = sizeof(prefix_data);
+    _eaarlio_arrow_put(&prefix, _EAARLIO_ARROW_CONTINUATION, 4);
+    _eaarlio_arrow_put(&prefix, aw->meta.len, 4);
+
+    err = _eaarlio_arrow_write(writer, prefix.data, prefix.len);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    return _eaarlio_arrow_write(writer, aw->meta.data, aw->meta.len);
+}
+
+static void _eaarlio_arrow_release(struct eaarlio_arrow_writer *writer)
+{
+    struct _eaarlio_arrow_writer *aw =
+        (struct _eaarlio_arrow_writer *)writer->internal;
+    struct eaarlio_memory *memory = writer->memory;
+    int i;
+
+    if(aw) {
+        for(i = 0; i < _EAARLIO_ARROW_COLS; i++)
+            if(aw->cols[i].data)
+                memory->free(memory, aw->cols[i].data);
+        if(aw->meta.data)
+            memory->free(memory, aw->meta.data);
+        if(aw->blocks.data)
+            memory->free(memory, aw->blocks.data);
+        memory->free(memory, aw);
+    }
+
+    *writer = eaarlio_arrow_writer_empty();
+}
+
+eaarlio_error eaarlio_arrow_writer_init(struct eaarlio_arrow_writer *writer,
+    struct eaarlio_stream *stream,
+    int format,
+    int include_waveforms,
+    uint32_t batch_rows,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_arrow_writer *aw;
+    eaarlio_error err;
+    uint64_t header;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    *writer = eaarlio_arrow_writer_empty();
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(stream))
+        return EAARLIO_STREAM_INVALID;
+    if(format != EAARLIO_ARROW_STREAM && format != EAARLIO_ARROW_FILE)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    aw = memory->calloc(memory, 1, sizeof(struct _eaarlio_arrow_writer));
+    if(!aw)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    aw->format = format;
+    aw->batch_rows = batch_rows ? batch_rows : EAARLIO_ARROW_BATCH_ROWS;
+    if(include_waveforms) {
+        aw->field_count = _EAARLIO_ARROW_FIELDS;
+        aw->col_count = _EAARLIO_ARROW_COLS;
+    } else {
+        aw->field_count = _EAARLIO_ARROW_FIELDS_NO_WAVEFORMS;
+        aw->col_count = _EAARLIO_ARROW_COLS_NO_WAVEFORMS;
+    }
+
+    writer->stream = stream;
+    writer->memory = memory;
+    writer->internal = aw;
+
+    /* The magic is padded to 8 bytes, which _EAARLIO_ARROW_MAGIC includes */
+    if(format == EAARLIO_ARROW_FILE) {
+        err = _eaarlio_arrow_write(
+            writer, (unsigned char const *)_EAARLIO_ARROW_MAGIC, 8);
+        if(err != EAARLIO_SUCCESS)
+            goto fail;
+    }
+
+    err = _eaarlio_arrow_reserve(memory, &aw->meta, _EAARLIO_ARROW_META_SIZE);
+    if(err != EAARLIO_SUCCESS)
+        goto fail;
+
+    header = _eaarlio_arrow_encode_message(
+        &aw->meta, _EAARLIO_ARROW_HEADER_SCHEMA, 0);
+    _eaarlio_arrow_link(&aw->meta, header,
+        _eaarlio_arrow_encode_schema(&aw->meta, aw->field_count));
+
+    err = _eaarlio_arrow_write_meta(writer);
+    if(err != EAARLIO_SUCCESS)
+        goto fail;
+
+    return EAARLIO_SUCCESS;
+
+fail:
+    _eaarlio_arrow_release(writer);
+    return err;
+}
+
+eaarlio_error eaarlio_arrow_writer_write_raster(
+    struct eaarlio_arrow_writer *writer,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster)
+{
+    struct _eaarlio_arrow_writer *aw;
+    struct _eaarlio_arrow_buffer *cols;
+    struct eaarlio_pulse *pulse;
+    eaarlio_error err;
+    uint64_t tx_len = 0;
+    uint64_t rx_len = 0;
+    uint64_t rx_count = 0;
+    uint64_t need;
+    uint32_t i;
+    uint16_t p;
+    int k, rxn;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+    if(!writer->stream || !writer->internal)
+        return EAARLIO_STREAM_INVALID;
+
+    aw = (struct _eaarlio_arrow_writer *)writer->internal;
+    cols = aw->cols;
+
+    if(!raster->pulse || !raster->pulse_count)
+        return EAARLIO_SUCCESS;
+
+    if(aw->col_count == _EAARLIO_ARROW_COLS) {
+        for(p = 0; p < raster->pulse_count; p++) {
+            pulse = &raster->pulse[p];
+            if(pulse->tx)
+                tx_len += pulse->tx_len;
+            rxn = pulse->rx_count < EAARLIO_MAX_RX_COUNT
+                ? pulse->rx_count
+                : EAARLIO_MAX_RX_COUNT;
+            rx_count += rxn;
+            for(k = 0; k < rxn; k++)
+                if(pulse->rx[k])
+                    rx_len += pulse->rx_len[k];
+        }
+
+        if(tx_len > _EAARLIO_ARROW_LIST_MAX || rx_len > _EAARLIO_ARROW_LIST_MAX)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+
+        /* List offsets are 32-bit, so start a new batch if they would
+         * overflow
+         */
+        if(cols[_EAARLIO_ARROW_COL_TX].len + tx_len > _EAARLIO_ARROW_LIST_MAX
+            || cols[_EAARLIO_ARROW_COL_RX].len + rx_len
+                > _EAARLIO_ARROW_LIST_MAX) {
+            err = eaarlio_arrow_writer_flush(writer);
+            if(err != EAARLIO_SUCCESS)
+                return err;
+        }
+    }
+
+    /* Reserve everything first, so that a failure leaves the batch intact.
+     * Offset buffers may also need their leading zero.
+     */
+    for(i = 0; i < aw->col_count; i++) {
+        switch(i) {
+            case _EAARLIO_ARROW_COL_TIME:
+            case _EAARLIO_ARROW_COL_SCAN_ANGLE:
+                need = 8 * raster->pulse_count;
+                break;
+            case _EAARLIO_ARROW_COL_BIAS_RX:
+                need = EAARLIO_MAX_RX_COUNT * raster->pulse_count;
+                break;
+            case _EAARLIO_ARROW_COL_TX_OFFSETS:
+            case _EAARLIO_ARROW_COL_RX_OFFSETS:
+                need = 4 * (raster->pulse_count + 1);
+                break;
+            case _EAARLIO_ARROW_COL_TX:
+                need = tx_len;
+                break;
+            case _EAARLIO_ARROW_COL_RX_WAVEFORMS:
+                need = 4 * (rx_count + 1);
+                break;
+            case _EAARLIO_ARROW_COL_RX:
+                need = rx_len;
+                break;
+            default:
+                need = _eaarlio_arrow_fields[i].param / 8
+                    * raster->pulse_count;
+                break;
+        }
+        err = _eaarlio_arrow_reserve(writer->memory, &cols[i], need);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    if(aw->rows == 0 && aw->col_count == _EAARLIO_ARROW_COLS) {
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_TX_OFFSETS], 0, 4);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_RX_OFFSETS], 0, 4);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_RX_WAVEFORMS], 0, 4);
+    }
+
+    for(p = 0; p < raster->pulse_count; p++) {
+        pulse = &raster->pulse[p];
+
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_RASTER_NUMBER], raster_number, 4);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_PULSE_NUMBER], p + 1, 2);
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_DIGITIZER], raster->digitizer, 1);
+        _eaarlio_arrow_put_double(&cols[_EAARLIO_ARROW_COL_TIME],
+            eaarlio_units_pulse_time(raster, p + 1));
+        _eaarlio_arrow_put_double(&cols[_EAARLIO_ARROW_COL_SCAN_ANGLE],
+            eaarlio_units_pulse_scan_angle(pulse));
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_TIME_OFFSET], pulse->time_offset, 4);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_SCAN_ANGLE_COUNTS],
+            (uint16_t)pulse->scan_angle_counts, 2);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_RANGE], pulse->range, 2);
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_RX_COUNT], pulse->rx_count, 1);
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_THRESH_TX], pulse->thresh_tx, 1);
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_THRESH_RX], pulse->thresh_rx, 1);
+        _eaarlio_arrow_put(
+            &cols[_EAARLIO_ARROW_COL_BIAS_TX], pulse->bias_tx, 1);
+        _eaarlio_arrow_put_bytes(&cols[_EAARLIO_ARROW_COL_BIAS_RX],
+            pulse->bias_rx, EAARLIO_MAX_RX_COUNT);
+
+        if(aw->col_count < _EAARLIO_ARROW_COLS)
+            continue;
+
+        if(pulse->tx)
+            _eaarlio_arrow_put_bytes(
+                &cols[_EAARLIO_ARROW_COL_TX], pulse->tx, pulse->tx_len);
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_TX_OFFSETS],
+            cols[_EAARLIO_ARROW_COL_TX].len, 4);
+
+        rxn = pulse->rx_count < EAARLIO_MAX_RX_COUNT ? pulse->rx_count
+                                                     : EAARLIO_MAX_RX_COUNT;
+        for(k = 0; k < rxn; k++) {
+            if(pulse->rx[k])
+                _eaarlio_arrow_put_bytes(&cols[_EAARLIO_ARROW_COL_RX],
+                    pulse->rx[k], pulse->rx_len[k]);
+            _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_RX_WAVEFORMS],
+                cols[_EAARLIO_ARROW_COL_RX].len, 4);
+        }
+        _eaarlio_arrow_put(&cols[_EAARLIO_ARROW_COL_RX_OFFSETS],
+            cols[_EAARLIO_ARROW_COL_RX_WAVEFORMS].len / 4 - 1, 4);
+    }
+
+    aw->rows += raster->pulse_count;
+
+    if(aw->rows >= aw->batch_rows)
+        return eaarlio_arrow_writer_flush(writer);
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_arrow_writer_flush(struct eaarlio_arrow_writer *writer)
+{
+    static unsigned char const zeros[8] = { 0 };
+    struct _eaarlio_arrow_writer *aw;
+    struct _eaarlio_arrow_buffer *col;
+    eaarlio_error err;
+    uint64_t body_len = 0;
+    uint64_t header;
+    int64_t position;
+    uint32_t i;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!writer->stream || !writer->internal)
+        return EAARLIO_STREAM_INVALID;
+
+    aw = (struct _eaarlio_arrow_writer *)writer->internal;
+    if(aw->rows == 0)
+        return EAARLIO_SUCCESS;
+
+    for(i = 0; i < aw->col_count; i++)
+        body_len += (aw->cols[i].len + 7) & ~(uint64_t)7;
+
+    err = _eaarlio_arrow_reserve(
+        writer->memory, &aw->blocks, _EAARLIO_ARROW_BLOCK_SIZE);
+    if(err != EAARLIO_SUCCESS)
+        goto done;
+
+    header = _eaarlio_arrow_encode_message(
+        &aw->meta, _EAARLIO_ARROW_HEADER_RECORD_BATCH, body_len);
+    _eaarlio_arrow_link(&aw->meta, header, _eaarlio_arrow_encode_batch(aw));
+
+    position = aw->position;
+    err = _eaarlio_arrow_write_meta(writer);
+    if(err != EAARLIO_SUCCESS)
+        goto done;
+
+    for(i = 0; i < aw->col_count; i++) {
+        col = &aw->cols[i];
+        err = _eaarlio_arrow_write(writer, col->data, col->len);
+        if(err == EAARLIO_SUCCESS && col->len % 8)
+            err = _eaarlio_arrow_write(writer, zeros, 8 - col->len % 8);
+        if(err != EAARLIO_SUCCESS)
+            goto done;
+    }
+
+    /* Block: offset, metaDataLength, padding, bodyLength */
+    _eaarlio_arrow_put(&aw->blocks, (uint64_t)position, 8);
+    _eaarlio_arrow_put(&aw->blocks, 8 + aw->meta.len, 4);
+    _eaarlio_arrow_put(&aw->blocks, 0, 4);
+    _eaarlio_arrow_put(&aw->blocks, body_len, 8);
+
+done:
+    /* Pending data is dropped even on failure, since a partial write leaves
+     * no way to know what made it out.
+     */
+    for(i = 0; i < aw->col_count; i++)
+        aw->cols[i].len = 0;
+    aw->rows = 0;
+
+    return err;
+}
+
+eaarlio_error eaarlio_arrow_writer_close(struct eaarlio_arrow_writer *writer)
+{
+    struct _eaarlio_arrow_writer *aw;
+    struct _eaarlio_arrow_buffer *buf;
+    struct _eaarlio_arrow_table table;
+    eaarlio_error err;
+    unsigned char tail[8];
+    uint64_t root, start, schema, dictionaries, batches, vector;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!writer->stream || !writer->internal) {
+        *writer = eaarlio_arrow_writer_empty();
+        return EAARLIO_STREAM_INVALID;
+    }
+
+    aw = (struct _eaarlio_arrow_writer *)writer->internal;
+    buf = &aw->meta;
+
+    err = eaarlio_arrow_writer_flush(writer);
+    if(err != EAARLIO_SUCCESS)
+        goto done;
+
+    /* End-of-stream marker: a continuation with empty metadata */
+    memset(tail, 0, sizeof(tail));
+    memset(tail, 0xff, 4);
+    err = _eaarlio_arrow_write(writer, tail, 8);
+    if(err != EAARLIO_SUCCESS || aw->format != EAARLIO_ARROW_FILE)
+        goto done;
+
+    err = _eaarlio_arrow_reserve(
+        writer->memory, buf, _EAARLIO_ARROW_META_SIZE + aw->blocks.len);
+    if(err != EAARLIO_SUCCESS)
+        goto done;
+
+    buf->len = 0;
+    root = buf->len;
+    _eaarlio_arrow_put(buf, 0, 4);
+
+    /* Footer: version, schema, dictionaries, recordBatches */
+    start = _eaarlio_arrow_table_start(buf, &table, 4);
+    _eaarlio_arrow_table_scalar(buf, &table, 0, _EAARLIO_ARROW_VERSION, 2);
+    schema = _eaarlio_arrow_table_ref(buf, &table, 1);
+    dictionaries = _eaarlio_arrow_table_ref(buf, &table, 2);
+    batches = _eaarlio_arrow_table_ref(buf, &table, 3);
+    _eaarlio_arrow_table_end(buf, &table);
+    _eaarlio_arrow_link(buf, root, start);
+
+    _eaarlio_arrow_link(
+        buf, schema, _eaarlio_arrow_encode_schema(buf, aw->field_count));
+    _eaarlio_arrow_link(buf, dictionaries,
+        _eaarlio_arrow_vector(buf, 0, _EAARLIO_ARROW_BLOCK_SIZE, 8));
+    vector = _eaarlio_arrow_vector(buf,
+        (uint32_t)(aw->blocks.len / _EAARLIO_ARROW_BLOCK_SIZE),
+        _EAARLIO_ARROW_BLOCK_SIZE, 8);
+    if(aw->blocks.len)
+        memcpy(buf->data + vector + 4, aw->blocks.data,
+            (size_t)aw->blocks.len);
+    _eaarlio_arrow_link(buf, batches, vector);
+    _eaarlio_arrow_pad(buf, 8);
+
+    err = _eaarlio_arrow_write(writer, buf->data, buf->len);
+    if(err != EAARLIO_SUCCESS)
+        goto done;
+
+    /* Footer length, then the magic again */
+    tail[0] = (unsigned char)(buf->len & 0xff);
+    tail[1] = (unsigned char)(buf->len >> 8 & 0xff);
+    tail[2] = (unsigned char)(buf->len >> 16 & 0xff);
+    tail[3] = (unsigned char)(buf->len >> 24 & 0xff);
+    err = _eaarlio_arrow_write(writer, tail, 4);
+    if(err == EAARLIO_SUCCESS)
+        err = _eaarlio_arrow_write(writer,
+            (unsigned char const *)_EAARLIO_ARROW_MAGIC,
+            _EAARLIO_ARROW_MAGIC_SIZE);
+
+done:
+    _eaarlio_arrow_release(writer);
+    return err;
+}
@@ -0,0 +1,567 @@
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/error.h"
+#include "eaarlio/int_decode.h"
+#include "eaarlio/int_encode.h"
+#include "eaarlio/lz.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Identifies a compressed container */
+#define _EAARLIO_COMPRESSED_MAGIC "EAARLIOZ"
+/** Length of #_EAARLIO_COMPRESSED_MAGIC */
+#define _EAARLIO_COMPRESSED_MAGIC_SIZE 8
+/** Format version written and understood */
+#define _EAARLIO_COMPRESSED_VERSION 1
+/** Size of the encoded header */
+#define _EAARLIO_COMPRESSED_HEADER_SIZE 32
+/** Size of each encoded index entry */
+#define _EAARLIO_COMPRESSED_ENTRY_SIZE 12
+
+/**
+ * Container header
+ */
+struct _eaarlio_compressed_header {
+    /** Uncompressed size of each block; the last may be shorter */
+    uint32_t block_size;
+    /** Total uncompressed size */
+    uint64_t data_size;
+    /** Location of the block index */
+    uint64_t index_offset;
+};
+
+/**
+ * Internal state for a compressed stream
+ */
+struct _eaarlio_compressed_stream {
+    /** Stream containing the container */
+    struct eaarlio_stream inner;
+    /** Container header */
+    struct _eaarlio_compressed_header header;
+    /** Number of blocks */
+    uint32_t block_count;
+    /** Location of each block in #inner */
+    uint64_t *block_offset;
+    /** Stored size of each block; equal to its uncompressed size if stored
+     * without compression */
+    uint32_t *block_length;
+    /** Decompressed data for #block */
+    unsigned char *block_data;
+    /** Compressed data read from #inner */
+    unsigned char *read_buf;
+    /** Block held in #block_data, or #block_count if none */
+    uint32_t block;
+    /** Current position in the uncompressed data */
+    uint64_t position;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static void _eaarlio_compressed_encode_uint64(unsigned char *buf, uint64_t val)
+{
+    eaarlio_int_encode_uint32(buf, (uint32_t)(val & 0xffffffffU));
+    eaarlio_int_encode_uint32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static uint64_t _eaarlio_compressed_decode_uint64(unsigned char const *buf)
+{
+    return (uint64_t)eaarlio_int_decode_uint32(buf)
+        | (uint64_t)eaarlio_int_decode_uint32(buf + 4) << 32;
+}
+
+static void _eaarlio_compressed_encode_header(unsigned char *buf,
+    struct _eaarlio_compressed_header const *header)
+{
+    memcpy(buf, _EAARLIO_COMPRESSED_MAGIC, _EAARLIO_COMPRESSED_MAGIC_SIZE);
+    eaarlio_int_encode_uint16(buf + 8, _EAARLIO_COMPRESSED_VERSION);
+    eaarlio_int_encode_uint16(buf + 10, 0);
+    eaarlio_int_encode_uint32(buf + 12, header->block_size);
+    _eaarlio_compressed_encode_uint64(buf + 16, header->data_size);
+    _eaarlio_compressed_encode_uint64(buf + 24, header->index_offset);
+}
+
+static eaarlio_error _eaarlio_compressed_decode_header(
+    unsigned char const *buf,
+    struct _eaarlio_compressed_header *header)
+{
+    if(memcmp(buf, _EAARLIO_COMPRESSED_MAGIC, _EAARLIO_COMPRESSED_MAGIC_SIZE))
+        return EAARLIO_CORRUPT;
+    if(eaarlio_int_decode_uint16(buf + 8) != _EAARLIO_COMPRESSED_VERSION)
+        return EAARLIO_CORRUPT;
+
+    header->block_size = eaarlio_int_decode_uint32(buf + 12);
+    header->data_size = _eaarlio_compressed_decode_uint64(buf + 16);
+    header->index_offset = _eaarlio_compressed_decode_uint64(buf + 24);
+
+    if(header->block_size == 0
+        || header->block_size > EAARLIO_COMPRESSED_BLOCK_SIZE_MAX)
+        return EAARLIO_CORRUPT;
+    if(header->data_size > INT64_MAX || header->index_offset > INT64_MAX)
+        return EAARLIO_CORRUPT;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Number of blocks needed for data_size bytes, or 0 with an error if that is
+ * more than can be indexed.
+ */
+static eaarlio_error _eaarlio_compressed_block_count(
+    struct _eaarlio_compressed_header const *header,
+    uint32_t *block_count)
+{
+    uint64_t count = header->data_size / header->block_size
+        + (header->data_size % header->block_size ? 1 : 0);
+
+    if(count > UINT32_MAX
+        || count > SIZE_MAX / _EAARLIO_COMPRESSED_ENTRY_SIZE
+        || count > SIZE_MAX / sizeof(uint64_t))
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    *block_count = (uint32_t)count;
+    return EAARLIO_SUCCESS;
+}
+
+/* Uncompressed size of a block */
+static uint32_t _eaarlio_compressed_block_size(
+    struct _eaarlio_compressed_header const *header,
+    uint32_t block)
+{
+    uint64_t start = (uint64_t)block * header->block_size;
+    uint64_t remain = header->data_size - start;
+    return remain < header->block_size ? (uint32_t)remain : header->block_size;
+}
+
+eaarlio_error eaarlio_compress_stream(struct eaarlio_stream *out,
+    struct eaarlio_stream *in,
+    uint32_t block_size,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_compressed_header header;
+    unsigned char head_buf[_EAARLIO_COMPRESSED_HEADER_SIZE];
+    unsigned char *raw = NULL;
+    unsigned char *packed = NULL;
+    unsigned char *index = NULL;
+    uint32_t *table = NULL;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint32_t block_count = 0;
+    uint32_t i, len, packed_len;
+    uint64_t offset;
+    int64_t size;
+
+    if(!out)
+        return EAARLIO_NULL;
+    if(!in)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(out))
+        return EAARLIO_STREAM_INVALID;
+    if(!eaarlio_stream_valid(in))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    if(block_size == 0)
+        block_size = EAARLIO_COMPRESSED_BLOCK_SIZE;
+    if(block_size > EAARLIO_COMPRESSED_BLOCK_SIZE_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    err = in->seek(in, 0, SEEK_END);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = in->tell(in, &size);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = in->seek(in, 0, SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    header.block_size = block_size;
+    header.data_size = (uint64_t)size;
+    header.index_offset = 0;
+
+    err = _eaarlio_compressed_block_count(&header, &block_count);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    raw = memory->malloc(memory, block_size);
+    packed = memory->malloc(memory, block_size);
+    index = memory->malloc(
+        memory, (size_t)block_count * _EAARLIO_COMPRESSED_ENTRY_SIZE + 1);
+    table = memory->malloc(memory, EAARLIO_LZ_HASH_SIZE * sizeof(uint32_t));
+    if(!raw || !packed || !index || !table) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    /* The header is rewritten once the index location is known */
+    _eaarlio_compressed_encode_header(head_buf, &header);
+    err = out->write(out, _EAARLIO_COMPRESSED_HEADER_SIZE, head_buf);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    offset = _EAARLIO_COMPRESSED_HEADER_SIZE;
+
+    for(i = 0; i < block_count; i++) {
+        len = _eaarlio_compressed_block_size(&header, i);
+
+        err = in->read(in, len, raw);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        /* Blocks that do not shrink are stored as-is */
+        err = eaarlio_lz_compress(packed, len - 1, raw, len, &packed_len, table);
+        if(err == EAARLIO_SUCCESS) {
+            err = out->write(out, packed_len, packed);
+        } else if(err == EAARLIO_BUFFER_SHORT) {
+            packed_len = len;
+            err = out->write(out, len, raw);
+        }
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        _eaarlio_compressed_encode_uint64(
+            index + (size_t)i * _EAARLIO_COMPRESSED_ENTRY_SIZE, offset);
+        eaarlio_int_encode_uint32(
+            index + (size_t)i * _EAARLIO_COMPRESSED_ENTRY_SIZE + 8, packed_len);
+        offset += packed_len;
+    }
+
+    header.index_offset = offset;
+    err = out->write(
+        out, (uint64_t)block_count * _EAARLIO_COMPRESSED_ENTRY_SIZE, index);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    offset += (uint64_t)block_count * _EAARLIO_COMPRESSED_ENTRY_SIZE;
+
+    _eaarlio_compressed_encode_header(head_buf, &header);
+    err = out->seek(out, 0, SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    err = out->write(out, _EAARLIO_COMPRESSED_HEADER_SIZE, head_buf);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    err = out->seek(out, (int64_t)offset, SEEK_SET);
+
+cleanup:
+    if(raw)
+        memory->free(memory, raw);
+    if(packed)
+        memory->free(memory, packed);
+    if(index)
+        memory->free(memory, index);
+    if(table)
+        memory->free(memory, table);
+    return err;
+}
+
+/* Release everything owned by internal except the inner stream */
+static void _eaarlio_compressed_stream_free(
+    struct _eaarlio_compressed_stream *internal)
+{
+    struct eaarlio_memory memory = internal->memory;
+
+    if(internal->block_offset)
+        memory.free(&memory, internal->block_offset);
+    if(internal->block_length)
+        memory.free(&memory, internal->block_length);
+    if(internal->block_data)
+        memory.free(&memory, internal->block_data);
+    if(internal->read_buf)
+        memory.free(&memory, internal->read_buf);
+    memory.free(&memory, internal);
+}
+
+static eaarlio_error _eaarlio_compressed_stream_close(
+    struct eaarlio_stream *self)
+{
+    struct _eaarlio_compressed_stream *internal;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_compressed_stream *)self->data;
+
+    err = internal->inner.close(&internal->inner);
+    _eaarlio_compressed_stream_free(internal);
+
+    *self = eaarlio_stream_empty();
+
+    return err;
+}
+
+/* Decompress a block into block_data */
+static eaarlio_error _eaarlio_compressed_load(
+    struct _eaarlio_compressed_stream *internal,
+    uint32_t block)
+{
+    struct eaarlio_stream *inner = &internal->inner;
+    uint32_t len = _eaarlio_compressed_block_size(&internal->header, block);
+    uint32_t stored = internal->block_length[block];
+    eaarlio_error err;
+
+    internal->block = internal->block_count;
+
+    err = inner->seek(inner, (int64_t)internal->block_offset[block], SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(stored == len) {
+        err = inner->read(inner, len, internal->block_data);
+    } else {
+        err = inner->read(inner, stored, internal->read_buf);
+        if(err == EAARLIO_SUCCESS)
+            err = eaarlio_lz_decompress(
+                internal->block_data, len, internal->read_buf, stored);
+    }
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    internal->block = block;
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_compressed_stream_read(
+    struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct _eaarlio_compressed_stream *internal;
+    eaarlio_error err;
+    uint32_t block, start, avail;
+    uint64_t block_start, want;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_compressed_stream *)self->data;
+
+    while(len > 0) {
+        if(internal->position >= internal->header.data_size)
+            return EAARLIO_STREAM_READ_SHORT;
+
+        block = (uint32_t)(internal->position / internal->header.block_size);
+        if(block != internal->block) {
+            err = _eaarlio_compressed_load(internal, block);
+            if(err != EAARLIO_SUCCESS)
+                return err;
+        }
+
+        block_start = (uint64_t)block * internal->header.block_size;
+        start = (uint32_t)(internal->position - block_start);
+        avail = _eaarlio_compressed_block_size(&internal->header, block)
+            - start;
+        want = len < avail ? len : avail;
+
+        memcpy(buf, internal->block_data + start, (size_t)want);
+        buf += want;
+        len -= want;
+        internal->position += want;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_compressed_stream_write(
+    struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    (void)self;
+    (void)len;
+    (void)buf;
+    return EAARLIO_STREAM_NOT_IMPL;
+}
+
+static eaarlio_error _eaarlio_compressed_stream_seek(
+    struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_compressed_stream *internal;
+    int64_t base;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_compressed_stream *)self->data;
+
+    switch(whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)internal->position;
+            break;
+        case SEEK_END:
+            base = (int64_t)internal->header.data_size;
+            break;
+        default:
+            return EAARLIO_STREAM_SEEK_INVALID;
+    }
+
+    if(offset < 0 && base < -offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+    if(offset > 0 && base > INT64_MAX - offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+
+    internal->position = (uint64_t)(base + offset);
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_compressed_stream_tell(
+    struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_compressed_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(!position)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_compressed_stream *)self->data;
+    *position = (int64_t)internal->position;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Read and validate the header and index */
+static eaarlio_error _eaarlio_compressed_stream_load_index(
+    struct _eaarlio_compressed_stream *internal)
+{
+    struct eaarlio_stream *inner = &internal->inner;
+    struct eaarlio_memory *memory = &internal->memory;
+    unsigned char head_buf[_EAARLIO_COMPRESSED_HEADER_SIZE];
+    unsigned char *index = NULL;
+    unsigned char *entry;
+    eaarlio_error err;
+    uint32_t i, len;
+    uint64_t index_len;
+
+    err = inner->seek(inner, 0, SEEK_SET);
+    if(err == EAARLIO_SUCCESS)
+        err = inner->read(inner, _EAARLIO_COMPRESSED_HEADER_SIZE, head_buf);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        return EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = _eaarlio_compressed_decode_header(head_buf, &internal->header);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = _eaarlio_compressed_block_count(
+        &internal->header, &internal->block_count);
+    if(err != EAARLIO_SUCCESS)
+        return EAARLIO_CORRUPT;
+    internal->block = internal->block_count;
+
+    index_len = (uint64_t)internal->block_count * _EAARLIO_COMPRESSED_ENTRY_SIZE;
+    index = memory->malloc(memory, (size_t)index_len + 1);
+    internal->block_offset = memory->malloc(
+        memory, ((size_t)internal->block_count + 1) * sizeof(uint64_t));
+    internal->block_length = memory->malloc(
+        memory, ((size_t)internal->block_count + 1) * sizeof(uint32_t));
+    internal->block_data =
+        memory->malloc(memory, internal->header.block_size);
+    internal->read_buf = memory->malloc(memory, internal->header.block_size);
+    if(!index || !internal->block_offset || !internal->block_length
+        || !internal->block_data || !internal->read_buf) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    err = inner->seek(inner, (int64_t)internal->header.index_offset, SEEK_SET);
+    if(err == EAARLIO_SUCCESS)
+        err = inner->read(inner, index_len, index);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+    for(i = 0; i < internal->block_count; i++) {
+        entry = index + (size_t)i * _EAARLIO_COMPRESSED_ENTRY_SIZE;
+        internal->block_offset[i] = _eaarlio_compressed_decode_uint64(entry);
+        internal->block_length[i] = eaarlio_int_decode_uint32(entry + 8);
+
+        len = _eaarlio_compressed_block_size(&internal->header, i);
+        if(internal->block_offset[i] > INT64_MAX
+            || internal->block_length[i] == 0
+            || internal->block_length[i] > len) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    if(index)
+        memory->free(memory, index);
+    return err;
+}
+
+eaarlio_error eaarlio_compressed_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_compressed_stream *internal;
+    eaarlio_error err;
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!inner)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(inner))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal =
+        memory->calloc(memory, 1, sizeof(struct _eaarlio_compressed_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->memory = *memory;
+    internal->inner = *inner;
+
+    err = _eaarlio_compressed_stream_load_index(internal);
+    if(err != EAARLIO_SUCCESS) {
+        _eaarlio_compressed_stream_free(internal);
+        return err;
+    }
+
+    *inner = eaarlio_stream_empty();
+
+    stream->close = &_eaarlio_compressed_stream_close;
+    stream->read = &_eaarlio_compressed_stream_read;
+    stream->write = &_eaarlio_compressed_stream_write;
+    stream->seek = &_eaarlio_compressed_stream_seek;
+    stream->tell = &_eaarlio_compressed_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
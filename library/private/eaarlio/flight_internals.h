@@ -0,0 +1,134 @@
+#ifndef EAARLIO_FLIGHT_INTERNALS_H
+#define EAARLIO_FLIGHT_INTERNALS_H
+
+/**
+ * @file
+ * @brief Internals for flights: internal state and shared helpers
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * Internal state for ::eaarlio_flight::internal
+ */
+struct _eaarlio_flight_internal {
+    /** Stream for currently open TLD */
+    struct eaarlio_stream stream;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** ::eaarlio_edb_record::file_index corresponding to #stream */
+    int16_t file_index;
+    /** Are statistics being collected? */
+    int stats_enabled;
+    /** Statistics collected since the last reset */
+    struct eaarlio_stats stats;
+    /** Wrapper around #memory that counts into #stats */
+    struct eaarlio_stats_memory stats_memory;
+};
+
+/**
+ * Check that a flight is ready for reading rasters
+ *
+ * @param[in] flight Flight to check
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_flight_check(struct eaarlio_flight const *flight);
+
+/**
+ * Look up and validate the EDB record for a raster
+ *
+ * @param[in] flight Flight to use
+ * @param[in] raster_number Raster number to look up
+ * @param[out] record Pointer to record to be populated
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_FLIGHT_RASTER_INVALID if @p raster_number is not in the
+ *      EDB
+ * @retval ::EAARLIO_CORRUPT if the record references an invalid file
+ */
+eaarlio_error eaarlio_flight_record(struct eaarlio_flight const *flight,
+    uint32_t raster_number,
+    struct eaarlio_edb_record *record);
+
+/**
+ * Retrieve the internal stream for a TLD file, opening it if needed
+ *
+ * If the flight's internal stream is currently open to a different TLD file,
+ * then it is closed first.
+ *
+ * @param[in] flight Flight to use
+ * @param[in] file_index One-based index into ::eaarlio_edb::files
+ * @param[out] stream Pointer to be set to the flight's internal stream
+ *
+ * @returns_eaarlio_error
+ *
+ * @pre @p flight must have passed ::eaarlio_flight_check.
+ */
+eaarlio_error eaarlio_flight_stream(struct eaarlio_flight *flight,
+    int16_t file_index,
+    struct eaarlio_stream **stream);
+
+/**
+ * Open a TLD file with the flight's TLD opener
+ *
+ * When @p stats is given, the open is counted and timed, and @p stream is
+ * wrapped with ::eaarlio_stats_stream so that its use is counted as well.
+ *
+ * @param[in] flight Flight to use
+ * @param[out] stream Stream to open
+ * @param[in] file_index One-based index into ::eaarlio_edb::files
+ * @param[in] stats Statistics to update, or @c NULL
+ * @param[in] memory Memory handler for the wrapper
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_flight_open_tld(struct eaarlio_flight *flight,
+    struct eaarlio_stream *stream,
+    int16_t file_index,
+    struct eaarlio_stats *stats,
+    struct eaarlio_memory *memory);
+
+/**
+ * Memory handler for the flight to allocate with
+ *
+ * This is the counting wrapper while statistics are enabled, and the
+ * caller's memory handler otherwise.
+ *
+ * @param[in] flight Flight to use
+ *
+ * @pre @p flight must have passed ::eaarlio_flight_check.
+ */
+struct eaarlio_memory *eaarlio_flight_memory(struct eaarlio_flight *flight);
+
+/**
+ * Statistics for the flight to update
+ *
+ * @param[in] flight Flight to use
+ *
+ * @returns The flight's statistics, or @c NULL if they are not enabled
+ *
+ * @pre @p flight must have passed ::eaarlio_flight_check.
+ */
+struct eaarlio_stats *eaarlio_flight_active_stats(
+    struct eaarlio_flight *flight);
+
+/**
+ * Count a decoded raster
+ *
+ * @param[in,out] stats Statistics to update, or @c NULL to do nothing
+ * @param[in] raster Raster that was decoded
+ * @param[in] include_waveforms Were waveforms decoded? 1 = yes, 0 = no
+ */
+void eaarlio_flight_count_raster(struct eaarlio_stats *stats,
+    struct eaarlio_raster const *raster,
+    int include_waveforms);
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef EAARLIO_FLIGHT_PLAN_H
+#define EAARLIO_FLIGHT_PLAN_H
+
+/**
+ * @file
+ * @brief Access planning for batches of rasters
+ *
+ * This header provides the planning step used by ::eaarlio_flight_plan. A plan
+ * takes an arbitrary list of raster numbers, sorts them by their location on
+ * disk, and groups neighboring records into extents that can each be
+ * retrieved with a single read.
+ */
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stats.h"
+#include <stdint.h>
+
+/**
+ * Largest gap (in bytes) between two records that will still be merged into a
+ * single extent
+ *
+ * Reading across a small gap is cheaper than issuing a second read, since the
+ * gap is usually already in the same block on disk.
+ */
+#define EAARLIO_FLIGHT_PLAN_MAX_GAP 65536U
+
+/**
+ * A single raster request within a plan
+ */
+struct eaarlio_plan_entry {
+    /** Position of this request in the caller's list */
+    uint32_t index;
+    /** Raster number requested */
+    uint32_t raster_number;
+    /** EDB record for the raster */
+    struct eaarlio_edb_record record;
+};
+
+/**
+ * A contiguous byte range in a single TLD file
+ */
+struct eaarlio_plan_extent {
+    /** One-based index into ::eaarlio_edb::files */
+    int16_t file_index;
+    /** Byte offset into the TLD file */
+    uint32_t offset;
+    /** Byte length of the range */
+    uint32_t length;
+    /** Index into ::eaarlio_plan::entries of the first entry in this extent */
+    uint32_t first;
+    /** Number of entries in this extent */
+    uint32_t count;
+};
+
+/**
+ * Access plan
+ */
+struct eaarlio_plan {
+    /** Number of entries in ::eaarlio_plan::entries */
+    uint32_t entry_count;
+    /** Requests, sorted by file index and record offset */
+    struct eaarlio_plan_entry *entries;
+    /** Number of extents in ::eaarlio_plan::extents */
+    uint32_t extent_count;
+    /** Extents, in the order they should be read */
+    struct eaarlio_plan_extent *extents;
+    /** Length of the longest extent */
+    uint32_t max_length;
+};
+
+/**
+ * Empty ::eaarlio_plan value
+ *
+ * All numeric fields will contain zero values. All pointers will be null.
+ */
+#define eaarlio_plan_empty()                                                   \
+    (struct eaarlio_plan)                                                      \
+    {                                                                          \
+        0, NULL, 0, NULL, 0                                                    \
+    }
+
+/**
+ * Build an access plan
+ *
+ * @param[out] plan Plan to be populated
+ * @param[in] flight Flight whose EDB data should be used
+ * @param[in] raster_numbers Raster numbers requested
+ * @param[in] raster_count Number of entries in @p raster_numbers
+ * @param[in] max_read Largest extent to build, in bytes. Records larger than
+ *      this are still given an extent of their own. Use 0 for
+ *      ::EAARLIO_FLIGHT_PLAN_MAX_READ.
+ * @param[in] memory Memory handler, or @c NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_FLIGHT_RASTER_INVALID if any raster number is not in the
+ *      EDB
+ * @retval ::EAARLIO_CORRUPT if any raster references an invalid file
+ *
+ * @post On success, any non-null pointers in @p plan represent newly allocated
+ *      memory that must be released with ::eaarlio_plan_free.
+ * @post On failure, @p plan is empty.
+ */
+eaarlio_error eaarlio_plan_build(struct eaarlio_plan *plan,
+    struct eaarlio_flight const *flight,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    uint32_t max_read,
+    struct eaarlio_memory *memory);
+
+/**
+ * Decode the rasters in an extent and pass each one to a callback
+ *
+ * Rasters are decoded and delivered in the order they appear in @p buffer.
+ * Each raster is released after @p fn returns.
+ *
+ * @param[in] plan Plan that @p extent belongs to
+ * @param[in] extent Extent to decode
+ * @param[in] buffer The bytes read for @p extent; must be at least
+ *      @p extent->length bytes
+ * @param[in] memory Memory handler, or @c NULL for stdlib
+ * @param[in] include_pulses Should pulse data be decoded? 1 = yes, 0 = no
+ * @param[in] include_waveforms Should waveform data be decoded? 1 = yes, 0 =
+ *      no
+ * @param[in] fn Callback to receive each raster
+ * @param[in] ctx Context pointer passed through to @p fn
+ * @param[in,out] stats Statistics to update, or @c NULL. Time spent in @p fn
+ *      is not counted.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_TLD_TYPE_UNKNOWN if a record is not a raster
+ */
+eaarlio_error eaarlio_plan_decode_extent(struct eaarlio_plan const *plan,
+    struct eaarlio_plan_extent const *extent,
+    unsigned char const *buffer,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx,
+    struct eaarlio_stats *stats);
+
+/**
+ * Release memory held by an ::eaarlio_plan
+ *
+ * @param[in,out] plan Plan with memory to release
+ * @param[in] memory Memory handler, or @c NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_plan_free(struct eaarlio_plan *plan,
+    struct eaarlio_memory *memory);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef EAARLIO_LZ_H
+#define EAARLIO_LZ_H
+
+/**
+ * @file
+ * @brief Small built-in LZ77 codec
+ *
+ * This header provides a simple byte-oriented LZ77 codec used for the blocks
+ * of compressed streams. It favors decoding speed and having no external
+ * dependency over compression ratio.
+ *
+ * Compressed data is a series of sequences. Each sequence is:
+ *      - A token byte. The high nibble is the literal length and the low
+ *        nibble is the match length minus ::EAARLIO_LZ_MATCH_MIN.
+ *      - If the literal nibble is 15, extra length bytes follow. Each is added
+ *        to the length; a byte less than 255 ends the run.
+ *      - The literal bytes.
+ *      - If the input ends here, this is the last sequence. Otherwise, a
+ *        2-byte little-endian match offset (1 to 65535) follows.
+ *      - If the match nibble is 15, extra length bytes follow as for literals.
+ *
+ * Matches are copied from @c offset bytes back in the output and may overlap
+ * the bytes being produced.
+ */
+
+#include "eaarlio/error.h"
+#include <stdint.h>
+
+/**
+ * Shortest match encoded
+ */
+#define EAARLIO_LZ_MATCH_MIN 4U
+
+/**
+ * Number of entries in the hash table used by ::eaarlio_lz_compress
+ */
+#define EAARLIO_LZ_HASH_SIZE 4096U
+
+/**
+ * Largest compressed size possible for @p len bytes of input
+ *
+ * @p len must be no larger than 0xFE000000 for the result to fit in 32 bits.
+ */
+#define EAARLIO_LZ_BOUND(len) ((len) + (len) / 255U + 16U)
+
+/**
+ * Compress a buffer
+ *
+ * @param[out] dst Destination for the compressed data
+ * @param[in] dst_len Size of @p dst
+ * @param[in] src Data to compress
+ * @param[in] src_len Size of @p src
+ * @param[out] out_len Number of bytes written to @p dst
+ * @param[in,out] table Work space of ::EAARLIO_LZ_HASH_SIZE entries. Its
+ *      contents on entry do not matter.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if the compressed data does not fit in
+ *      @p dst. This never happens if @p dst_len is at least
+ *      ::EAARLIO_LZ_BOUND(@p src_len).
+ */
+eaarlio_error eaarlio_lz_compress(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *out_len,
+    uint32_t *table);
+
+/**
+ * Decompress a buffer
+ *
+ * @param[out] dst Destination for the decompressed data
+ * @param[in] dst_len Exact size of the decompressed data
+ * @param[in] src Compressed data
+ * @param[in] src_len Size of @p src
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if @p src is malformed or does not decompress to
+ *      exactly @p dst_len bytes. Nothing outside @p dst is written in that
+ *      case, though @p dst may be partially populated.
+ */
+eaarlio_error eaarlio_lz_decompress(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len);
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef EAARLIO_THREAD_SUPPORT_H
+#define EAARLIO_THREAD_SUPPORT_H
+
+/**
+ * @file
+ * @brief Support code for thread synchronization
+ *
+ * These are thin wrappers around POSIX threads. When the library is built
+ * without thread support (::EAARLIO_HAVE_PTHREADS is not defined), mutexes do
+ * nothing and threads run to completion as soon as they are started, which is
+ * correct as long as the library is only used from one thread.
+ */
+
+#include "eaarlio/error.h"
+#include <stdint.h>
+
+#ifdef EAARLIO_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+/**
+ * Mutual exclusion lock
+ */
+struct eaarlio_mutex {
+#ifdef EAARLIO_HAVE_PTHREADS
+    /** Underlying POSIX mutex */
+    pthread_mutex_t mutex;
+#else
+    /** Placeholder, since C99 does not permit empty structs */
+    int unused;
+#endif
+};
+
+/**
+ * Condition variable, used with ::eaarlio_mutex to wait for a change in state
+ */
+struct eaarlio_cond {
+#ifdef EAARLIO_HAVE_PTHREADS
+    /** Underlying POSIX condition variable */
+    pthread_cond_t cond;
+#else
+    /** Placeholder, since C99 does not permit empty structs */
+    int unused;
+#endif
+};
+
+/**
+ * Function run by a thread started with ::eaarlio_thread_start
+ */
+typedef void (*eaarlio_thread_fn)(void *arg);
+
+/**
+ * A thread of execution
+ */
+struct eaarlio_thread {
+#ifdef EAARLIO_HAVE_PTHREADS
+    /** Underlying POSIX thread */
+    pthread_t thread;
+#endif
+    /** Function to run */
+    eaarlio_thread_fn fn;
+    /** Argument for #fn */
+    void *arg;
+};
+
+/**
+ * Initialize a mutex
+ *
+ * @param[out] mutex Mutex to initialize
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_ALLOC_FAIL if the system could not create it
+ */
+eaarlio_error eaarlio_mutex_init(struct eaarlio_mutex *mutex);
+
+/**
+ * Release the resources held by a mutex
+ *
+ * @param[in,out] mutex Mutex initialized by ::eaarlio_mutex_init, which must
+ *      not be locked
+ */
+void eaarlio_mutex_destroy(struct eaarlio_mutex *mutex);
+
+/**
+ * Lock a mutex, waiting for another thread to unlock it if needed
+ */
+void eaarlio_mutex_lock(struct eaarlio_mutex *mutex);
+
+/**
+ * Unlock a mutex locked by the calling thread
+ */
+void eaarlio_mutex_unlock(struct eaarlio_mutex *mutex);
+
+/**
+ * Initialize a condition variable
+ *
+ * @param[out] cond Condition variable to initialize
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_ALLOC_FAIL if the system could not create it
+ */
+eaarlio_error eaarlio_cond_init(struct eaarlio_cond *cond);
+
+/**
+ * Release the resources held by a condition variable
+ *
+ * @param[in,out] cond Condition variable initialized by ::eaarlio_cond_init,
+ *      which must not have any waiters
+ */
+void eaarlio_cond_destroy(struct eaarlio_cond *cond);
+
+/**
+ * Unlock a mutex and wait for a condition variable to be signaled, then lock
+ * the mutex again
+ *
+ * As with POSIX condition variables, this may return without a signal, so
+ * the caller must check its condition again in a loop.
+ *
+ * Without thread support, this returns immediately. Code that waits must
+ * therefore only run when ::EAARLIO_HAVE_PTHREADS is defined.
+ */
+void eaarlio_cond_wait(struct eaarlio_cond *cond, struct eaarlio_mutex *mutex);
+
+/**
+ * Wake one thread waiting on a condition variable
+ */
+void eaarlio_cond_signal(struct eaarlio_cond *cond);
+
+/**
+ * Wake all threads waiting on a condition variable
+ */
+void eaarlio_cond_broadcast(struct eaarlio_cond *cond);
+
+/**
+ * Run a function in a new thread
+ *
+ * Without thread support, @p fn is run to completion before this returns.
+ *
+ * @param[out] thread Thread to start
+ * @param[in] fn Function to run
+ * @param[in] arg Argument for @p fn
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_ALLOC_FAIL if the system could not create it
+ *
+ * @post On success, ::eaarlio_thread_join must be called for @p thread.
+ */
+eaarlio_error eaarlio_thread_start(struct eaarlio_thread *thread,
+    eaarlio_thread_fn fn,
+    void *arg);
+
+/**
+ * Wait for a thread started by ::eaarlio_thread_start to finish
+ */
+void eaarlio_thread_join(struct eaarlio_thread *thread);
+
+/**
+ * Number of threads worth running at once
+ *
+ * @returns The number of online processors, or 1 without thread support or
+ *      if it cannot be determined
+ */
+uint32_t eaarlio_thread_count(void);
+
+#endif
@@ -53,4 +53,58 @@ eaarlio_error eaarlio_tld_pack_raster(unsigned char **buffer,
     struct eaarlio_raster *raster,
     struct eaarlio_memory *memory);
 
+/**
+ * Pack a raster into an existing buffer
+ *
+ * This is the same as ::eaarlio_tld_pack_raster except that the caller
+ * provides the buffer, so no memory is allocated. This allows a buffer to be
+ * reused across many rasters.
+ *
+ * @param[out] buffer Destination for encoded data
+ * @param[in] buffer_len Length of @p buffer; must be at least the size given
+ *      by ::eaarlio_tld_size_raster
+ * @param[in] raster Pointer to single raster to be encoded
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if @p buffer_len is too small
+ *
+ * @post On failure, @p buffer may be partially populated.
+ */
+eaarlio_error eaarlio_tld_pack_raster_into(unsigned char *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster);
+
+/**
+ * Pack a raster with packed waveforms into an existing buffer
+ *
+ * This encodes the data of an ::EAARLIO_TLD_TYPE_RASTER_WFPACK record. It is
+ * laid out as for ::eaarlio_tld_pack_raster_into, except that each waveform is
+ * packed with ::eaarlio_wfpack_encode and each pulse's waveform data length is
+ * the length of its packed waveforms. The size of the result is not known
+ * until it has been packed.
+ *
+ * @param[out] buffer Destination for encoded data
+ * @param[in] buffer_len Length of @p buffer
+ * @param[in] raster Pointer to single raster to be encoded
+ * @param[out] used Number of bytes of @p buffer used
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if @p buffer_len is too small
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if a pulse's packed waveforms are
+ *      too long to record
+ *
+ * @post On failure, @p buffer may be partially populated.
+ *
+ * @remark Packed waveforms are usually much smaller, but a waveform of noise
+ *      can be slightly larger. Callers that want the smaller encoding can pass
+ *      the size from ::eaarlio_tld_size_raster as @p buffer_len and fall back
+ *      to ::eaarlio_tld_pack_raster_into on ::EAARLIO_BUFFER_SHORT.
+ */
+eaarlio_error eaarlio_tld_pack_raster_wfpack_into(unsigned char *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    uint32_t *used);
+
 #endif
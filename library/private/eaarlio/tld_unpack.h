@@ -144,4 +144,63 @@ eaarlio_error eaarlio_tld_unpack_raster(unsigned char const *buffer,
     int include_pulses,
     int include_waveforms);
 
+/**
+ * Unpack the data for a raster with packed waveforms
+ *
+ * This is the same as ::eaarlio_tld_unpack_raster, except that it decodes the
+ * data of an ::EAARLIO_TLD_TYPE_RASTER_WFPACK record. Waveforms are unpacked
+ * with ::eaarlio_wfpack_decode.
+ *
+ * @retval ::EAARLIO_CORRUPT if the packed waveform data is invalid or
+ *      truncated
+ */
+eaarlio_error eaarlio_tld_unpack_raster_wfpack(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms);
+
+/**
+ * Unpack a full TLD record
+ *
+ * This function decodes a complete TLD record (record header followed by the
+ * record's data) from a buffer. This encapsulates the following functions:
+ *      - ::eaarlio_tld_decode_record_header
+ *      - ::eaarlio_tld_unpack_raster
+ *      - ::eaarlio_tld_unpack_raster_wfpack
+ *
+ * This is the buffer-based counterpart to ::eaarlio_tld_read_record and is
+ * intended for callers that have already retrieved the raw bytes for one or
+ * more records in a single read.
+ *
+ * If the record type does not hold a raster, then only
+ * @p record_header is populated and @p raster->pulse is set to @c NULL.
+ *
+ * On failure, @p raster may be partially populated. Any pointers not populated
+ * will be set to null. Any non-null pointers are newly allocated memory.
+ *
+ * @param[in] buffer Raw data to decode, starting at the record header
+ * @param[in] buffer_len Length of @p buffer
+ * @param[out] record_header Pointer to record header to be populated
+ * @param[out] raster Pointer to a single raster value to be populated
+ * @param[in] memory Memory handler, or @c NULL for stdlib
+ * @param[in] include_pulses Should pulse data be unpacked? 1 = yes, 0 = no
+ * @param[in] include_waveforms Should waveform data be unpacked? 1 = yes, 0 =
+ *      no
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if @p buffer does not hold the full record
+ *      as described by its header
+ * @retval ::EAARLIO_CORRUPT if the record header gives an impossible length
+ */
+eaarlio_error eaarlio_tld_unpack_record(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_tld_header *record_header,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms);
+
 #endif
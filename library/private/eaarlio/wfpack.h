@@ -0,0 +1,109 @@
+#ifndef EAARLIO_WFPACK_H
+#define EAARLIO_WFPACK_H
+
+/**
+ * @file
+ * @brief Lossless codec for waveform samples
+ *
+ * EAARL waveforms are 8-bit samples that change little from one sample to the
+ * next. This codec stores the difference between neighboring samples using
+ * only as many bits as needed, which takes much less space than the raw
+ * samples while remaining cheap to decode.
+ *
+ * A packed waveform of @c n samples is empty if @c n is 0. Otherwise it is:
+ *      - The first sample, as-is.
+ *      - The bit widths of each group of ::EAARLIO_WFPACK_GROUP deltas, as
+ *        4-bit values packed two per byte, low nibble first.
+ *      - The data for each group. A group of width @c w is @c w bit planes of
+ *        2 bytes each, starting with the lowest bit. Bit @c i (little-endian)
+ *        of plane @c b is bit @c b of the group's delta @c i.
+ *
+ * Each delta is the difference from the previous sample, modulo 256,
+ * zigzag-encoded so that small negative differences are small numbers too.
+ * Unused deltas in the last group are zero.
+ *
+ * Bit planes let a group be decoded with a handful of vector operations. When
+ * SSE2 is available, ::eaarlio_wfpack_decode uses it.
+ */
+
+#include "eaarlio/error.h"
+#include <stdint.h>
+
+/**
+ * Number of deltas in a group
+ */
+#define EAARLIO_WFPACK_GROUP 16U
+
+/**
+ * Number of groups needed for a waveform of @p len samples
+ */
+#define EAARLIO_WFPACK_GROUPS(len)                                             \
+    ((len) ? ((len)-1U + EAARLIO_WFPACK_GROUP - 1U) / EAARLIO_WFPACK_GROUP : 0U)
+
+/**
+ * Largest packed size possible for a waveform of @p len samples
+ */
+#define EAARLIO_WFPACK_BOUND(len)                                              \
+    ((len) ? 1U + (EAARLIO_WFPACK_GROUPS(len) + 1U) / 2U                       \
+            + EAARLIO_WFPACK_GROUPS(len) * EAARLIO_WFPACK_GROUP                \
+           : 0U)
+
+/**
+ * Pack a waveform
+ *
+ * @param[out] dst Destination for the packed data
+ * @param[in] dst_len Size of @p dst
+ * @param[in] src Samples to pack
+ * @param[in] src_len Number of samples in @p src
+ * @param[out] out_len Number of bytes written to @p dst
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if the packed data does not fit in @p dst.
+ *      This never happens if @p dst_len is at least
+ *      ::EAARLIO_WFPACK_BOUND(@p src_len).
+ *
+ * @post On failure, @p dst may be partially populated.
+ */
+eaarlio_error eaarlio_wfpack_encode(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *out_len);
+
+/**
+ * Unpack a waveform
+ *
+ * @param[out] dst Destination for the samples
+ * @param[in] dst_len Number of samples to unpack
+ * @param[in] src Packed data
+ * @param[in] src_len Size of @p src; this may be larger than the packed data
+ * @param[out] in_len Number of bytes of @p src used
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_BUFFER_SHORT if @p src is too short for the packed data
+ * @retval ::EAARLIO_CORRUPT if a group width is larger than 8
+ *
+ * @post On failure, @p dst may be partially populated.
+ */
+eaarlio_error eaarlio_wfpack_decode(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *in_len);
+
+/**
+ * Unpack a waveform without vector instructions
+ *
+ * This is the portable implementation that ::eaarlio_wfpack_decode falls back
+ * to. It is exposed so that the two can be compared. Parameters and results
+ * are the same as for ::eaarlio_wfpack_decode.
+ */
+eaarlio_error eaarlio_wfpack_decode_generic(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *in_len);
+
+#endif
@@ -0,0 +1,335 @@
+/* O_DIRECT is a Linux extension and pread and posix_fadvise are POSIX, none of
+ * which are part of C99, so they need to be requested explicitly.
+ */
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef EAARLIO_HAVE_PREAD
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Alignment used for the buffer, file offsets, and read lengths
+ *
+ * Direct I/O requires all three to be multiples of the device's logical block
+ * size. 4096 covers both 512-byte and 4K sector devices.
+ */
+#define _EAARLIO_DIRECT_ALIGN 4096U
+
+/**
+ * Internal state for a direct stream
+ */
+struct _eaarlio_direct_stream {
+    /** File descriptor */
+    int fd;
+    /** Is O_DIRECT in effect for #fd? */
+    int direct;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+    /** Allocation backing #buffer */
+    void *raw;
+    /** Aligned read buffer */
+    unsigned char *buffer;
+    /** Size of #buffer; a multiple of the alignment */
+    uint32_t buffer_size;
+    /** File offset of the first byte in #buffer */
+    uint64_t buffer_start;
+    /** Number of valid bytes in #buffer */
+    uint32_t buffer_len;
+    /** Current logical position in the file */
+    uint64_t position;
+};
+
+/* Stop using O_DIRECT for a file, after the filesystem has refused it. */
+static void _eaarlio_direct_disable(struct _eaarlio_direct_stream *internal)
+{
+#ifdef O_DIRECT
+    int flags = fcntl(internal->fd, F_GETFL);
+    if(flags != -1)
+        fcntl(internal->fd, F_SETFL, flags & ~O_DIRECT);
+#endif
+    internal->direct = 0;
+}
+
+/* Fill the buffer with the aligned block that contains position. */
+static eaarlio_error _eaarlio_direct_fill(
+    struct _eaarlio_direct_stream *internal,
+    uint64_t position)
+{
+    uint64_t start = position & ~(uint64_t)(_EAARLIO_DIRECT_ALIGN - 1);
+    ssize_t got;
+
+    if((uint64_t)(off_t)start != start)
+        return EAARLIO_STREAM_READ_ERROR;
+
+    while(1) {
+        got = pread(
+            internal->fd, internal->buffer, internal->buffer_size, (off_t)start);
+        if(got >= 0)
+            break;
+        if(errno == EINTR)
+            continue;
+        /* Some filesystems accept O_DIRECT at open but reject the reads */
+        if(errno == EINVAL && internal->direct) {
+            _eaarlio_direct_disable(internal);
+            continue;
+        }
+        internal->buffer_len = 0;
+        return EAARLIO_STREAM_READ_ERROR;
+    }
+
+    internal->buffer_start = start;
+    internal->buffer_len = (uint32_t)got;
+
+#ifdef EAARLIO_HAVE_POSIX_FADVISE
+    /* Without O_DIRECT, the data still went through the page cache. It has
+     * been copied into our buffer, so tell the kernel it can be dropped.
+     */
+    if(!internal->direct && got > 0)
+        posix_fadvise(internal->fd, (off_t)start, (off_t)got,
+            POSIX_FADV_DONTNEED);
+#endif
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_direct_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_direct_stream *internal;
+    struct eaarlio_memory memory;
+    int fail;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_direct_stream *)self->data;
+    memory = internal->memory;
+
+    fail = close(internal->fd);
+    memory.free(&memory, internal->raw);
+    memory.free(&memory, internal);
+
+    *self = eaarlio_stream_empty();
+
+    if(fail)
+        return EAARLIO_STREAM_CLOSE_ERROR;
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_direct_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct _eaarlio_direct_stream *internal;
+    uint64_t end, avail;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_direct_stream *)self->data;
+
+    while(len > 0) {
+        end = internal->buffer_start + internal->buffer_len;
+        if(internal->position < internal->buffer_start
+            || internal->position >= end) {
+            err = _eaarlio_direct_fill(internal, internal->position);
+            if(err != EAARLIO_SUCCESS)
+                return err;
+
+            end = internal->buffer_start + internal->buffer_len;
+            if(internal->position >= end)
+                return EAARLIO_STREAM_READ_SHORT;
+        }
+
+        avail = end - internal->position;
+        if(avail > len)
+            avail = len;
+
+        memcpy(buf,
+            internal->buffer + (internal->position - internal->buffer_start),
+            (size_t)avail);
+        buf += avail;
+        len -= avail;
+        internal->position += avail;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_direct_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_direct_stream *internal;
+    struct stat st;
+    int64_t base;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_direct_stream *)self->data;
+
+    switch(whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)internal->position;
+            break;
+        case SEEK_END:
+            if(fstat(internal->fd, &st))
+                return EAARLIO_STREAM_SEEK_ERROR;
+            base = (int64_t)st.st_size;
+            break;
+        default:
+            return EAARLIO_STREAM_SEEK_INVALID;
+    }
+
+    if(offset < 0 && base < -offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+    if(offset > 0 && base > INT64_MAX - offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+
+    internal->position = (uint64_t)(base + offset);
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_direct_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_direct_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(!position)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_direct_stream *)self->data;
+    *position = (int64_t)internal->position;
+
+    return EAARLIO_SUCCESS;
+}
+
+#endif /* EAARLIO_HAVE_PREAD */
+
+/* Direct streams are read-only, including the plain file stream fallback */
+static eaarlio_error _eaarlio_direct_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    (void)self;
+    (void)len;
+    (void)buf;
+    return EAARLIO_STREAM_NOT_IMPL;
+}
+
+eaarlio_error eaarlio_file_direct_stream(struct eaarlio_stream *stream,
+    char const *fn,
+    uint32_t buffer_size,
+    struct eaarlio_memory *memory)
+{
+#ifdef EAARLIO_HAVE_PREAD
+    struct _eaarlio_direct_stream *internal;
+    uintptr_t aligned;
+    int fd = -1;
+#endif
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!fn)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+#ifdef EAARLIO_HAVE_PREAD
+    if(buffer_size == 0)
+        buffer_size = EAARLIO_FILE_DIRECT_BUFFER_SIZE;
+    if(buffer_size > UINT32_MAX - _EAARLIO_DIRECT_ALIGN)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+    buffer_size = (buffer_size + _EAARLIO_DIRECT_ALIGN - 1)
+        & ~(_EAARLIO_DIRECT_ALIGN - 1);
+
+    internal = memory->calloc(memory, 1, sizeof(struct _eaarlio_direct_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->memory = *memory;
+    internal->buffer_size = buffer_size;
+    internal->raw =
+        memory->malloc(memory, (size_t)buffer_size + _EAARLIO_DIRECT_ALIGN - 1);
+    if(!internal->raw) {
+        memory->free(memory, internal);
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    }
+    aligned = ((uintptr_t)internal->raw + _EAARLIO_DIRECT_ALIGN - 1)
+        & ~(uintptr_t)(_EAARLIO_DIRECT_ALIGN - 1);
+    internal->buffer = (unsigned char *)aligned;
+
+#ifdef O_DIRECT
+    fd = open(fn, O_RDONLY | O_CLOEXEC | O_DIRECT);
+    internal->direct = fd >= 0;
+#endif
+    /* Filesystems such as tmpfs refuse O_DIRECT outright */
+    if(fd < 0)
+        fd = open(fn, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        memory->free(memory, internal->raw);
+        memory->free(memory, internal);
+        return EAARLIO_STREAM_OPEN_ERROR;
+    }
+    internal->fd = fd;
+
+#ifdef EAARLIO_HAVE_POSIX_FADVISE
+    if(!internal->direct)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    stream->close = &_eaarlio_direct_stream_close;
+    stream->read = &_eaarlio_direct_stream_read;
+    stream->write = &_eaarlio_direct_stream_write;
+    stream->seek = &_eaarlio_direct_stream_seek;
+    stream->tell = &_eaarlio_direct_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+#else
+    eaarlio_error err;
+
+    (void)buffer_size;
+    err = eaarlio_file_stream(stream, fn, "r");
+    if(err == EAARLIO_SUCCESS)
+        stream->write = &_eaarlio_direct_stream_write;
+    return err;
+#endif
+}
@@ -0,0 +1,765 @@
+/* Positional reads, open, and the io_uring system calls are not part of C99,
+ * so the POSIX and Linux interfaces need to be requested explicitly.
+ */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/flight_internals.h"
+#include "eaarlio/flight_plan.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef EAARLIO_HAVE_PREAD
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef EAARLIO_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+/**
+ * Largest extent read by the io_uring backend
+ *
+ * Every slot in the buffer ring is this large (or as large as the largest
+ * single record), so this bounds the memory used to queue_depth times this
+ * value.
+ */
+#define _EAARLIO_FETCH_URING_MAX_READ 262144U
+
+/**
+ * Largest queue depth accepted by the io_uring backend
+ */
+#define _EAARLIO_FETCH_URING_MAX_DEPTH 4096U
+
+#ifdef EAARLIO_HAVE_PREAD
+
+/**
+ * State shared by the file descriptor based backends
+ */
+struct _eaarlio_fetch {
+    /** Plan being executed */
+    struct eaarlio_plan plan;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Flight being read */
+    struct eaarlio_flight const *flight;
+    /** Directory holding the TLD files */
+    char const *tld_path;
+    /** Length of #tld_path */
+    size_t path_len;
+    /** File descriptors indexed by file_index - 1; -1 if not open */
+    int *fds;
+    /**
+     * Extents not yet finished for each file, indexed like #fds. A file is
+     * closed once its count reaches zero.
+     */
+    uint32_t *remaining;
+    /** Number of entries in #fds and #remaining */
+    uint32_t fd_count;
+    /** Should pulse data be decoded? */
+    int include_pulses;
+    /** Should waveform data be decoded? */
+    int include_waveforms;
+    /** Caller's callback */
+    eaarlio_flight_raster_fn fn;
+    /** Caller's context */
+    void *ctx;
+    /** Flight's statistics, or @c NULL if they are not enabled */
+    struct eaarlio_stats *stats;
+};
+
+/* Set up descriptor tracking for the files referenced by the plan. Files are
+ * only opened when their first extent is read, so that a large request does
+ * not hold a descriptor for every TLD file at once.
+ */
+static eaarlio_error _eaarlio_fetch_files(struct _eaarlio_fetch *fetch,
+    struct eaarlio_flight const *flight,
+    char const *tld_path)
+{
+    struct eaarlio_memory *memory = fetch->memory;
+    uint32_t i;
+
+    fetch->flight = flight;
+    fetch->tld_path = tld_path;
+    fetch->path_len = eaarlio_strnlen(tld_path, PATH_MAX);
+    if(fetch->path_len == PATH_MAX)
+        return EAARLIO_STRING_UNTERMINATED;
+
+    fetch->fd_count = flight->edb.file_count;
+    fetch->fds = memory->malloc(memory, fetch->fd_count * sizeof(int));
+    if(!fetch->fds)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    for(i = 0; i < fetch->fd_count; i++)
+        fetch->fds[i] = -1;
+
+    fetch->remaining =
+        memory->calloc(memory, fetch->fd_count, sizeof(uint32_t));
+    if(!fetch->remaining)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    for(i = 0; i < fetch->plan.extent_count; i++)
+        fetch->remaining[fetch->plan.extents[i].file_index - 1]++;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Make sure the TLD file for file_index is open. */
+static eaarlio_error _eaarlio_fetch_file_open(struct _eaarlio_fetch *fetch,
+    int16_t file_index)
+{
+    struct eaarlio_memory *memory = fetch->memory;
+    struct eaarlio_flight const *flight = fetch->flight;
+    uint32_t file = file_index - 1;
+    size_t name_len;
+    char *path;
+    double start = 0;
+
+    if(fetch->fds[file] >= 0)
+        return EAARLIO_SUCCESS;
+
+    name_len = eaarlio_strnlen(
+        flight->edb.files[file], EAARLIO_EDB_FILENAME_MAX_LENGTH + 1);
+    if(name_len > EAARLIO_EDB_FILENAME_MAX_LENGTH)
+        return EAARLIO_STRING_UNTERMINATED;
+
+    path = memory->malloc(memory, fetch->path_len + name_len + 2);
+    if(!path)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    strcpy(path, fetch->tld_path);
+    strcat(path, "/");
+    strcat(path, flight->edb.files[file]);
+
+    if(fetch->stats)
+        start = eaarlio_clock();
+    fetch->fds[file] = open(path, O_RDONLY | O_CLOEXEC);
+    if(fetch->stats)
+        fetch->stats->io_seconds += eaarlio_clock() - start;
+    memory->free(memory, path);
+
+    if(fetch->fds[file] < 0)
+        return EAARLIO_STREAM_OPEN_ERROR;
+    if(fetch->stats)
+        fetch->stats->tld_opens++;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Note that one extent of file_index has been read, closing the file after
+ * its last one.
+ */
+static void _eaarlio_fetch_file_done(struct _eaarlio_fetch *fetch,
+    int16_t file_index)
+{
+    uint32_t file = file_index - 1;
+
+    if(--fetch->remaining[file] == 0 && fetch->fds[file] >= 0) {
+        close(fetch->fds[file]);
+        fetch->fds[file] = -1;
+    }
+}
+
+/* Close any descriptors still open and release the plan. */
+static void _eaarlio_fetch_close(struct _eaarlio_fetch *fetch)
+{
+    uint32_t i;
+
+    if(fetch->fds) {
+        for(i = 0; i < fetch->fd_count; i++)
+            if(fetch->fds[i] >= 0)
+                close(fetch->fds[i]);
+        fetch->memory->free(fetch->memory, fetch->fds);
+        fetch->fds = NULL;
+    }
+    if(fetch->remaining) {
+        fetch->memory->free(fetch->memory, fetch->remaining);
+        fetch->remaining = NULL;
+    }
+
+    eaarlio_plan_free(&fetch->plan, fetch->memory);
+}
+
+/* Decode the extent held in buffer and deliver its rasters. */
+static eaarlio_error _eaarlio_fetch_deliver(struct _eaarlio_fetch *fetch,
+    struct eaarlio_plan_extent const *extent,
+    unsigned char const *buffer)
+{
+    return eaarlio_plan_decode_extent(&fetch->plan, extent, buffer,
+        fetch->memory, fetch->include_pulses, fetch->include_waveforms,
+        fetch->fn, fetch->ctx, fetch->stats);
+}
+
+/* Read an entire extent with pread, retrying short reads. Each call is
+ * counted in stats, if given.
+ */
+static eaarlio_error _eaarlio_fetch_pread_extent(int fd,
+    struct eaarlio_plan_extent const *extent,
+    unsigned char *buffer,
+    struct eaarlio_stats *stats)
+{
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint32_t done = 0;
+    ssize_t got;
+    double start = 0;
+
+    if(stats)
+        start = eaarlio_clock();
+
+    while(done < extent->length) {
+        got = pread(fd, buffer + done, extent->length - done,
+            (off_t)extent->offset + done);
+        if(stats) {
+            stats->read_calls++;
+            if(got > 0)
+                stats->bytes_read += (uint64_t)got;
+        }
+        if(got < 0) {
+            if(errno == EINTR)
+                continue;
+            err = EAARLIO_STREAM_READ_ERROR;
+            break;
+        }
+        if(got == 0) {
+            err = EAARLIO_STREAM_READ_SHORT;
+            break;
+        }
+        done += (uint32_t)got;
+    }
+
+    if(stats)
+        stats->io_seconds += eaarlio_clock() - start;
+    return err;
+}
+
+/* The pread backend: read each extent in disk order and decode it. */
+static eaarlio_error _eaarlio_fetch_pread(struct _eaarlio_fetch *fetch)
+{
+    struct eaarlio_memory *memory = fetch->memory;
+    struct eaarlio_plan_extent *extent;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    unsigned char *buf;
+    uint32_t i;
+
+    buf = memory->malloc(memory, fetch->plan.max_length);
+    if(!buf)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    for(i = 0; i < fetch->plan.extent_count; i++) {
+        extent = &fetch->plan.extents[i];
+
+        err = _eaarlio_fetch_file_open(fetch, extent->file_index);
+        if(err != EAARLIO_SUCCESS)
+            break;
+        err = _eaarlio_fetch_pread_extent(
+            fetch->fds[extent->file_index - 1], extent, buf, fetch->stats);
+        if(err != EAARLIO_SUCCESS)
+            break;
+        _eaarlio_fetch_file_done(fetch, extent->file_index);
+
+        err = _eaarlio_fetch_deliver(fetch, extent, buf);
+        if(err != EAARLIO_SUCCESS)
+            break;
+    }
+
+    memory->free(memory, buf);
+    return err;
+}
+
+#endif /* EAARLIO_HAVE_PREAD */
+
+#ifdef EAARLIO_HAVE_IO_URING
+
+/**
+ * A minimal io_uring instance, driven through the raw system calls
+ */
+struct _eaarlio_uring {
+    /** Ring file descriptor */
+    int fd;
+    /** Mapping for the submission queue ring */
+    void *sq_ring;
+    /** Length of #sq_ring */
+    size_t sq_ring_len;
+    /** Mapping for the completion queue ring; may equal #sq_ring */
+    void *cq_ring;
+    /** Length of #cq_ring */
+    size_t cq_ring_len;
+    /** Mapping for the submission queue entries */
+    struct io_uring_sqe *sqes;
+    /** Length of #sqes */
+    size_t sqes_len;
+    /** Submission queue fields */
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    /** Completion queue fields */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    /** Completion queue entries */
+    struct io_uring_cqe *cqes;
+};
+
+/* Tear down a ring created by _eaarlio_uring_setup. */
+static void _eaarlio_uring_teardown(struct _eaarlio_uring *ring)
+{
+    if(ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_len);
+    if(ring->cq_ring && ring->cq_ring != MAP_FAILED
+        && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    if(ring->sq_ring && ring->sq_ring != MAP_FAILED)
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    if(ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/* Create a ring with room for at least entries submissions. Returns
+ * EAARLIO_STREAM_NOT_IMPL if the kernel will not provide one.
+ */
+static eaarlio_error _eaarlio_uring_setup(struct _eaarlio_uring *ring,
+    unsigned entries)
+{
+    struct io_uring_params params;
+    unsigned char *sq, *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0)
+        return EAARLIO_STREAM_NOT_IMPL;
+
+    ring->sq_ring_len =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_ring_len > ring->sq_ring_len)
+            ring->sq_ring_len = ring->cq_ring_len;
+        ring->cq_ring_len = ring->sq_ring_len;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ring == MAP_FAILED)
+        goto fail;
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ring == MAP_FAILED)
+            goto fail;
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+        ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+        goto fail;
+
+    sq = (unsigned char *)ring->sq_ring;
+    cq = (unsigned char *)ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return EAARLIO_SUCCESS;
+
+fail:
+    _eaarlio_uring_teardown(ring);
+    return EAARLIO_STREAM_NOT_IMPL;
+}
+
+/* Submit queued entries and optionally wait for at least one completion.
+ * Returns the number of entries the kernel consumed, or -1 on failure.
+ */
+static int _eaarlio_uring_enter(struct _eaarlio_uring *ring,
+    unsigned to_submit,
+    unsigned min_complete)
+{
+    int ret;
+
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit,
+            min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while(ret < 0 && errno == EINTR);
+
+    return ret;
+}
+
+/* Wait for count submitted requests to complete, discarding their results.
+ * Returns 0 once they all have, or -1 if the ring fails first.
+ */
+static int _eaarlio_uring_reap(struct _eaarlio_uring *ring, unsigned count)
+{
+    unsigned head, tail;
+
+    while(count > 0) {
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            if(_eaarlio_uring_enter(ring, 0, 1) < 0)
+                return -1;
+            continue;
+        }
+        if(tail - head < count) {
+            count -= tail - head;
+        } else {
+            tail = head + count;
+            count = 0;
+        }
+        __atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/**
+ * A slot in the buffer ring
+ */
+struct _eaarlio_uring_slot {
+    /** Buffer for this slot */
+    unsigned char *buffer;
+    /** Extent being read into #buffer */
+    struct eaarlio_plan_extent const *extent;
+    /** Bytes of #extent read so far */
+    uint32_t done;
+    /** iovec used when buffers could not be registered */
+    struct iovec iov;
+};
+
+/* Queue a read for the remaining bytes of a slot's extent. */
+static void _eaarlio_uring_queue(struct _eaarlio_uring *ring,
+    struct _eaarlio_fetch *fetch,
+    struct _eaarlio_uring_slot *slots,
+    unsigned slot,
+    int fixed)
+{
+    struct _eaarlio_uring_slot *s = &slots[slot];
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fetch->fds[s->extent->file_index - 1];
+    sqe->off = (uint64_t)s->extent->offset + s->done;
+    sqe->user_data = slot;
+
+    if(fixed) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)(s->buffer + s->done);
+        sqe->len = s->extent->length - s->done;
+        sqe->buf_index = (uint16_t)slot;
+    } else {
+        s->iov.iov_base = s->buffer + s->done;
+        s->iov.iov_len = s->extent->length - s->done;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)&s->iov;
+        sqe->len = 1;
+    }
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* The io_uring backend. Keeps up to depth extents in flight and decodes each
+ * as soon as its read completes.
+ */
+static eaarlio_error _eaarlio_fetch_uring(struct _eaarlio_fetch *fetch,
+    unsigned depth)
+{
+    struct eaarlio_memory *memory = fetch->memory;
+    struct _eaarlio_uring ring;
+    struct _eaarlio_uring_slot *slots = NULL;
+    struct iovec *iovecs = NULL;
+    struct io_uring_cqe *cqe;
+    unsigned char *buffers = NULL;
+    unsigned *free_slots = NULL;
+    unsigned free_count = 0;
+    unsigned inflight = 0;
+    unsigned unsubmitted = 0;
+    unsigned pending = 0;
+    unsigned head, tail, slot, i;
+    uint32_t next = 0;
+    int fixed = 0;
+    int ret;
+    double start = 0;
+    eaarlio_error err;
+
+    if(depth > fetch->plan.extent_count)
+        depth = fetch->plan.extent_count;
+
+    err = _eaarlio_uring_setup(&ring, depth);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    slots = memory->calloc(memory, depth, sizeof(struct _eaarlio_uring_slot));
+    iovecs = memory->calloc(memory, depth, sizeof(struct iovec));
+    free_slots = memory->calloc(memory, depth, sizeof(unsigned));
+    buffers = memory->malloc(memory, (size_t)depth * fetch->plan.max_length);
+    if(!slots || !iovecs || !free_slots || !buffers) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    for(i = 0; i < depth; i++) {
+        slots[i].buffer = buffers + (size_t)i * fetch->plan.max_length;
+        iovecs[i].iov_base = slots[i].buffer;
+        iovecs[i].iov_len = fetch->plan.max_length;
+        free_slots[free_count++] = depth - 1 - i;
+    }
+
+    /* Registering the buffers lets the kernel skip mapping them on every
+     * read. This can fail when locked memory is restricted, in which case
+     * plain vectored reads are used instead.
+     */
+    fixed = 0 == syscall(__NR_io_uring_register, ring.fd,
+                     IORING_REGISTER_BUFFERS, iovecs, depth);
+
+    while(next < fetch->plan.extent_count || inflight > 0) {
+        /* Fill the queue, unless an error means we are only draining */
+        while(err == EAARLIO_SUCCESS && free_count > 0
+            && next < fetch->plan.extent_count) {
+            err = _eaarlio_fetch_file_open(
+                fetch, fetch->plan.extents[next].file_index);
+            if(err != EAARLIO_SUCCESS)
+                break;
+            slot = free_slots[--free_count];
+            slots[slot].extent = &fetch->plan.extents[next++];
+            slots[slot].done = 0;
+            _eaarlio_uring_queue(&ring, fetch, slots, slot, fixed);
+            unsubmitted++;
+            inflight++;
+        }
+        if(err != EAARLIO_SUCCESS)
+            next = fetch->plan.extent_count;
+        if(inflight == 0)
+            break;
+
+        /* Submitting and waiting for completions is the I/O time; the reads
+         * themselves are counted as they complete
+         */
+        if(fetch->stats)
+            start = eaarlio_clock();
+        ret = _eaarlio_uring_enter(&ring, unsubmitted, 1);
+        if(fetch->stats)
+            fetch->stats->io_seconds += eaarlio_clock() - start;
+        if(ret < 0) {
+            /* Nothing more can be submitted, but reads the kernel already
+             * accepted may still complete into the buffers.
+             */
+            if(err == EAARLIO_SUCCESS)
+                err = EAARLIO_STREAM_READ_ERROR;
+            pending = inflight - unsubmitted;
+            break;
+        }
+        unsubmitted -= (unsigned)ret;
+
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while(head != tail) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            slot = (unsigned)cqe->user_data;
+            ret = cqe->res;
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+            assert(slot < depth);
+
+            if(fetch->stats) {
+                fetch->stats->read_calls++;
+                if(ret > 0)
+                    fetch->stats->bytes_read += (uint64_t)ret;
+            }
+
+            if(err == EAARLIO_SUCCESS) {
+                if(ret == -EINTR || ret == -EAGAIN) {
+                    ret = 0;
+                } else if(ret < 0) {
+                    err = EAARLIO_STREAM_READ_ERROR;
+                } else if(ret == 0) {
+                    err = EAARLIO_STREAM_READ_SHORT;
+                }
+            }
+
+            if(err == EAARLIO_SUCCESS) {
+                slots[slot].done += (uint32_t)ret;
+                if(slots[slot].done < slots[slot].extent->length) {
+                    /* Short read: ask for the rest */
+                    _eaarlio_uring_queue(&ring, fetch, slots, slot, fixed);
+                    unsubmitted++;
+                    continue;
+                }
+                _eaarlio_fetch_file_done(fetch, slots[slot].extent->file_index);
+                err = _eaarlio_fetch_deliver(
+                    fetch, slots[slot].extent, slots[slot].buffer);
+            }
+
+            inflight--;
+            free_slots[free_count++] = slot;
+        }
+    }
+
+cleanup:
+    /* Closing the ring does not wait for reads in progress, so they must all
+     * complete before their buffers are freed. If the ring cannot even wait
+     * for them, the buffers are leaked rather than freed under the kernel.
+     */
+    if(pending && _eaarlio_uring_reap(&ring, pending) < 0) {
+        slots = NULL;
+        buffers = NULL;
+    }
+    _eaarlio_uring_teardown(&ring);
+    if(slots)
+        memory->free(memory, slots);
+    if(iovecs)
+        memory->free(memory, iovecs);
+    if(free_slots)
+        memory->free(memory, free_slots);
+    if(buffers)
+        memory->free(memory, buffers);
+
+    return err;
+}
+
+#endif /* EAARLIO_HAVE_IO_URING */
+
+int eaarlio_file_fetch_available(int backend)
+{
+    switch(backend) {
+        case EAARLIO_FETCH_AUTO:
+        case EAARLIO_FETCH_STREAM:
+            return 1;
+        case EAARLIO_FETCH_PREAD:
+#ifdef EAARLIO_HAVE_PREAD
+            return 1;
+#else
+            return 0;
+#endif
+        case EAARLIO_FETCH_IO_URING:
+#ifdef EAARLIO_HAVE_IO_URING
+        {
+            struct _eaarlio_uring ring;
+            if(_eaarlio_uring_setup(&ring, 1) != EAARLIO_SUCCESS)
+                return 0;
+            _eaarlio_uring_teardown(&ring);
+            return 1;
+        }
+#else
+            return 0;
+#endif
+        default:
+            return 0;
+    }
+}
+
+eaarlio_error eaarlio_file_flight_fetch(struct eaarlio_flight *flight,
+    char const *tld_path,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    int backend,
+    unsigned int queue_depth,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx)
+{
+#ifdef EAARLIO_HAVE_PREAD
+    struct _eaarlio_fetch fetch;
+    uint32_t max_read = 0;
+#endif
+    eaarlio_error err;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!tld_path)
+        return EAARLIO_NULL;
+    if(!raster_numbers && raster_count > 0)
+        return EAARLIO_NULL;
+    if(!fn)
+        return EAARLIO_NULL;
+    if(backend < EAARLIO_FETCH_AUTO || backend > EAARLIO_FETCH_IO_URING)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    err = eaarlio_flight_check(flight);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(queue_depth == 0)
+        queue_depth = EAARLIO_FETCH_QUEUE_DEPTH;
+    if(queue_depth > _EAARLIO_FETCH_URING_MAX_DEPTH)
+        queue_depth = _EAARLIO_FETCH_URING_MAX_DEPTH;
+
+    if(backend == EAARLIO_FETCH_STREAM) {
+        return eaarlio_flight_plan(flight, raster_numbers, raster_count,
+            EAARLIO_FLIGHT_ORDER_DISK, 0, include_pulses, include_waveforms,
+            fn, ctx);
+    }
+
+#ifdef EAARLIO_HAVE_PREAD
+#ifdef EAARLIO_HAVE_IO_URING
+    if(backend != EAARLIO_FETCH_PREAD)
+        max_read = _EAARLIO_FETCH_URING_MAX_READ;
+#else
+    if(backend == EAARLIO_FETCH_IO_URING)
+        return EAARLIO_STREAM_NOT_IMPL;
+#endif
+
+    memset(&fetch, 0, sizeof(fetch));
+    fetch.memory = eaarlio_flight_memory(flight);
+    fetch.stats = eaarlio_flight_active_stats(flight);
+    fetch.include_pulses = include_pulses;
+    fetch.include_waveforms = include_waveforms;
+    fetch.fn = fn;
+    fetch.ctx = ctx;
+
+    err = eaarlio_plan_build(&fetch.plan, flight, raster_numbers, raster_count,
+        max_read, fetch.memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    if(fetch.plan.entry_count == 0)
+        return EAARLIO_SUCCESS;
+
+    err = _eaarlio_fetch_files(&fetch, flight, tld_path);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+#ifdef EAARLIO_HAVE_IO_URING
+    if(backend != EAARLIO_FETCH_PREAD) {
+        err = _eaarlio_fetch_uring(&fetch, queue_depth);
+        if(err != EAARLIO_STREAM_NOT_IMPL || backend == EAARLIO_FETCH_IO_URING)
+            goto cleanup;
+    }
+#endif
+
+    err = _eaarlio_fetch_pread(&fetch);
+
+cleanup:
+    _eaarlio_fetch_close(&fetch);
+    return err;
+#else
+    if(backend != EAARLIO_FETCH_AUTO)
+        return EAARLIO_STREAM_NOT_IMPL;
+
+    return eaarlio_flight_plan(flight, raster_numbers, raster_count,
+        EAARLIO_FLIGHT_ORDER_DISK, 0, include_pulses, include_waveforms, fn,
+        ctx);
+#endif
+}
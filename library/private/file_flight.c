@@ -1,5 +1,6 @@
 #include "eaarlio/file.h"
 #include "eaarlio/memory_support.h"
+#include "eaarlio/pack.h"
 
 eaarlio_error eaarlio_file_flight(struct eaarlio_flight *flight,
     char const *edb_file,
@@ -49,3 +50,27 @@ exit:
         stream.close(&stream);
     return err;
 }
+
+eaarlio_error eaarlio_file_pack_flight(struct eaarlio_flight *flight,
+    char const *pack_file,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    eaarlio_error err;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    *flight = eaarlio_flight_empty();
+
+    if(!pack_file)
+        return EAARLIO_NULL;
+
+    err = eaarlio_file_stream(&stream, pack_file, "r");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_pack_open_flight(flight, &stream, memory);
+    if(stream.close)
+        stream.close(&stream);
+    return err;
+}
@@ -0,0 +1,91 @@
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight_writer.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include <string.h>
+
+eaarlio_error eaarlio_file_flight_writer_open_tld(
+    struct eaarlio_flight_writer *writer,
+    char const *tld_path,
+    char const *tld_file)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    struct eaarlio_memory *memory;
+    eaarlio_error err;
+    size_t path_len, file_len;
+    char *path;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!tld_path)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+    if(!writer->memory)
+        return EAARLIO_MEMORY_INVALID;
+
+    memory = writer->memory;
+
+    path_len = strlen(tld_path);
+    file_len = eaarlio_strnlen(tld_file, EAARLIO_EDB_FILENAME_MAX_LENGTH + 1);
+    if(file_len > EAARLIO_EDB_FILENAME_MAX_LENGTH)
+        return EAARLIO_EDB_FILENAME_TOO_LONG;
+
+    path = memory->malloc(memory, path_len + file_len + 2);
+    if(!path)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    strcpy(path, tld_path);
+    strcat(path, "/");
+    strcat(path, tld_file);
+
+    err = eaarlio_file_stream(&stream, path, "w");
+    memory->free(memory, path);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_flight_writer_open_tld(writer, &stream, tld_file);
+    if(stream.close)
+        stream.close(&stream);
+
+    return err;
+}
+
+eaarlio_error eaarlio_file_flight_writer_close(
+    struct eaarlio_flight_writer *writer,
+    char const *edb_file)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    eaarlio_error err;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!edb_file) {
+        eaarlio_flight_writer_close(writer, NULL);
+        return EAARLIO_NULL;
+    }
+
+    /* Finish the TLD data before creating the EDB, so that a failure there
+     * does not leave behind an index for incomplete data.
+     */
+    err = eaarlio_flight_writer_close_tld(writer);
+    if(err != EAARLIO_SUCCESS) {
+        eaarlio_flight_writer_close(writer, NULL);
+        return err;
+    }
+
+    err = eaarlio_file_stream(&stream, edb_file, "w");
+    if(err != EAARLIO_SUCCESS) {
+        eaarlio_flight_writer_close(writer, NULL);
+        return err;
+    }
+
+    err = eaarlio_flight_writer_close(writer, &stream);
+    if(err != EAARLIO_SUCCESS) {
+        stream.close(&stream);
+        return err;
+    }
+
+    return stream.close(&stream);
+}
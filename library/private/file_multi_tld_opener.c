@@ -0,0 +1,412 @@
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/file.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/tld_opener.h"
+#include <stdint.h>
+#include <string.h>
+
+/** Initial number of cached lookups */
+#define _EAARLIO_MULTI_CACHE_CAPACITY 16
+
+/** ::_eaarlio_multi_lookup::root for a file that was not found anywhere */
+#define _EAARLIO_MULTI_MISSING UINT32_MAX
+
+/**
+ * Cached result of looking up one TLD file
+ */
+struct _eaarlio_multi_lookup {
+    /** TLD file name, as passed to open_tld */
+    char *name;
+
+    /** Index of the root holding the file, or ::_EAARLIO_MULTI_MISSING */
+    uint32_t root;
+
+    /** Was the compressed copy of the file found? */
+    int compressed;
+};
+
+/**
+ * Internal structure for the multi-root tld_opener
+ */
+struct _eaarlio_multi_tld_opener {
+    /** Root directories, in search order */
+    char **roots;
+
+    /** Cached @c strlen of each root */
+    size_t *root_lens;
+
+    /** Number of roots */
+    uint32_t root_count;
+
+    /** Length of the longest root */
+    size_t root_max;
+
+    /** Buffer for building paths, grown as needed */
+    char *path;
+
+    /** Allocated size of @c path */
+    size_t path_size;
+
+    /** Lookups so far, sorted by name */
+    struct _eaarlio_multi_lookup *lookups;
+
+    /** Number of entries in @c lookups */
+    uint32_t lookup_count;
+
+    /** Allocated capacity of @c lookups */
+    uint32_t lookup_capacity;
+
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+/**
+ * Find a cached lookup, or where it should be inserted
+ *
+ * @returns 1 if @p name was found at @p *index, otherwise 0 with @p *index set
+ *      to its insertion point
+ */
+static int _eaarlio_multi_find(struct _eaarlio_multi_tld_opener *internal,
+    char const *name,
+    uint32_t *index)
+{
+    uint32_t lo = 0;
+    uint32_t hi = internal->lookup_count;
+    uint32_t mid;
+    int cmp;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcmp(name, internal->lookups[mid].name);
+        if(cmp == 0) {
+            *index = mid;
+            return 1;
+        }
+        if(cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    *index = lo;
+    return 0;
+}
+
+/**
+ * Record the result of a lookup at the insertion point @p index
+ */
+static eaarlio_error _eaarlio_multi_insert(
+    struct _eaarlio_multi_tld_opener *internal,
+    uint32_t index,
+    char const *name,
+    size_t name_len,
+    uint32_t root,
+    int compressed)
+{
+    struct eaarlio_memory *memory = &internal->memory;
+    struct _eaarlio_multi_lookup *lookups;
+    struct _eaarlio_multi_lookup *lookup;
+    uint32_t capacity;
+    char *copy;
+
+    if(internal->lookup_count == internal->lookup_capacity) {
+        if(internal->lookup_capacity > UINT32_MAX / 2)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+        capacity = internal->lookup_capacity
+            ? internal->lookup_capacity * 2
+            : _EAARLIO_MULTI_CACHE_CAPACITY;
+        lookups = memory->realloc(memory, internal->lookups,
+            (size_t)capacity * sizeof(struct _eaarlio_multi_lookup));
+        if(!lookups)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        internal->lookups = lookups;
+        internal->lookup_capacity = capacity;
+    }
+
+    copy = memory->malloc(memory, name_len + 1);
+    if(!copy)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    memcpy(copy, name, name_len + 1);
+
+    memmove(&internal->lookups[index + 1], &internal->lookups[index],
+        (size_t)(internal->lookup_count - index)
+            * sizeof(struct _eaarlio_multi_lookup));
+    lookup = &internal->lookups[index];
+    lookup->name = copy;
+    lookup->root = root;
+    lookup->compressed = compressed;
+    internal->lookup_count++;
+
+    return EAARLIO_SUCCESS;
+}
+
+/**
+ * Forget the cached lookup at @p index
+ */
+static void _eaarlio_multi_remove(struct _eaarlio_multi_tld_opener *internal,
+    uint32_t index)
+{
+    struct eaarlio_memory *memory = &internal->memory;
+
+    memory->free(memory, internal->lookups[index].name);
+    internal->lookup_count--;
+    memmove(&internal->lookups[index], &internal->lookups[index + 1],
+        (size_t)(internal->lookup_count - index)
+            * sizeof(struct _eaarlio_multi_lookup));
+}
+
+/**
+ * Open @p name under one root, as a compressed or plain file
+ *
+ * @retval ::EAARLIO_STREAM_OPEN_ERROR if that file does not exist
+ */
+static eaarlio_error _eaarlio_multi_open(
+    struct _eaarlio_multi_tld_opener *internal,
+    struct eaarlio_stream *stream,
+    char const *name,
+    uint32_t root,
+    int compressed)
+{
+    struct eaarlio_stream inner = eaarlio_stream_empty();
+    char *path = internal->path;
+    eaarlio_error err;
+
+    memcpy(path, internal->roots[root], internal->root_lens[root]);
+    path[internal->root_lens[root]] = '/';
+    strcpy(path + internal->root_lens[root] + 1, name);
+
+    if(!compressed)
+        return eaarlio_file_stream(stream, path, "r");
+
+    strcat(path, EAARLIO_COMPRESSED_SUFFIX);
+    err = eaarlio_file_stream(&inner, path, "r");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_compressed_stream(stream, &inner, &internal->memory);
+    if(err != EAARLIO_SUCCESS)
+        inner.close(&inner);
+    return err;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::open_tld
+ */
+static eaarlio_error _eaarlio_multi_tld_opener_open_tld(
+    struct eaarlio_tld_opener *self,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct _eaarlio_multi_tld_opener *internal;
+    struct _eaarlio_multi_lookup *lookup;
+    struct eaarlio_memory *memory;
+    eaarlio_error err;
+    uint32_t index;
+    uint32_t root;
+    size_t len, need;
+    char *path;
+    int compressed;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_multi_tld_opener *)self->opaque;
+    if(!internal)
+        return EAARLIO_TLD_OPENER_INVALID;
+    memory = &internal->memory;
+
+    len = eaarlio_strnlen(tld_file, EAARLIO_EDB_FILENAME_MAX_LENGTH + 1);
+    if(len > EAARLIO_EDB_FILENAME_MAX_LENGTH)
+        return EAARLIO_STRING_UNTERMINATED;
+
+    need = internal->root_max + len + strlen(EAARLIO_COMPRESSED_SUFFIX) + 2;
+    if(need > internal->path_size) {
+        path = memory->realloc(memory, internal->path, need);
+        if(!path)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        internal->path = path;
+        internal->path_size = need;
+    }
+
+    if(_eaarlio_multi_find(internal, tld_file, &index)) {
+        lookup = &internal->lookups[index];
+        if(lookup->root == _EAARLIO_MULTI_MISSING)
+            return EAARLIO_STREAM_OPEN_ERROR;
+        err = _eaarlio_multi_open(
+            internal, stream, tld_file, lookup->root, lookup->compressed);
+        if(err != EAARLIO_STREAM_OPEN_ERROR)
+            return err;
+
+        /* The file has gone away since it was found, so search again */
+        _eaarlio_multi_remove(internal, index);
+    }
+
+    /* Every root is searched for the file itself before any is searched for
+     * a compressed copy, so files that are not compressed never cost an
+     * extra open. A compressed copy that exists but cannot be used is
+     * reported; only a missing file moves the search on.
+     */
+    for(compressed = 0; compressed <= 1; compressed++) {
+        for(root = 0; root < internal->root_count; root++) {
+            err = _eaarlio_multi_open(
+                internal, stream, tld_file, root, compressed);
+            if(err == EAARLIO_STREAM_OPEN_ERROR)
+                continue;
+            if(err != EAARLIO_SUCCESS)
+                return err;
+
+            err = _eaarlio_multi_insert(
+                internal, index, tld_file, len, root, compressed);
+            if(err != EAARLIO_SUCCESS) {
+                stream->close(stream);
+                *stream = eaarlio_stream_empty();
+            }
+            return err;
+        }
+    }
+
+    /* Remember the miss so that later requests do not probe every root
+     * again. The cache is only an optimization, so failing to record it
+     * does not change the result.
+     */
+    _eaarlio_multi_insert(
+        internal, index, tld_file, len, _EAARLIO_MULTI_MISSING, 0);
+    return EAARLIO_STREAM_OPEN_ERROR;
+}
+
+eaarlio_error eaarlio_file_multi_tld_opener_forget(
+    struct eaarlio_tld_opener *tld_opener)
+{
+    struct _eaarlio_multi_tld_opener *internal;
+    uint32_t i;
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+    if(tld_opener->open_tld != &_eaarlio_multi_tld_opener_open_tld
+        || !tld_opener->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_multi_tld_opener *)tld_opener->opaque;
+    for(i = internal->lookup_count; i > 0; i--)
+        if(internal->lookups[i - 1].root == _EAARLIO_MULTI_MISSING)
+            _eaarlio_multi_remove(internal, i - 1);
+
+    return EAARLIO_SUCCESS;
+}
+
+/**
+ * Free everything allocated for an opener
+ */
+static void _eaarlio_multi_free(struct _eaarlio_multi_tld_opener *internal)
+{
+    struct eaarlio_memory memory = internal->memory;
+    uint32_t i;
+
+    if(internal->roots) {
+        for(i = 0; i < internal->root_count; i++)
+            memory.free(&memory, internal->roots[i]);
+    }
+    for(i = 0; i < internal->lookup_count; i++)
+        memory.free(&memory, internal->lookups[i].name);
+
+    memory.free(&memory, internal->roots);
+    memory.free(&memory, internal->root_lens);
+    memory.free(&memory, internal->path);
+    memory.free(&memory, internal->lookups);
+    memory.free(&memory, internal);
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::close
+ */
+static eaarlio_error _eaarlio_multi_tld_opener_close(
+    struct eaarlio_tld_opener *self)
+{
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    _eaarlio_multi_free((struct _eaarlio_multi_tld_opener *)self->opaque);
+    *self = eaarlio_tld_opener_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_file_multi_tld_opener(struct eaarlio_tld_opener *opener,
+    char const *const *tld_paths,
+    uint32_t path_count,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_multi_tld_opener *internal = NULL;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    size_t max_len = 0;
+    size_t len;
+    uint32_t i;
+
+    if(!opener)
+        return EAARLIO_NULL;
+    *opener = eaarlio_tld_opener_empty();
+
+    if(!tld_paths)
+        return EAARLIO_NULL;
+    if(!path_count)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    for(i = 0; i < path_count; i++) {
+        if(!tld_paths[i])
+            return EAARLIO_NULL;
+        len = eaarlio_strnlen(tld_paths[i], PATH_MAX);
+        if(len == PATH_MAX)
+            return EAARLIO_STRING_UNTERMINATED;
+        if(len > max_len)
+            max_len = len;
+    }
+
+    internal =
+        memory->calloc(memory, 1, sizeof(struct _eaarlio_multi_tld_opener));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    internal->memory = *memory;
+
+    internal->roots = memory->calloc(memory, path_count, sizeof(char *));
+    internal->root_lens = memory->calloc(memory, path_count, sizeof(size_t));
+    if(!internal->roots || !internal->root_lens) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    for(i = 0; i < path_count; i++) {
+        len = strlen(tld_paths[i]);
+        internal->roots[i] = memory->malloc(memory, len + 1);
+        if(!internal->roots[i]) {
+            err = EAARLIO_MEMORY_ALLOC_FAIL;
+            goto cleanup;
+        }
+        memcpy(internal->roots[i], tld_paths[i], len + 1);
+        internal->root_lens[i] = len;
+        internal->root_count++;
+    }
+    internal->root_max = max_len;
+
+    opener->opaque = internal;
+    opener->open_tld = _eaarlio_multi_tld_opener_open_tld;
+    opener->close = _eaarlio_multi_tld_opener_close;
+    internal = NULL;
+
+cleanup:
+    if(internal)
+        _eaarlio_multi_free(internal);
+    return err;
+}
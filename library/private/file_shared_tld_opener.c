@@ -0,0 +1,593 @@
+/* open and pread are POSIX, not C99, so they need to be requested explicitly.
+ */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/thread_support.h"
+#include "eaarlio/tld_opener.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef EAARLIO_HAVE_PREAD
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * An open TLD file
+ *
+ * These are allocated individually so that streams can keep pointers to them
+ * while the pool's array of files is reallocated.
+ */
+struct _eaarlio_shared_file {
+    /** TLD file name, as passed to open_tld */
+    char *name;
+    /** File descriptor */
+    int fd;
+    /** Is #fd the compressed copy of the file? */
+    int compressed;
+    /** Number of open streams using #fd */
+    uint32_t refs;
+    /** Value of the pool's clock when this was last opened */
+    uint64_t last_used;
+};
+
+/**
+ * State shared by every handle to a shared opener and its streams
+ */
+struct _eaarlio_shared_pool {
+    /** Guards everything below */
+    struct eaarlio_mutex mutex;
+    /** Number of opener handles and open streams */
+    uint32_t refs;
+    /** Path to the TLD files */
+    char *path;
+    /** Cached @c strlen of #path */
+    size_t path_len;
+    /** Number of idle descriptors to keep open */
+    uint32_t max_open;
+    /** Open files */
+    struct _eaarlio_shared_file **files;
+    /** Number of entries in #files */
+    uint32_t file_count;
+    /** Allocated capacity of #files */
+    uint32_t file_capacity;
+    /** Incremented on every open, to find the least recently used file */
+    uint64_t clock;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+/**
+ * Internal state for a stream from a shared opener
+ */
+struct _eaarlio_shared_stream {
+    /** Pool that owns #file */
+    struct _eaarlio_shared_pool *pool;
+    /** File being read */
+    struct _eaarlio_shared_file *file;
+    /** Current position in the file */
+    uint64_t position;
+};
+
+/* Close and free the file at index i of the pool. The caller holds the lock.
+ */
+static void _eaarlio_shared_drop(struct _eaarlio_shared_pool *pool, uint32_t i)
+{
+    struct _eaarlio_shared_file *file = pool->files[i];
+
+    close(file->fd);
+    pool->memory.free(&pool->memory, file->name);
+    pool->memory.free(&pool->memory, file);
+
+    pool->file_count--;
+    pool->files[i] = pool->files[pool->file_count];
+}
+
+/* Close idle files, least recently used first, until at most limit are open
+ * or none are idle. The caller holds the lock.
+ */
+static void _eaarlio_shared_trim(struct _eaarlio_shared_pool *pool,
+    uint32_t limit)
+{
+    uint32_t i, oldest;
+
+    while(pool->file_count > limit) {
+        oldest = pool->file_count;
+        for(i = 0; i < pool->file_count; i++) {
+            if(pool->files[i]->refs)
+                continue;
+            if(oldest == pool->file_count
+                || pool->files[i]->last_used
+                    < pool->files[oldest]->last_used)
+                oldest = i;
+        }
+        if(oldest == pool->file_count)
+            return;
+        _eaarlio_shared_drop(pool, oldest);
+    }
+}
+
+/* Find an open file by name. The caller holds the lock. */
+static struct _eaarlio_shared_file *_eaarlio_shared_find(
+    struct _eaarlio_shared_pool *pool,
+    char const *name)
+{
+    uint32_t i;
+
+    for(i = 0; i < pool->file_count; i++)
+        if(strcmp(pool->files[i]->name, name) == 0)
+            return pool->files[i];
+    return NULL;
+}
+
+/* Free the pool and everything in it */
+static void _eaarlio_shared_free(struct _eaarlio_shared_pool *pool)
+{
+    struct eaarlio_memory memory = pool->memory;
+
+    while(pool->file_count)
+        _eaarlio_shared_drop(pool, pool->file_count - 1);
+    eaarlio_mutex_destroy(&pool->mutex);
+    memory.free(&memory, pool->files);
+    memory.free(&memory, pool->path);
+    memory.free(&memory, pool);
+}
+
+/* Drop one reference to the pool, freeing it if that was the last */
+static void _eaarlio_shared_release(struct _eaarlio_shared_pool *pool)
+{
+    uint32_t refs;
+
+    eaarlio_mutex_lock(&pool->mutex);
+    refs = --pool->refs;
+    eaarlio_mutex_unlock(&pool->mutex);
+
+    if(!refs)
+        _eaarlio_shared_free(pool);
+}
+
+static eaarlio_error _eaarlio_shared_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_shared_stream *internal;
+    struct _eaarlio_shared_pool *pool;
+    uint32_t refs;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_shared_stream *)self->data;
+    pool = internal->pool;
+
+    eaarlio_mutex_lock(&pool->mutex);
+    internal->file->refs--;
+    _eaarlio_shared_trim(pool, pool->max_open);
+    pool->memory.free(&pool->memory, internal);
+    refs = --pool->refs;
+    eaarlio_mutex_unlock(&pool->mutex);
+
+    if(!refs)
+        _eaarlio_shared_free(pool);
+
+    *self = eaarlio_stream_empty();
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_shared_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct _eaarlio_shared_stream *internal;
+    size_t want;
+    ssize_t got;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_shared_stream *)self->data;
+
+    while(len > 0) {
+        if((uint64_t)(off_t)internal->position != internal->position)
+            return EAARLIO_STREAM_READ_SHORT;
+
+        want = len > SSIZE_MAX ? SSIZE_MAX : (size_t)len;
+        got = pread(internal->file->fd, buf, want, (off_t)internal->position);
+        if(got < 0) {
+            if(errno == EINTR)
+                continue;
+            return EAARLIO_STREAM_READ_ERROR;
+        }
+        if(got == 0)
+            return EAARLIO_STREAM_READ_SHORT;
+
+        buf += got;
+        len -= (uint64_t)got;
+        internal->position += (uint64_t)got;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_shared_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_shared_stream *internal;
+    struct stat st;
+    int64_t base;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_shared_stream *)self->data;
+
+    switch(whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)internal->position;
+            break;
+        case SEEK_END:
+            if(fstat(internal->file->fd, &st))
+                return EAARLIO_STREAM_SEEK_ERROR;
+            base = (int64_t)st.st_size;
+            break;
+        default:
+            return EAARLIO_STREAM_SEEK_INVALID;
+    }
+
+    if(offset < 0 && base < -offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+    if(offset > 0 && base > INT64_MAX - offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+
+    internal->position = (uint64_t)(base + offset);
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_shared_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_shared_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(!position)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_shared_stream *)self->data;
+    *position = (int64_t)internal->position;
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_shared_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    (void)self;
+    (void)len;
+    (void)buf;
+    return EAARLIO_STREAM_NOT_IMPL;
+}
+
+/* Open a TLD file, or its compressed copy if the file itself is missing. This
+ * is done without the lock held, so that a slow open does not hold up other
+ * threads.
+ */
+static eaarlio_error _eaarlio_shared_open_file(
+    struct _eaarlio_shared_pool *pool,
+    char const *name,
+    size_t name_len,
+    int *fd,
+    int *compressed)
+{
+    struct eaarlio_memory *memory = &pool->memory;
+    char *path;
+
+    path = memory->malloc(memory,
+        pool->path_len + name_len + strlen(EAARLIO_COMPRESSED_SUFFIX) + 2);
+    if(!path)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    memcpy(path, pool->path, pool->path_len);
+    path[pool->path_len] = '/';
+    memcpy(path + pool->path_len + 1, name, name_len);
+    path[pool->path_len + 1 + name_len] = '\0';
+
+    *compressed = 0;
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(*fd < 0 && errno == ENOENT) {
+        strcat(path, EAARLIO_COMPRESSED_SUFFIX);
+        *compressed = 1;
+        *fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    memory->free(memory, path);
+
+    if(*fd < 0)
+        return EAARLIO_STREAM_OPEN_ERROR;
+    return EAARLIO_SUCCESS;
+}
+
+/* Add a newly opened file to the pool, unless another thread got there first.
+ * The caller holds the lock.
+ */
+static eaarlio_error _eaarlio_shared_add(struct _eaarlio_shared_pool *pool,
+    char const *name,
+    size_t name_len,
+    int fd,
+    int compressed,
+    struct _eaarlio_shared_file **result)
+{
+    struct eaarlio_memory *memory = &pool->memory;
+    struct _eaarlio_shared_file **files;
+    struct _eaarlio_shared_file *file;
+    uint32_t capacity;
+
+    *result = _eaarlio_shared_find(pool, name);
+    if(*result) {
+        close(fd);
+        return EAARLIO_SUCCESS;
+    }
+
+    /* Make room for the new file, if there are idle files to close */
+    if(pool->max_open)
+        _eaarlio_shared_trim(pool, pool->max_open - 1);
+
+    if(pool->file_count == pool->file_capacity) {
+        if(pool->file_capacity > UINT32_MAX / 2)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+        capacity = pool->file_capacity ? pool->file_capacity * 2 : 16;
+        files = memory->realloc(memory, pool->files,
+            (size_t)capacity * sizeof(struct _eaarlio_shared_file *));
+        if(!files)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        pool->files = files;
+        pool->file_capacity = capacity;
+    }
+
+    file = memory->calloc(memory, 1, sizeof(struct _eaarlio_shared_file));
+    if(!file)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    file->name = memory->malloc(memory, name_len + 1);
+    if(!file->name) {
+        memory->free(memory, file);
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    }
+    memcpy(file->name, name, name_len + 1);
+    file->fd = fd;
+    file->compressed = compressed;
+
+    pool->files[pool->file_count++] = file;
+    *result = file;
+    return EAARLIO_SUCCESS;
+}
+
+/* Attach a new stream to an open file. The caller holds the lock. */
+static void _eaarlio_shared_use(struct _eaarlio_shared_pool *pool,
+    struct _eaarlio_shared_file *file,
+    struct _eaarlio_shared_stream *internal)
+{
+    file->refs++;
+    file->last_used = ++pool->clock;
+    pool->refs++;
+    internal->file = file;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::open_tld
+ */
+static eaarlio_error _eaarlio_shared_tld_opener_open_tld(
+    struct eaarlio_tld_opener *self,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct _eaarlio_shared_pool *pool;
+    struct _eaarlio_shared_stream *internal;
+    struct _eaarlio_shared_file *file;
+    struct eaarlio_stream inner = eaarlio_stream_empty();
+    struct eaarlio_memory *memory;
+    eaarlio_error err;
+    size_t len;
+    int fd, compressed;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    pool = (struct _eaarlio_shared_pool *)self->opaque;
+    memory = &pool->memory;
+
+    len = eaarlio_strnlen(tld_file, EAARLIO_EDB_FILENAME_MAX_LENGTH + 1);
+    if(len > EAARLIO_EDB_FILENAME_MAX_LENGTH)
+        return EAARLIO_STRING_UNTERMINATED;
+
+    internal = memory->calloc(memory, 1, sizeof(struct _eaarlio_shared_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    internal->pool = pool;
+
+    eaarlio_mutex_lock(&pool->mutex);
+    file = _eaarlio_shared_find(pool, tld_file);
+    if(file)
+        _eaarlio_shared_use(pool, file, internal);
+    eaarlio_mutex_unlock(&pool->mutex);
+
+    if(!file) {
+        err = _eaarlio_shared_open_file(pool, tld_file, len, &fd, &compressed);
+        if(err != EAARLIO_SUCCESS) {
+            memory->free(memory, internal);
+            return err;
+        }
+
+        eaarlio_mutex_lock(&pool->mutex);
+        err = _eaarlio_shared_add(pool, tld_file, len, fd, compressed, &file);
+        if(err == EAARLIO_SUCCESS)
+            _eaarlio_shared_use(pool, file, internal);
+        eaarlio_mutex_unlock(&pool->mutex);
+
+        if(err != EAARLIO_SUCCESS) {
+            close(fd);
+            memory->free(memory, internal);
+            return err;
+        }
+    }
+
+    inner.close = &_eaarlio_shared_stream_close;
+    inner.read = &_eaarlio_shared_stream_read;
+    inner.write = &_eaarlio_shared_stream_write;
+    inner.seek = &_eaarlio_shared_stream_seek;
+    inner.tell = &_eaarlio_shared_stream_tell;
+    inner.data = (void *)internal;
+
+    if(!file->compressed) {
+        *stream = inner;
+        return EAARLIO_SUCCESS;
+    }
+
+    err = eaarlio_compressed_stream(stream, &inner, memory);
+    if(err != EAARLIO_SUCCESS)
+        inner.close(&inner);
+    return err;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::close
+ */
+static eaarlio_error _eaarlio_shared_tld_opener_close(
+    struct eaarlio_tld_opener *self)
+{
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    _eaarlio_shared_release((struct _eaarlio_shared_pool *)self->opaque);
+    *self = eaarlio_tld_opener_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+#endif /* EAARLIO_HAVE_PREAD */
+
+eaarlio_error eaarlio_file_shared_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *tld_path,
+    uint32_t max_open,
+    struct eaarlio_memory *memory)
+{
+#ifdef EAARLIO_HAVE_PREAD
+    struct _eaarlio_shared_pool *pool;
+    size_t len;
+#endif
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+    *tld_opener = eaarlio_tld_opener_empty();
+
+    if(!tld_path)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+#ifdef EAARLIO_HAVE_PREAD
+    len = eaarlio_strnlen(tld_path, PATH_MAX);
+    if(len == PATH_MAX)
+        return EAARLIO_STRING_UNTERMINATED;
+
+    pool = memory->calloc(memory, 1, sizeof(struct _eaarlio_shared_pool));
+    if(!pool)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    pool->memory = *memory;
+    pool->refs = 1;
+    pool->max_open = max_open ? max_open : EAARLIO_FILE_SHARED_MAX_OPEN;
+    pool->path_len = len;
+    pool->path = memory->malloc(memory, len + 1);
+    if(!pool->path) {
+        memory->free(memory, pool);
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    }
+    memcpy(pool->path, tld_path, len + 1);
+
+    if(eaarlio_mutex_init(&pool->mutex) != EAARLIO_SUCCESS) {
+        memory->free(memory, pool->path);
+        memory->free(memory, pool);
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    }
+
+    tld_opener->opaque = pool;
+    tld_opener->open_tld = &_eaarlio_shared_tld_opener_open_tld;
+    tld_opener->close = &_eaarlio_shared_tld_opener_close;
+
+    return EAARLIO_SUCCESS;
+#else
+    (void)max_open;
+    return EAARLIO_STREAM_NOT_IMPL;
+#endif
+}
+
+eaarlio_error eaarlio_file_shared_tld_opener_share(
+    struct eaarlio_tld_opener *copy,
+    struct eaarlio_tld_opener const *tld_opener)
+{
+#ifdef EAARLIO_HAVE_PREAD
+    struct _eaarlio_shared_pool *pool;
+#endif
+
+    if(!copy)
+        return EAARLIO_NULL;
+    *copy = eaarlio_tld_opener_empty();
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+
+#ifdef EAARLIO_HAVE_PREAD
+    if(tld_opener->open_tld != &_eaarlio_shared_tld_opener_open_tld
+        || !tld_opener->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    pool = (struct _eaarlio_shared_pool *)tld_opener->opaque;
+    eaarlio_mutex_lock(&pool->mutex);
+    pool->refs++;
+    eaarlio_mutex_unlock(&pool->mutex);
+
+    *copy = *tld_opener;
+    return EAARLIO_SUCCESS;
+#else
+    return EAARLIO_TLD_OPENER_INVALID;
+#endif
+}
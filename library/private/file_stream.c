@@ -1,6 +1,17 @@
+/* fileno and fsync are POSIX rather than C99 */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <assert.h>
 #include <stdio.h>
 
+#if defined(EAARLIO_HAVE_FSYNC)
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
 #include "eaarlio/error.h"
 #include "eaarlio/file.h"
 #include "eaarlio/misc_support.h"
@@ -166,3 +177,32 @@ eaarlio_error eaarlio_file_stream(struct eaarlio_stream *stream,
 
     return EAARLIO_SUCCESS;
 }
+
+eaarlio_error eaarlio_file_stream_sync(struct eaarlio_stream *stream)
+{
+    FILE *f;
+    int fail = 0;
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!stream->data)
+        return EAARLIO_STREAM_INVALID;
+    if(stream->close != &eaarlio_file_stream_close)
+        return EAARLIO_STREAM_INVALID;
+
+    f = (FILE *)stream->data;
+
+    if(fflush(f))
+        return EAARLIO_STREAM_WRITE_ERROR;
+
+#if defined(EAARLIO_HAVE_FSYNC)
+    fail = fsync(fileno(f));
+#elif defined(_WIN32)
+    fail = _commit(_fileno(f));
+#endif
+
+    if(fail)
+        return EAARLIO_STREAM_WRITE_ERROR;
+
+    return EAARLIO_SUCCESS;
+}
@@ -1,7 +1,9 @@
+#include "eaarlio/compressed_stream.h"
 #include "eaarlio/edb_internals.h"
 #include "eaarlio/file.h"
 #include "eaarlio/memory_support.h"
 #include "eaarlio/misc_support.h"
+#include "eaarlio/tar.h"
 #include "eaarlio/tld_opener.h"
 
 /**
@@ -18,10 +20,29 @@ struct _eaarlio_file_tld_opener {
      */
     size_t path_len;
 
+    /** Open files with ::eaarlio_file_direct_stream? */
+    int direct;
+
+    /** Fall back to a compressed copy of a missing file? */
+    int compressed;
+
     /** Memory handler */
     struct eaarlio_memory memory;
 };
 
+/**
+ * Open a single file as configured for the opener
+ */
+static eaarlio_error _eaarlio_file_tld_opener_stream(
+    struct _eaarlio_file_tld_opener *internal,
+    struct eaarlio_stream *stream,
+    char const *path)
+{
+    if(internal->direct)
+        return eaarlio_file_direct_stream(stream, path, 0, &internal->memory);
+    return eaarlio_file_stream(stream, path, "r");
+}
+
 /**
  * Implementation for ::eaarlio_tld_opener::open_tld
  */
@@ -47,7 +68,8 @@ static eaarlio_error _eaarlio_file_tld_opener_open_tld(
         return EAARLIO_STRING_UNTERMINATED;
     len += internal->path_len + 2;
 
-    char *path = memory->malloc(memory, len);
+    char *path = memory->malloc(memory,
+        len + (internal->compressed ? strlen(EAARLIO_COMPRESSED_SUFFIX) : 0));
     if(!path)
         return EAARLIO_MEMORY_ALLOC_FAIL;
 
@@ -55,7 +77,22 @@ static eaarlio_error _eaarlio_file_tld_opener_open_tld(
     strcat(path, "/");
     strcat(path, tld_file);
 
-    err = eaarlio_file_stream(stream, path, "r");
+    err = _eaarlio_file_tld_opener_stream(internal, stream, path);
+
+    /* The compressed copy is only tried when the file itself is missing. If
+     * it exists but cannot be used, that is reported.
+     */
+    if(err == EAARLIO_STREAM_OPEN_ERROR && internal->compressed) {
+        struct eaarlio_stream inner = eaarlio_stream_empty();
+        strcat(path, EAARLIO_COMPRESSED_SUFFIX);
+        err = _eaarlio_file_tld_opener_stream(internal, &inner, path);
+        if(err == EAARLIO_SUCCESS) {
+            err = eaarlio_compressed_stream(stream, &inner, memory);
+            if(err != EAARLIO_SUCCESS)
+                inner.close(&inner);
+        }
+    }
+
     memory->free(memory, path);
     return err;
 }
@@ -80,9 +117,16 @@ static eaarlio_error _eaarlio_file_tld_opener_close(
     return EAARLIO_SUCCESS;
 }
 
-eaarlio_error eaarlio_file_tld_opener(struct eaarlio_tld_opener *opener,
+/**
+ * Shared implementation for ::eaarlio_file_tld_opener,
+ * ::eaarlio_file_direct_tld_opener, and ::eaarlio_file_compressed_tld_opener
+ */
+static eaarlio_error _eaarlio_file_tld_opener_init(
+    struct eaarlio_tld_opener *opener,
     char const *path,
-    struct eaarlio_memory *memory)
+    struct eaarlio_memory *memory,
+    int direct,
+    int compressed)
 {
     struct _eaarlio_file_tld_opener *internal;
     size_t len;
@@ -112,6 +156,8 @@ eaarlio_error eaarlio_file_tld_opener(struct eaarlio_tld_opener *opener,
         return EAARLIO_MEMORY_ALLOC_FAIL;
 
     internal->memory = *memory;
+    internal->direct = direct;
+    internal->compressed = compressed;
     internal->path_len = len;
     internal->path = memory->malloc(memory, internal->path_len + 1);
     if(!internal->path) {
@@ -127,3 +173,49 @@ eaarlio_error eaarlio_file_tld_opener(struct eaarlio_tld_opener *opener,
 
     return EAARLIO_SUCCESS;
 }
+
+eaarlio_error eaarlio_file_tld_opener(struct eaarlio_tld_opener *opener,
+    char const *path,
+    struct eaarlio_memory *memory)
+{
+    return _eaarlio_file_tld_opener_init(opener, path, memory, 0, 0);
+}
+
+eaarlio_error eaarlio_file_direct_tld_opener(struct eaarlio_tld_opener *opener,
+    char const *path,
+    struct eaarlio_memory *memory)
+{
+    return _eaarlio_file_tld_opener_init(opener, path, memory, 1, 0);
+}
+
+eaarlio_error eaarlio_file_compressed_tld_opener(
+    struct eaarlio_tld_opener *opener,
+    char const *path,
+    struct eaarlio_memory *memory)
+{
+    return _eaarlio_file_tld_opener_init(opener, path, memory, 0, 1);
+}
+
+eaarlio_error eaarlio_file_tar_tld_opener(struct eaarlio_tld_opener *opener,
+    char const *tar_file,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    eaarlio_error err;
+
+    if(!opener)
+        return EAARLIO_NULL;
+    *opener = eaarlio_tld_opener_empty();
+
+    if(!tar_file)
+        return EAARLIO_NULL;
+
+    err = eaarlio_file_stream(&stream, tar_file, "r");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_tar_tld_opener(opener, &stream, memory);
+    if(stream.close)
+        stream.close(&stream);
+    return err;
+}
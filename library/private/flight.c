@@ -1,20 +1,11 @@
 #include "eaarlio/flight.h"
+#include "eaarlio/flight_internals.h"
 #include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
 #include "eaarlio/stream_support.h"
 #include "eaarlio/tld.h"
 
-/**
- * Internal state for ::eaarlio_flight::internal
- */
-struct _eaarlio_flight_internal {
-    /** Stream for currently open TLD */
-    struct eaarlio_stream stream;
-    /** Memory handler */
-    struct eaarlio_memory *memory;
-    /** ::eaarlio_edb_record::file_index corresponding to #stream */
-    int16_t file_index;
-};
-
 eaarlio_error eaarlio_flight_init(struct eaarlio_flight *flight,
     struct eaarlio_memory *memory)
 {
@@ -39,6 +30,10 @@ eaarlio_error eaarlio_flight_init(struct eaarlio_flight *flight,
     internal->memory = memory;
     internal->stream = eaarlio_stream_empty();
     internal->file_index = 0;
+    internal->stats_enabled = 0;
+    internal->stats = eaarlio_stats_empty();
+    eaarlio_stats_memory_init(
+        &internal->stats_memory, memory, &internal->stats);
     flight->internal = internal;
 
     return EAARLIO_SUCCESS;
@@ -78,27 +73,10 @@ eaarlio_error eaarlio_flight_free(struct eaarlio_flight *flight)
     return EAARLIO_SUCCESS;
 }
 
-eaarlio_error eaarlio_flight_read_raster(struct eaarlio_flight *flight,
-    struct eaarlio_raster *raster,
-    int32_t *time_offset,
-    uint32_t raster_number,
-    int include_pulses,
-    int include_waveforms)
+eaarlio_error eaarlio_flight_check(struct eaarlio_flight const *flight)
 {
-    struct _eaarlio_flight_internal *internal;
-    struct eaarlio_stream *stream;
-    struct eaarlio_edb_record record;
-    eaarlio_error err;
-
-    if(raster)
-        *raster = eaarlio_raster_empty();
-    if(time_offset)
-        *time_offset = 0;
-
     if(!flight)
         return EAARLIO_NULL;
-    if(!raster)
-        return EAARLIO_NULL;
     if(!flight->tld_opener.close)
         return EAARLIO_TLD_OPENER_INVALID;
     if(!flight->tld_opener.open_tld)
@@ -110,47 +88,258 @@ eaarlio_error eaarlio_flight_read_raster(struct eaarlio_flight *flight,
     if(!flight->internal)
         return EAARLIO_FLIGHT_INVALID;
 
-    internal = (struct _eaarlio_flight_internal *)flight->internal;
-    stream = &internal->stream;
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_record(struct eaarlio_flight const *flight,
+    uint32_t raster_number,
+    struct eaarlio_edb_record *record)
+{
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!record)
+        return EAARLIO_NULL;
 
-    if(raster_number > flight->edb.record_count)
+    if(raster_number < 1 || raster_number > flight->edb.record_count)
         return EAARLIO_FLIGHT_RASTER_INVALID;
-    record = flight->edb.records[raster_number - 1];
-    if(record.file_index < 1)
+    *record = flight->edb.records[raster_number - 1];
+    if(record->file_index < 1)
         return EAARLIO_CORRUPT;
-    if((uint32_t)record.file_index > flight->edb.file_count)
+    if((uint32_t)record->file_index > flight->edb.file_count)
         return EAARLIO_CORRUPT;
 
-    if(internal->file_index && !eaarlio_stream_valid(stream))
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_stream(struct eaarlio_flight *flight,
+    int16_t file_index,
+    struct eaarlio_stream **stream)
+{
+    struct _eaarlio_flight_internal *internal;
+    eaarlio_error err;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!flight->internal)
+        return EAARLIO_FLIGHT_INVALID;
+
+    internal = (struct _eaarlio_flight_internal *)flight->internal;
+    *stream = &internal->stream;
+
+    if(internal->file_index && !eaarlio_stream_valid(*stream))
         return EAARLIO_STREAM_INVALID;
 
-    if(internal->file_index && internal->file_index != record.file_index) {
-        err = stream->close(stream);
+    if(internal->file_index && internal->file_index != file_index) {
+        err = (*stream)->close(*stream);
         if(err != EAARLIO_SUCCESS)
             return err;
         internal->file_index = 0;
     }
 
-    if(internal->file_index != record.file_index) {
-        err = flight->tld_opener.open_tld(&flight->tld_opener, stream,
-            flight->edb.files[record.file_index - 1]);
+    if(internal->file_index != file_index) {
+        err = eaarlio_flight_open_tld(flight, *stream, file_index,
+            eaarlio_flight_active_stats(flight), internal->memory);
         if(err != EAARLIO_SUCCESS)
             return err;
-        internal->file_index = record.file_index;
+        internal->file_index = file_index;
     }
 
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_open_tld(struct eaarlio_flight *flight,
+    struct eaarlio_stream *stream,
+    int16_t file_index,
+    struct eaarlio_stats *stats,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_tld_opener *opener = &flight->tld_opener;
+    struct eaarlio_stream tld = eaarlio_stream_empty();
+    char const *name = flight->edb.files[file_index - 1];
+    eaarlio_error err;
+    double start;
+
+    if(!stats)
+        return opener->open_tld(opener, stream, name);
+
+    start = eaarlio_clock();
+    err = opener->open_tld(opener, &tld, name);
+    stats->io_seconds += eaarlio_clock() - start;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    stats->tld_opens++;
+
+    err = eaarlio_stats_stream(stream, &tld, stats, memory);
+    if(err != EAARLIO_SUCCESS)
+        tld.close(&tld);
+
+    return err;
+}
+
+struct eaarlio_memory *eaarlio_flight_memory(struct eaarlio_flight *flight)
+{
+    struct _eaarlio_flight_internal *internal =
+        (struct _eaarlio_flight_internal *)flight->internal;
+
+    if(internal->stats_enabled)
+        return &internal->stats_memory.memory;
+    return internal->memory;
+}
+
+struct eaarlio_stats *eaarlio_flight_active_stats(
+    struct eaarlio_flight *flight)
+{
+    struct _eaarlio_flight_internal *internal =
+        (struct _eaarlio_flight_internal *)flight->internal;
+
+    if(internal->stats_enabled)
+        return &internal->stats;
+    return NULL;
+}
+
+void eaarlio_flight_count_raster(struct eaarlio_stats *stats,
+    struct eaarlio_raster const *raster,
+    int include_waveforms)
+{
+    uint16_t i;
+
+    if(!stats)
+        return;
+
+    stats->rasters++;
+    if(!raster->pulse)
+        return;
+
+    stats->pulses += raster->pulse_count;
+    if(include_waveforms)
+        for(i = 0; i < raster->pulse_count; i++)
+            stats->waveforms += 1 + (uint64_t)raster->pulse[i].rx_count;
+}
+
+eaarlio_error eaarlio_flight_read_raster(struct eaarlio_flight *flight,
+    struct eaarlio_raster *raster,
+    int32_t *time_offset,
+    uint32_t raster_number,
+    int include_pulses,
+    int include_waveforms)
+{
+    struct eaarlio_stream *stream;
+    struct eaarlio_edb_record record;
+    struct eaarlio_stats *stats;
+    eaarlio_error err;
+    double start = 0, io_start = 0;
+
+    if(raster)
+        *raster = eaarlio_raster_empty();
+    if(time_offset)
+        *time_offset = 0;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+
+    err = eaarlio_flight_check(flight);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_flight_record(flight, raster_number, &record);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    stats = eaarlio_flight_active_stats(flight);
+    if(stats) {
+        start = eaarlio_clock();
+        io_start = stats->io_seconds;
+    }
+
+    err = eaarlio_flight_stream(flight, record.file_index, &stream);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
     err = stream->seek(stream, record.record_offset, SEEK_SET);
     if(err != EAARLIO_SUCCESS)
         return err;
 
-    err = eaarlio_tld_read_raster(
-        stream, raster, internal->memory, include_pulses, include_waveforms);
+    err = eaarlio_tld_read_raster(stream, raster,
+        eaarlio_flight_memory(flight), include_pulses, include_waveforms);
     if(err != EAARLIO_SUCCESS)
         return err;
 
+    /* The reads and seeks made while decoding were already counted as I/O by
+     * the stream, so only the remainder is decoding
+     */
+    if(stats) {
+        stats->decode_seconds +=
+            eaarlio_clock() - start - (stats->io_seconds - io_start);
+        eaarlio_flight_count_raster(
+            stats, raster, include_pulses && include_waveforms);
+    }
+
     if(time_offset) {
         *time_offset = record.time_seconds - raster->time_seconds;
     }
 
     return EAARLIO_SUCCESS;
 }
+
+eaarlio_error eaarlio_flight_stats_enable(struct eaarlio_flight *flight,
+    int enable)
+{
+    struct _eaarlio_flight_internal *internal;
+    eaarlio_error err;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!flight->internal)
+        return EAARLIO_FLIGHT_INVALID;
+
+    internal = (struct _eaarlio_flight_internal *)flight->internal;
+    enable = enable != 0;
+    if(internal->stats_enabled == enable)
+        return EAARLIO_SUCCESS;
+
+    /* The open stream is wrapped or not depending on the setting it was
+     * opened under, so it is reopened on next use
+     */
+    if(internal->file_index) {
+        err = internal->stream.close(&internal->stream);
+        internal->file_index = 0;
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    internal->stats_enabled = enable;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_stats(struct eaarlio_flight const *flight,
+    struct eaarlio_stats *stats)
+{
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!stats)
+        return EAARLIO_NULL;
+    if(!flight->internal)
+        return EAARLIO_FLIGHT_INVALID;
+
+    *stats = ((struct _eaarlio_flight_internal *)flight->internal)->stats;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_stats_reset(struct eaarlio_flight *flight)
+{
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!flight->internal)
+        return EAARLIO_FLIGHT_INVALID;
+
+    ((struct _eaarlio_flight_internal *)flight->internal)->stats =
+        eaarlio_stats_empty();
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,352 @@
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/flight_internals.h"
+#include "eaarlio/flight_plan.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/thread_support.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct _eaarlio_parallel;
+
+/**
+ * State for one worker
+ *
+ * Each worker owns a contiguous range of extents, [#head, #tail), that it
+ * processes from the front. A worker that runs out takes extents from the
+ * back of another worker's range.
+ */
+struct _eaarlio_parallel_worker {
+    /** State shared by all workers */
+    struct _eaarlio_parallel *shared;
+    /** Thread running this worker; unused for the calling thread */
+    struct eaarlio_thread thread;
+    /** Guards #head and #tail */
+    struct eaarlio_mutex mutex;
+    /** Next extent to process */
+    uint32_t head;
+    /** One past the last extent to process */
+    uint32_t tail;
+    /** This worker's stream */
+    struct eaarlio_stream stream;
+    /** ::eaarlio_edb_record::file_index corresponding to #stream */
+    int16_t file_index;
+    /** Buffer for one extent */
+    unsigned char *buffer;
+    /** Error that stopped this worker */
+    eaarlio_error err;
+    /** Memory handler for decoding */
+    struct eaarlio_memory *memory;
+    /** This worker's statistics, merged into the flight's when done */
+    struct eaarlio_stats stats;
+    /** Wrapper around the flight's memory handler that counts into #stats */
+    struct eaarlio_stats_memory stats_memory;
+};
+
+/**
+ * State shared by all workers
+ */
+struct _eaarlio_parallel {
+    /** Flight being read */
+    struct eaarlio_flight *flight;
+    /** Plan for the whole range */
+    struct eaarlio_plan plan;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Flight's statistics, or @c NULL if they are not enabled */
+    struct eaarlio_stats *stats;
+    /** Workers */
+    struct _eaarlio_parallel_worker *workers;
+    /** Number of entries in #workers */
+    uint32_t worker_count;
+    /** Guards the flight's TLD opener and #stop */
+    struct eaarlio_mutex mutex;
+    /** Set once any worker fails, so that the others stop early */
+    int stop;
+    /** Should pulse data be decoded? */
+    int include_pulses;
+    /** Should waveform data be decoded? */
+    int include_waveforms;
+    /** Caller's callback */
+    eaarlio_flight_raster_fn fn;
+    /** Caller's context */
+    void *ctx;
+};
+
+/* Take the next extent for worker, stealing one if its own range is empty.
+ * Returns 0 when there is no work left anywhere.
+ */
+static int _eaarlio_parallel_next(struct _eaarlio_parallel_worker *worker,
+    uint32_t *extent)
+{
+    struct _eaarlio_parallel *shared = worker->shared;
+    struct _eaarlio_parallel_worker *victim;
+    uint32_t i;
+    int found = 0;
+
+    eaarlio_mutex_lock(&worker->mutex);
+    if(worker->head < worker->tail) {
+        *extent = worker->head++;
+        found = 1;
+    }
+    eaarlio_mutex_unlock(&worker->mutex);
+
+    /* Steal from the back, so that the victim keeps reading forward through
+     * its own extents
+     */
+    for(i = 1; !found && i < shared->worker_count; i++) {
+        victim = &shared->workers[(worker - shared->workers + i)
+            % shared->worker_count];
+        eaarlio_mutex_lock(&victim->mutex);
+        if(victim->head < victim->tail) {
+            *extent = --victim->tail;
+            found = 1;
+        }
+        eaarlio_mutex_unlock(&victim->mutex);
+    }
+
+    return found;
+}
+
+/* Point the worker's stream at a TLD file. The opener is shared by all
+ * workers, so it is only used with the lock held.
+ */
+static eaarlio_error _eaarlio_parallel_stream(
+    struct _eaarlio_parallel_worker *worker,
+    int16_t file_index)
+{
+    struct _eaarlio_parallel *shared = worker->shared;
+    eaarlio_error err = EAARLIO_SUCCESS;
+
+    if(worker->file_index == file_index)
+        return EAARLIO_SUCCESS;
+
+    eaarlio_mutex_lock(&shared->mutex);
+    if(worker->file_index) {
+        err = worker->stream.close(&worker->stream);
+        worker->file_index = 0;
+    }
+    if(err == EAARLIO_SUCCESS)
+        err = eaarlio_flight_open_tld(shared->flight, &worker->stream,
+            file_index, shared->stats ? &worker->stats : NULL,
+            worker->memory);
+    if(err == EAARLIO_SUCCESS)
+        worker->file_index = file_index;
+    eaarlio_mutex_unlock(&shared->mutex);
+
+    return err;
+}
+
+/* Has any worker failed? */
+static int _eaarlio_parallel_stopped(struct _eaarlio_parallel *shared)
+{
+    int stop;
+
+    eaarlio_mutex_lock(&shared->mutex);
+    stop = shared->stop;
+    eaarlio_mutex_unlock(&shared->mutex);
+
+    return stop;
+}
+
+/* Process extents until there are none left or a worker fails */
+static void _eaarlio_parallel_work(void *arg)
+{
+    struct _eaarlio_parallel_worker *worker =
+        (struct _eaarlio_parallel_worker *)arg;
+    struct _eaarlio_parallel *shared = worker->shared;
+    struct eaarlio_plan_extent *extent;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint32_t i;
+
+    while(err == EAARLIO_SUCCESS && !_eaarlio_parallel_stopped(shared)
+        && _eaarlio_parallel_next(worker, &i)) {
+        extent = &shared->plan.extents[i];
+
+        err = _eaarlio_parallel_stream(worker, extent->file_index);
+        if(err == EAARLIO_SUCCESS)
+            err = worker->stream.seek(
+                &worker->stream, extent->offset, SEEK_SET);
+        if(err == EAARLIO_SUCCESS)
+            err = worker->stream.read(
+                &worker->stream, extent->length, worker->buffer);
+        if(err == EAARLIO_SUCCESS)
+            err = eaarlio_plan_decode_extent(&shared->plan, extent,
+                worker->buffer, worker->memory, shared->include_pulses,
+                shared->include_waveforms, shared->fn, shared->ctx,
+                shared->stats ? &worker->stats : NULL);
+    }
+
+    if(err != EAARLIO_SUCCESS) {
+        eaarlio_mutex_lock(&shared->mutex);
+        shared->stop = 1;
+        eaarlio_mutex_unlock(&shared->mutex);
+    }
+    worker->err = err;
+}
+
+/* Release everything held by the workers. Returns the first error, if any. */
+static eaarlio_error _eaarlio_parallel_free(struct _eaarlio_parallel *shared,
+    uint32_t ready)
+{
+    struct eaarlio_memory *memory = shared->memory;
+    struct _eaarlio_parallel_worker *worker;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    eaarlio_error err_close;
+    uint32_t i;
+
+    for(i = 0; i < ready; i++) {
+        worker = &shared->workers[i];
+        if(err == EAARLIO_SUCCESS)
+            err = worker->err;
+        if(worker->file_index) {
+            err_close = worker->stream.close(&worker->stream);
+            if(err == EAARLIO_SUCCESS)
+                err = err_close;
+        }
+        if(shared->stats)
+            eaarlio_stats_add(shared->stats, &worker->stats);
+        memory->free(memory, worker->buffer);
+        eaarlio_mutex_destroy(&worker->mutex);
+    }
+    memory->free(memory, shared->workers);
+
+    return err;
+}
+
+eaarlio_error eaarlio_flight_parallel_for(struct eaarlio_flight *flight,
+    uint32_t first,
+    uint32_t last,
+    int flags,
+    uint32_t nthreads,
+    eaarlio_flight_raster_fn fn,
+    void *ctx)
+{
+    struct _eaarlio_flight_internal *internal;
+    struct _eaarlio_parallel shared;
+    struct _eaarlio_parallel_worker *worker;
+    eaarlio_error err, err_free;
+    uint32_t *raster_numbers;
+    uint32_t count, i, ready = 0, started = 0;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!fn)
+        return EAARLIO_NULL;
+    if(flags
+        & ~(EAARLIO_FLIGHT_INCLUDE_PULSES | EAARLIO_FLIGHT_INCLUDE_WAVEFORMS))
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+    if(first > last)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    err = eaarlio_flight_check(flight);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    if(first < 1 || last > flight->edb.record_count)
+        return EAARLIO_FLIGHT_RASTER_INVALID;
+
+    internal = (struct _eaarlio_flight_internal *)flight->internal;
+
+    memset(&shared, 0, sizeof(shared));
+    shared.flight = flight;
+    shared.plan = eaarlio_plan_empty();
+    shared.memory = eaarlio_flight_memory(flight);
+    shared.stats = eaarlio_flight_active_stats(flight);
+    shared.include_pulses = (flags & EAARLIO_FLIGHT_INCLUDE_PULSES) != 0;
+    shared.include_waveforms = (flags & EAARLIO_FLIGHT_INCLUDE_WAVEFORMS) != 0;
+    shared.fn = fn;
+    shared.ctx = ctx;
+
+    /* Planning sorts the range by file and offset and splits it into
+     * file-aligned extents, which are the units of work
+     */
+    count = last - first + 1;
+    raster_numbers =
+        shared.memory->malloc(shared.memory, (size_t)count * sizeof(uint32_t));
+    if(!raster_numbers)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    for(i = 0; i < count; i++)
+        raster_numbers[i] = first + i;
+    err = eaarlio_plan_build(&shared.plan, flight, raster_numbers, count,
+        EAARLIO_FLIGHT_PARALLEL_CHUNK, shared.memory);
+    shared.memory->free(shared.memory, raster_numbers);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(!nthreads)
+        nthreads = eaarlio_thread_count();
+    if(nthreads > shared.plan.extent_count)
+        nthreads = shared.plan.extent_count;
+
+    err = eaarlio_mutex_init(&shared.mutex);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup_plan;
+
+    shared.workers = shared.memory->calloc(
+        shared.memory, nthreads, sizeof(struct _eaarlio_parallel_worker));
+    if(!shared.workers) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+    shared.worker_count = nthreads;
+
+    for(ready = 0; ready < nthreads; ready++) {
+        worker = &shared.workers[ready];
+        worker->shared = &shared;
+        worker->stream = eaarlio_stream_empty();
+        worker->memory = shared.memory;
+        /* The flight's own counters are not synchronized, so each worker
+         * counts its allocations separately
+         */
+        if(shared.stats) {
+            worker->stats = eaarlio_stats_empty();
+            eaarlio_stats_memory_init(
+                &worker->stats_memory, internal->memory, &worker->stats);
+            worker->memory = &worker->stats_memory.memory;
+        }
+        worker->head = (uint32_t)(
+            (uint64_t)shared.plan.extent_count * ready / nthreads);
+        worker->tail = (uint32_t)(
+            (uint64_t)shared.plan.extent_count * (ready + 1) / nthreads);
+        worker->buffer =
+            shared.memory->malloc(shared.memory, shared.plan.max_length);
+        if(!worker->buffer) {
+            err = EAARLIO_MEMORY_ALLOC_FAIL;
+            goto cleanup;
+        }
+        err = eaarlio_mutex_init(&worker->mutex);
+        if(err != EAARLIO_SUCCESS) {
+            shared.memory->free(shared.memory, worker->buffer);
+            goto cleanup;
+        }
+    }
+
+    /* The calling thread is the first worker. If a thread cannot be started,
+     * its extents are stolen by the workers that are running.
+     */
+    for(started = 1; started < nthreads; started++) {
+        worker = &shared.workers[started];
+        if(eaarlio_thread_start(&worker->thread, &_eaarlio_parallel_work,
+               worker)
+            != EAARLIO_SUCCESS)
+            break;
+    }
+    if(nthreads)
+        _eaarlio_parallel_work(&shared.workers[0]);
+    for(i = 1; i < started; i++)
+        eaarlio_thread_join(&shared.workers[i].thread);
+
+cleanup:
+    if(shared.workers) {
+        err_free = _eaarlio_parallel_free(&shared, ready);
+        if(err == EAARLIO_SUCCESS)
+            err = err_free;
+    }
+    eaarlio_mutex_destroy(&shared.mutex);
+cleanup_plan:
+    eaarlio_plan_free(&shared.plan, shared.memory);
+
+    return err;
+}
@@ -0,0 +1,405 @@
+#include "eaarlio/flight_plan.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/flight_internals.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/tld_unpack.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* qsort comparison for plan entries: file, then offset, then request order.
+ * Using the request order as the final key keeps the sort deterministic even
+ * though qsort itself is not stable.
+ */
+static int _eaarlio_plan_entry_cmp(void const *a, void const *b)
+{
+    struct eaarlio_plan_entry const *ea = (struct eaarlio_plan_entry const *)a;
+    struct eaarlio_plan_entry const *eb = (struct eaarlio_plan_entry const *)b;
+
+    if(ea->record.file_index != eb->record.file_index)
+        return ea->record.file_index < eb->record.file_index ? -1 : 1;
+    if(ea->record.record_offset != eb->record.record_offset)
+        return ea->record.record_offset < eb->record.record_offset ? -1 : 1;
+    if(ea->index != eb->index)
+        return ea->index < eb->index ? -1 : 1;
+    return 0;
+}
+
+eaarlio_error eaarlio_plan_free(struct eaarlio_plan *plan,
+    struct eaarlio_memory *memory)
+{
+    if(!plan)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    if(plan->entries)
+        memory->free(memory, plan->entries);
+    if(plan->extents)
+        memory->free(memory, plan->extents);
+
+    *plan = eaarlio_plan_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_plan_build(struct eaarlio_plan *plan,
+    struct eaarlio_flight const *flight,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    uint32_t max_read,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_plan_entry *entry;
+    struct eaarlio_plan_extent *extent = NULL;
+    eaarlio_error err;
+    uint64_t end;
+    uint32_t i;
+
+    if(plan)
+        *plan = eaarlio_plan_empty();
+
+    if(!plan)
+        return EAARLIO_NULL;
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!raster_numbers && raster_count > 0)
+        return EAARLIO_NULL;
+    if(!flight->edb.records)
+        return EAARLIO_FLIGHT_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    if(max_read == 0)
+        max_read = EAARLIO_FLIGHT_PLAN_MAX_READ;
+
+    if(raster_count == 0)
+        return EAARLIO_SUCCESS;
+
+    plan->entries = memory->malloc(
+        memory, raster_count * sizeof(struct eaarlio_plan_entry));
+    if(!plan->entries)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    for(i = 0; i < raster_count; i++) {
+        entry = &plan->entries[i];
+        entry->index = i;
+        entry->raster_number = raster_numbers[i];
+        err = eaarlio_flight_record(flight, raster_numbers[i], &entry->record);
+        if(err != EAARLIO_SUCCESS)
+            goto fail;
+    }
+    plan->entry_count = raster_count;
+
+    qsort(plan->entries, raster_count, sizeof(struct eaarlio_plan_entry),
+        &_eaarlio_plan_entry_cmp);
+
+    /* In the worst case, every entry gets its own extent. */
+    plan->extents = memory->malloc(
+        memory, raster_count * sizeof(struct eaarlio_plan_extent));
+    if(!plan->extents) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto fail;
+    }
+
+    for(i = 0; i < raster_count; i++) {
+        entry = &plan->entries[i];
+        end = (uint64_t)entry->record.record_offset
+            + entry->record.record_length;
+
+        if(extent && extent->file_index == entry->record.file_index
+            && entry->record.record_offset
+                <= (uint64_t)extent->offset + extent->length
+                    + EAARLIO_FLIGHT_PLAN_MAX_GAP
+            && end - extent->offset <= max_read) {
+            if(end > (uint64_t)extent->offset + extent->length)
+                extent->length = (uint32_t)(end - extent->offset);
+            extent->count++;
+        } else {
+            if(end > UINT32_MAX) {
+                err = EAARLIO_CORRUPT;
+                goto fail;
+            }
+            extent = &plan->extents[plan->extent_count++];
+            extent->file_index = entry->record.file_index;
+            extent->offset = entry->record.record_offset;
+            extent->length = entry->record.record_length;
+            extent->first = i;
+            extent->count = 1;
+        }
+
+        if(extent->length > plan->max_length)
+            plan->max_length = extent->length;
+    }
+
+    return EAARLIO_SUCCESS;
+
+fail:
+    eaarlio_plan_free(plan, memory);
+    return err;
+}
+
+eaarlio_error eaarlio_plan_decode_extent(struct eaarlio_plan const *plan,
+    struct eaarlio_plan_extent const *extent,
+    unsigned char const *buffer,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx,
+    struct eaarlio_stats *stats)
+{
+    struct eaarlio_plan_entry const *entry;
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    eaarlio_error err = EAARLIO_SUCCESS;
+    eaarlio_error err_free;
+    uint32_t i;
+    double start = 0;
+
+    if(!plan)
+        return EAARLIO_NULL;
+    if(!extent)
+        return EAARLIO_NULL;
+    if(!buffer)
+        return EAARLIO_NULL;
+    if(!fn)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    for(i = extent->first; i < extent->first + extent->count; i++) {
+        entry = &plan->entries[i];
+
+        if(stats)
+            start = eaarlio_clock();
+        err = eaarlio_tld_unpack_record(
+            buffer + (entry->record.record_offset - extent->offset),
+            entry->record.record_length, &header, &raster, memory,
+            include_pulses, include_waveforms);
+        if(err == EAARLIO_SUCCESS
+            && !eaarlio_tld_type_is_raster(header.record_type))
+            err = EAARLIO_TLD_TYPE_UNKNOWN;
+        if(stats && err == EAARLIO_SUCCESS) {
+            stats->decode_seconds += eaarlio_clock() - start;
+            eaarlio_flight_count_raster(
+                stats, &raster, include_pulses && include_waveforms);
+        }
+
+        if(err == EAARLIO_SUCCESS)
+            err = fn(ctx, entry->index, entry->raster_number, &raster,
+                entry->record.time_seconds - raster.time_seconds);
+
+        if(stats)
+            start = eaarlio_clock();
+        err_free = eaarlio_raster_free(&raster, memory);
+        if(stats)
+            stats->free_seconds += eaarlio_clock() - start;
+        if(err == EAARLIO_SUCCESS)
+            err = err_free;
+        if(err != EAARLIO_SUCCESS)
+            break;
+    }
+
+    return err;
+}
+
+/**
+ * Reorder buffer used by ::eaarlio_flight_plan for
+ * ::EAARLIO_FLIGHT_ORDER_CALLER
+ */
+struct _eaarlio_plan_reorder {
+    /** Rasters that have been decoded but not yet delivered */
+    struct eaarlio_raster *pending;
+    /** Time offsets for #pending */
+    int32_t *time_offset;
+    /** Flags indicating which entries in #pending are populated */
+    unsigned char *ready;
+    /** Number of entries in each array */
+    uint32_t count;
+    /** Index of the next raster to deliver */
+    uint32_t next;
+    /** Raster numbers as given by the caller */
+    uint32_t const *raster_numbers;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Caller's callback */
+    eaarlio_flight_raster_fn fn;
+    /** Caller's context */
+    void *ctx;
+};
+
+/* Callback for eaarlio_plan_decode_extent that takes ownership of each raster
+ * and then delivers any that are now in turn.
+ */
+static eaarlio_error _eaarlio_plan_reorder(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct _eaarlio_plan_reorder *reorder =
+        (struct _eaarlio_plan_reorder *)ctx;
+    struct eaarlio_raster *next;
+    eaarlio_error err;
+    eaarlio_error err_free;
+
+    (void)raster_number;
+
+    /* Take ownership so that the caller's free is a no-op. */
+    reorder->pending[index] = *raster;
+    reorder->time_offset[index] = time_offset;
+    reorder->ready[index] = 1;
+    raster->pulse = NULL;
+
+    while(reorder->next < reorder->count && reorder->ready[reorder->next]) {
+        next = &reorder->pending[reorder->next];
+        reorder->ready[reorder->next] = 0;
+
+        err = reorder->fn(reorder->ctx, reorder->next,
+            reorder->raster_numbers[reorder->next], next,
+            reorder->time_offset[reorder->next]);
+        err_free = eaarlio_raster_free(next, reorder->memory);
+        reorder->next++;
+
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        if(err_free != EAARLIO_SUCCESS)
+            return err_free;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_plan(struct eaarlio_flight *flight,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    int order,
+    uint32_t max_read,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx)
+{
+    struct _eaarlio_plan_reorder reorder;
+    struct eaarlio_plan plan = eaarlio_plan_empty();
+    struct eaarlio_plan_extent *extent;
+    struct eaarlio_stream *stream;
+    struct eaarlio_memory *memory;
+    struct eaarlio_stats *stats;
+    eaarlio_error err;
+    unsigned char *buf = NULL;
+    uint32_t i;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!raster_numbers && raster_count > 0)
+        return EAARLIO_NULL;
+    if(!fn)
+        return EAARLIO_NULL;
+    if(order != EAARLIO_FLIGHT_ORDER_DISK
+        && order != EAARLIO_FLIGHT_ORDER_CALLER)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    err = eaarlio_flight_check(flight);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    memory = eaarlio_flight_memory(flight);
+    stats = eaarlio_flight_active_stats(flight);
+
+    memset(&reorder, 0, sizeof(reorder));
+    reorder.count = raster_count;
+    reorder.raster_numbers = raster_numbers;
+    reorder.memory = memory;
+    reorder.fn = fn;
+    reorder.ctx = ctx;
+
+    err = eaarlio_plan_build(
+        &plan, flight, raster_numbers, raster_count, max_read, memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(plan.entry_count == 0)
+        return EAARLIO_SUCCESS;
+
+    buf = memory->malloc(memory, plan.max_length);
+    if(!buf) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    if(order == EAARLIO_FLIGHT_ORDER_CALLER) {
+        reorder.pending =
+            memory->calloc(memory, raster_count, sizeof(struct eaarlio_raster));
+        reorder.time_offset =
+            memory->calloc(memory, raster_count, sizeof(int32_t));
+        reorder.ready = memory->calloc(memory, raster_count, 1);
+        if(!reorder.pending || !reorder.time_offset || !reorder.ready) {
+            err = EAARLIO_MEMORY_ALLOC_FAIL;
+            goto cleanup;
+        }
+    }
+
+    for(i = 0; i < plan.extent_count; i++) {
+        extent = &plan.extents[i];
+
+        err = eaarlio_flight_stream(flight, extent->file_index, &stream);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        err = stream->seek(stream, extent->offset, SEEK_SET);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        err = stream->read(stream, extent->length, buf);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        if(order == EAARLIO_FLIGHT_ORDER_CALLER) {
+            err = eaarlio_plan_decode_extent(&plan, extent, buf, memory,
+                include_pulses, include_waveforms, &_eaarlio_plan_reorder,
+                &reorder, stats);
+        } else {
+            err = eaarlio_plan_decode_extent(&plan, extent, buf, memory,
+                include_pulses, include_waveforms, fn, ctx, stats);
+        }
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+    }
+
+    assert(order == EAARLIO_FLIGHT_ORDER_DISK || reorder.next == raster_count);
+
+cleanup:
+    if(reorder.pending) {
+        for(i = 0; i < raster_count; i++)
+            eaarlio_raster_free(&reorder.pending[i], memory);
+        memory->free(memory, reorder.pending);
+    }
+    if(reorder.time_offset)
+        memory->free(memory, reorder.time_offset);
+    if(reorder.ready)
+        memory->free(memory, reorder.ready);
+    if(buf)
+        memory->free(memory, buf);
+    eaarlio_plan_free(&plan, memory);
+
+    return err;
+}
@@ -0,0 +1,252 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight_writer.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/tld.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initial allocation for ::eaarlio_flight_writer::edb records
+ */
+#define _EAARLIO_FLIGHT_WRITER_RECORDS 1024U
+
+eaarlio_error eaarlio_flight_writer_init(struct eaarlio_flight_writer *writer,
+    uint32_t block_size,
+    eaarlio_stream_sync_fn sync,
+    int sync_policy,
+    struct eaarlio_memory *memory)
+{
+    if(!writer)
+        return EAARLIO_NULL;
+    *writer = eaarlio_flight_writer_empty();
+
+    switch(sync_policy) {
+        case EAARLIO_TLD_SYNC_NEVER:
+            break;
+        case EAARLIO_TLD_SYNC_CLOSE:
+        case EAARLIO_TLD_SYNC_FLUSH:
+            if(!sync)
+                return EAARLIO_VALUE_OUT_OF_RANGE;
+            break;
+        default:
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+    }
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    writer->block_size = block_size;
+    writer->sync = sync;
+    writer->sync_policy = sync_policy;
+    writer->memory = memory;
+    writer->record_type = EAARLIO_TLD_TYPE_RASTER;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_writer_set_record_type(
+    struct eaarlio_flight_writer *writer,
+    int record_type)
+{
+    eaarlio_error err;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!eaarlio_tld_type_is_raster(record_type))
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(writer->tld.buffer) {
+        err = eaarlio_tld_writer_set_record_type(&writer->tld, record_type);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    writer->record_type = (uint8_t)record_type;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_writer_close_tld(
+    struct eaarlio_flight_writer *writer)
+{
+    eaarlio_error err = EAARLIO_SUCCESS;
+    eaarlio_error err_close = EAARLIO_SUCCESS;
+
+    if(!writer)
+        return EAARLIO_NULL;
+
+    if(writer->tld.buffer)
+        err = eaarlio_tld_writer_close(&writer->tld);
+
+    if(writer->stream.close)
+        err_close = writer->stream.close(&writer->stream);
+    writer->stream = eaarlio_stream_empty();
+
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    return err_close;
+}
+
+eaarlio_error eaarlio_flight_writer_open_tld(
+    struct eaarlio_flight_writer *writer,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct eaarlio_memory *memory;
+    eaarlio_error err;
+    char **files;
+    size_t len;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+    if(!writer->memory)
+        return EAARLIO_MEMORY_INVALID;
+    if(!eaarlio_stream_valid(stream))
+        return EAARLIO_STREAM_INVALID;
+
+    memory = writer->memory;
+
+    len = eaarlio_strnlen(tld_file, EAARLIO_EDB_FILENAME_MAX_LENGTH + 1);
+    if(len > EAARLIO_EDB_FILENAME_MAX_LENGTH)
+        return EAARLIO_EDB_FILENAME_TOO_LONG;
+
+    /* File indexes are stored as signed 16-bit values */
+    if(writer->edb.file_count >= INT16_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    err = eaarlio_flight_writer_close_tld(writer);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    files = memory->realloc(
+        memory, writer->edb.files, (writer->edb.file_count + 1) * sizeof(char *));
+    if(!files)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    writer->edb.files = files;
+
+    files[writer->edb.file_count] = memory->malloc(memory, len + 1);
+    if(!files[writer->edb.file_count])
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    memcpy(files[writer->edb.file_count], tld_file, len);
+    files[writer->edb.file_count][len] = '\0';
+
+    err = eaarlio_tld_writer_init(&writer->tld, stream, writer->block_size,
+        writer->sync, writer->sync_policy, memory);
+    if(err == EAARLIO_SUCCESS) {
+        err = eaarlio_tld_writer_set_record_type(
+            &writer->tld, writer->record_type);
+        if(err != EAARLIO_SUCCESS)
+            eaarlio_tld_writer_close(&writer->tld);
+    }
+    if(err != EAARLIO_SUCCESS) {
+        memory->free(memory, files[writer->edb.file_count]);
+        files[writer->edb.file_count] = NULL;
+        return err;
+    }
+
+    writer->edb.file_count++;
+
+    /* The TLD writer holds a pointer to the stream, so it must point at the
+     * writer's own copy rather than the caller's.
+     */
+    writer->stream = *stream;
+    writer->tld.stream = &writer->stream;
+    *stream = eaarlio_stream_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_writer_write_raster(
+    struct eaarlio_flight_writer *writer,
+    struct eaarlio_raster *raster,
+    uint32_t *raster_number)
+{
+    struct eaarlio_memory *memory;
+    struct eaarlio_edb_record *record;
+    eaarlio_error err;
+    uint32_t capacity;
+    int64_t offset;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+    if(!writer->tld.buffer)
+        return EAARLIO_STREAM_INVALID;
+
+    memory = writer->memory;
+
+    if(writer->edb.record_count == UINT32_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+    if(writer->tld.position + writer->tld.buffer_len > UINT32_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(writer->edb.record_count == writer->record_capacity) {
+        capacity = writer->record_capacity
+            ? writer->record_capacity * 2
+            : _EAARLIO_FLIGHT_WRITER_RECORDS;
+        if(capacity < writer->record_capacity)
+            capacity = UINT32_MAX;
+        record = memory->realloc(memory, writer->edb.records,
+            (size_t)capacity * sizeof(struct eaarlio_edb_record));
+        if(!record)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        writer->edb.records = record;
+        writer->record_capacity = capacity;
+    }
+
+    err = eaarlio_tld_writer_write_raster(&writer->tld, raster, &offset);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    record = &writer->edb.records[writer->edb.record_count];
+    record->time_seconds = raster->time_seconds;
+    record->time_fraction = raster->time_fraction;
+    record->record_offset = (uint32_t)offset;
+    /* The record's size depends on the record type the writer chose */
+    record->record_length =
+        (uint32_t)(writer->tld.position + writer->tld.buffer_len - offset);
+    record->file_index = (int16_t)writer->edb.file_count;
+    record->pulse_count = raster->pulse_count > UINT8_MAX
+        ? UINT8_MAX
+        : (uint8_t)raster->pulse_count;
+    record->digitizer = raster->digitizer;
+
+    writer->edb.record_count++;
+    if(raster_number)
+        *raster_number = writer->edb.record_count;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_flight_writer_close(struct eaarlio_flight_writer *writer,
+    struct eaarlio_stream *edb_stream)
+{
+    eaarlio_error err;
+
+    if(!writer)
+        return EAARLIO_NULL;
+
+    err = eaarlio_flight_writer_close_tld(writer);
+
+    if(err == EAARLIO_SUCCESS && edb_stream)
+        err = eaarlio_edb_write(edb_stream, &writer->edb);
+
+    if(writer->memory)
+        eaarlio_edb_free(&writer->edb, writer->memory);
+
+    *writer = eaarlio_flight_writer_empty();
+
+    return err;
+}
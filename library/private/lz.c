@@ -0,0 +1,229 @@
+#include "eaarlio/error.h"
+#include "eaarlio/lz.h"
+#include <stdint.h>
+#include <string.h>
+
+/** Marks an unused hash table entry */
+#define _EAARLIO_LZ_EMPTY UINT32_MAX
+
+/** Furthest back a match can refer */
+#define _EAARLIO_LZ_WINDOW 65535U
+
+static uint32_t _eaarlio_lz_read32(unsigned char const *buf)
+{
+    return (uint32_t)buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16
+        | (uint32_t)buf[3] << 24;
+}
+
+static uint32_t _eaarlio_lz_hash(uint32_t seq)
+{
+    return (seq * 2654435761U) >> 20;
+}
+
+/* Number of bytes needed for the extra length bytes of a length nibble */
+static uint32_t _eaarlio_lz_extra_size(uint32_t len)
+{
+    return len < 15 ? 0 : (len - 15) / 255 + 1;
+}
+
+static unsigned char *_eaarlio_lz_put_extra(unsigned char *op, uint32_t len)
+{
+    if(len < 15)
+        return op;
+    len -= 15;
+    while(len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/* Emit a sequence. With match_len 0, this is the final, literal-only sequence.
+ * Returns NULL if it does not fit before end.
+ */
+static unsigned char *_eaarlio_lz_put_sequence(unsigned char *op,
+    unsigned char const *end,
+    unsigned char const *literals,
+    uint32_t literal_len,
+    uint32_t offset,
+    uint32_t match_len)
+{
+    uint32_t code = match_len ? match_len - EAARLIO_LZ_MATCH_MIN : 0;
+    uint64_t need = 1 + (uint64_t)_eaarlio_lz_extra_size(literal_len)
+        + literal_len;
+
+    if(match_len)
+        need += 2 + _eaarlio_lz_extra_size(code);
+    if(need > (uint64_t)(end - op))
+        return NULL;
+
+    *op++ = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4
+        | (code < 15 ? code : 15));
+    op = _eaarlio_lz_put_extra(op, literal_len);
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if(match_len) {
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+        op = _eaarlio_lz_put_extra(op, code);
+    }
+
+    return op;
+}
+
+eaarlio_error eaarlio_lz_compress(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *out_len,
+    uint32_t *table)
+{
+    unsigned char *op = dst;
+    unsigned char const *end = dst + dst_len;
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    uint32_t seq, h, candidate, match_len, i;
+
+    if(!dst)
+        return EAARLIO_NULL;
+    if(!src && src_len)
+        return EAARLIO_NULL;
+    if(!out_len)
+        return EAARLIO_NULL;
+    if(!table)
+        return EAARLIO_NULL;
+
+    for(i = 0; i < EAARLIO_LZ_HASH_SIZE; i++)
+        table[i] = _EAARLIO_LZ_EMPTY;
+
+    while(src_len >= EAARLIO_LZ_MATCH_MIN
+        && ip <= src_len - EAARLIO_LZ_MATCH_MIN) {
+        seq = _eaarlio_lz_read32(src + ip);
+        h = _eaarlio_lz_hash(seq);
+        candidate = table[h];
+        table[h] = ip;
+
+        if(candidate == _EAARLIO_LZ_EMPTY
+            || ip - candidate > _EAARLIO_LZ_WINDOW
+            || _eaarlio_lz_read32(src + candidate) != seq) {
+            ip++;
+            continue;
+        }
+
+        match_len = EAARLIO_LZ_MATCH_MIN;
+        while(ip + match_len < src_len
+            && src[candidate + match_len] == src[ip + match_len])
+            match_len++;
+
+        op = _eaarlio_lz_put_sequence(op, end, src + anchor, ip - anchor,
+            ip - candidate, match_len);
+        if(!op)
+            return EAARLIO_BUFFER_SHORT;
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    if(anchor < src_len) {
+        op = _eaarlio_lz_put_sequence(
+            op, end, src + anchor, src_len - anchor, 0, 0);
+        if(!op)
+            return EAARLIO_BUFFER_SHORT;
+    }
+
+    *out_len = (uint32_t)(op - dst);
+    return EAARLIO_SUCCESS;
+}
+
+/* Read the extra bytes for a length nibble of 15. Returns 0 if the input ends
+ * first or the length exceeds max.
+ */
+static int _eaarlio_lz_get_extra(unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *ip,
+    uint32_t *len,
+    uint32_t max)
+{
+    unsigned char byte;
+
+    if(*len > max)
+        return 0;
+
+    do {
+        if(*ip >= src_len)
+            return 0;
+        byte = src[(*ip)++];
+        if(byte > max - *len)
+            return 0;
+        *len += byte;
+    } while(byte == 255);
+
+    return 1;
+}
+
+eaarlio_error eaarlio_lz_decompress(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    uint32_t literal_len, match_len, offset, i;
+    unsigned char token;
+
+    if(!dst && dst_len)
+        return EAARLIO_NULL;
+    if(!src && src_len)
+        return EAARLIO_NULL;
+
+    while(ip < src_len) {
+        token = src[ip++];
+
+        literal_len = token >> 4;
+        if(literal_len == 15
+            && !_eaarlio_lz_get_extra(src, src_len, &ip, &literal_len, dst_len))
+            return EAARLIO_CORRUPT;
+        if(literal_len > src_len - ip || literal_len > dst_len - op)
+            return EAARLIO_CORRUPT;
+
+        memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+
+        if(ip == src_len)
+            break;
+
+        if(src_len - ip < 2)
+            return EAARLIO_CORRUPT;
+        offset = (uint32_t)src[ip] | (uint32_t)src[ip + 1] << 8;
+        ip += 2;
+        if(offset == 0 || offset > op)
+            return EAARLIO_CORRUPT;
+
+        match_len = token & 15;
+        if(match_len == 15
+            && !_eaarlio_lz_get_extra(src, src_len, &ip, &match_len, dst_len))
+            return EAARLIO_CORRUPT;
+        match_len += EAARLIO_LZ_MATCH_MIN;
+        if(match_len > dst_len - op)
+            return EAARLIO_CORRUPT;
+
+        /* Overlapping matches repeat recent output, so copy forward a byte at
+         * a time unless the source is entirely behind the destination.
+         */
+        if(offset >= match_len) {
+            memcpy(dst + op, dst + op - offset, match_len);
+        } else {
+            for(i = 0; i < match_len; i++)
+                dst[op + i] = dst[op + i - offset];
+        }
+        op += match_len;
+    }
+
+    if(op != dst_len)
+        return EAARLIO_CORRUPT;
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,328 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Internal state for a memory stream
+ */
+struct _eaarlio_memory_stream {
+    /** Stream data */
+    unsigned char *buf;
+    /** Number of bytes of data in #buf */
+    uint64_t size;
+    /** Allocated size of #buf; only meaningful if #growable */
+    uint64_t capacity;
+    /** Current position */
+    uint64_t position;
+    /** Are writes permitted? */
+    int writable;
+    /** Does the stream own #buf and grow it as needed? */
+    int growable;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static eaarlio_error _eaarlio_memory_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_memory_stream *internal;
+    struct eaarlio_memory memory;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_memory_stream *)self->data;
+    memory = internal->memory;
+
+    if(internal->growable && internal->buf)
+        memory.free(&memory, internal->buf);
+    memory.free(&memory, internal);
+
+    *self = eaarlio_stream_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_memory_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct _eaarlio_memory_stream *internal;
+    uint64_t avail;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(len == 0)
+        return EAARLIO_SUCCESS;
+
+    internal = (struct _eaarlio_memory_stream *)self->data;
+
+    avail = internal->position < internal->size
+        ? internal->size - internal->position
+        : 0;
+    if(avail > len)
+        avail = len;
+
+    if(avail) {
+        memcpy(buf, internal->buf + internal->position, (size_t)avail);
+        internal->position += avail;
+    }
+
+    if(avail < len)
+        return EAARLIO_STREAM_READ_SHORT;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Make room in a growable stream for at least need bytes. */
+static eaarlio_error _eaarlio_memory_stream_reserve(
+    struct _eaarlio_memory_stream *internal,
+    uint64_t need)
+{
+    uint64_t capacity = internal->capacity;
+    unsigned char *buf;
+
+    if(need <= capacity)
+        return EAARLIO_SUCCESS;
+    if((uint64_t)(size_t)need != need || need > INT64_MAX)
+        return EAARLIO_STREAM_WRITE_ERROR;
+
+    if(capacity == 0)
+        capacity = EAARLIO_MEMORY_STREAM_CAPACITY;
+    while(capacity < need)
+        capacity = capacity > INT64_MAX / 2 ? need : capacity * 2;
+    if((uint64_t)(size_t)capacity != capacity)
+        capacity = need;
+
+    if(internal->buf)
+        buf = internal->memory.realloc(
+            &internal->memory, internal->buf, (size_t)capacity);
+    else
+        buf = internal->memory.malloc(&internal->memory, (size_t)capacity);
+    if(!buf)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->buf = buf;
+    internal->capacity = capacity;
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_memory_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    struct _eaarlio_memory_stream *internal;
+    eaarlio_error err;
+    uint64_t avail;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_memory_stream *)self->data;
+
+    if(!internal->writable)
+        return EAARLIO_STREAM_NOT_IMPL;
+    if(len == 0)
+        return EAARLIO_SUCCESS;
+
+    if(internal->growable) {
+        if(len > INT64_MAX - internal->position)
+            return EAARLIO_STREAM_WRITE_ERROR;
+
+        err = _eaarlio_memory_stream_reserve(
+            internal, internal->position + len);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+
+        /* Seeking past the end leaves a gap that reads back as zeroes */
+        if(internal->position > internal->size)
+            memset(internal->buf + internal->size, 0,
+                (size_t)(internal->position - internal->size));
+
+        avail = len;
+    } else {
+        avail = internal->position < internal->size
+            ? internal->size - internal->position
+            : 0;
+        if(avail > len)
+            avail = len;
+    }
+
+    if(avail) {
+        memcpy(internal->buf + internal->position, buf, (size_t)avail);
+        internal->position += avail;
+        if(internal->position > internal->size)
+            internal->size = internal->position;
+    }
+
+    if(avail < len)
+        return EAARLIO_STREAM_WRITE_SHORT;
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_memory_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_memory_stream *internal;
+    int64_t base;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_memory_stream *)self->data;
+
+    switch(whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)internal->position;
+            break;
+        case SEEK_END:
+            base = (int64_t)internal->size;
+            break;
+        default:
+            return EAARLIO_STREAM_SEEK_INVALID;
+    }
+
+    if(offset < 0 && base < -offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+    if(offset > 0 && base > INT64_MAX - offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+
+    internal->position = (uint64_t)(base + offset);
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_memory_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_memory_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(!position)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_memory_stream *)self->data;
+    *position = (int64_t)internal->position;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_memory_stream(struct eaarlio_stream *stream,
+    unsigned char *buf,
+    uint64_t len,
+    char const *mode,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_memory_stream *internal;
+    int writable, growable;
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!mode)
+        return EAARLIO_NULL;
+
+    if(strcmp(mode, "r") == 0) {
+        writable = 0;
+        growable = 0;
+    } else if(strcmp(mode, "r+") == 0) {
+        writable = 1;
+        growable = 0;
+    } else if(strcmp(mode, "w") == 0) {
+        writable = 1;
+        growable = 1;
+    } else {
+        return EAARLIO_STREAM_OPEN_ERROR;
+    }
+
+    if(growable && buf)
+        return EAARLIO_STREAM_OPEN_ERROR;
+    if(!growable && !buf && len)
+        return EAARLIO_NULL;
+    if(len > INT64_MAX || (uint64_t)(size_t)len != len)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal = memory->calloc(memory, 1, sizeof(struct _eaarlio_memory_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->memory = *memory;
+    internal->writable = writable;
+    internal->growable = growable;
+
+    if(growable) {
+        if(len && _eaarlio_memory_stream_reserve(internal, len)
+                != EAARLIO_SUCCESS) {
+            memory->free(memory, internal);
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        }
+    } else {
+        internal->buf = buf;
+        internal->size = len;
+    }
+
+    stream->close = &_eaarlio_memory_stream_close;
+    stream->read = &_eaarlio_memory_stream_read;
+    stream->write = &_eaarlio_memory_stream_write;
+    stream->seek = &_eaarlio_memory_stream_seek;
+    stream->tell = &_eaarlio_memory_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_memory_stream_buffer(struct eaarlio_stream *stream,
+    unsigned char **buf,
+    uint64_t *len)
+{
+    struct _eaarlio_memory_stream *internal;
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!len)
+        return EAARLIO_NULL;
+    if(!stream->data)
+        return EAARLIO_STREAM_INVALID;
+    if(stream->close != &_eaarlio_memory_stream_close)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_memory_stream *)stream->data;
+    *buf = internal->buf;
+    *len = internal->size;
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,293 @@
+#include "eaarlio/memory_tracking.h"
+#include "eaarlio/error.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/thread_support.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Header stored in front of each block
+ *
+ * The union makes the header a multiple of the strictest alignment of the
+ * basic types, so the caller's part of the block stays suitably aligned.
+ */
+union _eaarlio_memory_tracking_header {
+    /** Size requested by the caller */
+    size_t size;
+    /** Alignment padding */
+    long double align_ld;
+    /** Alignment padding */
+    void *align_ptr;
+    /** Alignment padding */
+    uint64_t align_u64;
+};
+
+#define HEADER_SIZE sizeof(union _eaarlio_memory_tracking_header)
+
+/**
+ * Internal state for a tracking memory handler
+ */
+struct _eaarlio_memory_tracking {
+    /** Memory handler that does the work */
+    struct eaarlio_memory inner;
+    /** Protects #usage */
+    struct eaarlio_mutex mutex;
+    /** Measurements */
+    struct eaarlio_memory_usage usage;
+};
+
+static void *_eaarlio_memory_tracking_malloc(struct eaarlio_memory *self,
+    size_t size);
+
+/* Return the internal state of a tracking memory handler, or NULL if it is not
+ * one.
+ */
+static struct _eaarlio_memory_tracking *_eaarlio_memory_tracking_internal(
+    struct eaarlio_memory const *wrapper)
+{
+    if(wrapper->malloc != &_eaarlio_memory_tracking_malloc)
+        return NULL;
+    return (struct _eaarlio_memory_tracking *)wrapper->opaque;
+}
+
+/* Record a successful request of size bytes. The mutex must be held. */
+static void _eaarlio_memory_tracking_record(
+    struct _eaarlio_memory_tracking *internal,
+    size_t size)
+{
+    struct eaarlio_memory_usage *usage = &internal->usage;
+    int bin = 0;
+
+    while(bin < EAARLIO_MEMORY_TRACKING_BINS - 1
+        && ((uint64_t)1 << bin) < (uint64_t)size)
+        bin++;
+
+    usage->histogram[bin]++;
+    usage->total_bytes += size;
+    usage->live_bytes += size;
+    if(usage->live_bytes > usage->peak_bytes)
+        usage->peak_bytes = usage->live_bytes;
+}
+
+/* Record a new block of size bytes at base, or a failure if base is NULL, and
+ * return the caller's pointer.
+ */
+static void *_eaarlio_memory_tracking_new(
+    struct _eaarlio_memory_tracking *internal,
+    union _eaarlio_memory_tracking_header *base,
+    size_t size)
+{
+    eaarlio_mutex_lock(&internal->mutex);
+    if(base) {
+        _eaarlio_memory_tracking_record(internal, size);
+        internal->usage.allocs++;
+        internal->usage.live_blocks++;
+    } else {
+        internal->usage.failures++;
+    }
+    eaarlio_mutex_unlock(&internal->mutex);
+
+    if(!base)
+        return NULL;
+    base->size = size;
+    return (unsigned char *)base + HEADER_SIZE;
+}
+
+static void *_eaarlio_memory_tracking_malloc(struct eaarlio_memory *self,
+    size_t size)
+{
+    struct _eaarlio_memory_tracking *internal =
+        (struct _eaarlio_memory_tracking *)self->opaque;
+    union _eaarlio_memory_tracking_header *base = NULL;
+
+    if(size <= SIZE_MAX - HEADER_SIZE)
+        base = internal->inner.malloc(&internal->inner, HEADER_SIZE + size);
+    return _eaarlio_memory_tracking_new(internal, base, size);
+}
+
+static void _eaarlio_memory_tracking_free(struct eaarlio_memory *self,
+    void *ptr)
+{
+    struct _eaarlio_memory_tracking *internal =
+        (struct _eaarlio_memory_tracking *)self->opaque;
+    union _eaarlio_memory_tracking_header *base;
+
+    if(!ptr)
+        return;
+
+    base = (union _eaarlio_memory_tracking_header *)((unsigned char *)ptr
+        - HEADER_SIZE);
+
+    eaarlio_mutex_lock(&internal->mutex);
+    internal->usage.frees++;
+    internal->usage.live_bytes -= base->size;
+    internal->usage.live_blocks--;
+    eaarlio_mutex_unlock(&internal->mutex);
+
+    internal->inner.free(&internal->inner, base);
+}
+
+static void *_eaarlio_memory_tracking_realloc(struct eaarlio_memory *self,
+    void *ptr,
+    size_t size)
+{
+    struct _eaarlio_memory_tracking *internal =
+        (struct _eaarlio_memory_tracking *)self->opaque;
+    union _eaarlio_memory_tracking_header *base;
+    size_t old_size;
+
+    if(!ptr)
+        return _eaarlio_memory_tracking_malloc(self, size);
+
+    base = (union _eaarlio_memory_tracking_header *)((unsigned char *)ptr
+        - HEADER_SIZE);
+    old_size = base->size;
+
+    /* The header keeps the request from ever being for zero bytes, so a
+     * resize to zero keeps a valid block instead of freeing it.
+     */
+    if(size <= SIZE_MAX - HEADER_SIZE)
+        base = internal->inner.realloc(
+            &internal->inner, base, HEADER_SIZE + size);
+    else
+        base = NULL;
+
+    eaarlio_mutex_lock(&internal->mutex);
+    if(base) {
+        internal->usage.live_bytes -= old_size;
+        _eaarlio_memory_tracking_record(internal, size);
+        internal->usage.reallocs++;
+    } else {
+        internal->usage.failures++;
+    }
+    eaarlio_mutex_unlock(&internal->mutex);
+
+    if(!base)
+        return NULL;
+    base->size = size;
+    return (unsigned char *)base + HEADER_SIZE;
+}
+
+static void *_eaarlio_memory_tracking_calloc(struct eaarlio_memory *self,
+    size_t nmemb,
+    size_t size)
+{
+    struct _eaarlio_memory_tracking *internal =
+        (struct _eaarlio_memory_tracking *)self->opaque;
+    union _eaarlio_memory_tracking_header *base = NULL;
+    size_t total = 0;
+
+    if(size == 0 || nmemb <= (SIZE_MAX - HEADER_SIZE) / size) {
+        total = nmemb * size;
+        base = internal->inner.calloc(&internal->inner, 1, HEADER_SIZE + total);
+    }
+    return _eaarlio_memory_tracking_new(internal, base, total);
+}
+
+eaarlio_error eaarlio_memory_tracking(struct eaarlio_memory *wrapper,
+    struct eaarlio_memory *inner)
+{
+    struct _eaarlio_memory_tracking *internal;
+    eaarlio_error err;
+
+    if(!wrapper)
+        return EAARLIO_NULL;
+
+    *wrapper = eaarlio_memory_empty();
+
+    if(!inner) {
+        inner = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(inner)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal = inner->malloc(inner, sizeof(struct _eaarlio_memory_tracking));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    err = eaarlio_mutex_init(&internal->mutex);
+    if(err != EAARLIO_SUCCESS) {
+        inner->free(inner, internal);
+        return err;
+    }
+
+    internal->inner = *inner;
+    memset(&internal->usage, 0, sizeof(internal->usage));
+
+    wrapper->malloc = &_eaarlio_memory_tracking_malloc;
+    wrapper->free = &_eaarlio_memory_tracking_free;
+    wrapper->realloc = &_eaarlio_memory_tracking_realloc;
+    wrapper->calloc = &_eaarlio_memory_tracking_calloc;
+    wrapper->opaque = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_memory_tracking_usage(
+    struct eaarlio_memory const *wrapper,
+    struct eaarlio_memory_usage *usage)
+{
+    struct _eaarlio_memory_tracking *internal;
+
+    if(!wrapper)
+        return EAARLIO_NULL;
+    if(!usage)
+        return EAARLIO_NULL;
+
+    internal = _eaarlio_memory_tracking_internal(wrapper);
+    if(!internal)
+        return EAARLIO_MEMORY_INVALID;
+
+    eaarlio_mutex_lock(&internal->mutex);
+    *usage = internal->usage;
+    eaarlio_mutex_unlock(&internal->mutex);
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_memory_tracking_reset(struct eaarlio_memory *wrapper)
+{
+    struct _eaarlio_memory_tracking *internal;
+    struct eaarlio_memory_usage *usage;
+    uint64_t live_bytes, live_blocks;
+
+    if(!wrapper)
+        return EAARLIO_NULL;
+
+    internal = _eaarlio_memory_tracking_internal(wrapper);
+    if(!internal)
+        return EAARLIO_MEMORY_INVALID;
+
+    eaarlio_mutex_lock(&internal->mutex);
+    usage = &internal->usage;
+    live_bytes = usage->live_bytes;
+    live_blocks = usage->live_blocks;
+    memset(usage, 0, sizeof(*usage));
+    usage->live_bytes = live_bytes;
+    usage->live_blocks = live_blocks;
+    usage->peak_bytes = live_bytes;
+    eaarlio_mutex_unlock(&internal->mutex);
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_memory_tracking_free(struct eaarlio_memory *wrapper)
+{
+    struct _eaarlio_memory_tracking *internal;
+    struct eaarlio_memory inner;
+
+    if(!wrapper)
+        return EAARLIO_NULL;
+
+    internal = _eaarlio_memory_tracking_internal(wrapper);
+    if(!internal)
+        return EAARLIO_MEMORY_INVALID;
+
+    inner = internal->inner;
+    eaarlio_mutex_destroy(&internal->mutex);
+    inner.free(&inner, internal);
+
+    *wrapper = eaarlio_memory_empty();
+
+    return EAARLIO_SUCCESS;
+}
@@ -1,4 +1,11 @@
+/* clock_gettime is POSIX, not C99, so it needs to be requested explicitly. */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
+#include <time.h>
 
 size_t eaarlio_strnlen(char const *str, size_t max_len)
 {
@@ -23,3 +30,13 @@ FILE *eaarlio_fopenb(char const *filename, char const *mode)
 #endif
     return fopen(filename, mode);
 }
+
+double eaarlio_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+    return (double)clock() / CLOCKS_PER_SEC;
+}
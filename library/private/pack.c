@@ -0,0 +1,591 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/int_decode.h"
+#include "eaarlio/int_encode.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/pack.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/window_stream.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Identifies a flight pack */
+#define _EAARLIO_PACK_MAGIC "EAARLIOP"
+/** Length of #_EAARLIO_PACK_MAGIC */
+#define _EAARLIO_PACK_MAGIC_SIZE 8
+/** Format version written and understood */
+#define _EAARLIO_PACK_VERSION 1
+/** Size of the encoded header */
+#define _EAARLIO_PACK_HEADER_SIZE 48
+/** Size of each encoded table entry, excluding its name */
+#define _EAARLIO_PACK_ENTRY_SIZE 18
+/** Size of the buffer used to copy TLD data into a pack */
+#define _EAARLIO_PACK_COPY_SIZE 1048576U
+
+/**
+ * Pack header
+ */
+struct _eaarlio_pack_header {
+    /** Number of entries in the file table */
+    uint32_t file_count;
+    /** Location of the embedded EDB */
+    uint64_t edb_offset;
+    /** Size of the embedded EDB */
+    uint64_t edb_length;
+    /** Location of the file table */
+    uint64_t table_offset;
+    /** Size of the file table */
+    uint64_t table_length;
+};
+
+/**
+ * File table entry
+ */
+struct _eaarlio_pack_entry {
+    /** Name of the TLD file, pointing into
+     * ::_eaarlio_pack_tld_opener::names */
+    char const *name;
+    /** Location of the TLD data */
+    uint64_t offset;
+    /** Size of the TLD data */
+    uint64_t length;
+};
+
+/**
+ * Internal structure for pack-based tld_opener
+ */
+struct _eaarlio_pack_tld_opener {
+    /** Stream containing the pack */
+    struct eaarlio_stream pack;
+    /** Pack header */
+    struct _eaarlio_pack_header header;
+    /** File table, with header.file_count entries */
+    struct _eaarlio_pack_entry *entries;
+    /** Storage for the null-terminated names in #entries */
+    char *names;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static void _eaarlio_pack_encode_uint64(unsigned char *buf, uint64_t val)
+{
+    eaarlio_int_encode_uint32(buf, (uint32_t)(val & 0xffffffffU));
+    eaarlio_int_encode_uint32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static uint64_t _eaarlio_pack_decode_uint64(unsigned char const *buf)
+{
+    return (uint64_t)eaarlio_int_decode_uint32(buf)
+        | (uint64_t)eaarlio_int_decode_uint32(buf + 4) << 32;
+}
+
+static void _eaarlio_pack_encode_header(unsigned char *buf,
+    struct _eaarlio_pack_header const *header)
+{
+    memcpy(buf, _EAARLIO_PACK_MAGIC, _EAARLIO_PACK_MAGIC_SIZE);
+    eaarlio_int_encode_uint16(buf + 8, _EAARLIO_PACK_VERSION);
+    eaarlio_int_encode_uint16(buf + 10, 0);
+    eaarlio_int_encode_uint32(buf + 12, header->file_count);
+    _eaarlio_pack_encode_uint64(buf + 16, header->edb_offset);
+    _eaarlio_pack_encode_uint64(buf + 24, header->edb_length);
+    _eaarlio_pack_encode_uint64(buf + 32, header->table_offset);
+    _eaarlio_pack_encode_uint64(buf + 40, header->table_length);
+}
+
+/* Check that a range lies within the pack's data, after the header */
+static int _eaarlio_pack_range_valid(uint64_t offset,
+    uint64_t length,
+    uint64_t size)
+{
+    return offset >= _EAARLIO_PACK_HEADER_SIZE && offset <= size
+        && length <= size - offset;
+}
+
+static eaarlio_error _eaarlio_pack_decode_header(unsigned char const *buf,
+    uint64_t size,
+    struct _eaarlio_pack_header *header)
+{
+    if(memcmp(buf, _EAARLIO_PACK_MAGIC, _EAARLIO_PACK_MAGIC_SIZE))
+        return EAARLIO_CORRUPT;
+    if(eaarlio_int_decode_uint16(buf + 8) != _EAARLIO_PACK_VERSION)
+        return EAARLIO_CORRUPT;
+
+    header->file_count = eaarlio_int_decode_uint32(buf + 12);
+    header->edb_offset = _eaarlio_pack_decode_uint64(buf + 16);
+    header->edb_length = _eaarlio_pack_decode_uint64(buf + 24);
+    header->table_offset = _eaarlio_pack_decode_uint64(buf + 32);
+    header->table_length = _eaarlio_pack_decode_uint64(buf + 40);
+
+    if(!_eaarlio_pack_range_valid(header->edb_offset, header->edb_length, size))
+        return EAARLIO_CORRUPT;
+    if(!_eaarlio_pack_range_valid(
+           header->table_offset, header->table_length, size))
+        return EAARLIO_CORRUPT;
+    if(header->table_length
+        < (uint64_t)header->file_count * _EAARLIO_PACK_ENTRY_SIZE)
+        return EAARLIO_CORRUPT;
+    if(header->table_length > SIZE_MAX - header->file_count)
+        return EAARLIO_CORRUPT;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Copy the whole of in to the current position of out, returning its size */
+static eaarlio_error _eaarlio_pack_copy(struct eaarlio_stream *out,
+    struct eaarlio_stream *in,
+    unsigned char *buf,
+    uint64_t *length)
+{
+    eaarlio_error err;
+    uint64_t remain, chunk;
+    int64_t size;
+
+    err = in->seek(in, 0, SEEK_END);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = in->tell(in, &size);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = in->seek(in, 0, SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    for(remain = (uint64_t)size; remain > 0; remain -= chunk) {
+        chunk = remain < _EAARLIO_PACK_COPY_SIZE ? remain
+                                                 : _EAARLIO_PACK_COPY_SIZE;
+        err = in->read(in, chunk, buf);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        err = out->write(out, chunk, buf);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    *length = (uint64_t)size;
+    return EAARLIO_SUCCESS;
+}
+
+/* Write the encoded EDB to out, returning its size */
+static eaarlio_error _eaarlio_pack_write_edb(struct eaarlio_stream *out,
+    struct eaarlio_edb const *edb,
+    struct eaarlio_memory *memory,
+    uint64_t *length)
+{
+    struct eaarlio_stream buffer = eaarlio_stream_empty();
+    unsigned char *data;
+    eaarlio_error err;
+
+    /* eaarlio_edb_write seeks within its stream, so the EDB is built in
+     * memory rather than written in place.
+     */
+    err = eaarlio_memory_stream(&buffer, NULL, 0, "w", memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_edb_write(&buffer, edb);
+    if(err == EAARLIO_SUCCESS)
+        err = eaarlio_memory_stream_buffer(&buffer, &data, length);
+    if(err == EAARLIO_SUCCESS)
+        err = out->write(out, *length, data);
+
+    buffer.close(&buffer);
+    return err;
+}
+
+eaarlio_error eaarlio_pack_write(struct eaarlio_stream *out,
+    struct eaarlio_edb const *edb,
+    struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_pack_header header;
+    unsigned char head_buf[_EAARLIO_PACK_HEADER_SIZE];
+    struct eaarlio_stream tld = eaarlio_stream_empty();
+    unsigned char *buf = NULL;
+    unsigned char *table = NULL;
+    unsigned char *entry;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint64_t table_len = 0;
+    uint64_t offset, length;
+    size_t name_len;
+    uint32_t i;
+
+    if(!out)
+        return EAARLIO_NULL;
+    if(!edb)
+        return EAARLIO_NULL;
+    if(!tld_opener)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(out))
+        return EAARLIO_STREAM_INVALID;
+    if(!tld_opener->open_tld)
+        return EAARLIO_TLD_OPENER_INVALID;
+    if(edb->file_count && !edb->files)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    for(i = 0; i < edb->file_count; i++) {
+        if(!edb->files[i])
+            return EAARLIO_NULL;
+        name_len = eaarlio_strnlen(edb->files[i], UINT16_MAX + 1U);
+        if(name_len > UINT16_MAX)
+            return EAARLIO_EDB_FILENAME_TOO_LONG;
+        table_len += _EAARLIO_PACK_ENTRY_SIZE + name_len;
+    }
+    if(table_len >= SIZE_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    buf = memory->malloc(memory, _EAARLIO_PACK_COPY_SIZE);
+    table = memory->malloc(memory, (size_t)table_len + 1);
+    if(!buf || !table) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    /* The header is rewritten once the layout is known */
+    header.file_count = edb->file_count;
+    header.edb_offset = 0;
+    header.edb_length = 0;
+    header.table_offset = 0;
+    header.table_length = table_len;
+    _eaarlio_pack_encode_header(head_buf, &header);
+    err = out->write(out, _EAARLIO_PACK_HEADER_SIZE, head_buf);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    offset = _EAARLIO_PACK_HEADER_SIZE;
+
+    entry = table;
+    for(i = 0; i < edb->file_count; i++) {
+        err = tld_opener->open_tld(tld_opener, &tld, edb->files[i]);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+        err = _eaarlio_pack_copy(out, &tld, buf, &length);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+        err = tld.close(&tld);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        name_len = strlen(edb->files[i]);
+        _eaarlio_pack_encode_uint64(entry, offset);
+        _eaarlio_pack_encode_uint64(entry + 8, length);
+        eaarlio_int_encode_uint16(entry + 16, (uint16_t)name_len);
+        memcpy(entry + _EAARLIO_PACK_ENTRY_SIZE, edb->files[i], name_len);
+        entry += _EAARLIO_PACK_ENTRY_SIZE + name_len;
+        offset += length;
+    }
+
+    header.edb_offset = offset;
+    err = _eaarlio_pack_write_edb(out, edb, memory, &header.edb_length);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    offset += header.edb_length;
+
+    header.table_offset = offset;
+    err = out->write(out, table_len, table);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    offset += table_len;
+
+    _eaarlio_pack_encode_header(head_buf, &header);
+    err = out->seek(out, 0, SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    err = out->write(out, _EAARLIO_PACK_HEADER_SIZE, head_buf);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    err = out->seek(out, (int64_t)offset, SEEK_SET);
+
+cleanup:
+    if(tld.close)
+        tld.close(&tld);
+    if(buf)
+        memory->free(memory, buf);
+    if(table)
+        memory->free(memory, table);
+    return err;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::open_tld
+ */
+static eaarlio_error _eaarlio_pack_tld_opener_open_tld(
+    struct eaarlio_tld_opener *self,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct _eaarlio_pack_tld_opener *internal;
+    uint32_t i;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_pack_tld_opener *)self->opaque;
+
+    for(i = 0; i < internal->header.file_count; i++) {
+        if(strcmp(internal->entries[i].name, tld_file) == 0)
+            return eaarlio_window_stream(stream, &internal->pack,
+                internal->entries[i].offset, internal->entries[i].length,
+                &internal->memory);
+    }
+
+    return EAARLIO_STREAM_OPEN_ERROR;
+}
+
+/* Release everything owned by internal except the pack stream */
+static void _eaarlio_pack_tld_opener_free(
+    struct _eaarlio_pack_tld_opener *internal)
+{
+    struct eaarlio_memory memory = internal->memory;
+
+    if(internal->entries)
+        memory.free(&memory, internal->entries);
+    if(internal->names)
+        memory.free(&memory, internal->names);
+    memory.free(&memory, internal);
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::close
+ */
+static eaarlio_error _eaarlio_pack_tld_opener_close(
+    struct eaarlio_tld_opener *self)
+{
+    struct _eaarlio_pack_tld_opener *internal;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_pack_tld_opener *)self->opaque;
+
+    err = internal->pack.close(&internal->pack);
+    _eaarlio_pack_tld_opener_free(internal);
+
+    *self = eaarlio_tld_opener_empty();
+
+    return err;
+}
+
+/* Read and validate the header and file table */
+static eaarlio_error _eaarlio_pack_load_table(
+    struct _eaarlio_pack_tld_opener *internal)
+{
+    struct eaarlio_stream *pack = &internal->pack;
+    struct eaarlio_memory *memory = &internal->memory;
+    struct _eaarlio_pack_header *header = &internal->header;
+    unsigned char head_buf[_EAARLIO_PACK_HEADER_SIZE];
+    unsigned char *table = NULL;
+    unsigned char *entry, *end;
+    char *name;
+    eaarlio_error err;
+    uint32_t i;
+    uint16_t name_len;
+    int64_t size;
+
+    err = pack->seek(pack, 0, SEEK_END);
+    if(err == EAARLIO_SUCCESS)
+        err = pack->tell(pack, &size);
+    if(err == EAARLIO_SUCCESS)
+        err = pack->seek(pack, 0, SEEK_SET);
+    if(err == EAARLIO_SUCCESS)
+        err = pack->read(pack, _EAARLIO_PACK_HEADER_SIZE, head_buf);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        return EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = _eaarlio_pack_decode_header(head_buf, (uint64_t)size, header);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    table = memory->malloc(memory, (size_t)header->table_length + 1);
+    internal->entries = memory->malloc(memory,
+        ((size_t)header->file_count + 1) * sizeof(struct _eaarlio_pack_entry));
+    internal->names = memory->malloc(
+        memory, (size_t)header->table_length + header->file_count + 1);
+    if(!table || !internal->entries || !internal->names) {
+        err = EAARLIO_MEMORY_ALLOC_FAIL;
+        goto cleanup;
+    }
+
+    err = pack->seek(pack, (int64_t)header->table_offset, SEEK_SET);
+    if(err == EAARLIO_SUCCESS)
+        err = pack->read(pack, header->table_length, table);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+    entry = table;
+    end = table + header->table_length;
+    name = internal->names;
+    for(i = 0; i < header->file_count; i++) {
+        if((size_t)(end - entry) < _EAARLIO_PACK_ENTRY_SIZE) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+        internal->entries[i].offset = _eaarlio_pack_decode_uint64(entry);
+        internal->entries[i].length = _eaarlio_pack_decode_uint64(entry + 8);
+        name_len = eaarlio_int_decode_uint16(entry + 16);
+        entry += _EAARLIO_PACK_ENTRY_SIZE;
+
+        if((size_t)(end - entry) < name_len
+            || !_eaarlio_pack_range_valid(internal->entries[i].offset,
+                   internal->entries[i].length, (uint64_t)size)) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+
+        memcpy(name, entry, name_len);
+        name[name_len] = '\0';
+        internal->entries[i].name = name;
+        name += name_len + 1;
+        entry += name_len;
+    }
+
+cleanup:
+    if(table)
+        memory->free(memory, table);
+    return err;
+}
+
+/* Shared implementation of eaarlio_pack_tld_opener, leaving pack in place */
+static eaarlio_error _eaarlio_pack_tld_opener_init(
+    struct _eaarlio_pack_tld_opener **opener,
+    struct eaarlio_stream *pack,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_pack_tld_opener *internal;
+    eaarlio_error err;
+
+    internal =
+        memory->calloc(memory, 1, sizeof(struct _eaarlio_pack_tld_opener));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->memory = *memory;
+    internal->pack = *pack;
+
+    err = _eaarlio_pack_load_table(internal);
+    if(err != EAARLIO_SUCCESS) {
+        _eaarlio_pack_tld_opener_free(internal);
+        return err;
+    }
+
+    *opener = internal;
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_pack_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_stream *pack,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_pack_tld_opener *internal = NULL;
+    eaarlio_error err;
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+
+    *tld_opener = eaarlio_tld_opener_empty();
+
+    if(!pack)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(pack))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    err = _eaarlio_pack_tld_opener_init(&internal, pack, memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    *pack = eaarlio_stream_empty();
+
+    tld_opener->open_tld = &_eaarlio_pack_tld_opener_open_tld;
+    tld_opener->close = &_eaarlio_pack_tld_opener_close;
+    tld_opener->opaque = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_pack_open_flight(struct eaarlio_flight *flight,
+    struct eaarlio_stream *pack,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_pack_tld_opener *internal = NULL;
+    struct eaarlio_stream edb_stream = eaarlio_stream_empty();
+    eaarlio_error err;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    *flight = eaarlio_flight_empty();
+
+    if(!pack)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(pack))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    err = _eaarlio_pack_tld_opener_init(&internal, pack, memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    /* eaarlio_edb_read seeks to absolute positions, so the EDB is read
+     * through a window that places it at the start of a stream.
+     */
+    err = eaarlio_window_stream(&edb_stream, &internal->pack,
+        internal->header.edb_offset, internal->header.edb_length, memory);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+    err = eaarlio_edb_read(&edb_stream, &flight->edb, memory, 1, 1);
+    edb_stream.close(&edb_stream);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+    err = eaarlio_flight_init(flight, memory);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+
+    *pack = eaarlio_stream_empty();
+    flight->tld_opener.open_tld = &_eaarlio_pack_tld_opener_open_tld;
+    flight->tld_opener.close = &_eaarlio_pack_tld_opener_close;
+    flight->tld_opener.opaque = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+
+cleanup:
+    eaarlio_edb_free(&flight->edb, memory);
+    _eaarlio_pack_tld_opener_free(internal);
+    return err;
+}
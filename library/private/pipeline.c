@@ -0,0 +1,517 @@
+#include "eaarlio/pipeline.h"
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/flight_internals.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/thread_support.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/tld_unpack.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * One entry in the reorder buffer
+ *
+ * Raster number @c n of the sequence (counting from 0) always uses slot
+ * <tt>n % depth</tt>. Ownership passes from the read thread to a decode
+ * thread to the output stage as the shared counters advance.
+ */
+struct _eaarlio_pipeline_slot {
+    /** Raster number held in this slot */
+    uint32_t raster_number;
+    /** ::eaarlio_edb_record::time_seconds for the raster */
+    uint32_t time_seconds;
+    /** Raw record */
+    unsigned char *buffer;
+    /** Allocated size of #buffer */
+    uint32_t capacity;
+    /** Number of bytes of #buffer in use */
+    uint32_t length;
+    /** Decoded raster */
+    struct eaarlio_raster raster;
+    /** Has the raster been decoded and processed? */
+    int ready;
+};
+
+/**
+ * State shared by the stages of a running pipeline
+ */
+struct _eaarlio_pipeline_run {
+    /** Flight being read */
+    struct eaarlio_flight *flight;
+    /** Caller's configuration */
+    struct eaarlio_pipeline const *config;
+    /** Memory handler for the read stage and the reorder buffer */
+    struct eaarlio_memory *memory;
+    /** Caller's memory handler, before any counting wrapper */
+    struct eaarlio_memory *base_memory;
+    /** Flight's statistics, or @c NULL if they are not enabled */
+    struct eaarlio_stats *stats;
+    /** Reorder buffer */
+    struct _eaarlio_pipeline_slot *slots;
+    /** Number of entries in #slots */
+    uint32_t depth;
+    /** Guards everything below */
+    struct eaarlio_mutex mutex;
+    /** Signaled when a slot is released by the output stage */
+    struct eaarlio_cond space;
+    /** Signaled when a record has been read */
+    struct eaarlio_cond work;
+    /** Signaled when a raster is ready for output */
+    struct eaarlio_cond ready;
+    /** Number of records read so far */
+    uint32_t read_count;
+    /** Number of records handed to decode threads so far */
+    uint32_t decode_count;
+    /** Number of rasters passed to the output stage so far */
+    uint32_t output_count;
+    /** Set when the read stage has no more records */
+    int done;
+    /** Set when any stage fails */
+    int stop;
+    /** First error encountered */
+    eaarlio_error err;
+};
+
+/**
+ * State for one decode or output thread
+ *
+ * The flight's statistics are not synchronized and belong to the read stage
+ * while the pipeline runs, so each of these threads counts into its own
+ * #stats, which are merged into the flight's when the threads are done.
+ */
+struct _eaarlio_pipeline_stage {
+    /** State shared by all stages */
+    struct _eaarlio_pipeline_run *run;
+    /** Thread running this stage; unused for the calling thread */
+    struct eaarlio_thread thread;
+    /** Memory handler for decoding and releasing rasters */
+    struct eaarlio_memory *memory;
+    /** Statistics to update, or @c NULL if they are not enabled */
+    struct eaarlio_stats *active_stats;
+    /** This stage's statistics, when it has its own */
+    struct eaarlio_stats stats;
+    /** Wrapper around the caller's memory handler that counts into #stats */
+    struct eaarlio_stats_memory stats_memory;
+};
+
+/* Set up a stage that counts separately from the flight */
+static void _eaarlio_pipeline_stage_init(struct _eaarlio_pipeline_run *run,
+    struct _eaarlio_pipeline_stage *stage)
+{
+    stage->run = run;
+    stage->memory = run->memory;
+    stage->active_stats = NULL;
+    if(run->stats) {
+        stage->stats = eaarlio_stats_empty();
+        eaarlio_stats_memory_init(
+            &stage->stats_memory, run->base_memory, &stage->stats);
+        stage->memory = &stage->stats_memory.memory;
+        stage->active_stats = &stage->stats;
+    }
+}
+
+/* Read the record for raster_number into slot, growing its buffer if
+ * needed
+ */
+static eaarlio_error _eaarlio_pipeline_read(struct _eaarlio_pipeline_run *run,
+    struct _eaarlio_pipeline_slot *slot,
+    uint32_t raster_number)
+{
+    struct eaarlio_memory *memory = run->memory;
+    struct eaarlio_edb_record record;
+    struct eaarlio_stream *stream;
+    unsigned char *buffer;
+    eaarlio_error err;
+
+    err = eaarlio_flight_record(run->flight, raster_number, &record);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(record.record_length > slot->capacity) {
+        buffer = memory->realloc(memory, slot->buffer, record.record_length);
+        if(!buffer)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        slot->buffer = buffer;
+        slot->capacity = record.record_length;
+    }
+
+    err = eaarlio_flight_stream(run->flight, record.file_index, &stream);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = stream->seek(stream, record.record_offset, SEEK_SET);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = stream->read(stream, record.record_length, slot->buffer);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    slot->raster_number = raster_number;
+    slot->time_seconds = record.time_seconds;
+    slot->length = record.record_length;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Decode the record in slot, then pass it to the work callback */
+static eaarlio_error _eaarlio_pipeline_decode(
+    struct _eaarlio_pipeline_stage *stage,
+    struct _eaarlio_pipeline_slot *slot)
+{
+    struct _eaarlio_pipeline_run *run = stage->run;
+    struct eaarlio_pipeline const *config = run->config;
+    struct eaarlio_stats *stats = stage->active_stats;
+    struct eaarlio_tld_header header;
+    eaarlio_error err;
+    double start = 0;
+
+    if(stats)
+        start = eaarlio_clock();
+    err = eaarlio_tld_unpack_record(slot->buffer, slot->length, &header,
+        &slot->raster, stage->memory, config->include_pulses,
+        config->include_waveforms);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    if(!eaarlio_tld_type_is_raster(header.record_type))
+        return EAARLIO_TLD_TYPE_UNKNOWN;
+    if(stats) {
+        stats->decode_seconds += eaarlio_clock() - start;
+        eaarlio_flight_count_raster(stats, &slot->raster,
+            config->include_pulses && config->include_waveforms);
+    }
+
+    if(config->work)
+        err = config->work(config->ctx, (uint32_t)(slot - run->slots),
+            slot->raster_number, &slot->raster,
+            slot->time_seconds - slot->raster.time_seconds);
+
+    return err;
+}
+
+/* Pass a processed raster to the output callback, then release it */
+static eaarlio_error _eaarlio_pipeline_output(
+    struct _eaarlio_pipeline_stage *stage,
+    struct _eaarlio_pipeline_slot *slot)
+{
+    struct _eaarlio_pipeline_run *run = stage->run;
+    struct eaarlio_pipeline const *config = run->config;
+    struct eaarlio_stats *stats = stage->active_stats;
+    eaarlio_error err, err_free;
+    double start = 0;
+
+    err = config->output(config->ctx, (uint32_t)(slot - run->slots),
+        slot->raster_number, &slot->raster,
+        slot->time_seconds - slot->raster.time_seconds);
+
+    if(stats)
+        start = eaarlio_clock();
+    err_free = eaarlio_raster_free(&slot->raster, stage->memory);
+    if(stats)
+        stats->free_seconds += eaarlio_clock() - start;
+    if(err == EAARLIO_SUCCESS)
+        err = err_free;
+    slot->ready = 0;
+
+    return err;
+}
+
+/* Record a failure and wake every stage so that they can stop. Must be
+ * called with the lock held.
+ */
+static void _eaarlio_pipeline_fail(
+    struct _eaarlio_pipeline_run *run, eaarlio_error err)
+{
+    if(!run->stop) {
+        run->stop = 1;
+        run->err = err;
+    }
+    eaarlio_cond_broadcast(&run->space);
+    eaarlio_cond_broadcast(&run->work);
+    eaarlio_cond_broadcast(&run->ready);
+}
+
+/* Read stage: read records while there are free slots */
+static void _eaarlio_pipeline_reader(void *arg)
+{
+    struct _eaarlio_pipeline_run *run = (struct _eaarlio_pipeline_run *)arg;
+    struct eaarlio_pipeline const *config = run->config;
+    struct _eaarlio_pipeline_slot *slot;
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint32_t raster_number;
+
+    for(;;) {
+        eaarlio_mutex_lock(&run->mutex);
+        while(!run->stop && run->read_count - run->output_count >= run->depth)
+            eaarlio_cond_wait(&run->space, &run->mutex);
+        if(run->stop) {
+            eaarlio_mutex_unlock(&run->mutex);
+            break;
+        }
+        eaarlio_mutex_unlock(&run->mutex);
+
+        /* The slot was released by the output stage, and no other stage
+         * looks at it until read_count moves past it
+         */
+        slot = &run->slots[run->read_count % run->depth];
+
+        err = config->next(config->ctx, &raster_number);
+        if(err != EAARLIO_SUCCESS || !raster_number)
+            break;
+        err = _eaarlio_pipeline_read(run, slot, raster_number);
+        if(err != EAARLIO_SUCCESS)
+            break;
+
+        eaarlio_mutex_lock(&run->mutex);
+        run->read_count++;
+        eaarlio_cond_signal(&run->work);
+        eaarlio_mutex_unlock(&run->mutex);
+    }
+
+    eaarlio_mutex_lock(&run->mutex);
+    run->done = 1;
+    if(err != EAARLIO_SUCCESS)
+        _eaarlio_pipeline_fail(run, err);
+    eaarlio_cond_broadcast(&run->work);
+    eaarlio_cond_broadcast(&run->ready);
+    eaarlio_mutex_unlock(&run->mutex);
+}
+
+/* Decode stage: decode records as they are read */
+static void _eaarlio_pipeline_decoder(void *arg)
+{
+    struct _eaarlio_pipeline_stage *stage =
+        (struct _eaarlio_pipeline_stage *)arg;
+    struct _eaarlio_pipeline_run *run = stage->run;
+    struct _eaarlio_pipeline_slot *slot;
+    eaarlio_error err;
+
+    eaarlio_mutex_lock(&run->mutex);
+    for(;;) {
+        while(!run->stop && !run->done && run->decode_count == run->read_count)
+            eaarlio_cond_wait(&run->work, &run->mutex);
+        if(run->stop || run->decode_count == run->read_count)
+            break;
+
+        slot = &run->slots[run->decode_count % run->depth];
+        run->decode_count++;
+        eaarlio_mutex_unlock(&run->mutex);
+
+        err = _eaarlio_pipeline_decode(stage, slot);
+
+        eaarlio_mutex_lock(&run->mutex);
+        if(err != EAARLIO_SUCCESS) {
+            _eaarlio_pipeline_fail(run, err);
+        } else {
+            slot->ready = 1;
+            eaarlio_cond_signal(&run->ready);
+        }
+    }
+    eaarlio_mutex_unlock(&run->mutex);
+}
+
+/* Output stage: deliver rasters in order, releasing their slots */
+static void _eaarlio_pipeline_writer(struct _eaarlio_pipeline_stage *stage)
+{
+    struct _eaarlio_pipeline_run *run = stage->run;
+    struct _eaarlio_pipeline_slot *slot;
+    eaarlio_error err;
+
+    eaarlio_mutex_lock(&run->mutex);
+    for(;;) {
+        slot = &run->slots[run->output_count % run->depth];
+        while(!run->stop
+            && !(run->output_count < run->read_count && slot->ready)
+            && !(run->done && run->output_count == run->read_count))
+            eaarlio_cond_wait(&run->ready, &run->mutex);
+        if(run->stop || run->output_count == run->read_count)
+            break;
+        eaarlio_mutex_unlock(&run->mutex);
+
+        err = _eaarlio_pipeline_output(stage, slot);
+
+        eaarlio_mutex_lock(&run->mutex);
+        if(err != EAARLIO_SUCCESS) {
+            _eaarlio_pipeline_fail(run, err);
+            break;
+        }
+        run->output_count++;
+        eaarlio_cond_signal(&run->space);
+    }
+    eaarlio_mutex_unlock(&run->mutex);
+}
+
+/* Run every stage in the calling thread, one raster at a time. Nothing else
+ * touches the flight's statistics, so they are updated directly.
+ */
+static eaarlio_error _eaarlio_pipeline_serial(struct _eaarlio_pipeline_run *run)
+{
+    struct eaarlio_pipeline const *config = run->config;
+    struct _eaarlio_pipeline_slot *slot = &run->slots[0];
+    struct _eaarlio_pipeline_stage stage;
+    eaarlio_error err;
+    uint32_t raster_number;
+
+    memset(&stage, 0, sizeof(stage));
+    stage.run = run;
+    stage.memory = run->memory;
+    stage.active_stats = run->stats;
+
+    for(;;) {
+        err = config->next(config->ctx, &raster_number);
+        if(err != EAARLIO_SUCCESS || !raster_number)
+            return err;
+        err = _eaarlio_pipeline_read(run, slot, raster_number);
+        if(err == EAARLIO_SUCCESS)
+            err = _eaarlio_pipeline_decode(&stage, slot);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        err = _eaarlio_pipeline_output(&stage, slot);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+}
+
+/* Run the stages on their own threads */
+static eaarlio_error _eaarlio_pipeline_threaded(
+    struct _eaarlio_pipeline_run *run,
+    uint32_t threads)
+{
+    struct eaarlio_memory *memory = run->memory;
+    struct eaarlio_thread reader;
+    struct _eaarlio_pipeline_stage writer;
+    struct _eaarlio_pipeline_stage *decoders;
+    eaarlio_error err;
+    uint32_t i, started = 0;
+
+    decoders = memory->calloc(
+        memory, threads, sizeof(struct _eaarlio_pipeline_stage));
+    if(!decoders)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    for(i = 0; i < threads; i++)
+        _eaarlio_pipeline_stage_init(run, &decoders[i]);
+    _eaarlio_pipeline_stage_init(run, &writer);
+
+    err = eaarlio_mutex_init(&run->mutex);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup;
+    err = eaarlio_cond_init(&run->space);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup_mutex;
+    err = eaarlio_cond_init(&run->work);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup_space;
+    err = eaarlio_cond_init(&run->ready);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup_work;
+
+    err = eaarlio_thread_start(&reader, &_eaarlio_pipeline_reader, run);
+    if(err != EAARLIO_SUCCESS)
+        goto cleanup_ready;
+
+    for(started = 0; started < threads; started++) {
+        err = eaarlio_thread_start(&decoders[started].thread,
+            &_eaarlio_pipeline_decoder, &decoders[started]);
+        if(err != EAARLIO_SUCCESS)
+            break;
+    }
+
+    if(err == EAARLIO_SUCCESS) {
+        _eaarlio_pipeline_writer(&writer);
+    } else {
+        eaarlio_mutex_lock(&run->mutex);
+        _eaarlio_pipeline_fail(run, err);
+        eaarlio_mutex_unlock(&run->mutex);
+    }
+
+    eaarlio_thread_join(&reader);
+    for(i = 0; i < started; i++)
+        eaarlio_thread_join(&decoders[i].thread);
+    err = run->err;
+
+    if(run->stats) {
+        for(i = 0; i < started; i++)
+            eaarlio_stats_add(run->stats, &decoders[i].stats);
+        eaarlio_stats_add(run->stats, &writer.stats);
+    }
+
+cleanup_ready:
+    eaarlio_cond_destroy(&run->ready);
+cleanup_work:
+    eaarlio_cond_destroy(&run->work);
+cleanup_space:
+    eaarlio_cond_destroy(&run->space);
+cleanup_mutex:
+    eaarlio_mutex_destroy(&run->mutex);
+cleanup:
+    memory->free(memory, decoders);
+    return err;
+}
+
+eaarlio_error eaarlio_pipeline_run(
+    struct eaarlio_flight *flight, struct eaarlio_pipeline const *pipeline)
+{
+    struct _eaarlio_flight_internal *internal;
+    struct _eaarlio_pipeline_run run;
+    struct eaarlio_memory *memory;
+    eaarlio_error err, err_free;
+    uint32_t threads, i;
+
+    if(!flight)
+        return EAARLIO_NULL;
+    if(!pipeline)
+        return EAARLIO_NULL;
+    if(!pipeline->next)
+        return EAARLIO_NULL;
+    if(!pipeline->output)
+        return EAARLIO_NULL;
+
+    err = eaarlio_flight_check(flight);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    internal = (struct _eaarlio_flight_internal *)flight->internal;
+    memory = eaarlio_flight_memory(flight);
+
+    threads = pipeline->threads ? pipeline->threads : eaarlio_thread_count();
+#ifndef EAARLIO_HAVE_PTHREADS
+    threads = 1;
+#endif
+
+    memset(&run, 0, sizeof(run));
+    run.flight = flight;
+    run.config = pipeline;
+    run.memory = memory;
+    run.base_memory = internal->memory;
+    run.stats = eaarlio_flight_active_stats(flight);
+    run.depth = pipeline->depth ? pipeline->depth : EAARLIO_PIPELINE_DEPTH;
+    if(threads == 1)
+        run.depth = 1;
+
+    run.slots = memory->calloc(
+        memory, run.depth, sizeof(struct _eaarlio_pipeline_slot));
+    if(!run.slots)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    for(i = 0; i < run.depth; i++)
+        run.slots[i].raster = eaarlio_raster_empty();
+
+    if(threads == 1)
+        err = _eaarlio_pipeline_serial(&run);
+    else
+        err = _eaarlio_pipeline_threaded(&run, threads);
+
+    /* After a failure, slots may still hold rasters that were never output */
+    for(i = 0; i < run.depth; i++) {
+        err_free = eaarlio_raster_free(&run.slots[i].raster, memory);
+        if(err == EAARLIO_SUCCESS)
+            err = err_free;
+        memory->free(memory, run.slots[i].buffer);
+    }
+    memory->free(memory, run.slots);
+
+    return err;
+}
@@ -0,0 +1,271 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include <stdint.h>
+
+eaarlio_error eaarlio_stats_add(struct eaarlio_stats *stats,
+    struct eaarlio_stats const *other)
+{
+    if(!stats)
+        return EAARLIO_NULL;
+    if(!other)
+        return EAARLIO_NULL;
+
+    stats->read_calls += other->read_calls;
+    stats->bytes_read += other->bytes_read;
+    stats->seek_calls += other->seek_calls;
+    stats->tld_opens += other->tld_opens;
+    stats->allocs += other->allocs;
+    stats->alloc_bytes += other->alloc_bytes;
+    stats->frees += other->frees;
+    stats->rasters += other->rasters;
+    stats->pulses += other->pulses;
+    stats->waveforms += other->waveforms;
+    stats->io_seconds += other->io_seconds;
+    stats->decode_seconds += other->decode_seconds;
+    stats->free_seconds += other->free_seconds;
+
+    return EAARLIO_SUCCESS;
+}
+
+/******************************************************************************/
+
+/**
+ * Internal state for a counting stream
+ */
+struct _eaarlio_stats_stream {
+    /** Stream being counted; owned */
+    struct eaarlio_stream inner;
+    /** Statistics to update */
+    struct eaarlio_stats *stats;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static eaarlio_error _eaarlio_stats_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_stats_stream *internal;
+    struct eaarlio_memory memory;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_stats_stream *)self->data;
+    err = internal->inner.close(&internal->inner);
+    memory = internal->memory;
+    memory.free(&memory, internal);
+
+    *self = eaarlio_stream_empty();
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_stats_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buffer)
+{
+    struct _eaarlio_stats_stream *internal;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_stats_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.read(&internal->inner, len, buffer);
+    internal->stats->io_seconds += eaarlio_clock() - start;
+
+    internal->stats->read_calls++;
+    if(err == EAARLIO_SUCCESS)
+        internal->stats->bytes_read += len;
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_stats_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buffer)
+{
+    struct _eaarlio_stats_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_stats_stream *)self->data;
+    return internal->inner.write(&internal->inner, len, buffer);
+}
+
+static eaarlio_error _eaarlio_stats_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_stats_stream *internal;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_stats_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.seek(&internal->inner, offset, whence);
+    internal->stats->io_seconds += eaarlio_clock() - start;
+
+    internal->stats->seek_calls++;
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_stats_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_stats_stream *internal;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_stats_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.tell(&internal->inner, position);
+    internal->stats->io_seconds += eaarlio_clock() - start;
+
+    return err;
+}
+
+eaarlio_error eaarlio_stats_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_stats *stats,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_stats_stream *internal;
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!inner)
+        return EAARLIO_NULL;
+    if(!stats)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(inner))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal = memory->malloc(memory, sizeof(struct _eaarlio_stats_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->inner = *inner;
+    internal->stats = stats;
+    internal->memory = *memory;
+
+    *inner = eaarlio_stream_empty();
+
+    stream->close = &_eaarlio_stats_stream_close;
+    stream->read = &_eaarlio_stats_stream_read;
+    stream->write = &_eaarlio_stats_stream_write;
+    stream->seek = &_eaarlio_stats_stream_seek;
+    stream->tell = &_eaarlio_stats_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+/******************************************************************************/
+
+static void *_eaarlio_stats_memory_malloc(struct eaarlio_memory *self,
+    size_t size)
+{
+    struct eaarlio_stats_memory *wrapper =
+        (struct eaarlio_stats_memory *)self->opaque;
+
+    wrapper->stats->allocs++;
+    wrapper->stats->alloc_bytes += size;
+    return wrapper->inner->malloc(wrapper->inner, size);
+}
+
+static void _eaarlio_stats_memory_free(struct eaarlio_memory *self, void *ptr)
+{
+    struct eaarlio_stats_memory *wrapper =
+        (struct eaarlio_stats_memory *)self->opaque;
+
+    if(ptr)
+        wrapper->stats->frees++;
+    wrapper->inner->free(wrapper->inner, ptr);
+}
+
+static void *_eaarlio_stats_memory_realloc(struct eaarlio_memory *self,
+    void *ptr,
+    size_t size)
+{
+    struct eaarlio_stats_memory *wrapper =
+        (struct eaarlio_stats_memory *)self->opaque;
+
+    wrapper->stats->allocs++;
+    wrapper->stats->alloc_bytes += size;
+    return wrapper->inner->realloc(wrapper->inner, ptr, size);
+}
+
+static void *_eaarlio_stats_memory_calloc(struct eaarlio_memory *self,
+    size_t nmemb,
+    size_t size)
+{
+    struct eaarlio_stats_memory *wrapper =
+        (struct eaarlio_stats_memory *)self->opaque;
+
+    wrapper->stats->allocs++;
+    wrapper->stats->alloc_bytes += (uint64_t)nmemb * size;
+    return wrapper->inner->calloc(wrapper->inner, nmemb, size);
+}
+
+eaarlio_error eaarlio_stats_memory_init(struct eaarlio_stats_memory *wrapper,
+    struct eaarlio_memory *inner,
+    struct eaarlio_stats *stats)
+{
+    if(!wrapper)
+        return EAARLIO_NULL;
+    if(!stats)
+        return EAARLIO_NULL;
+
+    if(!inner) {
+        inner = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(inner)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    wrapper->memory.malloc = &_eaarlio_stats_memory_malloc;
+    wrapper->memory.free = &_eaarlio_stats_memory_free;
+    wrapper->memory.realloc = &_eaarlio_stats_memory_realloc;
+    wrapper->memory.calloc = &_eaarlio_stats_memory_calloc;
+    wrapper->memory.opaque = (void *)wrapper;
+    wrapper->inner = inner;
+    wrapper->stats = stats;
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,538 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/tar.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/window_stream.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Size of a tar header and of the units member data is padded to */
+#define _EAARLIO_TAR_BLOCK_SIZE 512U
+/** Largest long name or pax extended header accepted */
+#define _EAARLIO_TAR_META_MAX 1048576U
+/** Initial capacity of the member index */
+#define _EAARLIO_TAR_CAPACITY 64U
+
+/* Locations and sizes of the header fields used */
+#define _EAARLIO_TAR_NAME 0
+#define _EAARLIO_TAR_NAME_SIZE 100
+#define _EAARLIO_TAR_SIZE 124
+#define _EAARLIO_TAR_SIZE_SIZE 12
+#define _EAARLIO_TAR_CHKSUM 148
+#define _EAARLIO_TAR_CHKSUM_SIZE 8
+#define _EAARLIO_TAR_TYPEFLAG 156
+
+/**
+ * Indexed archive member
+ */
+struct _eaarlio_tar_entry {
+    /** Final component of the member's path */
+    char *name;
+    /** Location of the member's data */
+    uint64_t offset;
+    /** Size of the member's data */
+    uint64_t length;
+};
+
+/**
+ * Internal structure for tar-based tld_opener
+ */
+struct _eaarlio_tar_tld_opener {
+    /** Stream containing the archive */
+    struct eaarlio_stream tar;
+    /** Indexed members, in archive order */
+    struct _eaarlio_tar_entry *entries;
+    /** Number of entries in #entries */
+    uint32_t entry_count;
+    /** Allocated number of entries in #entries */
+    uint32_t entry_capacity;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+/**
+ * Metadata from extension members that applies to the next member
+ */
+struct _eaarlio_tar_pending {
+    /** Path from a GNU long name or pax header, or @c NULL */
+    char *path;
+    /** Size from a pax header */
+    uint64_t size;
+    /** Is #size set? */
+    int has_size;
+};
+
+/* Parse a numeric header field, which is octal text or, for values too large
+ * for that, base-256 flagged by the high bit of the first byte.
+ */
+static eaarlio_error _eaarlio_tar_number(unsigned char const *field,
+    size_t len,
+    uint64_t *value)
+{
+    uint64_t val = 0;
+    size_t i = 0;
+
+    if(field[0] & 0x80U) {
+        /* Negative values are not meaningful here */
+        if(field[0] & 0x40U)
+            return EAARLIO_CORRUPT;
+        val = field[0] & 0x3fU;
+        for(i = 1; i < len; i++) {
+            if(val > UINT64_MAX >> 8)
+                return EAARLIO_CORRUPT;
+            val = val << 8 | field[i];
+        }
+        *value = val;
+        return EAARLIO_SUCCESS;
+    }
+
+    while(i < len && field[i] == ' ')
+        i++;
+    for(; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        if(val > UINT64_MAX >> 3)
+            return EAARLIO_CORRUPT;
+        val = val << 3 | (uint64_t)(field[i] - '0');
+    }
+    if(i < len && field[i] != ' ' && field[i] != '\0')
+        return EAARLIO_CORRUPT;
+
+    *value = val;
+    return EAARLIO_SUCCESS;
+}
+
+/* Check a header's checksum. Some old implementations summed signed bytes,
+ * so either sum is accepted.
+ */
+static int _eaarlio_tar_checksum_valid(unsigned char const *block)
+{
+    uint64_t want;
+    int64_t sum_signed = 0;
+    uint64_t sum = 0;
+    unsigned char c;
+    size_t i;
+
+    if(_eaarlio_tar_number(block + _EAARLIO_TAR_CHKSUM,
+           _EAARLIO_TAR_CHKSUM_SIZE, &want)
+        != EAARLIO_SUCCESS)
+        return 0;
+
+    for(i = 0; i < _EAARLIO_TAR_BLOCK_SIZE; i++) {
+        if(i >= _EAARLIO_TAR_CHKSUM
+            && i < _EAARLIO_TAR_CHKSUM + _EAARLIO_TAR_CHKSUM_SIZE)
+            c = ' ';
+        else
+            c = block[i];
+        sum += c;
+        sum_signed += c < 0x80 ? (int64_t)c : (int64_t)c - 256;
+    }
+
+    return want == sum || (int64_t)want == sum_signed;
+}
+
+static int _eaarlio_tar_block_zero(unsigned char const *block)
+{
+    size_t i;
+    for(i = 0; i < _EAARLIO_TAR_BLOCK_SIZE; i++)
+        if(block[i])
+            return 0;
+    return 1;
+}
+
+/* Replace *dst with a null-terminated copy of len bytes of src */
+static eaarlio_error _eaarlio_tar_set_path(struct eaarlio_memory *memory,
+    char **dst,
+    char const *src,
+    size_t len)
+{
+    char *path = memory->malloc(memory, len + 1);
+    if(!path)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    memcpy(path, src, len);
+    path[len] = '\0';
+
+    if(*dst)
+        memory->free(memory, *dst);
+    *dst = path;
+    return EAARLIO_SUCCESS;
+}
+
+/* Apply the path and size records of a pax extended header. Each record is
+ * "<length> <key>=<value>\n", where length counts the whole record.
+ */
+static eaarlio_error _eaarlio_tar_pax(struct eaarlio_memory *memory,
+    struct _eaarlio_tar_pending *pending,
+    char const *data,
+    size_t len)
+{
+    char const *record, *key, *value, *end;
+    size_t pos = 0, rec_len, i;
+    uint64_t size;
+    eaarlio_error err;
+
+    while(pos < len) {
+        record = data + pos;
+        rec_len = 0;
+        for(i = 0; pos + i < len && record[i] >= '0' && record[i] <= '9';
+            i++) {
+            if(rec_len > (SIZE_MAX - 9) / 10)
+                return EAARLIO_CORRUPT;
+            rec_len = rec_len * 10 + (size_t)(record[i] - '0');
+        }
+        if(i == 0 || pos + i >= len || record[i] != ' ' || rec_len <= i + 1
+            || rec_len > len - pos || record[rec_len - 1] != '\n')
+            return EAARLIO_CORRUPT;
+
+        key = record + i + 1;
+        end = record + rec_len - 1;
+        value = memchr(key, '=', (size_t)(end - key));
+        if(!value)
+            return EAARLIO_CORRUPT;
+        value++;
+
+        if(value - key == 5 && memcmp(key, "path", 4) == 0) {
+            err = _eaarlio_tar_set_path(
+                memory, &pending->path, value, (size_t)(end - value));
+            if(err != EAARLIO_SUCCESS)
+                return err;
+        } else if(value - key == 5 && memcmp(key, "size", 4) == 0) {
+            size = 0;
+            if(value == end)
+                return EAARLIO_CORRUPT;
+            for(; value < end; value++) {
+                if(*value < '0' || *value > '9')
+                    return EAARLIO_CORRUPT;
+                if(size > (UINT64_MAX - 9) / 10)
+                    return EAARLIO_CORRUPT;
+                size = size * 10 + (uint64_t)(*value - '0');
+            }
+            pending->size = size;
+            pending->has_size = 1;
+        }
+
+        pos += rec_len;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Add a regular file to the index under the final component of its path */
+static eaarlio_error _eaarlio_tar_add(struct _eaarlio_tar_tld_opener *internal,
+    char const *path,
+    size_t path_len,
+    uint64_t offset,
+    uint64_t length)
+{
+    struct eaarlio_memory *memory = &internal->memory;
+    struct _eaarlio_tar_entry *entries;
+    struct _eaarlio_tar_entry *entry;
+    uint32_t capacity;
+    uint64_t bytes;
+    size_t start;
+
+    /* Only the file name matters. A ustar prefix only adds directories, so
+     * it is not needed either.
+     */
+    for(start = path_len; start > 0 && path[start - 1] != '/'; start--)
+        ;
+    if(start == path_len)
+        return EAARLIO_SUCCESS;
+
+    if(internal->entry_count == internal->entry_capacity) {
+        if(internal->entry_capacity > UINT32_MAX / 2)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+        capacity = internal->entry_capacity ? internal->entry_capacity * 2
+                                            : _EAARLIO_TAR_CAPACITY;
+        bytes = (uint64_t)capacity * sizeof(struct _eaarlio_tar_entry);
+        if(bytes >= SIZE_MAX)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+        entries = memory->realloc(memory, internal->entries, (size_t)bytes);
+        if(!entries)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        internal->entries = entries;
+        internal->entry_capacity = capacity;
+    }
+
+    entry = &internal->entries[internal->entry_count];
+    entry->name = NULL;
+    if(_eaarlio_tar_set_path(
+           memory, &entry->name, path + start, path_len - start)
+        != EAARLIO_SUCCESS)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+    entry->offset = offset;
+    entry->length = length;
+    internal->entry_count++;
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Read the data of an extension member into a new null-terminated buffer */
+static eaarlio_error _eaarlio_tar_read_meta(
+    struct _eaarlio_tar_tld_opener *internal,
+    uint64_t offset,
+    uint64_t length,
+    char **data)
+{
+    struct eaarlio_stream *tar = &internal->tar;
+    struct eaarlio_memory *memory = &internal->memory;
+    eaarlio_error err;
+
+    if(length > _EAARLIO_TAR_META_MAX)
+        return EAARLIO_CORRUPT;
+
+    *data = memory->malloc(memory, (size_t)length + 1);
+    if(!*data)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    err = tar->seek(tar, (int64_t)offset, SEEK_SET);
+    if(err == EAARLIO_SUCCESS)
+        err = tar->read(tar, length, (unsigned char *)*data);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS) {
+        memory->free(memory, *data);
+        *data = NULL;
+        return err;
+    }
+
+    (*data)[length] = '\0';
+    return EAARLIO_SUCCESS;
+}
+
+/* Read every member header and index the regular files */
+static eaarlio_error _eaarlio_tar_load_index(
+    struct _eaarlio_tar_tld_opener *internal)
+{
+    struct eaarlio_stream *tar = &internal->tar;
+    struct eaarlio_memory *memory = &internal->memory;
+    struct _eaarlio_tar_pending pending = { NULL, 0, 0 };
+    unsigned char block[_EAARLIO_TAR_BLOCK_SIZE];
+    eaarlio_error err;
+    char *meta = NULL;
+    uint64_t offset = 0, data, length, padded;
+    int64_t size;
+
+    err = tar->seek(tar, 0, SEEK_END);
+    if(err == EAARLIO_SUCCESS)
+        err = tar->tell(tar, &size);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    /* An archive may end without the usual two zero blocks */
+    while(offset < (uint64_t)size) {
+        if((uint64_t)size - offset < _EAARLIO_TAR_BLOCK_SIZE) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+
+        err = tar->seek(tar, (int64_t)offset, SEEK_SET);
+        if(err == EAARLIO_SUCCESS)
+            err = tar->read(tar, _EAARLIO_TAR_BLOCK_SIZE, block);
+        if(err == EAARLIO_STREAM_READ_SHORT)
+            err = EAARLIO_CORRUPT;
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        if(_eaarlio_tar_block_zero(block))
+            break;
+        if(!_eaarlio_tar_checksum_valid(block)) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+
+        err = _eaarlio_tar_number(
+            block + _EAARLIO_TAR_SIZE, _EAARLIO_TAR_SIZE_SIZE, &length);
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        data = offset + _EAARLIO_TAR_BLOCK_SIZE;
+
+        switch(block[_EAARLIO_TAR_TYPEFLAG]) {
+            case '\0':
+            case '0':
+            case '7':
+                /* Regular file */
+                if(pending.has_size)
+                    length = pending.size;
+                if(pending.path)
+                    err = _eaarlio_tar_add(internal, pending.path,
+                        strlen(pending.path), data, length);
+                else
+                    err = _eaarlio_tar_add(internal,
+                        (char const *)block + _EAARLIO_TAR_NAME,
+                        eaarlio_strnlen((char const *)block + _EAARLIO_TAR_NAME,
+                            _EAARLIO_TAR_NAME_SIZE),
+                        data, length);
+                break;
+            case 'L':
+                /* GNU long name for the next member */
+                err = _eaarlio_tar_read_meta(internal, data, length, &meta);
+                if(err == EAARLIO_SUCCESS)
+                    err = _eaarlio_tar_set_path(
+                        memory, &pending.path, meta, strlen(meta));
+                break;
+            case 'x':
+                /* pax extended header for the next member */
+                err = _eaarlio_tar_read_meta(internal, data, length, &meta);
+                if(err == EAARLIO_SUCCESS)
+                    err = _eaarlio_tar_pax(
+                        memory, &pending, meta, (size_t)length);
+                break;
+            default:
+                /* Directories, links, global headers, and so on */
+                break;
+        }
+        if(meta) {
+            memory->free(memory, meta);
+            meta = NULL;
+        }
+        if(err != EAARLIO_SUCCESS)
+            goto cleanup;
+
+        /* Extension members describe the member after them; anything else
+         * uses them up.
+         */
+        if(block[_EAARLIO_TAR_TYPEFLAG] != 'L'
+            && block[_EAARLIO_TAR_TYPEFLAG] != 'K'
+            && block[_EAARLIO_TAR_TYPEFLAG] != 'x'
+            && block[_EAARLIO_TAR_TYPEFLAG] != 'g') {
+            if(pending.path)
+                memory->free(memory, pending.path);
+            pending.path = NULL;
+            pending.has_size = 0;
+        }
+
+        if(length > (uint64_t)size - data) {
+            err = EAARLIO_CORRUPT;
+            goto cleanup;
+        }
+        padded = length + (_EAARLIO_TAR_BLOCK_SIZE - 1);
+        padded -= padded % _EAARLIO_TAR_BLOCK_SIZE;
+        offset = data + padded;
+    }
+
+cleanup:
+    if(pending.path)
+        memory->free(memory, pending.path);
+    return err;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::open_tld
+ */
+static eaarlio_error _eaarlio_tar_tld_opener_open_tld(
+    struct eaarlio_tld_opener *self,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct _eaarlio_tar_tld_opener *internal;
+    uint32_t i;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!tld_file)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_tar_tld_opener *)self->opaque;
+
+    /* Later members replace earlier ones of the same name */
+    for(i = internal->entry_count; i > 0; i--) {
+        if(strcmp(internal->entries[i - 1].name, tld_file) == 0)
+            return eaarlio_window_stream(stream, &internal->tar,
+                internal->entries[i - 1].offset,
+                internal->entries[i - 1].length, &internal->memory);
+    }
+
+    return EAARLIO_STREAM_OPEN_ERROR;
+}
+
+/* Release everything owned by internal except the archive stream */
+static void _eaarlio_tar_tld_opener_free(
+    struct _eaarlio_tar_tld_opener *internal)
+{
+    struct eaarlio_memory memory = internal->memory;
+    uint32_t i;
+
+    for(i = 0; i < internal->entry_count; i++)
+        memory.free(&memory, internal->entries[i].name);
+    if(internal->entries)
+        memory.free(&memory, internal->entries);
+    memory.free(&memory, internal);
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::close
+ */
+static eaarlio_error _eaarlio_tar_tld_opener_close(
+    struct eaarlio_tld_opener *self)
+{
+    struct _eaarlio_tar_tld_opener *internal;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_tar_tld_opener *)self->opaque;
+
+    err = internal->tar.close(&internal->tar);
+    _eaarlio_tar_tld_opener_free(internal);
+
+    *self = eaarlio_tld_opener_empty();
+
+    return err;
+}
+
+eaarlio_error eaarlio_tar_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_stream *tar,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_tar_tld_opener *internal;
+    eaarlio_error err;
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+
+    *tld_opener = eaarlio_tld_opener_empty();
+
+    if(!tar)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(tar))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal =
+        memory->calloc(memory, 1, sizeof(struct _eaarlio_tar_tld_opener));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->memory = *memory;
+    internal->tar = *tar;
+
+    err = _eaarlio_tar_load_index(internal);
+    if(err != EAARLIO_SUCCESS) {
+        _eaarlio_tar_tld_opener_free(internal);
+        return err;
+    }
+
+    *tar = eaarlio_stream_empty();
+
+    tld_opener->open_tld = &_eaarlio_tar_tld_opener_open_tld;
+    tld_opener->close = &_eaarlio_tar_tld_opener_close;
+    tld_opener->opaque = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
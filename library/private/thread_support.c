@@ -0,0 +1,153 @@
+/* sysconf(_SC_NPROCESSORS_ONLN) is a widely supported extension to POSIX, so
+ * it needs to be requested explicitly.
+ */
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif
+
+#include "eaarlio/thread_support.h"
+
+#ifdef EAARLIO_HAVE_PTHREADS
+#include <unistd.h>
+#endif
+
+eaarlio_error eaarlio_mutex_init(struct eaarlio_mutex *mutex)
+{
+    if(!mutex)
+        return EAARLIO_NULL;
+#ifdef EAARLIO_HAVE_PTHREADS
+    if(pthread_mutex_init(&mutex->mutex, NULL))
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+#else
+    mutex->unused = 0;
+#endif
+    return EAARLIO_SUCCESS;
+}
+
+void eaarlio_mutex_destroy(struct eaarlio_mutex *mutex)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_mutex_destroy(&mutex->mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void eaarlio_mutex_lock(struct eaarlio_mutex *mutex)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_mutex_lock(&mutex->mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void eaarlio_mutex_unlock(struct eaarlio_mutex *mutex)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_mutex_unlock(&mutex->mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+eaarlio_error eaarlio_cond_init(struct eaarlio_cond *cond)
+{
+    if(!cond)
+        return EAARLIO_NULL;
+#ifdef EAARLIO_HAVE_PTHREADS
+    if(pthread_cond_init(&cond->cond, NULL))
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+#else
+    cond->unused = 0;
+#endif
+    return EAARLIO_SUCCESS;
+}
+
+void eaarlio_cond_destroy(struct eaarlio_cond *cond)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_cond_destroy(&cond->cond);
+#else
+    (void)cond;
+#endif
+}
+
+void eaarlio_cond_wait(struct eaarlio_cond *cond, struct eaarlio_mutex *mutex)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+#else
+    (void)cond;
+    (void)mutex;
+#endif
+}
+
+void eaarlio_cond_signal(struct eaarlio_cond *cond)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_cond_signal(&cond->cond);
+#else
+    (void)cond;
+#endif
+}
+
+void eaarlio_cond_broadcast(struct eaarlio_cond *cond)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_cond_broadcast(&cond->cond);
+#else
+    (void)cond;
+#endif
+}
+
+#ifdef EAARLIO_HAVE_PTHREADS
+/* Adapt eaarlio_thread_fn to the signature pthread_create expects */
+static void *_eaarlio_thread_main(void *arg)
+{
+    struct eaarlio_thread *thread = (struct eaarlio_thread *)arg;
+    thread->fn(thread->arg);
+    return NULL;
+}
+#endif
+
+eaarlio_error eaarlio_thread_start(struct eaarlio_thread *thread,
+    eaarlio_thread_fn fn,
+    void *arg)
+{
+    if(!thread)
+        return EAARLIO_NULL;
+    if(!fn)
+        return EAARLIO_NULL;
+
+    thread->fn = fn;
+    thread->arg = arg;
+
+#ifdef EAARLIO_HAVE_PTHREADS
+    if(pthread_create(&thread->thread, NULL, &_eaarlio_thread_main, thread))
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+#else
+    fn(arg);
+#endif
+
+    return EAARLIO_SUCCESS;
+}
+
+void eaarlio_thread_join(struct eaarlio_thread *thread)
+{
+#ifdef EAARLIO_HAVE_PTHREADS
+    pthread_join(thread->thread, NULL);
+#else
+    (void)thread;
+#endif
+}
+
+uint32_t eaarlio_thread_count(void)
+{
+#if defined(EAARLIO_HAVE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if(count > 1)
+        return count > 1024 ? 1024U : (uint32_t)count;
+#endif
+    return 1;
+}
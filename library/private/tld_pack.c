@@ -6,14 +6,14 @@
 #include "eaarlio/tld_encode.h"
 #include "eaarlio/tld_pack.h"
 #include "eaarlio/tld_size.h"
+#include "eaarlio/wfpack.h"
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
 
-eaarlio_error eaarlio_tld_pack_raster(unsigned char **buffer,
-    uint32_t *buffer_len,
-    struct eaarlio_raster *raster,
-    struct eaarlio_memory *memory)
+eaarlio_error eaarlio_tld_pack_raster_into(unsigned char *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster)
 {
     struct eaarlio_pulse *pulse;
     eaarlio_error err;
@@ -23,36 +23,15 @@ eaarlio_error eaarlio_tld_pack_raster(unsigned char **buffer,
     uint16_t i;
     uint8_t j;
 
-    if(buffer)
-        *buffer = NULL;
-    if(buffer_len)
-        *buffer_len = 0;
-
     if(!buffer)
         return EAARLIO_NULL;
-    if(!buffer_len)
-        return EAARLIO_NULL;
     if(!raster)
         return EAARLIO_NULL;
     if(!raster->pulse && raster->pulse_count > 0)
         return EAARLIO_NULL;
 
-    if(!memory) {
-        memory = &eaarlio_memory_default;
-    } else if(!eaarlio_memory_valid(memory)) {
-        return EAARLIO_MEMORY_INVALID;
-    }
-
-    err = eaarlio_tld_size_raster(raster, buffer_len);
-    if(err != EAARLIO_SUCCESS)
-        return err;
-
-    *buffer = memory->calloc(memory, 1, *buffer_len);
-    if(!buffer)
-        return EAARLIO_MEMORY_ALLOC_FAIL;
-
-    work = *buffer;
-    work_len = *buffer_len;
+    work = buffer;
+    work_len = buffer_len;
 
 #define CHECK_AND_ADVANCE(size)                                                \
     do {                                                                       \
@@ -100,3 +79,128 @@ eaarlio_error eaarlio_tld_pack_raster(unsigned char **buffer,
 
     return EAARLIO_SUCCESS;
 }
+
+eaarlio_error eaarlio_tld_pack_raster_wfpack_into(unsigned char *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    uint32_t *used)
+{
+    struct eaarlio_pulse *pulse;
+    eaarlio_error err;
+    unsigned char *work;
+    unsigned char *wfdata;
+    uint32_t work_len;
+    uint32_t packed_len;
+    uint16_t i;
+    uint8_t j;
+
+    if(used)
+        *used = 0;
+
+    if(!buffer)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+    if(!used)
+        return EAARLIO_NULL;
+    if(!raster->pulse && raster->pulse_count > 0)
+        return EAARLIO_NULL;
+
+    work = buffer;
+    work_len = buffer_len;
+
+#define CHECK_AND_ADVANCE(size)                                                \
+    do {                                                                       \
+        if(err != EAARLIO_SUCCESS)                                             \
+            return err;                                                        \
+        work += (size);                                                        \
+        work_len -= (size);                                                    \
+    } while(0)
+
+    err = eaarlio_tld_encode_raster_header(work, work_len, raster);
+    CHECK_AND_ADVANCE(EAARLIO_TLD_RASTER_HEADER_SIZE);
+
+    for(i = 0; i < raster->pulse_count; i++) {
+        pulse = &raster->pulse[i];
+
+        if(pulse->rx_count > EAARLIO_MAX_RX_COUNT)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+
+        err = eaarlio_tld_encode_pulse_header(work, work_len, pulse);
+        CHECK_AND_ADVANCE(EAARLIO_TLD_PULSE_HEADER_SIZE);
+
+        /* The length is filled in once the waveforms are packed */
+        err = eaarlio_tld_encode_wf_data_length(work, work_len, 0);
+        wfdata = work;
+        CHECK_AND_ADVANCE(EAARLIO_TLD_WF_DATA_LENGTH_SIZE);
+
+        err = eaarlio_tld_encode_tx_length(work, work_len, pulse->tx_len);
+        CHECK_AND_ADVANCE(EAARLIO_TLD_TX_LENGTH_SIZE);
+
+        err = eaarlio_wfpack_encode(
+            work, work_len, pulse->tx, pulse->tx_len, &packed_len);
+        CHECK_AND_ADVANCE(packed_len);
+
+        for(j = 0; j < pulse->rx_count; j++) {
+            err =
+                eaarlio_tld_encode_rx_length(work, work_len, pulse->rx_len[j]);
+            CHECK_AND_ADVANCE(EAARLIO_TLD_RX_LENGTH_SIZE);
+
+            err = eaarlio_wfpack_encode(
+                work, work_len, pulse->rx[j], pulse->rx_len[j], &packed_len);
+            CHECK_AND_ADVANCE(packed_len);
+        }
+
+        packed_len = (uint32_t)(work - wfdata) - EAARLIO_TLD_WF_DATA_LENGTH_SIZE;
+        if(packed_len > UINT16_MAX)
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+        err = eaarlio_tld_encode_wf_data_length(wfdata,
+            EAARLIO_TLD_WF_DATA_LENGTH_SIZE, (uint16_t)packed_len);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+#undef CHECK_AND_ADVANCE
+
+    *used = buffer_len - work_len;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_tld_pack_raster(unsigned char **buffer,
+    uint32_t *buffer_len,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory)
+{
+    eaarlio_error err;
+
+    if(buffer)
+        *buffer = NULL;
+    if(buffer_len)
+        *buffer_len = 0;
+
+    if(!buffer)
+        return EAARLIO_NULL;
+    if(!buffer_len)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+    if(!raster->pulse && raster->pulse_count > 0)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    err = eaarlio_tld_size_raster(raster, buffer_len);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    *buffer = memory->calloc(memory, 1, *buffer_len);
+    if(!*buffer)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    return eaarlio_tld_pack_raster_into(*buffer, *buffer_len, raster);
+}
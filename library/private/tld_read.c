@@ -67,7 +67,7 @@ eaarlio_error eaarlio_tld_read_record(struct eaarlio_stream *stream,
         goto cleanup;
     }
 
-    if(record_header->record_type != EAARLIO_TLD_TYPE_RASTER) {
+    if(!eaarlio_tld_type_is_raster(record_header->record_type)) {
         if(raster_length > 0)
             stream->seek(stream, raster_length, SEEK_CUR);
         err = EAARLIO_SUCCESS;
@@ -91,8 +91,12 @@ eaarlio_error eaarlio_tld_read_record(struct eaarlio_stream *stream,
             goto cleanup;
     }
 
-    err = eaarlio_tld_unpack_raster(buf, (uint32_t)raster_length, raster,
-        memory, include_pulses, include_waveforms);
+    if(record_header->record_type == EAARLIO_TLD_TYPE_RASTER_WFPACK)
+        err = eaarlio_tld_unpack_raster_wfpack(buf, (uint32_t)raster_length,
+            raster, memory, include_pulses, include_waveforms);
+    else
+        err = eaarlio_tld_unpack_raster(buf, (uint32_t)raster_length, raster,
+            memory, include_pulses, include_waveforms);
 
 cleanup:
     if(buf)
@@ -114,7 +118,7 @@ eaarlio_error eaarlio_tld_read_raster(struct eaarlio_stream *stream,
     if(err != EAARLIO_SUCCESS)
         return err;
 
-    if(record_header.record_type != EAARLIO_TLD_TYPE_RASTER)
+    if(!eaarlio_tld_type_is_raster(record_header.record_type))
         return EAARLIO_TLD_TYPE_UNKNOWN;
 
     return EAARLIO_SUCCESS;
@@ -5,6 +5,7 @@
 #include "eaarlio/tld_constants.h"
 #include "eaarlio/tld_decode.h"
 #include "eaarlio/tld_unpack.h"
+#include "eaarlio/wfpack.h"
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
@@ -48,12 +49,50 @@ static eaarlio_error _eaarlio_retrieve_wf(unsigned char const *buffer,
     return eaarlio_tld_decode_waveform(buffer, buffer_len, *wf, wf_len);
 }
 
+/* Wrapper around eaarlio_wfpack_decode that handles memory allocation and
+ * advances past the packed data.
+ *
+ * Packed waveforms are never legitimately truncated, so running out of data
+ * is reported as corruption rather than EAARLIO_BUFFER_SHORT.
+ */
+static eaarlio_error _eaarlio_retrieve_wfpack(unsigned char const **buffer,
+    uint32_t *buffer_len,
+    unsigned char **wf,
+    uint16_t wf_len,
+    struct eaarlio_memory *memory)
+{
+    eaarlio_error err;
+    uint32_t used;
+
+    assert(buffer);
+    assert(*buffer);
+    assert(buffer_len);
+    assert(wf);
+
+    if(wf_len < 1)
+        return EAARLIO_SUCCESS;
+
+    *wf = memory->malloc(memory, wf_len);
+    if(!*wf)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    err = eaarlio_wfpack_decode(*wf, wf_len, *buffer, *buffer_len, &used);
+    if(err == EAARLIO_BUFFER_SHORT)
+        return EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    _eaarlio_advance_buffer(buffer, buffer_len, (uint16_t)used);
+
+    return EAARLIO_SUCCESS;
+}
+
 /* Decodes and assigns tx_len and tx
  */
 static eaarlio_error _eaarlio_unpack_tx(unsigned char const **buffer,
     uint32_t *buffer_len,
     struct eaarlio_pulse *pulse,
-    struct eaarlio_memory *mem)
+    struct eaarlio_memory *mem,
+    int wfpack)
 {
     assert(buffer);
     assert(*buffer);
@@ -67,6 +106,10 @@ static eaarlio_error _eaarlio_unpack_tx(unsigned char const **buffer,
         return err;
     _eaarlio_advance_buffer(buffer, buffer_len, EAARLIO_TLD_TX_LENGTH_SIZE);
 
+    if(wfpack)
+        return _eaarlio_retrieve_wfpack(
+            buffer, buffer_len, &pulse->tx, pulse->tx_len, mem);
+
     if(pulse->tx_len > *buffer_len) {
         pulse->tx_len = (uint8_t)*buffer_len;
         final = EAARLIO_BUFFER_SHORT;
@@ -87,7 +130,8 @@ static eaarlio_error _eaarlio_unpack_rx(unsigned char const **buffer,
     uint32_t *buffer_len,
     uint8_t channel,
     struct eaarlio_pulse *pulse,
-    struct eaarlio_memory *mem)
+    struct eaarlio_memory *mem,
+    int wfpack)
 {
     assert(buffer);
     assert(*buffer);
@@ -101,6 +145,10 @@ static eaarlio_error _eaarlio_unpack_rx(unsigned char const **buffer,
         return err;
     _eaarlio_advance_buffer(buffer, buffer_len, EAARLIO_TLD_RX_LENGTH_SIZE);
 
+    if(wfpack)
+        return _eaarlio_retrieve_wfpack(buffer, buffer_len, &pulse->rx[channel],
+            pulse->rx_len[channel], mem);
+
     if(pulse->rx_len[channel] > *buffer_len) {
         pulse->rx_len[channel] = (uint16_t)*buffer_len;
         final = EAARLIO_BUFFER_SHORT;
@@ -115,10 +163,13 @@ static eaarlio_error _eaarlio_unpack_rx(unsigned char const **buffer,
     return final;
 }
 
-eaarlio_error eaarlio_tld_unpack_waveforms(unsigned char const *buffer,
+/* Body of eaarlio_tld_unpack_waveforms, for either waveform encoding
+ */
+static eaarlio_error _eaarlio_unpack_waveforms(unsigned char const *buffer,
     uint32_t buffer_len,
     struct eaarlio_pulse *pulse,
-    struct eaarlio_memory *memory)
+    struct eaarlio_memory *memory,
+    int wfpack)
 {
     eaarlio_error err;
     uint8_t channel;
@@ -145,12 +196,13 @@ eaarlio_error eaarlio_tld_unpack_waveforms(unsigned char const *buffer,
         return EAARLIO_MEMORY_INVALID;
     }
 
-    err = _eaarlio_unpack_tx(&buffer, &buffer_len, pulse, memory);
+    err = _eaarlio_unpack_tx(&buffer, &buffer_len, pulse, memory, wfpack);
     if(err != EAARLIO_SUCCESS)
         return err;
 
     for(channel = 0; channel < pulse->rx_count; channel++) {
-        err = _eaarlio_unpack_rx(&buffer, &buffer_len, channel, pulse, memory);
+        err = _eaarlio_unpack_rx(
+            &buffer, &buffer_len, channel, pulse, memory, wfpack);
         if(err != EAARLIO_SUCCESS)
             return err;
     }
@@ -158,11 +210,22 @@ eaarlio_error eaarlio_tld_unpack_waveforms(unsigned char const *buffer,
     return EAARLIO_SUCCESS;
 }
 
-eaarlio_error eaarlio_tld_unpack_pulses(unsigned char const *buffer,
+eaarlio_error eaarlio_tld_unpack_waveforms(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_pulse *pulse,
+    struct eaarlio_memory *memory)
+{
+    return _eaarlio_unpack_waveforms(buffer, buffer_len, pulse, memory, 0);
+}
+
+/* Body of eaarlio_tld_unpack_pulses, for either waveform encoding
+ */
+static eaarlio_error _eaarlio_unpack_pulses(unsigned char const *buffer,
     uint32_t buffer_len,
     struct eaarlio_raster *raster,
     struct eaarlio_memory *memory,
-    int include_waveforms)
+    int include_waveforms,
+    int wfpack)
 {
     eaarlio_error err;
     uint16_t data_length;
@@ -208,8 +271,8 @@ eaarlio_error eaarlio_tld_unpack_pulses(unsigned char const *buffer,
             data_length = (uint16_t)buffer_len;
 
         if(include_waveforms) {
-            err = eaarlio_tld_unpack_waveforms(
-                buffer, data_length, &raster->pulse[i], memory);
+            err = _eaarlio_unpack_waveforms(
+                buffer, data_length, &raster->pulse[i], memory, wfpack);
 
             /* Special case: The EAARL system is known to write out the last
              * waveform of the last pulse of a raster incorrectly by shorting
@@ -244,12 +307,25 @@ eaarlio_error eaarlio_tld_unpack_pulses(unsigned char const *buffer,
     return EAARLIO_SUCCESS;
 }
 
-eaarlio_error eaarlio_tld_unpack_raster(unsigned char const *buffer,
+eaarlio_error eaarlio_tld_unpack_pulses(unsigned char const *buffer,
     uint32_t buffer_len,
     struct eaarlio_raster *raster,
     struct eaarlio_memory *memory,
-    int include_pulses,
     int include_waveforms)
+{
+    return _eaarlio_unpack_pulses(
+        buffer, buffer_len, raster, memory, include_waveforms, 0);
+}
+
+/* Body of eaarlio_tld_unpack_raster, for either waveform encoding
+ */
+static eaarlio_error _eaarlio_unpack_raster(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms,
+    int wfpack)
 {
     eaarlio_error err;
 
@@ -279,6 +355,69 @@ eaarlio_error eaarlio_tld_unpack_raster(unsigned char const *buffer,
     _eaarlio_advance_buffer(
         &buffer, &buffer_len, EAARLIO_TLD_RASTER_HEADER_SIZE);
 
-    return eaarlio_tld_unpack_pulses(
-        buffer, buffer_len, raster, memory, include_waveforms);
+    return _eaarlio_unpack_pulses(
+        buffer, buffer_len, raster, memory, include_waveforms, wfpack);
+}
+
+eaarlio_error eaarlio_tld_unpack_raster(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms)
+{
+    return _eaarlio_unpack_raster(buffer, buffer_len, raster, memory,
+        include_pulses, include_waveforms, 0);
+}
+
+eaarlio_error eaarlio_tld_unpack_raster_wfpack(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms)
+{
+    return _eaarlio_unpack_raster(buffer, buffer_len, raster, memory,
+        include_pulses, include_waveforms, 1);
+}
+
+eaarlio_error eaarlio_tld_unpack_record(unsigned char const *buffer,
+    uint32_t buffer_len,
+    struct eaarlio_tld_header *record_header,
+    struct eaarlio_raster *raster,
+    struct eaarlio_memory *memory,
+    int include_pulses,
+    int include_waveforms)
+{
+    eaarlio_error err;
+
+    if(raster)
+        raster->pulse = NULL;
+
+    if(!buffer)
+        return EAARLIO_NULL;
+    if(!record_header)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+
+    err = eaarlio_tld_decode_record_header(buffer, buffer_len, record_header);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(record_header->record_length < EAARLIO_TLD_RECORD_HEADER_SIZE)
+        return EAARLIO_CORRUPT;
+    if(record_header->record_length > buffer_len)
+        return EAARLIO_BUFFER_SHORT;
+
+    if(!eaarlio_tld_type_is_raster(record_header->record_type))
+        return EAARLIO_SUCCESS;
+
+    _eaarlio_advance_buffer(
+        &buffer, &buffer_len, EAARLIO_TLD_RECORD_HEADER_SIZE);
+
+    return _eaarlio_unpack_raster(buffer,
+        record_header->record_length - EAARLIO_TLD_RECORD_HEADER_SIZE, raster,
+        memory, include_pulses, include_waveforms,
+        record_header->record_type == EAARLIO_TLD_TYPE_RASTER_WFPACK);
 }
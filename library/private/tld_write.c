@@ -6,6 +6,7 @@
 #include "eaarlio/tld_constants.h"
 #include "eaarlio/tld_encode.h"
 #include "eaarlio/tld_pack.h"
+#include "eaarlio/tld_size.h"
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
@@ -16,9 +17,8 @@ eaarlio_error eaarlio_tld_write_raster(struct eaarlio_stream *stream,
 {
     eaarlio_error err = EAARLIO_SUCCESS;
     struct eaarlio_tld_header header;
-    unsigned char *buf_raster;
-    uint32_t buf_raster_len;
-    unsigned char buf_record[EAARLIO_TLD_RECORD_HEADER_SIZE];
+    unsigned char *buf = NULL;
+    uint32_t raster_len;
 
     if(!stream)
         return EAARLIO_NULL;
@@ -34,28 +34,34 @@ eaarlio_error eaarlio_tld_write_raster(struct eaarlio_stream *stream,
         return EAARLIO_MEMORY_INVALID;
     }
 
-    err = eaarlio_tld_pack_raster(&buf_raster, &buf_raster_len, raster, memory);
+    err = eaarlio_tld_size_raster(raster, &raster_len);
     if(err != EAARLIO_SUCCESS)
-        goto cleanup;
+        return err;
 
     header.record_type = EAARLIO_TLD_TYPE_RASTER;
-    header.record_length = buf_raster_len + EAARLIO_TLD_RECORD_HEADER_SIZE;
+    header.record_length = raster_len + EAARLIO_TLD_RECORD_HEADER_SIZE;
+
+    /* Encode the record header and raster together so that the record goes
+     * out in a single write.
+     */
+    buf = memory->malloc(memory, header.record_length);
+    if(!buf)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
 
     err = eaarlio_tld_encode_record_header(
-        (unsigned char *)buf_record, EAARLIO_TLD_RECORD_HEADER_SIZE, &header);
+        buf, EAARLIO_TLD_RECORD_HEADER_SIZE, &header);
     if(err != EAARLIO_SUCCESS)
         goto cleanup;
 
-    err = stream->write(
-        stream, EAARLIO_TLD_RECORD_HEADER_SIZE, (unsigned char *)buf_record);
+    err = eaarlio_tld_pack_raster_into(
+        buf + EAARLIO_TLD_RECORD_HEADER_SIZE, raster_len, raster);
     if(err != EAARLIO_SUCCESS)
         goto cleanup;
 
-    err = stream->write(stream, buf_raster_len, buf_raster);
+    err = stream->write(stream, header.record_length, buf);
 
 cleanup:
-    if(buf_raster)
-        memory->free(memory, buf_raster);
+    memory->free(memory, buf);
 
     return err;
 }
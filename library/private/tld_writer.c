@@ -0,0 +1,221 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/tld_constants.h"
+#include "eaarlio/tld_encode.h"
+#include "eaarlio/tld_pack.h"
+#include "eaarlio/tld_size.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+eaarlio_error eaarlio_tld_writer_init(struct eaarlio_tld_writer *writer,
+    struct eaarlio_stream *stream,
+    uint32_t block_size,
+    eaarlio_stream_sync_fn sync,
+    int sync_policy,
+    struct eaarlio_memory *memory)
+{
+    int64_t position = 0;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    *writer = eaarlio_tld_writer_empty();
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(stream))
+        return EAARLIO_STREAM_INVALID;
+
+    switch(sync_policy) {
+        case EAARLIO_TLD_SYNC_NEVER:
+            break;
+        case EAARLIO_TLD_SYNC_CLOSE:
+        case EAARLIO_TLD_SYNC_FLUSH:
+            if(!sync)
+                return EAARLIO_VALUE_OUT_OF_RANGE;
+            break;
+        default:
+            return EAARLIO_VALUE_OUT_OF_RANGE;
+    }
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    if(block_size == 0)
+        block_size = EAARLIO_TLD_WRITER_BLOCK_SIZE;
+
+    if(stream->tell(stream, &position) != EAARLIO_SUCCESS || position < 0)
+        position = 0;
+
+    writer->buffer = memory->malloc(memory, block_size);
+    if(!writer->buffer)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    writer->stream = stream;
+    writer->sync = sync;
+    writer->sync_policy = sync_policy;
+    writer->buffer_size = block_size;
+    writer->block_size = block_size;
+    writer->position = position;
+    writer->memory = memory;
+    writer->record_type = EAARLIO_TLD_TYPE_RASTER;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_tld_writer_flush(struct eaarlio_tld_writer *writer)
+{
+    eaarlio_error err = EAARLIO_SUCCESS;
+    uint32_t len;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!writer->stream || !writer->buffer)
+        return EAARLIO_STREAM_INVALID;
+
+    len = writer->buffer_len;
+    if(len == 0)
+        return EAARLIO_SUCCESS;
+
+    /* Pending data is dropped even on failure, since a partial write leaves
+     * no way to know what made it out.
+     */
+    writer->buffer_len = 0;
+    writer->position += len;
+
+    err = writer->stream->write(writer->stream, len, writer->buffer);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(writer->sync_policy == EAARLIO_TLD_SYNC_FLUSH)
+        err = writer->sync(writer->stream);
+
+    return err;
+}
+
+eaarlio_error eaarlio_tld_writer_write_raster(
+    struct eaarlio_tld_writer *writer,
+    struct eaarlio_raster *raster,
+    int64_t *offset)
+{
+    struct eaarlio_memory *memory;
+    struct eaarlio_tld_header header;
+    eaarlio_error err;
+    unsigned char *work;
+    uint32_t raster_len;
+    uint32_t packed_len;
+
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!raster)
+        return EAARLIO_NULL;
+    if(!writer->stream || !writer->buffer)
+        return EAARLIO_STREAM_INVALID;
+
+    memory = writer->memory;
+
+    err = eaarlio_tld_size_raster(raster, &raster_len);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    header.record_type = EAARLIO_TLD_TYPE_RASTER;
+    header.record_length = raster_len + EAARLIO_TLD_RECORD_HEADER_SIZE;
+
+    if(writer->buffer_len + header.record_length > writer->buffer_size) {
+        err = eaarlio_tld_writer_flush(writer);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    /* A single record can be larger than a small block size */
+    if(header.record_length > writer->buffer_size) {
+        work = memory->realloc(memory, writer->buffer, header.record_length);
+        if(!work)
+            return EAARLIO_MEMORY_ALLOC_FAIL;
+        writer->buffer = work;
+        writer->buffer_size = header.record_length;
+    }
+
+    work = writer->buffer + writer->buffer_len;
+
+    /* Packed waveforms are only kept if they are smaller, so the space
+     * reserved for the plain record is always enough.
+     */
+    if(writer->record_type == EAARLIO_TLD_TYPE_RASTER_WFPACK) {
+        err = eaarlio_tld_pack_raster_wfpack_into(
+            work + EAARLIO_TLD_RECORD_HEADER_SIZE, raster_len - 1, raster,
+            &packed_len);
+        if(err == EAARLIO_SUCCESS) {
+            header.record_type = EAARLIO_TLD_TYPE_RASTER_WFPACK;
+            header.record_length = packed_len + EAARLIO_TLD_RECORD_HEADER_SIZE;
+        } else if(err != EAARLIO_BUFFER_SHORT
+            && err != EAARLIO_VALUE_OUT_OF_RANGE) {
+            return err;
+        }
+    }
+
+    if(header.record_type == EAARLIO_TLD_TYPE_RASTER) {
+        err = eaarlio_tld_pack_raster_into(
+            work + EAARLIO_TLD_RECORD_HEADER_SIZE, raster_len, raster);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+    }
+
+    err = eaarlio_tld_encode_record_header(
+        work, EAARLIO_TLD_RECORD_HEADER_SIZE, &header);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(offset)
+        *offset = writer->position + writer->buffer_len;
+    writer->buffer_len += header.record_length;
+
+    if(writer->buffer_len >= writer->block_size)
+        return eaarlio_tld_writer_flush(writer);
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_tld_writer_set_record_type(
+    struct eaarlio_tld_writer *writer,
+    int record_type)
+{
+    if(!writer)
+        return EAARLIO_NULL;
+    if(!eaarlio_tld_type_is_raster(record_type))
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    writer->record_type = (uint8_t)record_type;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_tld_writer_close(struct eaarlio_tld_writer *writer)
+{
+    eaarlio_error err = EAARLIO_SUCCESS;
+
+    if(!writer)
+        return EAARLIO_NULL;
+
+    if(writer->stream && writer->buffer) {
+        err = eaarlio_tld_writer_flush(writer);
+
+        /* A flush already synced with EAARLIO_TLD_SYNC_FLUSH */
+        if(err == EAARLIO_SUCCESS
+            && writer->sync_policy == EAARLIO_TLD_SYNC_CLOSE)
+            err = writer->sync(writer->stream);
+    }
+
+    if(writer->buffer)
+        writer->memory->free(writer->memory, writer->buffer);
+
+    *writer = eaarlio_tld_writer_empty();
+
+    return err;
+}
@@ -0,0 +1,584 @@
+#include "eaarlio/error.h"
+#include "eaarlio/int_decode.h"
+#include "eaarlio/int_encode.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/misc_support.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/thread_support.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/trace.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Identifies a trace */
+#define _EAARLIO_TRACE_MAGIC "EAARLTRC"
+/** Length of #_EAARLIO_TRACE_MAGIC */
+#define _EAARLIO_TRACE_MAGIC_SIZE 8
+/** Format version written and understood */
+#define _EAARLIO_TRACE_VERSION 1
+
+/**
+ * Internal structure for a trace
+ */
+struct _eaarlio_trace {
+    /** Stream the trace is written to; not owned */
+    struct eaarlio_stream *sink;
+    /** Protects everything below */
+    struct eaarlio_mutex mutex;
+    /** First error writing to #sink */
+    eaarlio_error err;
+    /** Number to give the next stream opened */
+    uint32_t next_id;
+    /** Value of eaarlio_clock when the trace was created */
+    double epoch;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+/**
+ * Internal structure for a traced stream
+ */
+struct _eaarlio_trace_stream {
+    /** Stream being traced; owned */
+    struct eaarlio_stream inner;
+    /** Trace to record to */
+    struct _eaarlio_trace *trace;
+    /** Number of this stream in the trace */
+    uint32_t id;
+    /** Current position of #inner, or -1 if not known */
+    int64_t position;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+/**
+ * Internal structure for a traced tld_opener
+ */
+struct _eaarlio_trace_tld_opener {
+    /** TLD opener being traced; owned */
+    struct eaarlio_tld_opener inner;
+    /** Trace to record to */
+    struct _eaarlio_trace *trace;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static void _eaarlio_trace_encode_uint64(unsigned char *buf, uint64_t val)
+{
+    eaarlio_int_encode_uint32(buf, (uint32_t)(val & 0xffffffffU));
+    eaarlio_int_encode_uint32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static uint64_t _eaarlio_trace_decode_uint64(unsigned char const *buf)
+{
+    return (uint64_t)eaarlio_int_decode_uint32(buf)
+        | (uint64_t)eaarlio_int_decode_uint32(buf + 4) << 32;
+}
+
+/* Convert a span of eaarlio_clock seconds to nanoseconds */
+static uint64_t _eaarlio_trace_ns(double seconds)
+{
+    if(seconds <= 0)
+        return 0;
+    return (uint64_t)(seconds * 1e9 + 0.5);
+}
+
+/* Take the next stream number */
+static uint32_t _eaarlio_trace_next_id(struct _eaarlio_trace *trace)
+{
+    uint32_t id;
+
+    eaarlio_mutex_lock(&trace->mutex);
+    id = trace->next_id++;
+    eaarlio_mutex_unlock(&trace->mutex);
+
+    return id;
+}
+
+/* Write one record for a call that started at eaarlio_clock time start */
+static void _eaarlio_trace_record(struct _eaarlio_trace *trace,
+    uint8_t op,
+    uint8_t whence,
+    eaarlio_error err,
+    uint32_t stream_id,
+    int64_t offset,
+    uint64_t size,
+    double start,
+    double end)
+{
+    unsigned char buf[EAARLIO_TRACE_RECORD_SIZE];
+
+    eaarlio_int_encode_uint8(buf, op);
+    eaarlio_int_encode_uint8(buf + 1, whence);
+    eaarlio_int_encode_uint16(buf + 2, (uint16_t)err);
+    eaarlio_int_encode_uint32(buf + 4, stream_id);
+    _eaarlio_trace_encode_uint64(buf + 8, (uint64_t)offset);
+    _eaarlio_trace_encode_uint64(buf + 16, size);
+    _eaarlio_trace_encode_uint64(
+        buf + 24, _eaarlio_trace_ns(start - trace->epoch));
+    _eaarlio_trace_encode_uint64(buf + 32, _eaarlio_trace_ns(end - start));
+
+    eaarlio_mutex_lock(&trace->mutex);
+    if(trace->err == EAARLIO_SUCCESS)
+        trace->err =
+            trace->sink->write(trace->sink, EAARLIO_TRACE_RECORD_SIZE, buf);
+    eaarlio_mutex_unlock(&trace->mutex);
+}
+
+/* Ask the inner stream where it is, without tracing the call */
+static void _eaarlio_trace_stream_sync(struct _eaarlio_trace_stream *internal)
+{
+    int64_t position;
+
+    if(internal->inner.tell(&internal->inner, &position) == EAARLIO_SUCCESS)
+        internal->position = position;
+    else
+        internal->position = -1;
+}
+
+static eaarlio_error _eaarlio_trace_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_trace_stream *internal;
+    struct eaarlio_memory memory;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_trace_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.close(&internal->inner);
+    _eaarlio_trace_record(internal->trace, EAARLIO_TRACE_CLOSE, 0, err,
+        internal->id, internal->position, 0, start, eaarlio_clock());
+
+    memory = internal->memory;
+    memory.free(&memory, internal);
+
+    *self = eaarlio_stream_empty();
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_trace_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buffer)
+{
+    struct _eaarlio_trace_stream *internal;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_trace_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.read(&internal->inner, len, buffer);
+    _eaarlio_trace_record(internal->trace, EAARLIO_TRACE_READ, 0, err,
+        internal->id, internal->position, len, start, eaarlio_clock());
+
+    if(err != EAARLIO_SUCCESS)
+        _eaarlio_trace_stream_sync(internal);
+    else if(internal->position >= 0)
+        internal->position += (int64_t)len;
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_trace_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buffer)
+{
+    struct _eaarlio_trace_stream *internal;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_trace_stream *)self->data;
+
+    err = internal->inner.write(&internal->inner, len, buffer);
+    if(err != EAARLIO_SUCCESS)
+        _eaarlio_trace_stream_sync(internal);
+    else if(internal->position >= 0)
+        internal->position += (int64_t)len;
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_trace_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_trace_stream *internal;
+    eaarlio_error err;
+    double start, end;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_trace_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.seek(&internal->inner, offset, whence);
+    end = eaarlio_clock();
+
+    if(err != EAARLIO_SUCCESS || whence == SEEK_END)
+        _eaarlio_trace_stream_sync(internal);
+    else if(whence == SEEK_SET)
+        internal->position = offset;
+    else if(internal->position >= 0)
+        internal->position += offset;
+
+    _eaarlio_trace_record(internal->trace, EAARLIO_TRACE_SEEK,
+        (uint8_t)whence, err, internal->id, internal->position, 0, start, end);
+
+    return err;
+}
+
+static eaarlio_error _eaarlio_trace_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_trace_stream *internal;
+    eaarlio_error err;
+    double start;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_trace_stream *)self->data;
+
+    start = eaarlio_clock();
+    err = internal->inner.tell(&internal->inner, position);
+    if(err == EAARLIO_SUCCESS && position)
+        internal->position = *position;
+    _eaarlio_trace_record(internal->trace, EAARLIO_TRACE_TELL, 0, err,
+        internal->id, internal->position, 0, start, eaarlio_clock());
+
+    return err;
+}
+
+/* Wrap inner, recording an open that took from start to end */
+static eaarlio_error _eaarlio_trace_stream_open(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct _eaarlio_trace *trace,
+    struct eaarlio_memory *memory,
+    double start,
+    double end)
+{
+    struct _eaarlio_trace_stream *internal;
+
+    internal = memory->malloc(memory, sizeof(struct _eaarlio_trace_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->inner = *inner;
+    internal->trace = trace;
+    internal->id = _eaarlio_trace_next_id(trace);
+    internal->memory = *memory;
+    _eaarlio_trace_stream_sync(internal);
+
+    *inner = eaarlio_stream_empty();
+
+    _eaarlio_trace_record(trace, EAARLIO_TRACE_OPEN, 0, EAARLIO_SUCCESS,
+        internal->id, internal->position, 0, start, end);
+
+    stream->close = &_eaarlio_trace_stream_close;
+    stream->read = &_eaarlio_trace_stream_read;
+    stream->write = &_eaarlio_trace_stream_write;
+    stream->seek = &_eaarlio_trace_stream_seek;
+    stream->tell = &_eaarlio_trace_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_stream_trace(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_trace *trace,
+    struct eaarlio_memory *memory)
+{
+    double now;
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!inner)
+        return EAARLIO_NULL;
+    if(!trace)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(inner))
+        return EAARLIO_STREAM_INVALID;
+    if(!trace->internal)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    now = eaarlio_clock();
+    return _eaarlio_trace_stream_open(stream, inner,
+        (struct _eaarlio_trace *)trace->internal, memory, now, now);
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::open_tld
+ */
+static eaarlio_error _eaarlio_trace_tld_opener_open_tld(
+    struct eaarlio_tld_opener *self,
+    struct eaarlio_stream *stream,
+    char const *tld_file)
+{
+    struct _eaarlio_trace_tld_opener *internal;
+    struct eaarlio_stream inner = eaarlio_stream_empty();
+    eaarlio_error err;
+    double start, end;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_trace_tld_opener *)self->opaque;
+
+    start = eaarlio_clock();
+    err = internal->inner.open_tld(&internal->inner, &inner, tld_file);
+    end = eaarlio_clock();
+
+    if(err != EAARLIO_SUCCESS) {
+        _eaarlio_trace_record(internal->trace, EAARLIO_TRACE_OPEN, 0, err, 0,
+            -1, 0, start, end);
+        return err;
+    }
+
+    err = _eaarlio_trace_stream_open(
+        stream, &inner, internal->trace, &internal->memory, start, end);
+    if(err != EAARLIO_SUCCESS)
+        inner.close(&inner);
+
+    return err;
+}
+
+/**
+ * Implementation for ::eaarlio_tld_opener::close
+ */
+static eaarlio_error _eaarlio_trace_tld_opener_close(
+    struct eaarlio_tld_opener *self)
+{
+    struct _eaarlio_trace_tld_opener *internal;
+    struct eaarlio_memory memory;
+    eaarlio_error err;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->opaque)
+        return EAARLIO_TLD_OPENER_INVALID;
+
+    internal = (struct _eaarlio_trace_tld_opener *)self->opaque;
+
+    err = internal->inner.close(&internal->inner);
+    memory = internal->memory;
+    memory.free(&memory, internal);
+
+    *self = eaarlio_tld_opener_empty();
+
+    return err;
+}
+
+eaarlio_error eaarlio_trace_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_tld_opener *inner,
+    struct eaarlio_trace *trace,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_trace_tld_opener *internal;
+
+    if(!tld_opener)
+        return EAARLIO_NULL;
+
+    *tld_opener = eaarlio_tld_opener_empty();
+
+    if(!inner)
+        return EAARLIO_NULL;
+    if(!trace)
+        return EAARLIO_NULL;
+    if(!inner->open_tld || !inner->close)
+        return EAARLIO_TLD_OPENER_INVALID;
+    if(!trace->internal)
+        return EAARLIO_NULL;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal =
+        memory->malloc(memory, sizeof(struct _eaarlio_trace_tld_opener));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->inner = *inner;
+    internal->trace = (struct _eaarlio_trace *)trace->internal;
+    internal->memory = *memory;
+
+    *inner = eaarlio_tld_opener_empty();
+
+    tld_opener->open_tld = &_eaarlio_trace_tld_opener_open_tld;
+    tld_opener->close = &_eaarlio_trace_tld_opener_close;
+    tld_opener->opaque = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_trace_init(struct eaarlio_trace *trace,
+    struct eaarlio_stream *sink,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_trace *internal;
+    unsigned char buf[EAARLIO_TRACE_HEADER_SIZE];
+    eaarlio_error err;
+
+    if(!trace)
+        return EAARLIO_NULL;
+
+    *trace = eaarlio_trace_empty();
+
+    if(!sink)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(sink))
+        return EAARLIO_STREAM_INVALID;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    memcpy(buf, _EAARLIO_TRACE_MAGIC, _EAARLIO_TRACE_MAGIC_SIZE);
+    eaarlio_int_encode_uint16(buf + 8, _EAARLIO_TRACE_VERSION);
+    eaarlio_int_encode_uint16(buf + 10, 0);
+    eaarlio_int_encode_uint32(buf + 12, EAARLIO_TRACE_RECORD_SIZE);
+
+    err = sink->write(sink, EAARLIO_TRACE_HEADER_SIZE, buf);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    internal = memory->malloc(memory, sizeof(struct _eaarlio_trace));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    err = eaarlio_mutex_init(&internal->mutex);
+    if(err != EAARLIO_SUCCESS) {
+        memory->free(memory, internal);
+        return err;
+    }
+
+    internal->sink = sink;
+    internal->err = EAARLIO_SUCCESS;
+    internal->next_id = 1;
+    internal->epoch = eaarlio_clock();
+    internal->memory = *memory;
+
+    trace->internal = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_trace_free(struct eaarlio_trace *trace)
+{
+    struct _eaarlio_trace *internal;
+    struct eaarlio_memory memory;
+    eaarlio_error err;
+
+    if(!trace)
+        return EAARLIO_NULL;
+    if(!trace->internal)
+        return EAARLIO_SUCCESS;
+
+    internal = (struct _eaarlio_trace *)trace->internal;
+
+    err = internal->err;
+    eaarlio_mutex_destroy(&internal->mutex);
+    memory = internal->memory;
+    memory.free(&memory, internal);
+
+    *trace = eaarlio_trace_empty();
+
+    return err;
+}
+
+eaarlio_error eaarlio_trace_read_header(struct eaarlio_stream *stream)
+{
+    unsigned char buf[EAARLIO_TRACE_HEADER_SIZE];
+    eaarlio_error err;
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(stream))
+        return EAARLIO_STREAM_INVALID;
+
+    err = stream->read(stream, EAARLIO_TRACE_HEADER_SIZE, buf);
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        return EAARLIO_CORRUPT;
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(memcmp(buf, _EAARLIO_TRACE_MAGIC, _EAARLIO_TRACE_MAGIC_SIZE))
+        return EAARLIO_CORRUPT;
+    if(eaarlio_int_decode_uint16(buf + 8) != _EAARLIO_TRACE_VERSION)
+        return EAARLIO_CORRUPT;
+    if(eaarlio_int_decode_uint32(buf + 12) != EAARLIO_TRACE_RECORD_SIZE)
+        return EAARLIO_CORRUPT;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_trace_read_record(struct eaarlio_stream *stream,
+    struct eaarlio_trace_record *record)
+{
+    unsigned char buf[EAARLIO_TRACE_RECORD_SIZE];
+    eaarlio_error err;
+
+    if(!stream)
+        return EAARLIO_NULL;
+    if(!record)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(stream))
+        return EAARLIO_STREAM_INVALID;
+
+    err = stream->read(stream, EAARLIO_TRACE_RECORD_SIZE, buf);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    record->op = eaarlio_int_decode_uint8(buf);
+    record->whence = eaarlio_int_decode_uint8(buf + 1);
+    record->error = eaarlio_int_decode_uint16(buf + 2);
+    record->stream_id = eaarlio_int_decode_uint32(buf + 4);
+    record->offset = (int64_t)_eaarlio_trace_decode_uint64(buf + 8);
+    record->size = _eaarlio_trace_decode_uint64(buf + 16);
+    record->start_ns = _eaarlio_trace_decode_uint64(buf + 24);
+    record->latency_ns = _eaarlio_trace_decode_uint64(buf + 32);
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,279 @@
+#include "eaarlio/error.h"
+#include "eaarlio/wfpack.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(EAARLIO_NO_SIMD)                                                  \
+    && (defined(__SSE2__) || defined(_M_X64)                                   \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define _EAARLIO_WFPACK_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* Width of group g, from the nibbles at widths */
+static unsigned int _eaarlio_wfpack_width(unsigned char const *widths,
+    uint32_t g)
+{
+    return (widths[g / 2] >> ((g & 1U) * 4U)) & 0x0fU;
+}
+
+/* Validate the group widths of a packed waveform and find its size.
+ *
+ * On success, *data is set to the start of the group data and *in_len to the
+ * full packed size.
+ */
+static eaarlio_error _eaarlio_wfpack_layout(uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    unsigned char const **data,
+    uint32_t *in_len)
+{
+    uint32_t groups = EAARLIO_WFPACK_GROUPS(dst_len);
+    uint32_t size = 1U + (groups + 1U) / 2U;
+    uint32_t g;
+    unsigned int width;
+
+    if(src_len < size)
+        return EAARLIO_BUFFER_SHORT;
+
+    for(g = 0; g < groups; g++) {
+        width = _eaarlio_wfpack_width(src + 1, g);
+        if(width > 8)
+            return EAARLIO_CORRUPT;
+        size += 2U * width;
+    }
+
+    if(src_len < size)
+        return EAARLIO_BUFFER_SHORT;
+
+    *data = src + 1U + (groups + 1U) / 2U;
+    *in_len = size;
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_wfpack_encode(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *out_len)
+{
+    unsigned char zigzag[EAARLIO_WFPACK_GROUP];
+    unsigned char prev;
+    unsigned char bits;
+    unsigned int delta;
+    unsigned int width;
+    unsigned int mask;
+    unsigned int b, i;
+    uint32_t groups;
+    uint32_t pos;
+    uint32_t at;
+    uint32_t g;
+
+    if(!dst && dst_len)
+        return EAARLIO_NULL;
+    if(!src && src_len)
+        return EAARLIO_NULL;
+    if(!out_len)
+        return EAARLIO_NULL;
+
+    *out_len = 0;
+    if(!src_len)
+        return EAARLIO_SUCCESS;
+
+    groups = EAARLIO_WFPACK_GROUPS(src_len);
+    pos = 1U + (groups + 1U) / 2U;
+    if(dst_len < pos)
+        return EAARLIO_BUFFER_SHORT;
+
+    dst[0] = src[0];
+    memset(dst + 1, 0, pos - 1U);
+    prev = src[0];
+    at = 1;
+
+    for(g = 0; g < groups; g++) {
+        bits = 0;
+        for(i = 0; i < EAARLIO_WFPACK_GROUP; i++) {
+            if(at < src_len) {
+                /* Zigzag the delta as a signed 8-bit value */
+                delta = (unsigned char)(src[at] - prev);
+                zigzag[i] = (unsigned char)((delta << 1)
+                    ^ (delta & 0x80U ? 0xffU : 0));
+                prev = src[at];
+                at++;
+            } else {
+                zigzag[i] = 0;
+            }
+            bits |= zigzag[i];
+        }
+
+        width = 0;
+        while(bits >> width)
+            width++;
+
+        if(dst_len - pos < 2U * width)
+            return EAARLIO_BUFFER_SHORT;
+
+        dst[1 + g / 2] |= (unsigned char)(width << ((g & 1U) * 4U));
+
+        for(b = 0; b < width; b++) {
+            mask = 0;
+            for(i = 0; i < EAARLIO_WFPACK_GROUP; i++)
+                mask |= ((zigzag[i] >> b) & 1U) << i;
+            dst[pos++] = (unsigned char)(mask & 0xffU);
+            dst[pos++] = (unsigned char)(mask >> 8);
+        }
+    }
+
+    *out_len = pos;
+    return EAARLIO_SUCCESS;
+}
+
+/* Decode one full group of EAARLIO_WFPACK_GROUP samples into out */
+static void _eaarlio_wfpack_group_generic(unsigned char *out,
+    unsigned char const *planes,
+    unsigned int width,
+    unsigned char *prev)
+{
+    unsigned char zigzag[EAARLIO_WFPACK_GROUP];
+    unsigned int mask;
+    unsigned int b, i;
+
+    memset(zigzag, 0, sizeof(zigzag));
+    for(b = 0; b < width; b++) {
+        mask = planes[2 * b] | ((unsigned int)planes[2 * b + 1] << 8);
+        for(i = 0; i < EAARLIO_WFPACK_GROUP; i++)
+            zigzag[i] |= (unsigned char)(((mask >> i) & 1U) << b);
+    }
+
+    for(i = 0; i < EAARLIO_WFPACK_GROUP; i++) {
+        *prev = (unsigned char)(*prev
+            + ((zigzag[i] >> 1) ^ (unsigned char)(0U - (zigzag[i] & 1U))));
+        out[i] = *prev;
+    }
+}
+
+#ifdef _EAARLIO_WFPACK_SSE2
+/* SSE2 version of _eaarlio_wfpack_group_generic */
+static void _eaarlio_wfpack_group_sse2(unsigned char *out,
+    unsigned char const *planes,
+    unsigned int width,
+    unsigned char *prev)
+{
+    __m128i const select = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08,
+        0x04, 0x02, 0x01, (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    __m128i const one = _mm_set1_epi8(1);
+    __m128i zigzag = _mm_setzero_si128();
+    __m128i plane, half, sign, delta;
+    unsigned int b;
+    int lo, hi;
+
+    /* Spread each plane so that byte i holds the plane byte with bit i, then
+     * turn the selected bit into a whole byte and keep bit b of it.
+     */
+    for(b = 0; b < width; b++) {
+        lo = (int)(planes[2 * b] * 0x01010101U);
+        hi = (int)(planes[2 * b + 1] * 0x01010101U);
+        plane = _mm_set_epi32(hi, hi, lo, lo);
+        plane = _mm_cmpeq_epi8(_mm_and_si128(plane, select), select);
+        zigzag = _mm_or_si128(
+            zigzag, _mm_and_si128(plane, _mm_set1_epi8((char)(1 << b))));
+    }
+
+    half = _mm_and_si128(_mm_srli_epi16(zigzag, 1), _mm_set1_epi8(0x7f));
+    sign = _mm_cmpeq_epi8(_mm_and_si128(zigzag, one), one);
+    delta = _mm_xor_si128(half, sign);
+
+    /* Prefix sum of the deltas, then add the previous sample */
+    delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 1));
+    delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 2));
+    delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 4));
+    delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 8));
+    delta = _mm_add_epi8(delta, _mm_set1_epi8((char)*prev));
+
+    _mm_storeu_si128((__m128i *)out, delta);
+    *prev = out[EAARLIO_WFPACK_GROUP - 1];
+}
+#endif
+
+/* Shared body of the decoders, using group_fn for each group */
+static eaarlio_error _eaarlio_wfpack_decode(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *in_len,
+    void (*group_fn)(unsigned char *,
+        unsigned char const *,
+        unsigned int,
+        unsigned char *))
+{
+    unsigned char tail[EAARLIO_WFPACK_GROUP];
+    unsigned char const *data;
+    unsigned char prev;
+    unsigned int width;
+    eaarlio_error err;
+    uint32_t groups;
+    uint32_t pos;
+    uint32_t g;
+
+    if(!dst && dst_len)
+        return EAARLIO_NULL;
+    if(!src && src_len)
+        return EAARLIO_NULL;
+    if(!in_len)
+        return EAARLIO_NULL;
+
+    *in_len = 0;
+    if(!dst_len)
+        return EAARLIO_SUCCESS;
+
+    err = _eaarlio_wfpack_layout(dst_len, src, src_len, &data, in_len);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    groups = EAARLIO_WFPACK_GROUPS(dst_len);
+    prev = src[0];
+    dst[0] = prev;
+    pos = 1;
+
+    for(g = 0; g < groups; g++) {
+        width = _eaarlio_wfpack_width(src + 1, g);
+        if(dst_len - pos >= EAARLIO_WFPACK_GROUP) {
+            group_fn(dst + pos, data, width, &prev);
+            pos += EAARLIO_WFPACK_GROUP;
+        } else {
+            group_fn(tail, data, width, &prev);
+            memcpy(dst + pos, tail, dst_len - pos);
+            pos = dst_len;
+        }
+        data += 2U * width;
+    }
+
+    assert(pos == dst_len);
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_wfpack_decode_generic(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *in_len)
+{
+    return _eaarlio_wfpack_decode(
+        dst, dst_len, src, src_len, in_len, &_eaarlio_wfpack_group_generic);
+}
+
+eaarlio_error eaarlio_wfpack_decode(unsigned char *dst,
+    uint32_t dst_len,
+    unsigned char const *src,
+    uint32_t src_len,
+    uint32_t *in_len)
+{
+#ifdef _EAARLIO_WFPACK_SSE2
+    return _eaarlio_wfpack_decode(
+        dst, dst_len, src, src_len, in_len, &_eaarlio_wfpack_group_sse2);
+#else
+    return _eaarlio_wfpack_decode(
+        dst, dst_len, src, src_len, in_len, &_eaarlio_wfpack_group_generic);
+#endif
+}
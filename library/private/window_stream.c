@@ -0,0 +1,198 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_support.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/stream_support.h"
+#include "eaarlio/window_stream.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Internal state for a window stream
+ */
+struct _eaarlio_window_stream {
+    /** Stream containing the window; not owned */
+    struct eaarlio_stream *parent;
+    /** Start of the window in #parent */
+    uint64_t offset;
+    /** Size of the window */
+    uint64_t length;
+    /** Current position relative to #offset */
+    uint64_t position;
+    /** Memory handler */
+    struct eaarlio_memory memory;
+};
+
+static eaarlio_error _eaarlio_window_stream_close(struct eaarlio_stream *self)
+{
+    struct _eaarlio_window_stream *internal;
+    struct eaarlio_memory memory;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_window_stream *)self->data;
+    memory = internal->memory;
+    memory.free(&memory, internal);
+
+    *self = eaarlio_stream_empty();
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_window_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct _eaarlio_window_stream *internal;
+    struct eaarlio_stream *parent;
+    eaarlio_error err;
+    uint64_t avail;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!buf)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(len == 0)
+        return EAARLIO_SUCCESS;
+
+    internal = (struct _eaarlio_window_stream *)self->data;
+    parent = internal->parent;
+
+    avail = internal->position < internal->length
+        ? internal->length - internal->position
+        : 0;
+    if(avail > len)
+        avail = len;
+
+    if(avail) {
+        err = parent->seek(
+            parent, (int64_t)(internal->offset + internal->position), SEEK_SET);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        err = parent->read(parent, avail, buf);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        internal->position += avail;
+    }
+
+    if(avail < len)
+        return EAARLIO_STREAM_READ_SHORT;
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_window_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    (void)self;
+    (void)len;
+    (void)buf;
+    return EAARLIO_STREAM_NOT_IMPL;
+}
+
+static eaarlio_error _eaarlio_window_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct _eaarlio_window_stream *internal;
+    int64_t base;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+
+    internal = (struct _eaarlio_window_stream *)self->data;
+
+    switch(whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = (int64_t)internal->position;
+            break;
+        case SEEK_END:
+            base = (int64_t)internal->length;
+            break;
+        default:
+            return EAARLIO_STREAM_SEEK_INVALID;
+    }
+
+    if(offset < 0 && base < -offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+    if(offset > 0 && base > INT64_MAX - offset)
+        return EAARLIO_STREAM_SEEK_ERROR;
+
+    internal->position = (uint64_t)(base + offset);
+
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error _eaarlio_window_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct _eaarlio_window_stream *internal;
+
+    if(!self)
+        return EAARLIO_NULL;
+    if(!self->data)
+        return EAARLIO_STREAM_INVALID;
+    if(!position)
+        return EAARLIO_NULL;
+
+    internal = (struct _eaarlio_window_stream *)self->data;
+    *position = (int64_t)internal->position;
+
+    return EAARLIO_SUCCESS;
+}
+
+eaarlio_error eaarlio_window_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *parent,
+    uint64_t offset,
+    uint64_t length,
+    struct eaarlio_memory *memory)
+{
+    struct _eaarlio_window_stream *internal;
+
+    if(!stream)
+        return EAARLIO_NULL;
+
+    *stream = eaarlio_stream_empty();
+
+    if(!parent)
+        return EAARLIO_NULL;
+    if(!eaarlio_stream_valid(parent))
+        return EAARLIO_STREAM_INVALID;
+    if(offset > INT64_MAX || length > INT64_MAX - offset)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    if(!memory) {
+        memory = &eaarlio_memory_default;
+    } else if(!eaarlio_memory_valid(memory)) {
+        return EAARLIO_MEMORY_INVALID;
+    }
+
+    internal = memory->calloc(memory, 1, sizeof(struct _eaarlio_window_stream));
+    if(!internal)
+        return EAARLIO_MEMORY_ALLOC_FAIL;
+
+    internal->parent = parent;
+    internal->offset = offset;
+    internal->length = length;
+    internal->position = 0;
+    internal->memory = *memory;
+
+    stream->close = &_eaarlio_window_stream_close;
+    stream->read = &_eaarlio_window_stream_read;
+    stream->write = &_eaarlio_window_stream_write;
+    stream->seek = &_eaarlio_window_stream_seek;
+    stream->tell = &_eaarlio_window_stream_tell;
+    stream->data = (void *)internal;
+
+    return EAARLIO_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#ifndef EAARLIO_ARROW_H
+#define EAARLIO_ARROW_H
+
+/**
+ * @file
+ * @brief Write pulses in the Apache Arrow IPC format
+ *
+ * Arrow is a columnar in-memory format with readers for most analysis
+ * environments, including Python (pyarrow, pandas, polars), R, and Rust. Its
+ * IPC format stores the columns exactly as they are laid out in memory, so a
+ * reader can use the data in place, or memory-map a file, without parsing it.
+ *
+ * ::eaarlio_arrow_writer writes one row per pulse. The columns are:
+ *
+ * | Column            | Arrow type                |
+ * | ----------------- | ------------------------- |
+ * | raster_number     | uint32                    |
+ * | pulse_number      | uint16                    |
+ * | digitizer         | uint8                     |
+ * | time              | float64                   |
+ * | scan_angle        | float64                   |
+ * | time_offset       | uint32                    |
+ * | scan_angle_counts | int16                     |
+ * | range             | uint16                    |
+ * | rx_count          | uint8                     |
+ * | thresh_tx         | uint8                     |
+ * | thresh_rx         | uint8                     |
+ * | bias_tx           | uint8                     |
+ * | bias_rx           | fixed_size_list<uint8>[4] |
+ * | tx                | list<uint8>               |
+ * | rx                | list<list<uint8>>         |
+ *
+ * Most columns are the ::eaarlio_pulse fields of the same name. The
+ * @c pulse_number is the 1-based index of the pulse within its raster, and
+ * @c time and @c scan_angle are derived with ::eaarlio_units_pulse_time and
+ * ::eaarlio_units_pulse_scan_angle. The @c tx and @c rx columns are only
+ * present when waveforms are requested; @c rx holds
+ * ::eaarlio_pulse::rx_count waveforms for each pulse. No column contains
+ * nulls.
+ *
+ * Pulses are collected into record batches, which are written to the stream
+ * as each fills up. Only one batch is held in memory at a time.
+ *
+ * This writer is self-contained; it does not require the Arrow libraries.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * Write the Arrow IPC streaming format; for use with
+ * ::eaarlio_arrow_writer_init
+ *
+ * This can be written to pipes and sockets and read as it arrives. Files in
+ * this format conventionally use the extension @c .arrows.
+ */
+#define EAARLIO_ARROW_STREAM 0
+
+/**
+ * Write the Arrow IPC file format; for use with ::eaarlio_arrow_writer_init
+ *
+ * This adds a footer indexing the record batches, allowing random access to
+ * them. Files in this format conventionally use the extension @c .arrow.
+ */
+#define EAARLIO_ARROW_FILE 1
+
+/**
+ * Default number of pulses per record batch for ::eaarlio_arrow_writer
+ */
+#define EAARLIO_ARROW_BATCH_ROWS 65536U
+
+/**
+ * Arrow IPC writer
+ *
+ * The fields are managed by the eaarlio_arrow_writer_* functions and should
+ * not be modified directly.
+ */
+struct eaarlio_arrow_writer {
+    /** Stream being written to */
+    struct eaarlio_stream *stream;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Internal state data */
+    void *internal;
+};
+
+/**
+ * Empty eaarlio_arrow_writer value
+ *
+ * All pointers will be null.
+ */
+#define eaarlio_arrow_writer_empty()                                           \
+    (struct eaarlio_arrow_writer)                                              \
+    {                                                                          \
+        NULL, NULL, NULL                                                       \
+    }
+
+/**
+ * Initialize an Arrow IPC writer
+ *
+ * The schema is written to @p stream immediately.
+ *
+ * @param[out] writer Writer to initialize
+ * @param[in] stream Stream to write to; must remain open until
+ *      ::eaarlio_arrow_writer_close
+ * @param[in] format ::EAARLIO_ARROW_STREAM or ::EAARLIO_ARROW_FILE
+ * @param[in] include_waveforms Include the @c tx and @c rx columns? 1 = yes,
+ *      0 = no
+ * @param[in] batch_rows Number of pulses to collect before writing a record
+ *      batch, or 0 for ::EAARLIO_ARROW_BATCH_ROWS
+ * @param[in] memory Memory handler, or NULL for stdlib. If provided, it must
+ *      remain valid until ::eaarlio_arrow_writer_close.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p format is invalid
+ *
+ * @post On success, @p writer must be released with
+ *      ::eaarlio_arrow_writer_close.
+ * @post On failure, @p writer is empty.
+ *
+ * @remark With ::EAARLIO_ARROW_FILE, the file must start where @p stream is
+ *      positioned when this is called.
+ */
+eaarlio_error eaarlio_arrow_writer_init(struct eaarlio_arrow_writer *writer,
+    struct eaarlio_stream *stream,
+    int format,
+    int include_waveforms,
+    uint32_t batch_rows,
+    struct eaarlio_memory *memory);
+
+/**
+ * Add a raster's pulses to an Arrow IPC writer
+ *
+ * The pulses are copied immediately, so the raster may be modified or
+ * released as soon as this returns. A record batch is written once the
+ * pending batch holds at least as many pulses as the writer's batch size;
+ * the pulses of a raster are never split between batches.
+ *
+ * @param[in,out] writer Writer to use
+ * @param[in] raster_number Raster number of @p raster
+ * @param[in] raster Raster to write. If its ::eaarlio_raster::pulse is
+ *      @c NULL, nothing is written.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if the raster's waveforms are too large
+ *      to fit in a single record batch
+ *
+ * @post On failure to add @p raster, nothing is added to the writer. On
+ *      failure to write a batch, the batch's data is discarded.
+ */
+eaarlio_error eaarlio_arrow_writer_write_raster(
+    struct eaarlio_arrow_writer *writer,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster);
+
+/**
+ * Write any pending pulses in an Arrow IPC writer as a record batch
+ *
+ * @param[in,out] writer Writer to flush
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_arrow_writer_flush(struct eaarlio_arrow_writer *writer);
+
+/**
+ * Finish and release an Arrow IPC writer
+ *
+ * Any pending pulses are written, followed by the end-of-stream marker and,
+ * for ::EAARLIO_ARROW_FILE, the footer. The stream itself is not closed.
+ *
+ * @param[in,out] writer Writer to close
+ *
+ * @returns_eaarlio_error
+ *
+ * @post @p writer is empty, even on failure.
+ */
+eaarlio_error eaarlio_arrow_writer_close(struct eaarlio_arrow_writer *writer);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef EAARLIO_COMPRESSED_STREAM_H
+#define EAARLIO_COMPRESSED_STREAM_H
+
+/**
+ * @file
+ * @brief Block-compressed streams with random access
+ *
+ * This header provides support for a compressed container that stores a
+ * stream's bytes in independently compressed blocks, along with an index of
+ * where each block is stored. Any position can be reached by decompressing a
+ * single block, so a compressed TLD file can be read through the normal
+ * ::eaarlio_stream interface and the record offsets in an EDB file remain
+ * valid. The format is described at @ref md_compressed_format.
+ *
+ * The compression codec is built into the library, so no external dependency
+ * is needed.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * File name suffix for compressed files
+ *
+ * ::eaarlio_file_tld_opener looks for a TLD file's name with this suffix
+ * appended.
+ */
+#define EAARLIO_COMPRESSED_SUFFIX ".z"
+
+/**
+ * Default uncompressed size of each block, in bytes
+ *
+ * Smaller blocks make random access cheaper, since a whole block has to be
+ * decompressed to read any part of it. Larger blocks compress slightly better.
+ */
+#define EAARLIO_COMPRESSED_BLOCK_SIZE 65536U
+
+/**
+ * Largest permitted uncompressed block size, in bytes
+ */
+#define EAARLIO_COMPRESSED_BLOCK_SIZE_MAX 16777216U
+
+/**
+ * Compress the contents of a stream
+ *
+ * The whole of @p in, from its start to its end, is compressed and written to
+ * @p out.
+ *
+ * @param[in,out] out Stream to write the compressed container to. It must be
+ *      empty and must support seeking, since the header is completed last.
+ * @param[in,out] in Stream to compress. It must support seeking with
+ *      @c SEEK_END.
+ * @param[in] block_size Uncompressed size of each block, or 0 for
+ *      ::EAARLIO_COMPRESSED_BLOCK_SIZE
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p block_size exceeds
+ *      ::EAARLIO_COMPRESSED_BLOCK_SIZE_MAX or @p in has too many blocks
+ *
+ * @post On success, @p out is positioned at the end of the container.
+ */
+eaarlio_error eaarlio_compress_stream(struct eaarlio_stream *out,
+    struct eaarlio_stream *in,
+    uint32_t block_size,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a read-only stream over a compressed container
+ *
+ * Reads and seeks on @p stream work in terms of the original, uncompressed
+ * data. The most recently used block is kept decompressed, so sequential
+ * reads only decompress each block once. Writing is not supported.
+ *
+ * @param[out] stream Stream to initialize
+ * @param[in,out] inner Stream containing the compressed container, starting
+ *      at its beginning. It must support seeking with @c SEEK_SET.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if @p inner does not contain a valid container
+ *
+ * @post On success, @p stream takes ownership of @p inner, which is set to
+ *      empty. Closing @p stream closes it.
+ * @post On failure, @p inner is left to the caller.
+ */
+eaarlio_error eaarlio_compressed_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_memory *memory);
+
+#endif
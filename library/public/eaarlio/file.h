@@ -10,12 +10,58 @@
  * with normal files.
  */
 
+#include "eaarlio/compressed_stream.h"
 #include "eaarlio/error.h"
 #include "eaarlio/flight.h"
+#include "eaarlio/flight_writer.h"
 #include "eaarlio/memory.h"
 #include "eaarlio/stream.h"
 #include "eaarlio/tld_opener.h"
 
+/**
+ * Pick the fastest available backend
+ *
+ * For use with ::eaarlio_file_flight_fetch.
+ */
+#define EAARLIO_FETCH_AUTO 0
+
+/**
+ * Read through the flight's TLD opener, as ::eaarlio_flight_plan does
+ *
+ * For use with ::eaarlio_file_flight_fetch. This backend is always available.
+ */
+#define EAARLIO_FETCH_STREAM 1
+
+/**
+ * Read with one positional read (pread) per extent
+ *
+ * For use with ::eaarlio_file_flight_fetch. Available on POSIX platforms.
+ */
+#define EAARLIO_FETCH_PREAD 2
+
+/**
+ * Read with many queued requests through io_uring
+ *
+ * For use with ::eaarlio_file_flight_fetch. Available on Linux when the library
+ * is built with io_uring support and the running kernel permits it.
+ */
+#define EAARLIO_FETCH_IO_URING 3
+
+/**
+ * Default number of reads kept in flight by ::eaarlio_file_flight_fetch
+ */
+#define EAARLIO_FETCH_QUEUE_DEPTH 32U
+
+/**
+ * Default buffer size for ::eaarlio_file_direct_stream
+ */
+#define EAARLIO_FILE_DIRECT_BUFFER_SIZE 1048576U
+
+/**
+ * Default number of descriptors kept by ::eaarlio_file_shared_tld_opener
+ */
+#define EAARLIO_FILE_SHARED_MAX_OPEN 64U
+
 /**
  * Open an eaarlio_flight using normal files
  *
@@ -37,6 +83,26 @@ eaarlio_error eaarlio_file_flight(struct eaarlio_flight *flight,
     char const *tld_path,
     struct eaarlio_memory *memory);
 
+/**
+ * Open an eaarlio_flight from a flight pack file
+ *
+ * This opens @p pack_file with ::eaarlio_file_stream and passes it to
+ * ::eaarlio_pack_open_flight, so the whole flight is read through a single
+ * open file.
+ *
+ * @param[out] flight Pointer to flight to be populated
+ * @param[in] pack_file Path to the pack file to load
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * Anything from eaarlio_file_stream
+ * Anything from eaarlio_pack_open_flight
+ */
+eaarlio_error eaarlio_file_pack_flight(struct eaarlio_flight *flight,
+    char const *pack_file,
+    struct eaarlio_memory *memory);
+
 /**
  * Open a stream for a normal file
  *
@@ -55,6 +121,23 @@ eaarlio_error eaarlio_file_stream(
     /** Mode to open the file as */
     char const *mode);
 
+/**
+ * Flush a stream from ::eaarlio_file_stream to durable storage
+ *
+ * This flushes the C library's buffers and then asks the operating system to
+ * commit the file's data to disk (fsync on POSIX systems). It can be passed
+ * to ::eaarlio_tld_writer_init.
+ *
+ * @param[in] stream Stream opened with ::eaarlio_file_stream
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_INVALID if @p stream was not opened with
+ *      ::eaarlio_file_stream
+ * @retval ::EAARLIO_STREAM_WRITE_ERROR if the data could not be flushed
+ */
+eaarlio_error eaarlio_file_stream_sync(struct eaarlio_stream *stream);
+
 /**
  * Open a tld_opener using normal files
  */
@@ -62,4 +145,320 @@ eaarlio_error eaarlio_file_tld_opener(struct eaarlio_tld_opener *tld_opener,
     char const *tld_path,
     struct eaarlio_memory *memory);
 
+/**
+ * Open a tld_opener using normal files, some of which may be compressed
+ *
+ * This is the same as ::eaarlio_file_tld_opener except that when a TLD file
+ * is missing from @p tld_path, a compressed copy named with
+ * ::EAARLIO_COMPRESSED_SUFFIX appended is used instead and read through
+ * ::eaarlio_compressed_stream. A TLD file that exists is always used in
+ * preference to its compressed copy.
+ *
+ * @remark Opening a file that is only present compressed costs one failed
+ *      open of the plain name first.
+ */
+eaarlio_error eaarlio_file_compressed_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *tld_path,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a tld_opener that searches several directories
+ *
+ * Each TLD file is looked for in @p tld_paths in order, and the first match
+ * is used. If the file is in none of the directories, they are searched again
+ * for a compressed copy, as ::eaarlio_file_compressed_tld_opener uses.
+ *
+ * Where each file was found is remembered for the life of the opener. Later
+ * requests for the same file open the path that was found directly, without
+ * probing the other directories again. This avoids repeated failed opens when
+ * the directories are on slow or remote filesystems. If a remembered file can
+ * no longer be opened, it is searched for again. Files that were not found
+ * are remembered too, and later requests for them fail without probing the
+ * directories; call ::eaarlio_file_multi_tld_opener_forget after adding files
+ * so that they are searched for again.
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in] tld_paths Directories to search, in order of preference
+ * @param[in] path_count Number of entries in @p tld_paths
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p path_count is 0
+ *
+ * The opener's @c open_tld returns ::EAARLIO_STREAM_OPEN_ERROR if the file is
+ * in none of the directories. Its @c open_tld and @c close return
+ * ::EAARLIO_TLD_OPENER_INVALID if its internal state is missing.
+ *
+ * @warning The opener's @c open_tld updates its cache, so it must not be
+ *      called from more than one thread at a time.
+ */
+eaarlio_error eaarlio_file_multi_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *const *tld_paths,
+    uint32_t path_count,
+    struct eaarlio_memory *memory);
+
+/**
+ * Forget the files a multi-directory tld_opener did not find
+ *
+ * Files that were found stay remembered. The next request for any other file
+ * searches every directory again.
+ *
+ * @param[in,out] tld_opener Opener from ::eaarlio_file_multi_tld_opener
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_TLD_OPENER_INVALID if @p tld_opener is not a
+ *      multi-directory opener
+ *
+ * @warning Like the opener's @c open_tld, this must not be called from more
+ *      than one thread at a time.
+ */
+eaarlio_error eaarlio_file_multi_tld_opener_forget(
+    struct eaarlio_tld_opener *tld_opener);
+
+/**
+ * Open a tld_opener that shares file descriptors between flights
+ *
+ * This opener keeps a pool of file descriptors, one per TLD file, and opens
+ * each file only once for as long as it stays in the pool. The streams it
+ * returns are small handles that read from the pooled descriptor with
+ * positional reads (pread), each keeping its own position, so any number of
+ * streams can read the same file at once without reopening it.
+ *
+ * Use ::eaarlio_file_shared_tld_opener_share to give other flights, such as
+ * one per worker thread, handles to the same pool. The pool and its
+ * descriptors are reference counted, and are released once every handle and
+ * every stream opened through them has been closed.
+ *
+ * Files are looked up in @p tld_path. When a file is missing, its compressed
+ * copy is used instead, as for ::eaarlio_file_compressed_tld_opener.
+ *
+ * @p max_open is not a hard limit on open descriptors; it only decides when
+ * idle ones are closed. Whenever more than @p max_open are open, descriptors
+ * that no stream is reading are closed, least recently used first. A
+ * descriptor that a stream is reading is never closed, so while streams are
+ * open on more than @p max_open files, the pool holds one descriptor for each
+ * of them.
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in] tld_path Path where the TLD files are located
+ * @param[in] max_open Number of descriptors to keep open when idle, or 0
+ *      for ::EAARLIO_FILE_SHARED_MAX_OPEN
+ * @param[in] memory Memory handler, or NULL for stdlib. It is used from
+ *      whichever thread opens or closes a stream, so it must be thread-safe if
+ *      the opener is shared between threads.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_NOT_IMPL if positional reads are not available on
+ *      this platform
+ *
+ * @remark Handles and streams may be used from different threads at the same
+ *      time if the library was built with thread support. Each individual
+ *      stream must still only be used by one thread at a time.
+ */
+eaarlio_error eaarlio_file_shared_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *tld_path,
+    uint32_t max_open,
+    struct eaarlio_memory *memory);
+
+/**
+ * Create another handle to a shared tld_opener
+ *
+ * @p copy uses the same descriptor pool as @p tld_opener, and must be closed
+ * separately. It is typically stored as the @c tld_opener of another flight.
+ *
+ * @param[out] copy TLD opener to initialize
+ * @param[in] tld_opener Opener from ::eaarlio_file_shared_tld_opener, or a
+ *      handle from this function
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_TLD_OPENER_INVALID if @p tld_opener is not a shared
+ *      opener
+ */
+eaarlio_error eaarlio_file_shared_tld_opener_share(
+    struct eaarlio_tld_opener *copy,
+    struct eaarlio_tld_opener const *tld_opener);
+
+/**
+ * Open a tld_opener for TLD files stored in a tar archive
+ *
+ * This opens @p tar_file with ::eaarlio_file_stream and passes it to
+ * ::eaarlio_tar_tld_opener, so the TLD files are read directly from the
+ * archive without extracting them.
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in] tar_file Path to the tar archive
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * Anything from eaarlio_file_stream
+ * Anything from eaarlio_tar_tld_opener
+ */
+eaarlio_error eaarlio_file_tar_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *tar_file,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a read-only stream for a normal file that bypasses the page cache
+ *
+ * This is intended for one-pass scans over large amounts of data, such as
+ * building an index or exporting a whole flight, where caching the data would
+ * only evict pages that other processes on the same machine still need.
+ *
+ * Where supported, the file is opened with @c O_DIRECT and read in aligned
+ * blocks of @p buffer_size bytes into an aligned buffer. Reads, seeks, and
+ * tells at arbitrary positions are served from that buffer, so the stream can
+ * be used anywhere a stream from ::eaarlio_file_stream can be used for
+ * reading. If the filesystem does not support @c O_DIRECT, the file is read
+ * normally and each block is dropped from the page cache with
+ * @c posix_fadvise once it has been buffered. On platforms with neither, this
+ * is equivalent to ::eaarlio_file_stream with mode @c "r".
+ *
+ * The write function of the stream returns ::EAARLIO_STREAM_NOT_IMPL.
+ *
+ * @param[out] stream Stream to open the file with
+ * @param[in] fn Path to file to open
+ * @param[in] buffer_size Size of the read buffer in bytes, or 0 for
+ *      ::EAARLIO_FILE_DIRECT_BUFFER_SIZE. Rounded up to a multiple of the
+ *      alignment required for direct I/O.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @remark Random access works, but each seek outside the current block costs
+ *      a full uncached read of @p buffer_size bytes. Use ::eaarlio_file_stream
+ *      for random access instead.
+ */
+eaarlio_error eaarlio_file_direct_stream(struct eaarlio_stream *stream,
+    char const *fn,
+    uint32_t buffer_size,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a tld_opener using normal files that bypasses the page cache
+ *
+ * This is the same as ::eaarlio_file_tld_opener except that TLD files are
+ * opened with ::eaarlio_file_direct_stream using the default buffer size.
+ */
+eaarlio_error eaarlio_file_direct_tld_opener(
+    struct eaarlio_tld_opener *tld_opener,
+    char const *tld_path,
+    struct eaarlio_memory *memory);
+
+/**
+ * Check whether a backend for ::eaarlio_file_flight_fetch is available
+ *
+ * @param[in] backend One of ::EAARLIO_FETCH_STREAM, ::EAARLIO_FETCH_PREAD, or
+ *      ::EAARLIO_FETCH_IO_URING. ::EAARLIO_FETCH_AUTO is always available.
+ *
+ * @retval 1 if the backend can be used
+ * @retval 0 if the backend cannot be used
+ *
+ * @remark For ::EAARLIO_FETCH_IO_URING, this probes the running kernel, since
+ *      io_uring may be disabled or restricted even when the library was built
+ *      with support for it.
+ */
+int eaarlio_file_fetch_available(int backend);
+
+/**
+ * Retrieve a batch of rasters from TLD files using queued reads
+ *
+ * This is a file-based counterpart to ::eaarlio_flight_plan. The rasters are
+ * planned the same way (sorted by file and offset and merged into larger
+ * extents), but the reads are issued directly against the TLD files in
+ * @p tld_path rather than through @p flight->tld_opener.
+ *
+ * With ::EAARLIO_FETCH_IO_URING, up to @p queue_depth reads are submitted at
+ * once into a ring of fixed buffers and each buffer is decoded as soon as its
+ * read completes. This lets a single thread keep a fast drive busy. Rasters
+ * are therefore delivered in completion order, which may differ from both the
+ * request order and the disk order; use the @c index argument of @p fn to
+ * place them.
+ *
+ * With ::EAARLIO_FETCH_PREAD, extents are read one at a time with positional
+ * reads and rasters are delivered in disk order. With ::EAARLIO_FETCH_STREAM,
+ * this calls ::eaarlio_flight_plan with ::EAARLIO_FLIGHT_ORDER_DISK.
+ * ::EAARLIO_FETCH_AUTO uses the first of io_uring, pread, and stream that is
+ * available.
+ *
+ * Each TLD file is opened when its first extent is read and closed once its
+ * last extent has been read, so only the files with reads in progress are
+ * held open.
+ *
+ * @param[in] flight Flight whose EDB data and memory handler should be used
+ * @param[in] tld_path Path where the associated TLD files are located
+ * @param[in] raster_numbers Raster numbers to retrieve
+ * @param[in] raster_count Number of entries in @p raster_numbers
+ * @param[in] backend One of the @c EAARLIO_FETCH_ values
+ * @param[in] queue_depth Number of reads to keep in flight, or 0 for
+ *      ::EAARLIO_FETCH_QUEUE_DEPTH. Only used by ::EAARLIO_FETCH_IO_URING.
+ * @param[in] include_pulses Should pulse data be read? 1 = yes, 0 = no
+ * @param[in] include_waveforms Should waveform data be read? 1 = yes, 0 = no
+ * @param[in] fn Callback to receive each raster
+ * @param[in] ctx Context pointer passed through to @p fn
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_NOT_IMPL if @p backend is not available
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ *
+ * @post All raster numbers are validated against the EDB before any data is
+ *      read, as for ::eaarlio_flight_plan.
+ * @post On failure, @p fn may have been called for some of the rasters.
+ */
+eaarlio_error eaarlio_file_flight_fetch(struct eaarlio_flight *flight,
+    char const *tld_path,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    int backend,
+    unsigned int queue_depth,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx);
+
+/**
+ * Start writing a new TLD file in a directory
+ *
+ * This opens @p tld_path/@p tld_file for writing with ::eaarlio_file_stream and
+ * passes it to ::eaarlio_flight_writer_open_tld.
+ *
+ * @param[in,out] writer Writer to use
+ * @param[in] tld_path Directory to create the TLD file in
+ * @param[in] tld_file Name of the TLD file to create
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_file_flight_writer_open_tld(
+    struct eaarlio_flight_writer *writer,
+    char const *tld_path,
+    char const *tld_file);
+
+/**
+ * Finish all writing and write the EDB to a file
+ *
+ * This finishes the current TLD file, then creates @p edb_file with
+ * ::eaarlio_file_stream and passes it to ::eaarlio_flight_writer_close.
+ *
+ * @param[in,out] writer Writer to close
+ * @param[in] edb_file Path of the EDB file to create
+ *
+ * @returns_eaarlio_error
+ *
+ * @post @p writer is empty, even on failure.
+ * @post If the TLD data could not be finished, @p edb_file is not created.
+ */
+eaarlio_error eaarlio_file_flight_writer_close(
+    struct eaarlio_flight_writer *writer,
+    char const *edb_file);
+
 #endif
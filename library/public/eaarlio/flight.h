@@ -13,6 +13,7 @@
 #include "eaarlio/error.h"
 #include "eaarlio/memory.h"
 #include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
 #include "eaarlio/tld_opener.h"
 
 /**
@@ -146,6 +147,239 @@ eaarlio_error eaarlio_flight_read_raster(struct eaarlio_flight *flight,
     int include_pulses,
     int include_waveforms);
 
+/**
+ * Default size limit, in bytes, for a single read issued by
+ * ::eaarlio_flight_plan
+ */
+#define EAARLIO_FLIGHT_PLAN_MAX_READ 4194304U
+
+/**
+ * Deliver rasters in the order they are stored on disk
+ *
+ * For use with ::eaarlio_flight_plan.
+ */
+#define EAARLIO_FLIGHT_ORDER_DISK 0
+
+/**
+ * Deliver rasters in the order they were requested
+ *
+ * For use with ::eaarlio_flight_plan.
+ *
+ * @remark Rasters read ahead of their turn are held, decoded, until they can
+ *      be delivered. In the worst case, such as a request list in reverse disk
+ *      order, every requested raster is in memory at once. Split very large
+ *      requests into smaller calls to bound this.
+ */
+#define EAARLIO_FLIGHT_ORDER_CALLER 1
+
+/**
+ * Callback that receives rasters read from a flight
+ *
+ * @param[in] ctx The context pointer given by the caller
+ * @param[in] index Position of the raster in the caller's request list
+ * @param[in] raster_number Raster number of @p raster
+ * @param[in] raster The raster data
+ * @param[in] time_offset The time offset for the raster, as for
+ *      ::eaarlio_flight_read_raster
+ *
+ * @returns_eaarlio_error
+ *
+ * @remark Returning anything other than ::EAARLIO_SUCCESS stops processing
+ *      and the value is returned to the caller.
+ * @remark The memory held by @p raster is released after the callback
+ *      returns. If you need the data afterwards, you must copy it.
+ */
+typedef eaarlio_error (*eaarlio_flight_raster_fn)(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset);
+
+/**
+ * Retrieve data for a batch of rasters using planned access
+ *
+ * Unlike calling ::eaarlio_flight_read_raster for each raster, this sorts the
+ * requested rasters by TLD file and record offset, then merges neighboring
+ * records into larger reads of up to @p max_read bytes. Each TLD file is
+ * visited once and is read front to back, which makes scattered selections
+ * (such as every tenth raster) close to sequential I/O.
+ *
+ * Each raster is passed to @p fn as it becomes available. With
+ * ::EAARLIO_FLIGHT_ORDER_DISK, rasters are delivered in the order they are
+ * read from disk. With ::EAARLIO_FLIGHT_ORDER_CALLER, rasters are delivered in
+ * the order given by @p raster_numbers; rasters that are read before their
+ * turn are held in memory until they can be delivered.
+ *
+ * @param[in] flight Flight to use to retrieve the rasters
+ * @param[in] raster_numbers Raster numbers to retrieve. The list does not need
+ *      to be sorted and may contain duplicates.
+ * @param[in] raster_count Number of entries in @p raster_numbers
+ * @param[in] order Either ::EAARLIO_FLIGHT_ORDER_DISK or
+ *      ::EAARLIO_FLIGHT_ORDER_CALLER
+ * @param[in] max_read Largest read to issue, in bytes, or 0 for
+ *      ::EAARLIO_FLIGHT_PLAN_MAX_READ. A record larger than this is still read
+ *      in full.
+ * @param[in] include_pulses Should pulse data be read? 1 = yes, 0 = no
+ * @param[in] include_waveforms Should waveform data be read? 1 = yes, 0 = no
+ * @param[in] fn Callback to receive each raster
+ * @param[in] ctx Context pointer passed through to @p fn
+ *
+ * @returns_eaarlio_error
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ *
+ * @post All raster numbers are validated against the EDB before any data is
+ *      read. If any are invalid, ::EAARLIO_FLIGHT_RASTER_INVALID or
+ *      ::EAARLIO_CORRUPT is returned and @p fn is never called.
+ * @post On failure, @p fn may have been called for some of the rasters.
+ *
+ * @remark Like ::eaarlio_flight_read_raster, this leaves the flight's internal
+ *      stream open to the last TLD file accessed.
+ */
+eaarlio_error eaarlio_flight_plan(struct eaarlio_flight *flight,
+    uint32_t const *raster_numbers,
+    uint32_t raster_count,
+    int order,
+    uint32_t max_read,
+    int include_pulses,
+    int include_waveforms,
+    eaarlio_flight_raster_fn fn,
+    void *ctx);
+
+/**
+ * Decode pulse data
+ *
+ * Flag for ::eaarlio_flight_parallel_for.
+ */
+#define EAARLIO_FLIGHT_INCLUDE_PULSES 1
+
+/**
+ * Decode waveform data
+ *
+ * Flag for ::eaarlio_flight_parallel_for. Waveforms are only decoded if
+ * ::EAARLIO_FLIGHT_INCLUDE_PULSES is also given.
+ */
+#define EAARLIO_FLIGHT_INCLUDE_WAVEFORMS 2
+
+/**
+ * Size limit, in bytes, for a single unit of work in
+ * ::eaarlio_flight_parallel_for
+ */
+#define EAARLIO_FLIGHT_PARALLEL_CHUNK 1048576U
+
+/**
+ * Retrieve data for a range of rasters using several threads
+ *
+ * The range is split into chunks of neighboring records within the same TLD
+ * file, of up to ::EAARLIO_FLIGHT_PARALLEL_CHUNK bytes each. Each thread
+ * starts with an even share of the chunks, in disk order, and opens its own
+ * stream for each TLD file it visits. A thread that finishes its share takes
+ * chunks from the end of another thread's share, so a slow file or a slow
+ * callback does not leave the other threads idle.
+ *
+ * The calling thread takes part in the work. Without thread support, the
+ * chunks are all processed by the calling thread.
+ *
+ * @param[in] flight Flight to use to retrieve the rasters
+ * @param[in] first First raster number to retrieve
+ * @param[in] last Last raster number to retrieve (inclusive)
+ * @param[in] flags Zero or more of ::EAARLIO_FLIGHT_INCLUDE_PULSES and
+ *      ::EAARLIO_FLIGHT_INCLUDE_WAVEFORMS, combined with bitwise or
+ * @param[in] nthreads Number of threads to use, or 0 for one per processor.
+ *      No more threads are used than there are chunks.
+ * @param[in] fn Callback to receive each raster. The index passed to @p fn is
+ *      the raster number minus @p first.
+ * @param[in] ctx Context pointer passed through to @p fn
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p first is greater than @p last or
+ *      @p flags contains an unknown flag
+ * @retval ::EAARLIO_FLIGHT_RASTER_INVALID if the range is not within the EDB
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ * @pre The flight's memory handler must be safe to use from several threads
+ *      at once. ::eaarlio_memory_default is.
+ * @pre Streams returned by the flight's TLD opener must be usable
+ *      independently of each other. This is true of
+ *      ::eaarlio_file_tld_opener, ::eaarlio_file_multi_tld_opener, and
+ *      ::eaarlio_file_shared_tld_opener, but not of openers that read from a
+ *      single underlying stream, such as ::eaarlio_tar_tld_opener. The
+ *      opener itself is only used by one thread at a time.
+ *
+ * @post On failure, @p fn may have been called for some of the rasters. The
+ *      other threads stop after their current chunk, and the first error
+ *      encountered is returned.
+ *
+ * @remark @p fn is called from several threads at once and in no particular
+ *      order. It must synchronize any access to shared state itself.
+ * @remark The flight's internal stream is not used or changed.
+ */
+eaarlio_error eaarlio_flight_parallel_for(struct eaarlio_flight *flight,
+    uint32_t first,
+    uint32_t last,
+    int flags,
+    uint32_t nthreads,
+    eaarlio_flight_raster_fn fn,
+    void *ctx);
+
+/**
+ * Start or stop collecting statistics for a flight
+ *
+ * While enabled, the flight counts and times its TLD opens and stream calls,
+ * counts the allocations made through its memory handler, and counts and
+ * times the rasters it decodes. This covers ::eaarlio_flight_read_raster,
+ * ::eaarlio_flight_plan, ::eaarlio_flight_parallel_for, and
+ * ::eaarlio_file_flight_fetch. Retrieve the results with
+ * ::eaarlio_flight_stats.
+ *
+ * Statistics are disabled when a flight is initialized. Changing the setting
+ * closes the flight's internal stream, so that the next TLD file opened is
+ * counted from the start. Disabling collection keeps the counts collected so
+ * far.
+ *
+ * @param[in,out] flight Flight to change
+ * @param[in] enable Collect statistics? 1 = yes, 0 = no
+ *
+ * @returns_eaarlio_error
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ *
+ * @remark The backends of ::eaarlio_file_flight_fetch that bypass streams do
+ *      not count their reads; their decoding and allocations are counted.
+ */
+eaarlio_error eaarlio_flight_stats_enable(struct eaarlio_flight *flight,
+    int enable);
+
+/**
+ * Retrieve the statistics collected for a flight
+ *
+ * @param[in] flight Flight to use
+ * @param[out] stats Statistics collected since the flight was initialized or
+ *      since the last ::eaarlio_flight_stats_reset
+ *
+ * @returns_eaarlio_error
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ *
+ * @remark Allocations are counted when they are made by the flight. Rasters
+ *      returned by ::eaarlio_flight_read_raster are released by the caller,
+ *      so those frees are not counted.
+ */
+eaarlio_error eaarlio_flight_stats(struct eaarlio_flight const *flight,
+    struct eaarlio_stats *stats);
+
+/**
+ * Reset the statistics collected for a flight to zero
+ *
+ * @param[in,out] flight Flight to reset
+ *
+ * @returns_eaarlio_error
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ */
+eaarlio_error eaarlio_flight_stats_reset(struct eaarlio_flight *flight);
+
 /**
  * Release resources held by ::eaarlio_flight
  *
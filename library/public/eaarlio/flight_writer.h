@@ -0,0 +1,186 @@
+#ifndef EAARLIO_FLIGHT_WRITER_H
+#define EAARLIO_FLIGHT_WRITER_H
+
+/**
+ * @file
+ * @brief Write TLD files and their EDB index in a single pass
+ *
+ * Producing a new flight normally means writing the TLD files and then
+ * scanning them again with eaarlio_edb_create to build the index. The writer
+ * in this header records each raster's EDB entry as the raster is written, so
+ * the EDB can be written directly once the TLD files are complete.
+ */
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include <stdint.h>
+
+/**
+ * Writer for a flight's TLD files and EDB index
+ *
+ * Rasters are written to one TLD file at a time using an
+ * ::eaarlio_tld_writer. The fields are managed by the eaarlio_flight_writer_*
+ * functions and should not be modified directly, but the EDB data may be
+ * inspected at any time.
+ *
+ * @warning The writer refers to its own fields internally, so it must not be
+ *      copied or moved while a TLD file is open.
+ */
+struct eaarlio_flight_writer {
+    /** EDB data for everything written so far */
+    struct eaarlio_edb edb;
+    /** Allocated number of entries in @c edb.records */
+    uint32_t record_capacity;
+    /** Stream for the TLD file currently being written */
+    struct eaarlio_stream stream;
+    /** Buffered writer for @c stream */
+    struct eaarlio_tld_writer tld;
+    /** Block size passed to ::eaarlio_tld_writer_init */
+    uint32_t block_size;
+    /** Sync function passed to ::eaarlio_tld_writer_init */
+    eaarlio_stream_sync_fn sync;
+    /** Sync policy passed to ::eaarlio_tld_writer_init */
+    int sync_policy;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Record type passed to ::eaarlio_tld_writer_set_record_type */
+    uint8_t record_type;
+};
+
+/**
+ * Empty ::eaarlio_flight_writer value
+ *
+ * All numeric fields will contain zero values. All pointers will be null.
+ */
+#define eaarlio_flight_writer_empty()                                          \
+    (struct eaarlio_flight_writer)                                             \
+    {                                                                          \
+        eaarlio_edb_empty(), 0, eaarlio_stream_empty(),                        \
+            eaarlio_tld_writer_empty(), 0, NULL, 0, NULL, 0                    \
+    }
+
+/**
+ * Initialize a flight writer
+ *
+ * @param[out] writer Writer to initialize
+ * @param[in] block_size Block size for each TLD file, or 0 for
+ *      ::EAARLIO_TLD_WRITER_BLOCK_SIZE
+ * @param[in] sync Function to sync each TLD stream with, or @c NULL
+ * @param[in] sync_policy One of the @c EAARLIO_TLD_SYNC_ values
+ * @param[in] memory Memory handler, or NULL for stdlib. If provided, it must
+ *      remain valid until ::eaarlio_flight_writer_close.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p sync_policy is invalid, or if it
+ *      is not ::EAARLIO_TLD_SYNC_NEVER and @p sync is @c NULL
+ *
+ * @post On success, @p writer must be released with
+ *      ::eaarlio_flight_writer_close.
+ */
+eaarlio_error eaarlio_flight_writer_init(struct eaarlio_flight_writer *writer,
+    uint32_t block_size,
+    eaarlio_stream_sync_fn sync,
+    int sync_policy,
+    struct eaarlio_memory *memory);
+
+/**
+ * Choose the record type rasters are written as
+ *
+ * This applies ::eaarlio_tld_writer_set_record_type to the current TLD file
+ * and to every TLD file opened afterward. Rasters are written as
+ * ::EAARLIO_TLD_TYPE_RASTER by default.
+ *
+ * @param[in,out] writer Writer to change
+ * @param[in] record_type ::EAARLIO_TLD_TYPE_RASTER or
+ *      ::EAARLIO_TLD_TYPE_RASTER_WFPACK
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p record_type is not one of the
+ *      above
+ */
+eaarlio_error eaarlio_flight_writer_set_record_type(
+    struct eaarlio_flight_writer *writer,
+    int record_type);
+
+/**
+ * Start writing a new TLD file
+ *
+ * Any TLD file currently being written is closed first, as with
+ * ::eaarlio_flight_writer_close_tld.
+ *
+ * @param[in,out] writer Writer to use
+ * @param[in,out] stream Stream for the new TLD file, open for writing
+ * @param[in] tld_file Name to record for the TLD file in the EDB. This should
+ *      be just the file name, without any directory.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_EDB_FILENAME_TOO_LONG if @p tld_file is too long for the
+ *      EDB format
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if the EDB cannot hold another file
+ *
+ * @post On success, @p writer takes ownership of @p stream, which is set to
+ *      empty. The writer closes it when the TLD file is finished.
+ * @post On failure, @p stream is left to the caller.
+ */
+eaarlio_error eaarlio_flight_writer_open_tld(
+    struct eaarlio_flight_writer *writer,
+    struct eaarlio_stream *stream,
+    char const *tld_file);
+
+/**
+ * Write a raster to the current TLD file and record it in the EDB
+ *
+ * @param[in,out] writer Writer to use
+ * @param[in] raster Raster to write
+ * @param[out] raster_number Raster number assigned to @p raster in the EDB,
+ *      or @c NULL
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_INVALID if no TLD file is open
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if the raster would start beyond the
+ *      4 GiB offset limit of the EDB format
+ *
+ * @remark The EDB stores pulse counts as 8-bit values. As with
+ *      eaarlio_edb_create, larger pulse counts are recorded as 255.
+ */
+eaarlio_error eaarlio_flight_writer_write_raster(
+    struct eaarlio_flight_writer *writer,
+    struct eaarlio_raster *raster,
+    uint32_t *raster_number);
+
+/**
+ * Finish the current TLD file
+ *
+ * Pending data is flushed and the TLD stream is closed. It is not an error to
+ * call this when no TLD file is open.
+ *
+ * @param[in,out] writer Writer to use
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_flight_writer_close_tld(
+    struct eaarlio_flight_writer *writer);
+
+/**
+ * Finish all writing, write the EDB, and release a flight writer
+ *
+ * @param[in,out] writer Writer to close
+ * @param[in] edb_stream Stream to write the EDB to, or @c NULL to discard the
+ *      EDB. The stream is not closed.
+ *
+ * @returns_eaarlio_error
+ *
+ * @post @p writer is empty, even on failure.
+ */
+eaarlio_error eaarlio_flight_writer_close(struct eaarlio_flight_writer *writer,
+    struct eaarlio_stream *edb_stream);
+
+#endif
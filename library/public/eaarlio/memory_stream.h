@@ -0,0 +1,88 @@
+#ifndef EAARLIO_MEMORY_STREAM_H
+#define EAARLIO_MEMORY_STREAM_H
+
+/**
+ * @file
+ * @brief Streams backed by memory buffers
+ *
+ * This header provides an ::eaarlio_stream implementation that reads from and
+ * writes to a byte buffer instead of a file. This permits data that is already
+ * in memory, such as TLD data received over the network, to be used with the
+ * library's stream-based functions without writing it to disk first.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * Initial capacity for a growable memory stream, in bytes
+ */
+#define EAARLIO_MEMORY_STREAM_CAPACITY 65536U
+
+/**
+ * Open a stream over a memory buffer
+ *
+ * The @p mode determines how @p buf is used:
+ *
+ * | mode   | Buffer                   | Access                              |
+ * | ------ | ------------------------ | ----------------------------------- |
+ * | @c r   | @p buf, @p len bytes     | read only                           |
+ * | @c r+  | @p buf, @p len bytes     | read and write; the size is fixed   |
+ * | @c w   | allocated by the stream  | read and write; grows as needed     |
+ *
+ * For @c r and @c r+, the caller retains ownership of @p buf, which must
+ * remain valid until the stream is closed. Nothing is copied. Writes in @c r+
+ * mode that would extend past the end of @p buf write as much as fits and
+ * return ::EAARLIO_STREAM_WRITE_SHORT.
+ *
+ * For @c w, the stream starts empty and @p buf must be @c NULL. If @p len is
+ * non-zero, it is used as the initial capacity instead of
+ * ::EAARLIO_MEMORY_STREAM_CAPACITY. Writing after seeking past the end fills
+ * the gap with zeroes. Use ::eaarlio_memory_stream_buffer to retrieve the
+ * data written.
+ *
+ * @param[out] stream Stream to initialize
+ * @param[in] buf Buffer to use, or @c NULL for @c w mode. May also be @c NULL
+ *      if @p len is 0.
+ * @param[in] len Length of @p buf in bytes, or the initial capacity for @c w
+ *      mode
+ * @param[in] mode One of @c "r", @c "r+", or @c "w"
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_OPEN_ERROR if @p mode is not recognized, or if @p
+ *      buf is given for @c w mode
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p len is too large to address
+ *
+ * @post On success, @p stream must be closed with its @c close function.
+ */
+eaarlio_error eaarlio_memory_stream(struct eaarlio_stream *stream,
+    unsigned char *buf,
+    uint64_t len,
+    char const *mode,
+    struct eaarlio_memory *memory);
+
+/**
+ * Retrieve the buffer behind a memory stream
+ *
+ * @param[in] stream Stream opened with ::eaarlio_memory_stream
+ * @param[out] buf Start of the stream's data
+ * @param[out] len Size of the stream's data in bytes. For @c w mode, this is
+ *      the furthest extent written, not the allocated capacity.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_INVALID if @p stream is not a memory stream
+ *
+ * @remark For @c w mode, the buffer remains owned by the stream. It is
+ *      invalidated by the next write to the stream and by closing it, so copy
+ *      anything that needs to outlive those.
+ */
+eaarlio_error eaarlio_memory_stream_buffer(struct eaarlio_stream *stream,
+    unsigned char **buf,
+    uint64_t *len);
+
+#endif
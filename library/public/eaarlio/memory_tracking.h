@@ -0,0 +1,135 @@
+#ifndef EAARLIO_MEMORY_TRACKING_H
+#define EAARLIO_MEMORY_TRACKING_H
+
+/**
+ * @file
+ * @brief Memory handler that measures memory use
+ *
+ * ::eaarlio_memory_tracking wraps another memory handler and keeps track of
+ * how much memory is live through it, the most that has been live at once,
+ * and the sizes of the blocks requested. Giving each worker its own tracking
+ * handler shows how much memory a particular way of reading or decoding needs
+ * per worker, which is what container memory limits must be sized for.
+ *
+ * Unlike ::eaarlio_stats_memory_init, the tracking handler needs to know the
+ * size of every block it releases, so it stores that in front of each block.
+ * Memory allocated through the tracking handler must therefore be resized and
+ * released through it as well, and never through the wrapped handler.
+ *
+ * A tracking handler may be used from several threads at once, provided the
+ * wrapped handler can be. Its counters are protected by a mutex.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include <stdint.h>
+
+/**
+ * Number of bins in ::eaarlio_memory_usage::histogram
+ */
+#define EAARLIO_MEMORY_TRACKING_BINS 32
+
+/**
+ * Memory use measured by a tracking memory handler
+ *
+ * Sizes are the sizes requested by the caller. Each live block also costs a
+ * small header that is not included, typically 16 bytes.
+ */
+struct eaarlio_memory_usage {
+    /** Bytes currently allocated */
+    uint64_t live_bytes;
+    /** Most bytes allocated at any one time */
+    uint64_t peak_bytes;
+    /** Blocks currently allocated */
+    uint64_t live_blocks;
+    /** Successful calls to @c malloc or @c calloc, and to @c realloc with a
+     * null pointer */
+    uint64_t allocs;
+    /** Successful calls to @c realloc that resized an existing block */
+    uint64_t reallocs;
+    /** Calls to @c free with a non-null pointer */
+    uint64_t frees;
+    /** Allocations or resizes that failed */
+    uint64_t failures;
+    /** Total bytes requested by successful allocations and resizes */
+    uint64_t total_bytes;
+    /**
+     * Sizes requested by successful allocations and resizes
+     *
+     * Bin 0 counts requests of 0 or 1 bytes, and each bin @c i after that
+     * counts requests of more than 2<sup>i-1</sup> and up to 2<sup>i</sup>
+     * bytes. The last bin also counts everything larger.
+     */
+    uint64_t histogram[EAARLIO_MEMORY_TRACKING_BINS];
+};
+
+/**
+ * Initialize a tracking memory handler
+ *
+ * The handler's state is allocated through @p inner and stored in
+ * @c wrapper->opaque. Copies of @p wrapper share that state.
+ *
+ * @param[out] wrapper Memory handler to initialize
+ * @param[in] inner Memory handler to wrap, or NULL for stdlib. It must remain
+ *      valid until ::eaarlio_memory_tracking_free is called.
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On success, ::eaarlio_memory_tracking_free must be called to release
+ *      @p wrapper.
+ */
+eaarlio_error eaarlio_memory_tracking(struct eaarlio_memory *wrapper,
+    struct eaarlio_memory *inner);
+
+/**
+ * Retrieve the memory use measured by a tracking memory handler
+ *
+ * @param[in] wrapper Memory handler initialized by ::eaarlio_memory_tracking
+ * @param[out] usage Memory use so far
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_INVALID if @p wrapper is not a tracking memory
+ *      handler
+ */
+eaarlio_error eaarlio_memory_tracking_usage(
+    struct eaarlio_memory const *wrapper,
+    struct eaarlio_memory_usage *usage);
+
+/**
+ * Reset the measurements of a tracking memory handler
+ *
+ * Everything is set to zero except for ::eaarlio_memory_usage::live_bytes and
+ * ::eaarlio_memory_usage::live_blocks, which still describe the memory that
+ * is allocated, and ::eaarlio_memory_usage::peak_bytes, which starts again
+ * from ::eaarlio_memory_usage::live_bytes. This allows the peak of one stage
+ * of a job to be measured on its own.
+ *
+ * @param[in,out] wrapper Memory handler initialized by
+ *      ::eaarlio_memory_tracking
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_INVALID if @p wrapper is not a tracking memory
+ *      handler
+ */
+eaarlio_error eaarlio_memory_tracking_reset(struct eaarlio_memory *wrapper);
+
+/**
+ * Release a tracking memory handler
+ *
+ * @param[in,out] wrapper Memory handler initialized by
+ *      ::eaarlio_memory_tracking
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_MEMORY_INVALID if @p wrapper is not a tracking memory
+ *      handler
+ *
+ * @post On success, @p wrapper is set to empty. It must not be used again,
+ *      and neither may any copies of it. Memory that was still allocated
+ *      through it can no longer be released.
+ */
+eaarlio_error eaarlio_memory_tracking_free(struct eaarlio_memory *wrapper);
+
+#endif
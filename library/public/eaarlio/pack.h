@@ -0,0 +1,110 @@
+#ifndef EAARLIO_PACK_H
+#define EAARLIO_PACK_H
+
+/**
+ * @file
+ * @brief Single-file flight packs
+ *
+ * A flight is normally an EDB file plus one TLD file per file name in the EDB,
+ * often several hundred of them. Opening each of those costs a round trip on a
+ * network filesystem or object store, and that latency often dominates the
+ * time spent on the data itself.
+ *
+ * A flight pack stores the EDB and all of its TLD files in a single file,
+ * along with a table of where each TLD file is. The TLD data is stored
+ * unchanged, so the record offsets in the EDB remain valid. A pack is opened
+ * with a single stream, and each TLD file is read through a view of a range
+ * of that stream. The format is described at @ref md_pack_format.
+ */
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+
+/**
+ * Write a flight pack
+ *
+ * Each TLD file named in @p edb is opened with @p tld_opener and copied into
+ * the pack, followed by @p edb itself and the file table.
+ *
+ * @param[in,out] out Stream to write the pack to. It must be empty and must
+ *      support seeking, since the header is completed last.
+ * @param[in] edb EDB for the flight
+ * @param[in] tld_opener TLD opener for the flight's TLD files. Each stream it
+ *      opens must support seeking with @c SEEK_END.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_EDB_FILENAME_TOO_LONG if a file name in @p edb is too
+ *      long for the EDB format
+ *
+ * Anything from tld_opener.open_tld, such as ::EAARLIO_STREAM_OPEN_ERROR if a
+ * TLD file is missing
+ *
+ * @post On success, @p out is positioned at the end of the pack.
+ */
+eaarlio_error eaarlio_pack_write(struct eaarlio_stream *out,
+    struct eaarlio_edb const *edb,
+    struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a TLD opener over a flight pack
+ *
+ * The pack's header and file table are read once. After that, opening a TLD
+ * file only looks its name up in the table and does not touch @p pack. The
+ * streams returned are read-only ::eaarlio_window_stream windows that all
+ * share @p pack.
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in,out] pack Stream containing the pack. It must support seeking.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if @p pack does not contain a valid pack
+ *
+ * The opener's @c open_tld returns ::EAARLIO_STREAM_OPEN_ERROR if the file is
+ * not in the pack.
+ *
+ * @post On success, @p tld_opener takes ownership of @p pack, which is set to
+ *      empty. Closing @p tld_opener closes it.
+ * @post On failure, @p pack is left to the caller.
+ *
+ * @warning Streams opened by @p tld_opener must be closed before it is, and
+ *      must not be used from more than one thread at a time.
+ */
+eaarlio_error eaarlio_pack_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_stream *pack,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open an eaarlio_flight from a flight pack
+ *
+ * The embedded EDB is read and @p flight->tld_opener is set up with
+ * ::eaarlio_pack_tld_opener.
+ *
+ * @param[out] flight Pointer to flight to be populated
+ * @param[in,out] pack Stream containing the pack. It must support seeking.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if @p pack does not contain a valid pack
+ *
+ * Anything from eaarlio_edb_read
+ * Anything from eaarlio_flight_init
+ *
+ * @post On success, @p flight takes ownership of @p pack, which is set to
+ *      empty. It is closed by ::eaarlio_flight_free.
+ * @post On failure, @p pack is left to the caller.
+ */
+eaarlio_error eaarlio_pack_open_flight(struct eaarlio_flight *flight,
+    struct eaarlio_stream *pack,
+    struct eaarlio_memory *memory);
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef EAARLIO_PIPELINE_H
+#define EAARLIO_PIPELINE_H
+
+/**
+ * @file
+ * @brief Decode rasters on several threads while delivering them in order
+ *
+ * A pipeline has three stages. One thread reads the raw record for each
+ * raster from its TLD file. Several threads decode those records and
+ * optionally process the decoded rasters further. Finally, the calling thread
+ * receives each raster in the order the rasters were requested.
+ *
+ * Rasters that finish decoding early wait in a reorder buffer until their
+ * turn. The buffer has a fixed number of slots, so a slow output stage holds
+ * back the read stage instead of letting decoded rasters pile up in memory.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include <stdint.h>
+
+/**
+ * Default number of rasters a pipeline may hold at once
+ */
+#define EAARLIO_PIPELINE_DEPTH 64U
+
+/**
+ * Callback that chooses the next raster for a pipeline
+ *
+ * @param[in] ctx The context pointer given in ::eaarlio_pipeline
+ * @param[out] raster_number The next raster number to retrieve, or 0 if there
+ *      are no more
+ *
+ * @returns_eaarlio_error
+ *
+ * @remark Returning anything other than ::EAARLIO_SUCCESS stops the pipeline
+ *      and the value is returned to the caller.
+ */
+typedef eaarlio_error (*eaarlio_pipeline_next_fn)(
+    void *ctx, uint32_t *raster_number);
+
+/**
+ * Callback that receives a decoded raster from a pipeline
+ *
+ * @param[in] ctx The context pointer given in ::eaarlio_pipeline
+ * @param[in] slot The reorder buffer slot holding @p raster, from 0 to one
+ *      less than ::eaarlio_pipeline::depth. A raster keeps the same slot from
+ *      ::eaarlio_pipeline::work through ::eaarlio_pipeline::output, and the
+ *      slot is not reused until ::eaarlio_pipeline::output returns. This makes
+ *      it suitable as an index into per-slot scratch space owned by the
+ *      caller.
+ * @param[in] raster_number Raster number of @p raster
+ * @param[in] raster The raster data
+ * @param[in] time_offset The time offset for the raster, as for
+ *      ::eaarlio_flight_read_raster
+ *
+ * @returns_eaarlio_error
+ *
+ * @remark Returning anything other than ::EAARLIO_SUCCESS stops the pipeline
+ *      and the value is returned to the caller.
+ * @remark The memory held by @p raster is released after
+ *      ::eaarlio_pipeline::output returns.
+ */
+typedef eaarlio_error (*eaarlio_pipeline_raster_fn)(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset);
+
+/**
+ * Configuration for ::eaarlio_pipeline_run
+ */
+struct eaarlio_pipeline {
+    /** Chooses each raster in turn; called from the read thread */
+    eaarlio_pipeline_next_fn next;
+    /**
+     * Optional processing for each decoded raster; called from the decode
+     * threads, for several rasters at once and in no particular order
+     */
+    eaarlio_pipeline_raster_fn work;
+    /**
+     * Receives each raster in the order chosen by #next; called from the
+     * thread that called ::eaarlio_pipeline_run
+     */
+    eaarlio_pipeline_raster_fn output;
+    /** Context pointer passed through to the callbacks */
+    void *ctx;
+    /** Number of decode threads, or 0 for one per processor */
+    uint32_t threads;
+    /**
+     * Number of rasters that may be held at once, or 0 for
+     * ::EAARLIO_PIPELINE_DEPTH
+     */
+    uint32_t depth;
+    /** Should pulse data be decoded? 1 = yes, 0 = no */
+    int include_pulses;
+    /** Should waveform data be decoded? 1 = yes, 0 = no */
+    int include_waveforms;
+};
+
+/**
+ * Empty ::eaarlio_pipeline value
+ *
+ * All numeric fields will contain zero values. All pointers will be null.
+ */
+#define eaarlio_pipeline_empty()                                               \
+    (struct eaarlio_pipeline)                                                  \
+    {                                                                          \
+        NULL, NULL, NULL, NULL, 0, 0, 0, 0                                     \
+    }
+
+/**
+ * Run a pipeline over a flight
+ *
+ * Rasters are requested from ::eaarlio_pipeline::next until it returns 0.
+ * Each is read, decoded, passed to ::eaarlio_pipeline::work (if given), and
+ * finally passed to ::eaarlio_pipeline::output in the order requested.
+ *
+ * If ::eaarlio_pipeline::threads is 1, or the library was built without
+ * thread support, every stage runs in the calling thread, one raster at a
+ * time.
+ *
+ * @param[in] flight Flight to retrieve rasters from
+ * @param[in] pipeline Pipeline configuration
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_NULL if ::eaarlio_pipeline::next or
+ *      ::eaarlio_pipeline::output is null
+ *
+ * @pre ::eaarlio_flight_init must have been called to initialize @p flight.
+ * @pre When more than one thread is used, the flight's memory handler must be
+ *      safe to use from several threads at once. ::eaarlio_memory_default is.
+ *
+ * @post On failure, ::eaarlio_pipeline::output may have been called for some
+ *      of the rasters. The first error encountered is returned.
+ *
+ * @remark Like ::eaarlio_flight_read_raster, this leaves the flight's internal
+ *      stream open to the last TLD file accessed. The flight must not be used
+ *      by anything else until this returns.
+ */
+eaarlio_error eaarlio_pipeline_run(
+    struct eaarlio_flight *flight, struct eaarlio_pipeline const *pipeline);
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef EAARLIO_STATS_H
+#define EAARLIO_STATS_H
+
+/**
+ * @file
+ * @brief Counters for I/O, allocation, and decoding
+ *
+ * An ::eaarlio_stats records how much work was done and where the time went,
+ * which shows whether a slow job is limited by I/O, by memory allocation, or
+ * by decoding without attaching a profiler.
+ *
+ * Statistics are collected by wrapping a stream with ::eaarlio_stats_stream
+ * or a memory handler with ::eaarlio_stats_memory_init. A flight can collect
+ * all of them itself once ::eaarlio_flight_stats_enable is called; see
+ * ::eaarlio_flight_stats.
+ *
+ * Collection is opt-in because timing each call costs a clock read. The
+ * counters are not synchronized, so each ::eaarlio_stats must only be updated
+ * by one thread at a time. Use ::eaarlio_stats_add to combine them.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * I/O, allocation, and decoding statistics
+ *
+ * Times are in seconds. The three stages do not overlap: time spent in I/O
+ * while decoding a raster is counted as I/O, not decoding.
+ */
+struct eaarlio_stats {
+    /**
+     * Calls to a stream's @c read function, and reads made directly by
+     * ::eaarlio_file_flight_fetch
+     */
+    uint64_t read_calls;
+    /** Bytes returned by successful reads */
+    uint64_t bytes_read;
+    /** Calls to a stream's @c seek function */
+    uint64_t seek_calls;
+    /** TLD files opened */
+    uint64_t tld_opens;
+    /** Calls to @c malloc, @c calloc, or @c realloc */
+    uint64_t allocs;
+    /** Bytes requested by those calls */
+    uint64_t alloc_bytes;
+    /** Calls to @c free */
+    uint64_t frees;
+    /** Rasters decoded */
+    uint64_t rasters;
+    /** Pulses decoded */
+    uint64_t pulses;
+    /** Waveforms decoded, counting each transmit and return waveform */
+    uint64_t waveforms;
+    /**
+     * Time spent opening TLD files, in stream reads, seeks, and tells, and
+     * waiting for the reads made by ::eaarlio_file_flight_fetch
+     */
+    double io_seconds;
+    /** Time spent decoding rasters, including their allocations */
+    double decode_seconds;
+    /** Time spent releasing decoded rasters */
+    double free_seconds;
+};
+
+/**
+ * Empty ::eaarlio_stats value
+ *
+ * All counters will be zero.
+ */
+#define eaarlio_stats_empty()                                                  \
+    (struct eaarlio_stats)                                                     \
+    {                                                                          \
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0.0, 0.0, 0.0                            \
+    }
+
+/**
+ * Add one set of statistics to another
+ *
+ * @param[in,out] stats Statistics to add to
+ * @param[in] other Statistics to add
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_stats_add(struct eaarlio_stats *stats,
+    struct eaarlio_stats const *other);
+
+/**
+ * Current time in seconds, from an arbitrary starting point
+ *
+ * This is the clock used for the times in ::eaarlio_stats, and is only useful
+ * for measuring elapsed time. A monotonic clock is used where available;
+ * elsewhere, this falls back to processor time.
+ */
+double eaarlio_clock(void);
+
+/**
+ * Open a stream that counts the calls made to another stream
+ *
+ * Reads update ::eaarlio_stats::read_calls and ::eaarlio_stats::bytes_read,
+ * seeks update ::eaarlio_stats::seek_calls, and the time spent in reads,
+ * seeks, and tells is added to ::eaarlio_stats::io_seconds. Writes are passed
+ * through without being counted.
+ *
+ * @param[out] stream Stream to initialize
+ * @param[in,out] inner Stream to count
+ * @param[in] stats Statistics to update. It must remain valid until
+ *      @p stream is closed.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On success, @p stream takes ownership of @p inner, which is set to
+ *      empty. Closing @p stream closes it.
+ * @post On failure, @p inner is left to the caller.
+ */
+eaarlio_error eaarlio_stats_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_stats *stats,
+    struct eaarlio_memory *memory);
+
+/**
+ * Memory handler that counts the calls made to another memory handler
+ *
+ * Initialize it with ::eaarlio_stats_memory_init and pass
+ * ::eaarlio_stats_memory::memory to the library.
+ */
+struct eaarlio_stats_memory {
+    /** Memory handler to use */
+    struct eaarlio_memory memory;
+    /** Memory handler that does the work */
+    struct eaarlio_memory *inner;
+    /** Statistics to update */
+    struct eaarlio_stats *stats;
+};
+
+/**
+ * Initialize a counting memory handler
+ *
+ * Allocations update ::eaarlio_stats::allocs and
+ * ::eaarlio_stats::alloc_bytes, and frees update ::eaarlio_stats::frees.
+ * Memory may be released through @p inner even if it was allocated through
+ * the wrapper, and the other way around.
+ *
+ * @param[out] wrapper Memory handler to initialize
+ * @param[in] inner Memory handler to count, or NULL for stdlib
+ * @param[in] stats Statistics to update
+ *
+ * @returns_eaarlio_error
+ *
+ * @warning @p wrapper, @p inner, and @p stats must all remain valid while
+ *      the wrapper is in use. Copies of ::eaarlio_stats_memory::memory refer
+ *      back to @p wrapper, so @p wrapper must not be moved.
+ */
+eaarlio_error eaarlio_stats_memory_init(struct eaarlio_stats_memory *wrapper,
+    struct eaarlio_memory *inner,
+    struct eaarlio_stats *stats);
+
+#endif
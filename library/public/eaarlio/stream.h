@@ -183,4 +183,18 @@ struct eaarlio_stream {
         NULL, NULL, NULL, NULL, NULL, NULL                                     \
     }
 
+/**
+ * Make data written to a stream durable
+ *
+ * This is not part of ::eaarlio_stream, since most streams have no meaningful
+ * notion of durability. Functions that accept one pair it with a stream that
+ * it knows how to handle, such as ::eaarlio_file_stream_sync for streams from
+ * ::eaarlio_file_stream.
+ *
+ * @param[in] stream Stream to sync
+ *
+ * @returns_eaarlio_error
+ */
+typedef eaarlio_error (*eaarlio_stream_sync_fn)(struct eaarlio_stream *stream);
+
 #endif
@@ -0,0 +1,59 @@
+#ifndef EAARLIO_TAR_H
+#define EAARLIO_TAR_H
+
+/**
+ * @file
+ * @brief Reading TLD files directly from tar archives
+ *
+ * Archived flights are often stored with their TLD files in a tar archive.
+ * The TLD opener in this header reads them in place, so a flight can be
+ * processed without first extracting the archive.
+ *
+ * POSIX ustar archives are supported, along with the GNU long name and pax
+ * extended header extensions used by GNU tar and bsdtar for long file names
+ * and large files. Compressed archives (such as .tar.gz) are not supported,
+ * since they cannot be read at random.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+
+/**
+ * Open a TLD opener over a tar archive
+ *
+ * The archive's member headers are read once, skipping over the member data.
+ * After that, opening a TLD file only looks its name up in that index and
+ * does not touch @p tar. The streams returned are read-only
+ * ::eaarlio_window_stream windows that all share @p tar.
+ *
+ * Members are matched by the final component of their path, since the EDB
+ * only records the TLD file name. If more than one member has the same name,
+ * the last one in the archive is used, as when the archive is extracted.
+ * Members other than regular files are ignored.
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in,out] tar Stream containing the archive. It must support seeking.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if a member header is invalid or the archive is
+ *      truncated
+ *
+ * The opener's @c open_tld returns ::EAARLIO_STREAM_OPEN_ERROR if the file is
+ * not in the archive.
+ *
+ * @post On success, @p tld_opener takes ownership of @p tar, which is set to
+ *      empty. Closing @p tld_opener closes it.
+ * @post On failure, @p tar is left to the caller.
+ *
+ * @warning Streams opened by @p tld_opener must be closed before it is, and
+ *      must not be used from more than one thread at a time.
+ */
+eaarlio_error eaarlio_tar_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_stream *tar,
+    struct eaarlio_memory *memory);
+
+#endif
@@ -18,10 +18,32 @@
  * Type value for an EAARL-A/B raster record
  *
  * Only records with ::eaarlio_tld_header::record_type ==
- * ::EAARLIO_TLD_TYPE_RASTER are understood to be rasters by this library.
+ * ::EAARLIO_TLD_TYPE_RASTER (or ::EAARLIO_TLD_TYPE_RASTER_WFPACK) are
+ * understood to be rasters by this library.
  */
 #define EAARLIO_TLD_TYPE_RASTER 5
 
+/**
+ * Type value for a raster record with packed waveforms
+ *
+ * This is not an EAARL-A/B record type; it is written by this library when
+ * requested with ::eaarlio_tld_writer_set_record_type. The record holds the
+ * same data as an ::EAARLIO_TLD_TYPE_RASTER record, but each waveform is
+ * stored as differences between neighboring samples using only as many bits
+ * as needed, which typically takes well under half the space. Such records
+ * are read the same way as any other raster.
+ */
+#define EAARLIO_TLD_TYPE_RASTER_WFPACK 0x85
+
+/**
+ * Does a record type hold a raster?
+ *
+ * True for ::EAARLIO_TLD_TYPE_RASTER and ::EAARLIO_TLD_TYPE_RASTER_WFPACK.
+ */
+#define eaarlio_tld_type_is_raster(type)                                       \
+    ((type) == EAARLIO_TLD_TYPE_RASTER                                         \
+        || (type) == EAARLIO_TLD_TYPE_RASTER_WFPACK)
+
 /******************************************************************************/
 
 /**
@@ -35,7 +57,8 @@ struct eaarlio_tld_header {
     /**
      * Record type
      *
-     * This is always ::EAARLIO_TLD_TYPE_RASTER (5) for EAARL-A/EAARL-B.
+     * This is always ::EAARLIO_TLD_TYPE_RASTER (5) for EAARL-A/EAARL-B. Files
+     * written by this library may also use ::EAARLIO_TLD_TYPE_RASTER_WFPACK.
      */
     uint8_t record_type;
 };
@@ -67,14 +90,15 @@ struct eaarlio_tld_header {
  *
  * @post On success, the stream is advanced to the end of the record.
  * @post On success, @p record_header is populated.
- * @post On success, if @p record_header->record_type is
- *      ::EAARLIO_TLD_TYPE_RASTER, then @p raster->header is populated.
- * @post On success, if @p record_header->record_type is
- *      ::EAARLIO_TLD_TYPE_RASTER and include_pulses = 1, then @p raster->pulse
- *      is populated; each pulse will have its header populated.
- * @post On success, if @p record_header->record_type is
- *      ::EAARLIO_TLD_TYPE_RASTER and include_pulses = 1 and include_waveforms =
- *      1, then the waveforms for each pulse in @p raster->pulse are populated.
+ * @post On success, if ::eaarlio_tld_type_is_raster(@p
+ *      record_header->record_type), then @p raster->header is populated.
+ * @post On success, if ::eaarlio_tld_type_is_raster(@p
+ *      record_header->record_type) and include_pulses = 1, then @p
+ *      raster->pulse is populated; each pulse will have its header populated.
+ * @post On success, if ::eaarlio_tld_type_is_raster(@p
+ *      record_header->record_type) and include_pulses = 1 and
+ *      include_waveforms = 1, then the waveforms for each pulse in @p
+ *      raster->pulse are populated.
  * @post On failure, anything might be partially populated.
  * @post Any non-null pointers in @p raster are newly-allocated memory.
  */
@@ -91,8 +115,9 @@ eaarlio_error eaarlio_tld_read_record(struct eaarlio_stream *stream,
  * This function is convenience wrapper around ::eaarlio_tld_read_record and
  * works nearly identically to it. The differences are:
  * - This function does not have a record_header parameter
- * - When the record type is not ::EAARLIO_TLD_TYPE_RASTER, this function
- *   returns ::EAARLIO_TLD_TYPE_UNKNOWN instead of ::EAARLIO_SUCCESS.
+ * - When the record type does not hold a raster (see
+ *   ::eaarlio_tld_type_is_raster), this function returns
+ *   ::EAARLIO_TLD_TYPE_UNKNOWN instead of ::EAARLIO_SUCCESS.
  *
  * Please refer to ::eaarlio_tld_read_record for further documentation.
  */
@@ -126,4 +151,178 @@ eaarlio_error eaarlio_tld_write_raster(struct eaarlio_stream *stream,
     struct eaarlio_raster *raster,
     struct eaarlio_memory *memory);
 
+/******************************************************************************/
+
+/**
+ * Default block size for ::eaarlio_tld_writer
+ */
+#define EAARLIO_TLD_WRITER_BLOCK_SIZE 1048576U
+
+/**
+ * Never sync; for use with ::eaarlio_tld_writer_init
+ */
+#define EAARLIO_TLD_SYNC_NEVER 0
+
+/**
+ * Sync once, when the writer is closed; for use with
+ * ::eaarlio_tld_writer_init
+ */
+#define EAARLIO_TLD_SYNC_CLOSE 1
+
+/**
+ * Sync after every block is written; for use with ::eaarlio_tld_writer_init
+ */
+#define EAARLIO_TLD_SYNC_FLUSH 2
+
+/**
+ * Buffered TLD writer
+ *
+ * ::eaarlio_tld_write_raster allocates and writes each raster on its own, which
+ * is fine for a handful of rasters but slow for millions. A writer instead
+ * encodes rasters one after another into a reusable buffer and only writes to
+ * the stream once a full block has accumulated.
+ *
+ * The fields are managed by the eaarlio_tld_writer_* functions and should not
+ * be modified directly.
+ */
+struct eaarlio_tld_writer {
+    /** Stream being written to */
+    struct eaarlio_stream *stream;
+    /** Function used to sync @c stream, or @c NULL */
+    eaarlio_stream_sync_fn sync;
+    /** When to call @c sync; one of the @c EAARLIO_TLD_SYNC_ values */
+    int sync_policy;
+    /** Encoded records that have not yet been written */
+    unsigned char *buffer;
+    /** Number of bytes of pending data in @c buffer */
+    uint32_t buffer_len;
+    /** Allocated size of @c buffer */
+    uint32_t buffer_size;
+    /** Pending data is written once it reaches this many bytes */
+    uint32_t block_size;
+    /** Stream position corresponding to the start of @c buffer */
+    int64_t position;
+    /** Memory handler */
+    struct eaarlio_memory *memory;
+    /** Record type to write rasters as */
+    uint8_t record_type;
+};
+
+/**
+ * Empty eaarlio_tld_writer value
+ *
+ * All numeric fields will contain zero values. All pointers will be null.
+ */
+#define eaarlio_tld_writer_empty()                                             \
+    (struct eaarlio_tld_writer)                                                \
+    {                                                                          \
+        NULL, NULL, 0, NULL, 0, 0, 0, 0, NULL, 0                               \
+    }
+
+/**
+ * Initialize a buffered TLD writer
+ *
+ * @param[out] writer Writer to initialize
+ * @param[in] stream Stream to write to; must remain open until
+ *      ::eaarlio_tld_writer_close
+ * @param[in] block_size Number of bytes to accumulate before writing, or 0 for
+ *      ::EAARLIO_TLD_WRITER_BLOCK_SIZE
+ * @param[in] sync Function to sync @p stream with, or @c NULL
+ * @param[in] sync_policy One of ::EAARLIO_TLD_SYNC_NEVER,
+ *      ::EAARLIO_TLD_SYNC_CLOSE, or ::EAARLIO_TLD_SYNC_FLUSH
+ * @param[in] memory Memory handler, or NULL for stdlib. If provided, it must
+ *      remain valid until ::eaarlio_tld_writer_close.
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p sync_policy is invalid, or if it
+ *      is not ::EAARLIO_TLD_SYNC_NEVER and @p sync is @c NULL
+ *
+ * @post On success, @p writer must be released with ::eaarlio_tld_writer_close.
+ * @post On failure, @p writer is empty.
+ *
+ * @remark Record offsets are reported relative to the position of @p stream
+ *      when this is called. If @p stream does not support tell, offsets are
+ *      reported relative to 0.
+ */
+eaarlio_error eaarlio_tld_writer_init(struct eaarlio_tld_writer *writer,
+    struct eaarlio_stream *stream,
+    uint32_t block_size,
+    eaarlio_stream_sync_fn sync,
+    int sync_policy,
+    struct eaarlio_memory *memory);
+
+/**
+ * Add a raster to a buffered TLD writer
+ *
+ * The raster is encoded immediately, so it may be modified or released as soon
+ * as this returns.
+ *
+ * @param[in,out] writer Writer to use
+ * @param[in] raster Raster to write
+ * @param[out] offset Stream position where the record will start, or @c NULL
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On failure to encode @p raster, nothing is added to the writer. On
+ *      failure to write a block, the block's data is discarded.
+ *
+ * @remark The raster will be written as a TLD record of the type given by
+ *      ::eaarlio_tld_writer_set_record_type, ::EAARLIO_TLD_TYPE_RASTER by
+ *      default. With ::EAARLIO_TLD_TYPE_RASTER_WFPACK, a raster whose packed
+ *      form would not be smaller is written as ::EAARLIO_TLD_TYPE_RASTER
+ *      instead. The record length is the difference between @p offset and the
+ *      next record's offset.
+ */
+eaarlio_error eaarlio_tld_writer_write_raster(
+    struct eaarlio_tld_writer *writer,
+    struct eaarlio_raster *raster,
+    int64_t *offset);
+
+/**
+ * Choose the record type a buffered TLD writer writes rasters as
+ *
+ * @param[in,out] writer Writer to change
+ * @param[in] record_type ::EAARLIO_TLD_TYPE_RASTER or
+ *      ::EAARLIO_TLD_TYPE_RASTER_WFPACK
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if @p record_type is not one of the
+ *      above
+ *
+ * @remark Only rasters written after this call are affected, so one file can
+ *      hold both types.
+ * @remark Files with ::EAARLIO_TLD_TYPE_RASTER_WFPACK records can only be read
+ *      by this library.
+ */
+eaarlio_error eaarlio_tld_writer_set_record_type(
+    struct eaarlio_tld_writer *writer,
+    int record_type);
+
+/**
+ * Write any pending data in a buffered TLD writer to its stream
+ *
+ * With ::EAARLIO_TLD_SYNC_FLUSH, the stream is also synced if anything was
+ * written.
+ *
+ * @param[in,out] writer Writer to flush
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error eaarlio_tld_writer_flush(struct eaarlio_tld_writer *writer);
+
+/**
+ * Flush and release a buffered TLD writer
+ *
+ * The stream itself is not closed.
+ *
+ * @param[in,out] writer Writer to close
+ *
+ * @returns_eaarlio_error
+ *
+ * @post @p writer is empty, even on failure.
+ */
+eaarlio_error eaarlio_tld_writer_close(struct eaarlio_tld_writer *writer);
+
 #endif
@@ -0,0 +1,242 @@
+#ifndef EAARLIO_TRACE_H
+#define EAARLIO_TRACE_H
+
+/**
+ * @file
+ * @brief Tracing of stream calls
+ *
+ * A trace records every call made to a stream: where it was in the file, how
+ * much was asked for, when the call started, and how long it took. This shows
+ * the access pattern a job actually produces, such as many small reads or
+ * seeks back and forth, and how the storage responded to it, without needing
+ * system-level tools such as strace.
+ *
+ * Create an ::eaarlio_trace over a sink stream with ::eaarlio_trace_init, then
+ * wrap streams with ::eaarlio_stream_trace, or wrap a flight's TLD opener with
+ * ::eaarlio_trace_tld_opener to trace every TLD file the flight opens. The
+ * trace is written to the sink in the format described at
+ * @ref md_trace_format, and can be read back with ::eaarlio_trace_read_header
+ * and ::eaarlio_trace_read_record. The eaarlio_trace program records and
+ * summarizes traces.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include <stdint.h>
+
+/**
+ * @defgroup trace_op Trace operations
+ *
+ * Values for ::eaarlio_trace_record::op
+ *
+ * @{
+ */
+
+/** A stream was opened */
+#define EAARLIO_TRACE_OPEN 1
+
+/** A stream was read */
+#define EAARLIO_TRACE_READ 2
+
+/** A stream was seeked */
+#define EAARLIO_TRACE_SEEK 3
+
+/** A stream's position was requested */
+#define EAARLIO_TRACE_TELL 4
+
+/** A stream was closed */
+#define EAARLIO_TRACE_CLOSE 5
+
+/** @} */
+
+/** Size of the encoded trace header */
+#define EAARLIO_TRACE_HEADER_SIZE 16
+
+/** Size of each encoded trace record */
+#define EAARLIO_TRACE_RECORD_SIZE 40
+
+/**
+ * One call recorded in a trace
+ */
+struct eaarlio_trace_record {
+    /** Call made; one of the @ref trace_op values */
+    uint8_t op;
+    /** For ::EAARLIO_TRACE_SEEK, the @c whence argument */
+    uint8_t whence;
+    /** Result of the call, an ::eaarlio_error value */
+    uint16_t error;
+    /**
+     * Stream the call was made on
+     *
+     * Streams are numbered from 1 in the order they were opened. A failed
+     * ::EAARLIO_TRACE_OPEN has stream 0.
+     */
+    uint32_t stream_id;
+    /**
+     * Position in the stream, or -1 if it is not known
+     *
+     * For ::EAARLIO_TRACE_READ, this is where the read started. For
+     * ::EAARLIO_TRACE_SEEK and ::EAARLIO_TRACE_TELL, this is the position
+     * after the call. For ::EAARLIO_TRACE_OPEN, this is the starting position.
+     */
+    int64_t offset;
+    /** For ::EAARLIO_TRACE_READ, the number of bytes requested */
+    uint64_t size;
+    /** When the call started, in nanoseconds since the trace was created */
+    uint64_t start_ns;
+    /** How long the call took, in nanoseconds */
+    uint64_t latency_ns;
+};
+
+/**
+ * Empty ::eaarlio_trace_record value
+ */
+#define eaarlio_trace_record_empty()                                           \
+    (struct eaarlio_trace_record)                                              \
+    {                                                                          \
+        0, 0, 0, 0, 0, 0, 0, 0                                                 \
+    }
+
+/**
+ * Trace of stream calls
+ */
+struct eaarlio_trace {
+    /**
+     * Internal data
+     *
+     * This is not used by calling code directly.
+     */
+    void *internal;
+};
+
+/**
+ * Empty ::eaarlio_trace value
+ */
+#define eaarlio_trace_empty()                                                  \
+    (struct eaarlio_trace)                                                     \
+    {                                                                          \
+        NULL                                                                   \
+    }
+
+/**
+ * Start a trace
+ *
+ * The trace header is written to @p sink immediately. Each record is written
+ * to it as its call completes.
+ *
+ * @param[out] trace Trace to initialize
+ * @param[in] sink Stream to write the trace to. It must remain valid until
+ *      ::eaarlio_trace_free is called, and is not closed by it.
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On success, ::eaarlio_trace_free must be called to release @p trace.
+ *
+ * @remark Streams traced with the same ::eaarlio_trace may be used from
+ *      different threads at once. Records are written to @p sink one at a
+ *      time.
+ */
+eaarlio_error eaarlio_trace_init(struct eaarlio_trace *trace,
+    struct eaarlio_stream *sink,
+    struct eaarlio_memory *memory);
+
+/**
+ * Finish a trace
+ *
+ * All streams traced with @p trace must be closed first.
+ *
+ * @param[in,out] trace Trace to release
+ *
+ * @returns_eaarlio_error
+ *
+ * Returns the first error encountered writing to the sink, if any. Once
+ * writing fails, no further records are written, but the traced streams keep
+ * working.
+ *
+ * @post @p trace is set to empty.
+ */
+eaarlio_error eaarlio_trace_free(struct eaarlio_trace *trace);
+
+/**
+ * Open a stream that traces the calls made to another stream
+ *
+ * Reads, seeks, tells, and the final close are recorded. Writes are passed
+ * through without being recorded. An ::EAARLIO_TRACE_OPEN record with no
+ * latency is written for the new stream.
+ *
+ * To know the position of each read without adding calls of its own, the
+ * stream keeps track of the position itself. It only asks @p inner, with an
+ * untraced tell, when the position cannot be known otherwise: on opening,
+ * after a seek relative to the end, and after a failed call.
+ *
+ * @param[out] stream Stream to initialize
+ * @param[in,out] inner Stream to trace
+ * @param[in] trace Trace to record to
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On success, @p stream takes ownership of @p inner, which is set to
+ *      empty. Closing @p stream closes it.
+ * @post On failure, @p inner is left to the caller.
+ */
+eaarlio_error eaarlio_stream_trace(struct eaarlio_stream *stream,
+    struct eaarlio_stream *inner,
+    struct eaarlio_trace *trace,
+    struct eaarlio_memory *memory);
+
+/**
+ * Open a tld_opener that traces the streams opened by another
+ *
+ * Each call to @c open_tld is recorded as an ::EAARLIO_TRACE_OPEN, including
+ * the time taken to open the file, and the stream returned is traced as by
+ * ::eaarlio_stream_trace. To trace a flight, replace its @c tld_opener:
+ *
+ *      eaarlio_trace_tld_opener(&traced, &flight.tld_opener, &trace, NULL);
+ *      flight.tld_opener = traced;
+ *
+ * @param[out] tld_opener TLD opener to initialize
+ * @param[in,out] inner TLD opener to trace
+ * @param[in] trace Trace to record to
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @post On success, @p tld_opener takes ownership of @p inner, which is set
+ *      to empty. Closing @p tld_opener closes it.
+ * @post On failure, @p inner is left to the caller.
+ */
+eaarlio_error eaarlio_trace_tld_opener(struct eaarlio_tld_opener *tld_opener,
+    struct eaarlio_tld_opener *inner,
+    struct eaarlio_trace *trace,
+    struct eaarlio_memory *memory);
+
+/**
+ * Read and check the header of a trace
+ *
+ * @param[in] stream Stream positioned at the start of a trace
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_CORRUPT if @p stream does not contain a trace that this
+ *      version of the library can read
+ */
+eaarlio_error eaarlio_trace_read_header(struct eaarlio_stream *stream);
+
+/**
+ * Read the next record of a trace
+ *
+ * @param[in] stream Stream positioned after the header or a previous record
+ * @param[out] record Record read
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_STREAM_READ_SHORT at the end of the trace
+ */
+eaarlio_error eaarlio_trace_read_record(struct eaarlio_stream *stream,
+    struct eaarlio_trace_record *record);
+
+#endif
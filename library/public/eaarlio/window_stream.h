@@ -0,0 +1,63 @@
+#ifndef EAARLIO_WINDOW_STREAM_H
+#define EAARLIO_WINDOW_STREAM_H
+
+/**
+ * @file
+ * @brief Streams over part of another stream
+ *
+ * This header provides an ::eaarlio_stream implementation that presents a
+ * range of bytes within another stream as a stream of its own. Positions are
+ * relative to the start of the range and reads stop at its end, so a TLD file
+ * embedded in a larger container can be passed to functions such as
+ * ::eaarlio_tld_read_raster as though it were a file by itself.
+ *
+ * Nothing is copied. Any number of windows may share the same parent stream,
+ * which lets them share a single open file.
+ */
+
+#include "eaarlio/error.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/stream.h"
+#include <stdint.h>
+
+/**
+ * Open a read-only stream over a range of another stream
+ *
+ * Each read seeks @p parent to the window's own position first, so windows
+ * sharing a parent do not disturb each other, and nothing needs to be assumed
+ * about where @p parent was left. Seeking past the end of the window is
+ * permitted, as with a file, but reads there return
+ * ::EAARLIO_STREAM_READ_SHORT. A read that crosses the end of the window reads
+ * what is available and returns ::EAARLIO_STREAM_READ_SHORT.
+ *
+ * The write function of the stream returns ::EAARLIO_STREAM_NOT_IMPL.
+ *
+ * @param[out] stream Stream to initialize
+ * @param[in] parent Stream containing the range. It must support seeking
+ *      with @c SEEK_SET.
+ * @param[in] offset Start of the range in @p parent
+ * @param[in] length Size of the range in bytes
+ * @param[in] memory Memory handler, or NULL for stdlib
+ *
+ * @returns_eaarlio_error
+ *
+ * @retval ::EAARLIO_VALUE_OUT_OF_RANGE if the range extends beyond the
+ *      largest position a stream can seek to
+ *
+ * @post On success, @p stream must be closed with its @c close function.
+ *      Closing it does not close @p parent.
+ *
+ * @warning @p parent is not owned by @p stream. It must remain valid, and at
+ *      the same address, until @p stream is closed. Windows sharing a parent
+ *      must not be used from more than one thread at a time.
+ *
+ * @remark The range is not checked against the size of @p parent. If it
+ *      extends past the end, reads there fail as they would on @p parent.
+ */
+eaarlio_error eaarlio_window_stream(struct eaarlio_stream *stream,
+    struct eaarlio_stream *parent,
+    uint64_t offset,
+    uint64_t length,
+    struct eaarlio_memory *memory);
+
+#endif
@@ -35,6 +35,10 @@ static void *_mock_realloc(struct eaarlio_memory *self, void *ptr, size_t size)
     struct mock_memory *mock = (struct mock_memory *)self->opaque;
     int i;
 
+    /* As with the standard library, realloc of NULL is malloc */
+    if(!ptr)
+        return _mock_malloc(self, size);
+
     for(i = 0; i < mock->ptrs_used; i++) {
         if(mock->ptrs[i] == ptr) {
             break;
@@ -0,0 +1,596 @@
+#include "eaarlio/arrow.h"
+#include "eaarlio/error.h"
+#include "eaarlio/int_decode.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/pulse.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PULSES 3
+#define CONTINUATION 0xffffffffU
+#define HEADER_SCHEMA 1
+#define HEADER_RECORD_BATCH 3
+
+/*******************************************************************************
+ * Helpers
+ *******************************************************************************
+ */
+
+static unsigned char samples[64];
+
+/* Fill a raster with PULSES pulses. Pulse i has i % 5 return channels, a
+ * transmit waveform of i + 1 samples, and return waveform k of k + 2 samples.
+ */
+static void fill_raster(struct eaarlio_raster *raster,
+    struct eaarlio_pulse *pulses,
+    uint16_t first)
+{
+    uint16_t i;
+    int k;
+
+    for(i = 0; i < sizeof(samples); i++)
+        samples[i] = (unsigned char)(i * 3);
+
+    *raster = eaarlio_raster_empty();
+    raster->time_seconds = 1000;
+    raster->digitizer = 1;
+    raster->pulse_count = PULSES;
+    raster->pulse = pulses;
+
+    for(i = 0; i < PULSES; i++) {
+        pulses[i] = eaarlio_pulse_empty();
+        pulses[i].time_offset = first + i;
+        pulses[i].scan_angle_counts = -(int16_t)(first + i);
+        pulses[i].range = 100 + first + i;
+        pulses[i].rx_count = (first + i) % 5;
+        pulses[i].bias_rx[3] = 7;
+        pulses[i].tx = samples;
+        pulses[i].tx_len = i + 1;
+        for(k = 0; k < pulses[i].rx_count; k++) {
+            pulses[i].rx[k] = samples + 10;
+            pulses[i].rx_len[k] = k + 2;
+        }
+    }
+}
+
+/* Position of field @p field of the flatbuffer table at @p table, or 0 */
+static uint64_t fb_field(unsigned char const *buf,
+    uint64_t table,
+    uint16_t field)
+{
+    uint64_t vtable = table - (int32_t)eaarlio_int_decode_uint32(buf + table);
+    uint16_t vsize = eaarlio_int_decode_uint16(buf + vtable);
+    uint16_t offset;
+
+    if(4 + 2 * field >= vsize)
+        return 0;
+    offset = eaarlio_int_decode_uint16(buf + vtable + 4 + 2 * field);
+    return offset ? table + offset : 0;
+}
+
+/* Follow the reference at @p at */
+static uint64_t fb_deref(unsigned char const *buf, uint64_t at)
+{
+    return at + eaarlio_int_decode_uint32(buf + at);
+}
+
+static uint64_t decode_uint64(unsigned char const *buf)
+{
+    return (uint64_t)eaarlio_int_decode_uint32(buf)
+        | (uint64_t)eaarlio_int_decode_uint32(buf + 4) << 32;
+}
+
+/**
+ * An encapsulated message
+ */
+struct message {
+    /** Position of the flatbuffer metadata; 0 for end of stream */
+    uint64_t meta;
+    /** Position of the Message table */
+    uint64_t table;
+    /** Position of the header table */
+    uint64_t header;
+    /** Position of the body */
+    uint64_t body;
+    /** MessageHeader type */
+    uint8_t header_type;
+    /** Length of the body */
+    uint64_t body_len;
+};
+
+/* Parse the message at @p pos; returns the position after it */
+static uint64_t read_message(unsigned char const *buf,
+    uint64_t pos,
+    struct message *msg)
+{
+    uint32_t meta_len;
+
+    memset(msg, 0, sizeof(*msg));
+    assert(eaarlio_int_decode_uint32(buf + pos) == CONTINUATION);
+    meta_len = eaarlio_int_decode_uint32(buf + pos + 4);
+    if(meta_len == 0)
+        return pos + 8;
+
+    msg->meta = pos + 8;
+    msg->table = fb_deref(buf, msg->meta);
+    msg->header_type = buf[fb_field(buf, msg->table, 1)];
+    msg->header = fb_deref(buf, fb_field(buf, msg->table, 2));
+    msg->body_len = decode_uint64(buf + fb_field(buf, msg->table, 3));
+    msg->body = msg->meta + meta_len;
+
+    return msg->body + msg->body_len;
+}
+
+/* Offset and length of buffer @p index of a record batch */
+static void batch_buffer(unsigned char const *buf,
+    struct message const *msg,
+    uint32_t index,
+    uint64_t *offset,
+    uint64_t *len)
+{
+    uint64_t vector = fb_deref(buf, fb_field(buf, msg->header, 2));
+    uint64_t at = vector + 4 + 16 * index;
+
+    *offset = msg->body + decode_uint64(buf + at);
+    *len = decode_uint64(buf + at + 8);
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_arrow_writer_init(NULL, NULL, 0, 0, 0, NULL);
+    eaarlio_arrow_writer_write_raster(NULL, 0, NULL);
+    eaarlio_arrow_writer_flush(NULL);
+    eaarlio_arrow_writer_close(NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_arrow_writer_init(NULL, NULL, 0, 0, 0, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_arrow_writer_init(&writer, NULL, 0, 0, 0, NULL));
+    ASSERT_EQ(NULL, writer.internal);
+
+    writer = eaarlio_arrow_writer_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_arrow_writer_write_raster(&writer, 1, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_arrow_writer_write_raster(&writer, 1, &raster));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_arrow_writer_flush(&writer));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_arrow_writer_close(&writer));
+    PASS();
+}
+
+TEST test_bad_format()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_arrow_writer_init(&writer, &stream, 2, 1, 0, NULL));
+    ASSERT_EQ(NULL, writer.internal);
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_write_error()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    unsigned char buf[16];
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, buf, sizeof(buf), "r+", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_WRITE_SHORT,
+        eaarlio_arrow_writer_init(
+            &writer, &stream, EAARLIO_ARROW_STREAM, 1, 0, NULL));
+    ASSERT_EQ(NULL, writer.internal);
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_memory()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_memory memory;
+    struct eaarlio_raster raster;
+    struct eaarlio_pulse pulses[PULSES];
+    struct mock_memory mock;
+
+    fill_raster(&raster, pulses, 1);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+
+    /* The internal state, but not the metadata buffer */
+    mock_memory_new(&memory, &mock, 1);
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        eaarlio_arrow_writer_init(
+            &writer, &stream, EAARLIO_ARROW_FILE, 1, 0, &memory));
+    ASSERT_EQ(NULL, writer.internal);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_reset(&mock, 100);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_FILE, 1, 0, &memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_arrow_writer_write_raster(&writer, 1, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    ASSERT_EQ(NULL, writer.internal);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_destroy(&memory);
+    stream.close(&stream);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_bad_format);
+    RUN_TEST(test_write_error);
+    RUN_TEST(test_memory);
+}
+
+/*******************************************************************************
+ * suite_format
+ *******************************************************************************
+ */
+
+TEST test_empty_stream()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len, pos;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 1, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+
+    pos = read_message(buf, 0, &msg);
+    ASSERT_EQ_FMT(HEADER_SCHEMA, msg.header_type, "%d");
+    ASSERT_EQ_FMT((uint64_t)0, msg.body_len, "%" PRIu64);
+    ASSERT_EQ_FMT((uint64_t)0, msg.meta % 8, "%" PRIu64);
+    ASSERT_EQ_FMT((uint64_t)0, pos % 8, "%" PRIu64);
+
+    /* Schema: endianness, fields */
+    ASSERT_EQ_FMT((uint32_t)15,
+        eaarlio_int_decode_uint32(
+            buf + fb_deref(buf, fb_field(buf, msg.header, 1))),
+        "%" PRIu32);
+
+    pos = read_message(buf, pos, &msg);
+    ASSERT_EQ_FMT((uint64_t)0, msg.meta, "%" PRIu64);
+    ASSERT_EQ_FMT(len, pos, "%" PRIu64);
+
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_no_waveforms_schema()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 0, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+
+    read_message(buf, 0, &msg);
+    ASSERT_EQ_FMT((uint32_t)13,
+        eaarlio_int_decode_uint32(
+            buf + fb_deref(buf, fb_field(buf, msg.header, 1))),
+        "%" PRIu32);
+
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_file_layout()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_raster raster;
+    struct eaarlio_pulse pulses[PULSES];
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len, pos, footer, blocks, batch;
+    uint32_t footer_len;
+
+    fill_raster(&raster, pulses, 1);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_FILE, 1, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_arrow_writer_write_raster(&writer, 1, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+
+    ASSERT_MEM_EQ("ARROW1\0\0", buf, 8);
+    ASSERT_MEM_EQ("ARROW1", buf + len - 6, 6);
+
+    pos = read_message(buf, 8, &msg);
+    ASSERT_EQ_FMT(HEADER_SCHEMA, msg.header_type, "%d");
+    batch = pos;
+    pos = read_message(buf, pos, &msg);
+    ASSERT_EQ_FMT(HEADER_RECORD_BATCH, msg.header_type, "%d");
+    pos = read_message(buf, pos, &msg);
+    ASSERT_EQ_FMT((uint64_t)0, msg.meta, "%" PRIu64);
+
+    /* The footer follows the end of stream marker */
+    footer_len = eaarlio_int_decode_uint32(buf + len - 10);
+    ASSERT_EQ_FMT(len - 10 - footer_len, pos, "%" PRIu64);
+
+    /* Footer: version, schema, dictionaries, recordBatches */
+    footer = fb_deref(buf, pos);
+    blocks = fb_deref(buf, fb_field(buf, footer, 3));
+    ASSERT_EQ_FMT((uint32_t)1, eaarlio_int_decode_uint32(buf + blocks),
+        "%" PRIu32);
+    ASSERT_EQ_FMT(batch, decode_uint64(buf + blocks + 4), "%" PRIu64);
+
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_batches()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_raster raster;
+    struct eaarlio_pulse pulses[PULSES];
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len, pos;
+    int i;
+
+    fill_raster(&raster, pulses, 1);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 1, 5, NULL));
+
+    /* Batches are only written at raster boundaries, so four rasters of
+     * three pulses make two batches of six
+     */
+    for(i = 1; i <= 4; i++)
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_arrow_writer_write_raster(&writer, i, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_flush(&writer));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+    pos = read_message(buf, 0, &msg);
+    for(i = 0; i < 2; i++) {
+        pos = read_message(buf, pos, &msg);
+        ASSERT_EQ_FMT(HEADER_RECORD_BATCH, msg.header_type, "%d");
+        ASSERT_EQ_FMT((uint64_t)6,
+            decode_uint64(buf + fb_field(buf, msg.header, 0)), "%" PRIu64);
+    }
+    ASSERT_EQ_FMT(len, pos, "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_no_pulses()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    unsigned char *buf;
+    uint64_t len, before;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 1, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+    before = len;
+
+    raster.pulse_count = 5;
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_arrow_writer_write_raster(&writer, 1, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_flush(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+    ASSERT_EQ_FMT(before, len, "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    stream.close(&stream);
+    PASS();
+}
+
+SUITE(suite_format)
+{
+    RUN_TEST(test_empty_stream);
+    RUN_TEST(test_no_waveforms_schema);
+    RUN_TEST(test_file_layout);
+    RUN_TEST(test_batches);
+    RUN_TEST(test_no_pulses);
+}
+
+/*******************************************************************************
+ * suite_values
+ *******************************************************************************
+ */
+
+TEST test_columns()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_raster raster;
+    struct eaarlio_pulse pulses[PULSES];
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len, pos, offset, size;
+    int i;
+
+    fill_raster(&raster, pulses, 2);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 0, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_arrow_writer_write_raster(&writer, 42, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_flush(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+
+    pos = read_message(buf, 0, &msg);
+    read_message(buf, pos, &msg);
+    ASSERT_EQ_FMT((uint64_t)0, msg.body % 8, "%" PRIu64);
+
+    /* Each scalar column has an empty validity buffer, then its data */
+    batch_buffer(buf, &msg, 0, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)0, size, "%" PRIu64);
+
+    batch_buffer(buf, &msg, 1, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(4 * PULSES), size, "%" PRIu64);
+    for(i = 0; i < PULSES; i++)
+        ASSERT_EQ_FMT((uint32_t)42,
+            eaarlio_int_decode_uint32(buf + offset + 4 * i), "%" PRIu32);
+
+    batch_buffer(buf, &msg, 3, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(2 * PULSES), size, "%" PRIu64);
+    for(i = 0; i < PULSES; i++)
+        ASSERT_EQ_FMT(i + 1,
+            eaarlio_int_decode_uint16(buf + offset + 2 * i), "%d");
+
+    /* scan_angle_counts */
+    batch_buffer(buf, &msg, 13, &offset, &size);
+    for(i = 0; i < PULSES; i++)
+        ASSERT_EQ_FMT(-(2 + i),
+            (int16_t)eaarlio_int_decode_uint16(buf + offset + 2 * i), "%d");
+
+    /* bias_rx: the fixed size list has only a validity buffer, then its
+     * child has validity and data
+     */
+    batch_buffer(buf, &msg, 24, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)0, size, "%" PRIu64);
+    batch_buffer(buf, &msg, 26, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(4 * PULSES), size, "%" PRIu64);
+    ASSERT_EQ_FMT(7, buf[offset + 3], "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    stream.close(&stream);
+    PASS();
+}
+
+TEST test_waveforms()
+{
+    struct eaarlio_arrow_writer writer;
+    struct eaarlio_stream stream;
+    struct eaarlio_raster raster;
+    struct eaarlio_pulse pulses[PULSES];
+    struct message msg;
+    unsigned char *buf;
+    uint64_t len, pos, offset, size;
+    uint32_t expected;
+    int i, k;
+
+    /* Pulses 3, 4, 5 have 3, 4, and 0 return channels */
+    fill_raster(&raster, pulses, 3);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_init(
+        &writer, &stream, EAARLIO_ARROW_STREAM, 1, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_arrow_writer_write_raster(&writer, 1, &raster));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_flush(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &buf, &len));
+
+    pos = read_message(buf, 0, &msg);
+    read_message(buf, pos, &msg);
+
+    /* tx offsets, then samples */
+    batch_buffer(buf, &msg, 28, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(4 * (PULSES + 1)), size, "%" PRIu64);
+    expected = 0;
+    for(i = 0; i <= PULSES; i++) {
+        ASSERT_EQ_FMT(expected,
+            eaarlio_int_decode_uint32(buf + offset + 4 * i), "%" PRIu32);
+        expected += i + 1;
+    }
+    batch_buffer(buf, &msg, 30, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)6, size, "%" PRIu64);
+    ASSERT_MEM_EQ(samples, buf + offset, 1);
+    ASSERT_MEM_EQ(samples, buf + offset + 1, 2);
+    ASSERT_MEM_EQ(samples, buf + offset + 3, 3);
+
+    /* rx offsets into the list of waveforms */
+    batch_buffer(buf, &msg, 32, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(4 * (PULSES + 1)), size, "%" PRIu64);
+    ASSERT_EQ_FMT((uint32_t)3, eaarlio_int_decode_uint32(buf + offset + 4),
+        "%" PRIu32);
+    ASSERT_EQ_FMT((uint32_t)7, eaarlio_int_decode_uint32(buf + offset + 8),
+        "%" PRIu32);
+    ASSERT_EQ_FMT((uint32_t)7, eaarlio_int_decode_uint32(buf + offset + 12),
+        "%" PRIu32);
+
+    /* Waveform offsets into the samples */
+    batch_buffer(buf, &msg, 34, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)(4 * 8), size, "%" PRIu64);
+    expected = 0;
+    for(i = 0; i < 2; i++) {
+        for(k = 0; k < 3 + i; k++) {
+            expected += k + 2;
+            ASSERT_EQ_FMT(expected,
+                eaarlio_int_decode_uint32(buf + offset + 4 + 4 * (3 * i + k)),
+                "%" PRIu32);
+        }
+    }
+    batch_buffer(buf, &msg, 36, &offset, &size);
+    ASSERT_EQ_FMT((uint64_t)expected, size, "%" PRIu64);
+    ASSERT_MEM_EQ(samples + 10, buf + offset, 2);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_arrow_writer_close(&writer));
+    stream.close(&stream);
+    PASS();
+}
+
+SUITE(suite_values)
+{
+    RUN_TEST(test_columns);
+    RUN_TEST(test_waveforms);
+}
+
+/*******************************************************************************
+ * Run tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_format);
+    RUN_SUITE(suite_values);
+
+    GREATEST_MAIN_END();
+}
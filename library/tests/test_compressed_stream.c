@@ -0,0 +1,360 @@
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char const tld_fn[] = DATADIR "/010909-014641.tld";
+#define tld_len 80040
+#define tld_rasters 4
+#define record_len 20010
+
+/* Contents of the test TLD file */
+static unsigned char tld_data[tld_len];
+
+/*******************************************************************************
+ * Helpers
+ *******************************************************************************
+ */
+
+/* Compress len bytes of data into a new growable memory stream */
+static eaarlio_error compress_data(struct eaarlio_stream *out,
+    unsigned char *data,
+    uint64_t len,
+    uint32_t block_size,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream in;
+    eaarlio_error err;
+
+    err = eaarlio_memory_stream(&in, data, len, "r", NULL);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_memory_stream(out, NULL, 0, "w", NULL);
+    if(err == EAARLIO_SUCCESS)
+        err = eaarlio_compress_stream(out, &in, block_size, memory);
+
+    in.close(&in);
+    return err;
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_compress_stream(NULL, NULL, 0, NULL);
+    eaarlio_compressed_stream(NULL, NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stream stream, inner;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&inner, NULL, 0, "w", NULL));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_compress_stream(NULL, &inner, 0, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_compress_stream(&inner, NULL, 0, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_compressed_stream(NULL, &inner, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_compressed_stream(&stream, NULL, NULL));
+    ASSERT_EQ(NULL, stream.data);
+
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+    PASS();
+}
+
+TEST test_block_size_too_large()
+{
+    struct eaarlio_stream stream;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        compress_data(&stream, tld_data, tld_len,
+            EAARLIO_COMPRESSED_BLOCK_SIZE_MAX + 1, NULL));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_block_size_too_large);
+}
+
+/*******************************************************************************
+ * suite_roundtrip
+ *******************************************************************************
+ */
+
+/* Compress the test TLD, then read it back in full and by raster */
+TEST test_roundtrip(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    uint32_t block_size)
+{
+    struct eaarlio_stream packed, stream, file;
+    struct eaarlio_raster expected, got;
+    unsigned char *out = malloc(tld_len);
+    unsigned char *buf;
+    uint64_t packed_len;
+    int64_t position;
+    int i, order[tld_rasters] = { 2, 0, 3, 1 };
+
+    ASSERT(out);
+    ASSERT_EAARLIO_SUCCESS(
+        compress_data(&packed, tld_data, tld_len, block_size, memory));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EAARLIO_SUCCESS(packed.tell(&packed, &position));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream_buffer(&packed, &buf, &packed_len));
+    ASSERT_EQ_FMT((int64_t)packed_len, position, "%" PRId64);
+    ASSERT(packed_len < tld_len);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_compressed_stream(&stream, &packed, memory));
+    ASSERT_EQ(NULL, packed.data);
+
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, tld_len, out));
+    ASSERT_MEM_EQ(tld_data, out, tld_len);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, out));
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -10, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT((int64_t)tld_len - 10, position, "%" PRId64);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 20, out));
+    ASSERT_MEM_EQ(tld_data + tld_len - 10, out, 10);
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL, stream.write(&stream, 1, out));
+
+    /* Rasters read at their record offsets, out of order */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, tld_fn, "r"));
+    for(i = 0; i < tld_rasters; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            file.seek(&file, (int64_t)order[i] * record_len, SEEK_SET));
+        ASSERT_EAARLIO_SUCCESS(
+            stream.seek(&stream, (int64_t)order[i] * record_len, SEEK_SET));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_read_raster(&file, &expected, NULL, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_read_raster(&stream, &got, NULL, 1, 1));
+        ASSERT_EQ_FMT(
+            expected.sequence_number, got.sequence_number, "%" PRIu32);
+        ASSERT_EQ_FMT(expected.pulse_count, got.pulse_count, "%d");
+        ASSERT_MEM_EQ(expected.pulse[0].rx[0], got.pulse[0].rx[0],
+            expected.pulse[0].rx_len[0]);
+        eaarlio_raster_free(&expected, NULL);
+        eaarlio_raster_free(&got, NULL);
+    }
+    ASSERT_EAARLIO_SUCCESS(file.close(&file));
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    free(out);
+    PASS();
+}
+
+/* Data that does not compress is stored as-is and still reads back */
+TEST test_incompressible(struct eaarlio_memory *memory,
+    struct mock_memory *mock)
+{
+    struct eaarlio_stream packed, stream;
+    unsigned char data[5000], out[5000];
+    unsigned char *buf;
+    uint64_t packed_len;
+    uint32_t i, seed = 1;
+
+    for(i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245U + 12345U;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(
+        compress_data(&packed, data, sizeof(data), 1024, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream_buffer(&packed, &buf, &packed_len));
+    /* Header, raw blocks, and 5 index entries */
+    ASSERT_EQ_FMT((uint64_t)(32 + sizeof(data) + 5 * 12), packed_len,
+        "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_compressed_stream(&stream, &packed, memory));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 3000, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 2000, out + 3000));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 3000, out));
+    ASSERT_MEM_EQ(data, out, sizeof(data));
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+TEST test_empty(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream packed, stream;
+    unsigned char out[1];
+    int64_t position;
+
+    ASSERT_EAARLIO_SUCCESS(compress_data(&packed, NULL, 0, 0, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_compressed_stream(&stream, &packed, memory));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, out));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 0, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT((int64_t)0, position, "%" PRId64);
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_roundtrip)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 20);
+    RUN_TESTp(test_roundtrip, &memory, &mock, 0);
+
+    /* Records span block boundaries */
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_roundtrip, &memory, &mock, 1000);
+
+    /* A single block holds the whole file */
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_roundtrip, &memory, &mock, 1000000);
+
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_incompressible, &memory, &mock);
+
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_empty, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_corrupt
+ *******************************************************************************
+ */
+
+/* Set a byte in a copy of a compressed container, optionally truncate it, and
+ * try to read it all. If in_index is set, offset is relative to the start of
+ * the block index.
+ */
+TEST test_corrupt(char const *msg,
+    uint64_t offset,
+    int in_index,
+    unsigned char value,
+    uint64_t truncate,
+    eaarlio_error open_err,
+    eaarlio_error read_err)
+{
+    struct eaarlio_stream packed, inner, stream;
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+    unsigned char *buf, *copy;
+    unsigned char *out = malloc(tld_len);
+    uint64_t len;
+
+    ASSERTm(msg, out);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, compress_data(&packed, tld_data, tld_len, 4096, NULL));
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream_buffer(&packed, &buf, &len));
+    copy = malloc(len);
+    ASSERTm(msg, copy);
+    memcpy(copy, buf, len);
+    ASSERT_EAARLIO_SUCCESSm(msg, packed.close(&packed));
+
+    /* The index offset is the low 4 bytes at 24 in the header */
+    if(in_index)
+        offset += (uint64_t)copy[24] | (uint64_t)copy[25] << 8
+            | (uint64_t)copy[26] << 16 | (uint64_t)copy[27] << 24;
+    if(offset < len)
+        copy[offset] = value;
+    if(truncate)
+        len = truncate;
+
+    mock_memory_new(&memory, &mock, 20);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream(&inner, copy, len, "r", NULL));
+    ASSERT_EAARLIO_ERRm(
+        msg, open_err, eaarlio_compressed_stream(&stream, &inner, &memory));
+
+    if(open_err == EAARLIO_SUCCESS) {
+        ASSERT_EAARLIO_ERRm(msg, read_err, stream.read(&stream, tld_len, out));
+        ASSERT_EAARLIO_SUCCESSm(msg, stream.close(&stream));
+    } else {
+        /* The inner stream is left to the caller */
+        ASSERTm(msg, inner.data);
+        ASSERT_EAARLIO_SUCCESSm(msg, inner.close(&inner));
+    }
+    ASSERT_EQ_FMTm(msg, 0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_destroy(&memory);
+    free(copy);
+    free(out);
+    PASS();
+}
+
+SUITE(suite_corrupt)
+{
+    RUN_TESTp(test_corrupt, "magic", 0, 0, 'X', 0, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "version", 8, 0, 9, 0, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "block size", 15, 0, 0x7f, 0, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "header only", 0, 0, 'E', 20, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "no index", 0, 0, 'E', 100, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "block too long", 9, 1, 0x7f, 0, EAARLIO_CORRUPT,
+        EAARLIO_SUCCESS);
+    RUN_TESTp(test_corrupt, "block past end", 5, 1, 0x7f, 0, EAARLIO_SUCCESS,
+        EAARLIO_CORRUPT);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    FILE *f = fopen(tld_fn, "rb");
+    if(!f || fread(tld_data, 1, tld_len, f) != tld_len) {
+        fprintf(stderr, "Unable to load %s\n", tld_fn);
+        return 1;
+    }
+    fclose(f);
+
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_roundtrip);
+    RUN_SUITE(suite_corrupt);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,486 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/memory_tracking.h"
+#include "eaarlio/pulse.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/tld_constants.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* These tests hold the decoding paths to an allocation budget. The budget for
+ * each raster is worked out from what it decodes to: one block for its pulse
+ * array and one per waveform, plus the record buffer when it is read on its
+ * own. Anything beyond that, and beyond the fixed costs below, fails the test.
+ * If a change genuinely needs more, raise the matching constant here.
+ */
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define FILE_COUNT 3
+
+/* Allocations made by eaarlio_tld_read_raster for the record itself: the
+ * header buffer, and resizing it to hold the raster
+ */
+#define RECORD_ALLOCS 2
+
+/* Most allocations and bytes used to open a TLD file through the flight: the
+ * file's path, and the stream wrapper that collects statistics
+ */
+#define OPEN_ALLOCS 2
+#define OPEN_BYTES (sizeof(DATADIR) + 128)
+
+/* Allocations made once by eaarlio_flight_plan: the plan entries and extents,
+ * and the read buffer
+ */
+#define PLAN_ALLOCS 3
+
+/* More allocations made by eaarlio_flight_plan to deliver rasters in the
+ * caller's order: the held rasters, their time offsets, and ready flags
+ */
+#define REORDER_ALLOCS 3
+
+/* Most bytes of planning state for each raster requested */
+#define PLAN_BYTES_PER_RASTER 64
+
+/* Allocations made once by eaarlio_flight_parallel_for: the raster list, the
+ * plan entries and extents, and the workers
+ */
+#define PARALLEL_ALLOCS 4
+
+/* Allocations made for each worker by eaarlio_flight_parallel_for: its read
+ * buffer
+ */
+#define WORKER_ALLOCS 1
+
+/* Most bytes of worker state for each worker, not counting its read buffer */
+#define WORKER_BYTES 512
+
+/* What decoding is allowed to cost */
+struct budget {
+    /* Allocations and resizes */
+    uint64_t allocs;
+    /* Bytes requested by them */
+    uint64_t bytes;
+    /* Bytes read from storage */
+    uint64_t read;
+};
+
+/* Budgets of the rasters delivered by a flight, indexed as delivered */
+struct delivery {
+    struct budget budgets[RASTER_COUNT];
+    int include_pulses;
+    int include_waveforms;
+};
+
+/* Flight loaded without tracking, for its EDB */
+static struct eaarlio_flight edb_flight;
+
+/* Add the cost of the pulse array and waveforms of a decoded raster */
+static void add_decode(struct budget *budget,
+    struct eaarlio_raster const *raster,
+    int include_pulses,
+    int include_waveforms)
+{
+    struct eaarlio_pulse const *pulse;
+    uint16_t i;
+    uint8_t j;
+
+    if(!include_pulses || raster->pulse_count < 1)
+        return;
+
+    budget->allocs++;
+    budget->bytes += raster->pulse_count * sizeof(struct eaarlio_pulse);
+    if(!include_waveforms)
+        return;
+
+    for(i = 0; i < raster->pulse_count; i++) {
+        pulse = &raster->pulse[i];
+        if(pulse->tx_len) {
+            budget->allocs++;
+            budget->bytes += pulse->tx_len;
+        }
+        for(j = 0; j < pulse->rx_count && j < EAARLIO_MAX_RX_COUNT; j++) {
+            if(pulse->rx_len[j]) {
+                budget->allocs++;
+                budget->bytes += pulse->rx_len[j];
+            }
+        }
+    }
+}
+
+/* Add the cost of reading one record with eaarlio_tld_read_raster. Without
+ * pulses, only the headers are read.
+ */
+static void add_record(struct budget *budget,
+    uint32_t record_length,
+    int include_pulses)
+{
+    uint64_t len = EAARLIO_TLD_RECORD_HEADER_SIZE;
+
+    if(include_pulses)
+        len = record_length;
+    else
+        len += EAARLIO_TLD_RASTER_HEADER_SIZE;
+
+    budget->allocs += RECORD_ALLOCS;
+    budget->bytes += len;
+    budget->read += len;
+}
+
+/* Sum of the record lengths of all rasters in the flight */
+static uint64_t flight_length()
+{
+    uint64_t len = 0;
+    uint32_t i;
+
+    for(i = 0; i < edb_flight.edb.record_count; i++)
+        len += edb_flight.edb.records[i].record_length;
+    return len;
+}
+
+/* Sum of the record lengths in the largest TLD file, which is the largest
+ * read buffer the planned paths need for this flight
+ */
+static uint64_t largest_file()
+{
+    uint64_t len, largest = 0;
+    uint32_t i, file;
+
+    for(file = 1; file <= edb_flight.edb.file_count; file++) {
+        len = 0;
+        for(i = 0; i < edb_flight.edb.record_count; i++)
+            if((uint32_t)edb_flight.edb.records[i].file_index == file)
+                len += edb_flight.edb.records[i].record_length;
+        if(len > largest)
+            largest = len;
+    }
+    return largest;
+}
+
+/* Is a measurement within its budget? */
+TEST check_within(char const *what, uint64_t used, uint64_t allowed)
+{
+    static char msg[128];
+
+    if(used > allowed) {
+        snprintf(msg, sizeof(msg),
+            "%s: used %" PRIu64 ", budget %" PRIu64, what, used, allowed);
+        FAILm(msg);
+    }
+    PASS();
+}
+
+/* Does measured use fit the budget? */
+TEST check_budget(struct budget const *budget,
+    struct eaarlio_memory_usage const *usage,
+    uint64_t read)
+{
+    CHECK_CALL(check_within(
+        "allocations", usage->allocs + usage->reallocs, budget->allocs));
+    CHECK_CALL(check_within("bytes allocated", usage->total_bytes,
+        budget->bytes));
+    CHECK_CALL(check_within("bytes read", read, budget->read));
+    ASSERT_EQ_FMT(0, (int)usage->failures, "%d");
+    PASS();
+}
+
+/* Records the budget of each raster delivered by a flight */
+static eaarlio_error budget_raster(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct delivery *delivery = (struct delivery *)ctx;
+    struct budget *budget = &delivery->budgets[index];
+
+    (void)raster_number;
+    (void)time_offset;
+
+    /* Each index is delivered once, so threads never share a slot */
+    *budget = (struct budget){ 0, 0, 0 };
+    add_decode(budget, raster, delivery->include_pulses,
+        delivery->include_waveforms);
+    return EAARLIO_SUCCESS;
+}
+
+/*******************************************************************************
+ * suite_tld
+ *******************************************************************************
+ */
+
+/* Does each record cost no more than its own decoded contents? */
+TEST test_tld_read(int include_pulses, int include_waveforms)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct eaarlio_stats stats;
+    struct eaarlio_stream file, stream;
+    struct eaarlio_edb_record const *record;
+    struct eaarlio_raster raster;
+    struct budget budget;
+    char path[1024];
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+
+    for(i = 0; i < edb_flight.edb.record_count; i++) {
+        record = &edb_flight.edb.records[i];
+        snprintf(path, sizeof(path), "%s/%s", DATADIR,
+            edb_flight.edb.files[record->file_index - 1]);
+        stats = eaarlio_stats_empty();
+        ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, path, "r"));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_stats_stream(&stream, &file, &stats, NULL));
+        ASSERT_EAARLIO_SUCCESS(
+            stream.seek(&stream, record->record_offset, SEEK_SET));
+
+        ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_tld_read_raster(&stream, &raster,
+            &tracking, include_pulses, include_waveforms));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_memory_tracking_usage(&tracking, &usage));
+
+        budget = (struct budget){ 0, 0, 0 };
+        add_record(&budget, record->record_length, include_pulses);
+        add_decode(&budget, &raster, include_pulses, include_waveforms);
+        CHECK_CALL(check_budget(&budget, &usage, stats.bytes_read));
+
+        /* Everything still allocated belongs to the raster */
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, &tracking));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_memory_tracking_usage(&tracking, &usage));
+        ASSERT_EQ_FMT(0, (int)usage.live_blocks, "%d");
+        ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+SUITE(suite_tld)
+{
+    RUN_TESTp(test_tld_read, 0, 0);
+    RUN_TESTp(test_tld_read, 1, 0);
+    RUN_TESTp(test_tld_read, 1, 1);
+}
+
+/*******************************************************************************
+ * suite_flight
+ *******************************************************************************
+ */
+
+/* Does eaarlio_flight_read_raster add nothing but opening each file? */
+TEST test_flight_read_raster(int include_pulses, int include_waveforms)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct eaarlio_stats stats;
+    struct eaarlio_flight flight;
+    struct eaarlio_edb_record const *record;
+    struct eaarlio_raster raster;
+    struct budget budget;
+    int16_t file_index = -1;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, &tracking));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+
+    for(i = 0; i < flight.edb.record_count; i++) {
+        record = &flight.edb.records[i];
+        budget = (struct budget){ 0, 0, 0 };
+        if(record->file_index != file_index) {
+            budget.allocs += OPEN_ALLOCS;
+            budget.bytes += OPEN_BYTES;
+            file_index = record->file_index;
+        }
+
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_reset(&flight));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_read_raster(&flight, &raster,
+            NULL, i + 1, include_pulses, include_waveforms));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_memory_tracking_usage(&tracking, &usage));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+
+        add_record(&budget, record->record_length, include_pulses);
+        add_decode(&budget, &raster, include_pulses, include_waveforms);
+        CHECK_CALL(check_budget(&budget, &usage, stats.bytes_read));
+
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, &tracking));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Does eaarlio_flight_plan stay within its fixed costs, one buffer for the
+ * records, and the decoded rasters?
+ */
+TEST test_flight_plan(int order, int include_pulses, int include_waveforms)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct eaarlio_stats stats;
+    struct eaarlio_flight flight;
+    struct delivery delivery;
+    struct budget budget = { 0, 0, 0 };
+    uint32_t raster_numbers[RASTER_COUNT];
+    uint32_t i;
+
+    /* Request the rasters in reverse, so that caller order must hold them */
+    for(i = 0; i < RASTER_COUNT; i++)
+        raster_numbers[i] = RASTER_COUNT - i;
+
+    delivery.include_pulses = include_pulses;
+    delivery.include_waveforms = include_pulses && include_waveforms;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, &tracking));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, raster_numbers,
+        RASTER_COUNT, order, 0, include_pulses, include_waveforms,
+        &budget_raster, &delivery));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+
+    for(i = 0; i < RASTER_COUNT; i++) {
+        budget.allocs += delivery.budgets[i].allocs;
+        budget.bytes += delivery.budgets[i].bytes;
+    }
+    budget.allocs += PLAN_ALLOCS + FILE_COUNT * OPEN_ALLOCS;
+    budget.bytes += largest_file() + RASTER_COUNT * PLAN_BYTES_PER_RASTER +
+        FILE_COUNT * OPEN_BYTES;
+    if(order == EAARLIO_FLIGHT_ORDER_CALLER) {
+        budget.allocs += REORDER_ALLOCS;
+        budget.bytes += RASTER_COUNT *
+            (sizeof(struct eaarlio_raster) + sizeof(int32_t) + 1);
+    }
+    budget.read = flight_length();
+    CHECK_CALL(check_budget(&budget, &usage, stats.bytes_read));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Does eaarlio_flight_parallel_for stay within its fixed costs, a buffer and
+ * streams for each worker, and the decoded rasters?
+ */
+TEST test_flight_parallel(uint32_t nthreads,
+    int include_pulses,
+    int include_waveforms)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct eaarlio_stats stats;
+    struct eaarlio_flight flight;
+    struct delivery delivery;
+    struct budget budget = { 0, 0, 0 };
+    int flags = 0;
+    uint32_t i;
+
+    if(include_pulses)
+        flags |= EAARLIO_FLIGHT_INCLUDE_PULSES;
+    if(include_waveforms)
+        flags |= EAARLIO_FLIGHT_INCLUDE_WAVEFORMS;
+
+    delivery.include_pulses = include_pulses;
+    delivery.include_waveforms = include_pulses && include_waveforms;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, &tracking));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1,
+        RASTER_COUNT, flags, nthreads, &budget_raster, &delivery));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+
+    for(i = 0; i < RASTER_COUNT; i++) {
+        budget.allocs += delivery.budgets[i].allocs;
+        budget.bytes += delivery.budgets[i].bytes;
+    }
+
+    /* Every file fits in one chunk, so no more than FILE_COUNT workers are
+     * used, and each file is opened once
+     */
+    if(nthreads > FILE_COUNT)
+        nthreads = FILE_COUNT;
+    budget.allocs += PARALLEL_ALLOCS + nthreads * WORKER_ALLOCS +
+        FILE_COUNT * OPEN_ALLOCS;
+    budget.bytes += RASTER_COUNT * (sizeof(uint32_t) + PLAN_BYTES_PER_RASTER) +
+        nthreads * (largest_file() + WORKER_BYTES) + FILE_COUNT * OPEN_BYTES;
+    budget.read = flight_length();
+    CHECK_CALL(check_budget(&budget, &usage, stats.bytes_read));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+SUITE(suite_flight)
+{
+    RUN_TESTp(test_flight_read_raster, 0, 0);
+    RUN_TESTp(test_flight_read_raster, 1, 0);
+    RUN_TESTp(test_flight_read_raster, 1, 1);
+
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_DISK, 0, 0);
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_DISK, 1, 0);
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_DISK, 1, 1);
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_CALLER, 0, 0);
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_CALLER, 1, 0);
+    RUN_TESTp(test_flight_plan, EAARLIO_FLIGHT_ORDER_CALLER, 1, 1);
+
+    RUN_TESTp(test_flight_parallel, 1, 0, 0);
+    RUN_TESTp(test_flight_parallel, 1, 1, 0);
+    RUN_TESTp(test_flight_parallel, 1, 1, 1);
+    RUN_TESTp(test_flight_parallel, 4, 0, 0);
+    RUN_TESTp(test_flight_parallel, 4, 1, 0);
+    RUN_TESTp(test_flight_parallel, 4, 1, 1);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    int result;
+
+    GREATEST_MAIN_BEGIN();
+
+    result = eaarlio_file_flight(&edb_flight, EDB_FILE, DATADIR, NULL);
+    if(result != EAARLIO_SUCCESS) {
+        fprintf(stderr, "Unable to load %s\n", EDB_FILE);
+        return 1;
+    }
+
+    RUN_SUITE(suite_tld);
+    RUN_SUITE(suite_flight);
+
+    eaarlio_flight_free(&edb_flight);
+
+    GREATEST_MAIN_END();
+}
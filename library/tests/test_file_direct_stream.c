@@ -0,0 +1,257 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static char const fn[] = DATADIR "/alphanum.txt";
+static char const raw[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789\n";
+#define raw_len 63
+
+static char const tld_fn[] = DATADIR "/010909-014641.tld";
+#define tld_len 80040
+
+/*******************************************************************************
+ * suite_null
+ *******************************************************************************
+ */
+
+TEST test_null_sanity()
+{
+    eaarlio_file_direct_stream(NULL, NULL, 0, NULL);
+    PASS();
+}
+
+TEST test_null_stream()
+{
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_direct_stream(NULL, fn, 0, NULL));
+    PASS();
+}
+
+TEST test_null_fn()
+{
+    struct eaarlio_stream stream;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_direct_stream(&stream, NULL, 0, NULL));
+    ASSERT_EQ(NULL, stream.data);
+    PASS();
+}
+
+TEST test_missing()
+{
+    struct eaarlio_stream stream;
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_file_direct_stream(
+            &stream, DATADIR "/missing.txt", 0, NULL));
+    ASSERT_EQ(NULL, stream.data);
+    PASS();
+}
+
+SUITE(suite_null)
+{
+    RUN_TEST(test_null_sanity);
+    RUN_TEST(test_null_stream);
+    RUN_TEST(test_null_fn);
+    RUN_TEST(test_missing);
+}
+
+/*******************************************************************************
+ * suite_read
+ *******************************************************************************
+ */
+
+TEST test_read_data(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[raw_len];
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_direct_stream(&stream, fn, 0, memory));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ(raw, buf, 10);
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, raw_len - 10, buf + 10));
+    ASSERT_MEM_EQ(raw, buf, raw_len);
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+TEST test_read_short(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[raw_len + 10];
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_direct_stream(&stream, fn, 0, memory));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, raw_len + 10, buf));
+    ASSERT_MEM_EQ(raw, buf, raw_len);
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, buf));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+TEST test_seek_tell(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[10];
+    int64_t position;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_direct_stream(&stream, fn, 0, memory));
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 5, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT(5, position, "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ(raw + 5, buf, 10);
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT(15, position, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -12, SEEK_CUR));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 3, buf));
+    ASSERT_MEM_EQ(raw + 3, buf, 3);
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -11, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT(raw_len - 11, position, "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ("0123456789", buf, 10);
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, stream.seek(&stream, -1, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_INVALID, stream.seek(&stream, 0, 99));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &position));
+    ASSERT_EQ_FMT(raw_len - 1, position, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+TEST test_write(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_direct_stream(&stream, fn, 0, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL,
+        stream.write(&stream, 3, (unsigned char const *)"abc"));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Do reads that straddle buffer boundaries match a normal file stream? */
+TEST test_read_blocks(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    uint64_t chunk)
+{
+    static unsigned char expected[tld_len];
+    static unsigned char actual[tld_len];
+    struct eaarlio_stream stream;
+    uint64_t done, len;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&stream, tld_fn, "r"));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, tld_len, expected));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+
+    memset(actual, 0, tld_len);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_direct_stream(&stream, tld_fn, 4096, memory));
+    for(done = 0; done < tld_len; done += len) {
+        len = tld_len - done < chunk ? tld_len - done : chunk;
+        ASSERT_EAARLIO_SUCCESS(stream.read(&stream, len, actual + done));
+    }
+    ASSERT_MEM_EQ(expected, actual, tld_len);
+
+    /* Backtrack into an earlier block */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 5000, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 9000, actual));
+    ASSERT_MEM_EQ(expected + 5000, actual, 9000);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Can TLD records be read through a small direct buffer? */
+TEST test_read_records(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster;
+    uint32_t count = 0;
+    eaarlio_error err;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_direct_stream(&stream, tld_fn, 4096, memory));
+    while(1) {
+        err = eaarlio_tld_read_record(
+            &stream, &header, &raster, memory, 1, 1);
+        if(err == EAARLIO_STREAM_READ_SHORT)
+            break;
+        ASSERT_EAARLIO_SUCCESS(err);
+        count++;
+        ASSERT_EQ_FMT(count, raster.sequence_number, "%u");
+        ASSERT_EQ_FMT(119, raster.pulse_count, "%d");
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, memory));
+    }
+    ASSERT_EQ_FMT(4, count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_read)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_read_data, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_read_short, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_seek_tell, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_read_blocks, &memory, &mock, 1000);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_read_blocks, &memory, &mock, 7777);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_read_blocks, &memory, &mock, tld_len);
+
+    mock_memory_reset(&mock, 10000);
+    RUN_TESTp(test_read_records, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_null);
+    RUN_SUITE(suite_read);
+
+    GREATEST_MAIN_END();
+}
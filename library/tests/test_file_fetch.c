@@ -0,0 +1,363 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_raster_log.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+#define EDB_FILE (DATADIR "/flight.idx")
+
+static int const backends[] = { EAARLIO_FETCH_AUTO, EAARLIO_FETCH_STREAM,
+    EAARLIO_FETCH_PREAD, EAARLIO_FETCH_IO_URING };
+static char const *const backend_names[] = { "auto", "stream", "pread",
+    "io_uring" };
+#define BACKEND_COUNT 4
+
+TEST test_sanity()
+{
+    eaarlio_file_flight_fetch(NULL, NULL, NULL, 0, 0, 0, 0, 0, NULL, NULL);
+    PASS();
+}
+
+TEST test_null_flight()
+{
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_fetch(NULL, DATADIR, rasters, 1,
+            EAARLIO_FETCH_AUTO, 0, 0, 0, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_null_path()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_fetch(&flight, NULL, rasters, 1,
+            EAARLIO_FETCH_AUTO, 0, 0, 0, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_null_fn()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    uint32_t rasters[] = { 1 };
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_fetch(&flight, DATADIR, rasters, 1,
+            EAARLIO_FETCH_AUTO, 0, 0, 0, NULL, NULL));
+    PASS();
+}
+
+TEST test_bad_backend()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_file_flight_fetch(&flight, DATADIR, rasters, 1, 4, 0, 0, 0,
+            &util_raster_log_fn, &log));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_file_flight_fetch(&flight, DATADIR, rasters, 1, -1, 0, 0, 0,
+            &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_available()
+{
+    ASSERT(eaarlio_file_fetch_available(EAARLIO_FETCH_AUTO));
+    ASSERT(eaarlio_file_fetch_available(EAARLIO_FETCH_STREAM));
+    ASSERT_FALSE(eaarlio_file_fetch_available(-1));
+    ASSERT_FALSE(eaarlio_file_fetch_available(4));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null_flight);
+    RUN_TEST(test_null_path);
+    RUN_TEST(test_null_fn);
+    RUN_TEST(test_bad_backend);
+    RUN_TEST(test_available);
+}
+
+/* Is every requested raster delivered exactly once with the right data? */
+TEST test_fetch(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int backend,
+    unsigned int queue_depth)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 10, 1, 5, 3, 8, 2, 5, 7 };
+    uint32_t count = sizeof(rasters) / sizeof(rasters[0]);
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_fetch(&flight, DATADIR,
+        rasters, count, backend, queue_depth, 1, 1, &util_raster_log_fn, &log));
+
+    ASSERT_EQ_FMT(count, log.count, "%u");
+    for(i = 0; i < count; i++) {
+        ASSERT_EQ_FMT(1, log.calls[i], "%u");
+        ASSERT_EQ_FMT(rasters[i], log.raster_number[i], "%u");
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT_EQ_FMT(119, log.pulse_count[i], "%d");
+        ASSERT(log.has_pulses[i]);
+        ASSERT(log.has_waveforms[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Is pulse and waveform decoding skipped when not requested? */
+TEST test_fetch_headers(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int backend)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 4, 9 };
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_fetch(&flight, DATADIR, rasters,
+        2, backend, 0, 0, 0, &util_raster_log_fn, &log));
+
+    ASSERT_EQ_FMT(2, log.count, "%u");
+    for(i = 0; i < 2; i++) {
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT_FALSE(log.has_pulses[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Are invalid raster numbers rejected before anything is delivered? */
+TEST test_fetch_invalid(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int backend)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 1, 2, 11 };
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_file_flight_fetch(&flight, DATADIR, rasters, 3, backend, 0, 0,
+            0, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(0, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Does an error from the callback stop processing without leaking? */
+TEST test_fetch_callback_error(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int backend)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    log.fail_on = 2;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_file_flight_fetch(&flight, DATADIR, rasters, 9, backend, 0, 1,
+            1, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(2, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Is a missing TLD directory reported as an open error? */
+TEST test_fetch_missing(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int backend)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+
+#ifndef EAARLIO_HAVE_PREAD
+    /* Without positional reads, rasters are read through the flight's own
+     * tld_opener, which does not use the path given here
+     */
+    SKIPm("positional reads are not available");
+#endif
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_file_flight_fetch(&flight, DATADIR "/nonexistent", rasters, 1,
+            backend, 0, 0, 0, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(0, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+#ifdef __linux__
+/* Number of descriptors the process has open, or -1 if unknown */
+static int count_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    int count = 0;
+
+    if(!dir)
+        return -1;
+    while(readdir(dir))
+        count++;
+    closedir(dir);
+    return count;
+}
+
+/* Most descriptors opened by a fetch at once, beyond those open before */
+struct fd_log {
+    int base;
+    int max;
+};
+
+static eaarlio_error fd_log_fn(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct fd_log *log = (struct fd_log *)ctx;
+    int count = count_fds();
+
+    (void)index;
+    (void)raster_number;
+    (void)raster;
+    (void)time_offset;
+    if(count - log->base > log->max)
+        log->max = count - log->base;
+    return EAARLIO_SUCCESS;
+}
+#endif
+
+/* Is each TLD file opened only when needed and closed after its last read? */
+TEST test_fetch_descriptors()
+{
+#if defined(EAARLIO_HAVE_PREAD) && defined(__linux__)
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    struct fd_log log = { 0, 0 };
+
+    if(count_fds() < 0)
+        SKIPm("open descriptors cannot be counted");
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT(flight.edb.file_count > 1);
+
+    /* Holding every file open would show all of them here */
+    log.base = count_fds();
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_fetch(&flight, DATADIR, rasters,
+        10, EAARLIO_FETCH_PREAD, 0, 0, 0, &fd_log_fn, &log));
+    ASSERT(log.max <= 1);
+    ASSERT_EQ_FMT(log.base, count_fds(), "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+#else
+    SKIPm("open descriptors cannot be counted without pread on Linux");
+#endif
+}
+
+SUITE(suite_fetch)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+    int i, backend;
+
+    mock_memory_new(&memory, &mock, 10000);
+
+    for(i = 0; i < BACKEND_COUNT; i++) {
+        backend = backends[i];
+
+        if(!eaarlio_file_fetch_available(backend)) {
+            fprintf(stderr, "skipping unavailable backend %s\n",
+                backend_names[i]);
+            continue;
+        }
+
+        mock_memory_reset(&mock, 10000);
+        RUN_TESTp(test_fetch, &memory, &mock, backend, 0);
+        mock_memory_reset(&mock, 10000);
+        RUN_TESTp(test_fetch, &memory, &mock, backend, 1);
+
+        mock_memory_reset(&mock, 1000);
+        RUN_TESTp(test_fetch_headers, &memory, &mock, backend);
+
+        mock_memory_reset(&mock, 100);
+        RUN_TESTp(test_fetch_invalid, &memory, &mock, backend);
+
+        mock_memory_reset(&mock, 10000);
+        RUN_TESTp(test_fetch_callback_error, &memory, &mock, backend);
+
+        if(backend == EAARLIO_FETCH_STREAM)
+            continue;
+
+        mock_memory_reset(&mock, 100);
+        RUN_TESTp(test_fetch_missing, &memory, &mock, backend);
+    }
+
+    mock_memory_destroy(&memory);
+
+    RUN_TEST(test_fetch_descriptors);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_fetch);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,158 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/flight_writer.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_tempfile.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_tld.c"
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define TLD_COUNT 2
+
+TEST test_sanity()
+{
+    eaarlio_file_flight_writer_open_tld(NULL, NULL, NULL);
+    eaarlio_file_flight_writer_close(NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_flight_writer writer;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_init(&writer, 0, NULL, 0, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_writer_open_tld(NULL, TEMPDIR, "a.tld"));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_writer_open_tld(&writer, NULL, "a.tld"));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_file_flight_writer_open_tld(&writer, TEMPDIR, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_flight_writer_close(NULL, "a.idx"));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_flight_writer_close(&writer, NULL));
+    ASSERT_EQ(NULL, writer.memory);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+}
+
+/* Copy the test flight into new TLD and EDB files, then read it back through
+ * eaarlio_file_flight and compare every raster.
+ */
+TEST test_roundtrip(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    int record_type)
+{
+    struct eaarlio_flight flight, copy;
+    struct eaarlio_flight_writer writer;
+    struct eaarlio_raster raster, got;
+    char *edb_file = util_tempfile();
+    char *tld_path[TLD_COUNT];
+    char const *tld_file[TLD_COUNT];
+    uint32_t i, raster_number;
+    int f;
+
+    ASSERT(edb_file);
+    for(f = 0; f < TLD_COUNT; f++) {
+        tld_path[f] = util_tempfile();
+        ASSERT(tld_path[f]);
+        tld_file[f] = strrchr(tld_path[f], '/') + 1;
+    }
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_init(
+        &writer, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_set_record_type(&writer, record_type));
+
+    for(i = 1; i <= RASTER_COUNT; i++) {
+        if(i == 1 || i == RASTER_COUNT / 2 + 1)
+            ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_writer_open_tld(
+                &writer, TEMPDIR, tld_file[i == 1 ? 0 : 1]));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_write_raster(
+            &writer, &raster, &raster_number));
+        ASSERT_EQ_FMT(i, raster_number, "%" PRIu32);
+        eaarlio_raster_free(&raster, NULL);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_writer_close(&writer, edb_file));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&copy, edb_file, TEMPDIR, NULL));
+    ASSERT_EQ_FMT((uint32_t)RASTER_COUNT, copy.edb.record_count, "%" PRIu32);
+    ASSERT_EQ_FMT((uint32_t)TLD_COUNT, copy.edb.file_count, "%" PRIu32);
+
+    for(i = 1; i <= RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&copy, &got, NULL, i, 1, 1));
+        CHECK_CALL(check_raster("copy", &raster, &got));
+
+        /* Packed records are smaller */
+        if(record_type == EAARLIO_TLD_TYPE_RASTER_WFPACK)
+            ASSERT(copy.edb.records[i - 1].record_length
+                < flight.edb.records[i - 1].record_length);
+        else
+            ASSERT_EQ_FMT(flight.edb.records[i - 1].record_length,
+                copy.edb.records[i - 1].record_length, "%" PRIu32);
+        eaarlio_raster_free(&raster, NULL);
+        eaarlio_raster_free(&got, NULL);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&copy));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+
+    remove(edb_file);
+    free(edb_file);
+    for(f = 0; f < TLD_COUNT; f++) {
+        remove(tld_path[f]);
+        free(tld_path[f]);
+    }
+    PASS();
+}
+
+SUITE(suite_roundtrip)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 100);
+    RUN_TESTp(test_roundtrip, &memory, &mock, EAARLIO_TLD_TYPE_RASTER);
+    mock_memory_reset(&mock, 100);
+    RUN_TESTp(test_roundtrip, &memory, &mock, EAARLIO_TLD_TYPE_RASTER_WFPACK);
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_roundtrip);
+
+    GREATEST_MAIN_END();
+}
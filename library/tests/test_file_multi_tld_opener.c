@@ -0,0 +1,339 @@
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_file.h"
+#include "util_tempfile.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_tld.c"
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define MISSING_DIR (DATADIR "/missing")
+
+/* Open name with opener and check that it starts with exp */
+TEST check_open(struct eaarlio_tld_opener *opener,
+    char const *name,
+    char const *exp)
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[5];
+
+    ASSERT_EAARLIO_SUCCESSm(name, opener->open_tld(opener, &stream, name));
+    ASSERT_EAARLIO_SUCCESSm(name, stream.read(&stream, 5, buf));
+    ASSERT_MEM_EQm(name, exp, buf, 5);
+    ASSERT_EAARLIO_SUCCESSm(name, stream.close(&stream));
+    PASS();
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_file_multi_tld_opener(NULL, NULL, 0, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_tld_opener opener;
+    char const *paths[] = { DATADIR, NULL };
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_multi_tld_opener(NULL, paths, 1, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_multi_tld_opener(&opener, NULL, 1, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_multi_tld_opener(&opener, paths, 2, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_file_multi_tld_opener(&opener, paths, 0, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_multi_tld_opener_forget(NULL));
+    PASS();
+}
+
+TEST test_invalid()
+{
+    struct eaarlio_tld_opener opener, bad;
+    struct eaarlio_stream stream;
+    char const *paths[] = { DATADIR };
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, paths, 1, NULL));
+    bad = opener;
+    bad.opaque = NULL;
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        bad.open_tld(&bad, &stream, "alphanum.txt"));
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID, bad.close(&bad));
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_file_multi_tld_opener_forget(&bad));
+    bad = eaarlio_tld_opener_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_file_multi_tld_opener_forget(&bad));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    PASS();
+}
+
+TEST test_alloc_fail(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_tld_opener opener;
+    char const *paths[] = { MISSING_DIR, DATADIR };
+    int limit;
+
+    /* Every allocation made while opening can fail without leaking */
+    for(limit = 0; limit < 5; limit++) {
+        mock_memory_reset(mock, limit);
+        ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+            eaarlio_file_multi_tld_opener(&opener, paths, 2, memory));
+        ASSERT_EQ(NULL, opener.opaque);
+        ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    }
+
+    mock_memory_reset(mock, 5);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, paths, 2, memory));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_invalid);
+
+    mock_memory_new(&memory, &mock, 0);
+    RUN_TESTp(test_alloc_fail, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_lookup
+ *******************************************************************************
+ */
+
+/* Earlier paths take precedence */
+TEST test_order()
+{
+    struct eaarlio_tld_opener opener;
+    char const *temp_first[] = { MISSING_DIR, TEMPDIR, DATADIR };
+    char const *data_first[] = { DATADIR, TEMPDIR };
+    char const *fn = TEMPDIR "/alphanum.txt";
+
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "ZYXWV"));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, temp_first, 3, NULL));
+    CHECK_CALL(check_open(&opener, "alphanum.txt", "ZYXWV"));
+    CHECK_CALL(check_open(&opener, "alphanum.txt", "ZYXWV"));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, data_first, 2, NULL));
+    CHECK_CALL(check_open(&opener, "alphanum.txt", "abcde"));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    remove(fn);
+    PASS();
+}
+
+/* Files that are found are remembered, and so are files that are not until
+ * the opener is told to forget them
+ */
+TEST test_cache(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_tld_opener first, second;
+    struct eaarlio_stream stream;
+    char const *paths[] = { MISSING_DIR, TEMPDIR };
+    char *fn = util_tempfile();
+    char const *name;
+    int used;
+
+    ASSERT(fn);
+    name = strrchr(fn, '/') + 1;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&first, paths, 2, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        first.open_tld(&first, &stream, name));
+    used = mock->ptrs_used;
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        first.open_tld(&first, &stream, name));
+    ASSERT_EQ_FMT(used, mock->ptrs_used, "%d");
+
+    /* A file that appears after a failed search is found once the miss is
+     * forgotten
+     */
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "12345"));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        first.open_tld(&first, &stream, name));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_multi_tld_opener_forget(&first));
+    CHECK_CALL(check_open(&first, name, "12345"));
+
+    /* Another opener finds it too, and opens it again without allocating */
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&second, paths, 2, memory));
+    CHECK_CALL(check_open(&second, name, "12345"));
+    used = mock->ptrs_used;
+    CHECK_CALL(check_open(&second, name, "12345"));
+    CHECK_CALL(check_open(&second, name, "12345"));
+    ASSERT_EQ_FMT(used, mock->ptrs_used, "%d");
+
+    /* If it goes away, it is searched for again; forgetting misses keeps
+     * the files that were found
+     */
+    remove(fn);
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        second.open_tld(&second, &stream, name));
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "67890"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_multi_tld_opener_forget(&second));
+    CHECK_CALL(check_open(&second, name, "67890"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_multi_tld_opener_forget(&second));
+    used = mock->ptrs_used;
+    CHECK_CALL(check_open(&second, name, "67890"));
+    ASSERT_EQ_FMT(used, mock->ptrs_used, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(first.close(&first));
+    ASSERT_EAARLIO_SUCCESS(second.close(&second));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    remove(fn);
+    free(fn);
+    PASS();
+}
+
+/* A compressed copy is used only when the file itself is missing */
+TEST test_compressed(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream in, out;
+    char const *paths[] = { MISSING_DIR, TEMPDIR };
+    char *fn = util_tempfile();
+    char *zfn;
+    char const *name;
+
+    ASSERT(fn);
+    name = strrchr(fn, '/') + 1;
+    zfn = malloc(strlen(fn) + strlen(EAARLIO_COMPRESSED_SUFFIX) + 1);
+    ASSERT(zfn);
+    strcpy(zfn, fn);
+    strcat(zfn, EAARLIO_COMPRESSED_SUFFIX);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_stream(&in, DATADIR "/alphanum.txt", "r"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&out, zfn, "w"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_compress_stream(&out, &in, 16, NULL));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, paths, 2, memory));
+    CHECK_CALL(check_open(&opener, name, "abcde"));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "12345"));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&opener, paths, 2, memory));
+    CHECK_CALL(check_open(&opener, name, "12345"));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    remove(fn);
+    remove(zfn);
+    free(fn);
+    free(zfn);
+    PASS();
+}
+
+/* Read the test flight, switching files between each raster */
+TEST test_flight(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight exp, flight;
+    struct eaarlio_stream edb;
+    struct eaarlio_raster raster, got;
+    char const *paths[] = { MISSING_DIR, TEMPDIR, DATADIR };
+    uint32_t i, order[] = { 1, 10, 2, 9, 3, 8, 4, 7, 5, 6 };
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight(&exp, EDB_FILE, DATADIR, NULL));
+
+    flight = eaarlio_flight_empty();
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&edb, EDB_FILE, "r"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_edb_read(&edb, &flight.edb, memory, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(edb.close(&edb));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_multi_tld_opener(&flight.tld_opener, paths, 3, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_init(&flight, memory));
+
+    for(i = 0; i < RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&exp, &raster, NULL, order[i], 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &got, NULL, order[i], 1, 1));
+        CHECK_CALL(check_raster("multi", &raster, &got));
+        eaarlio_raster_free(&raster, NULL);
+        eaarlio_raster_free(&got, memory);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&exp));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_lookup)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_order);
+
+    mock_memory_new(&memory, &mock, 100);
+    RUN_TESTp(test_cache, &memory, &mock);
+
+    mock_memory_reset(&mock, 100);
+    RUN_TESTp(test_compressed, &memory, &mock);
+
+    mock_memory_reset(&mock, 10000);
+    RUN_TESTp(test_flight, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_lookup);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,556 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_file.h"
+#include "util_tempfile.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef EAARLIO_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "data_tld.c"
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define THREAD_COUNT 8
+#define THREAD_PASSES 20
+
+/* Open a flight over a shared opener, taking ownership of the opener */
+static eaarlio_error open_flight(struct eaarlio_flight *flight,
+    struct eaarlio_tld_opener *opener,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream edb;
+    eaarlio_error err;
+
+    *flight = eaarlio_flight_empty();
+    flight->tld_opener = *opener;
+    *opener = eaarlio_tld_opener_empty();
+
+    err = eaarlio_file_stream(&edb, EDB_FILE, "r");
+    if(err == EAARLIO_SUCCESS) {
+        err = eaarlio_edb_read(&edb, &flight->edb, memory, 1, 1);
+        edb.close(&edb);
+    }
+    if(err == EAARLIO_SUCCESS)
+        err = eaarlio_flight_init(flight, memory);
+    if(err != EAARLIO_SUCCESS)
+        eaarlio_flight_free(flight);
+    return err;
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_file_shared_tld_opener(NULL, NULL, 0, NULL);
+    eaarlio_file_shared_tld_opener_share(NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_tld_opener opener, copy;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_shared_tld_opener(NULL, DATADIR, 0, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_shared_tld_opener(&opener, NULL, 0, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_shared_tld_opener_share(NULL, &opener));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_shared_tld_opener_share(&copy, NULL));
+    ASSERT_EQ(NULL, copy.opaque);
+    PASS();
+}
+
+TEST test_share_invalid()
+{
+    struct eaarlio_tld_opener opener, copy;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_tld_opener(&opener, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_file_shared_tld_opener_share(&copy, &opener));
+    ASSERT_EQ(NULL, copy.opaque);
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    opener = eaarlio_tld_opener_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_file_shared_tld_opener_share(&copy, &opener));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_share_invalid);
+}
+
+/*******************************************************************************
+ * suite_stream
+ *******************************************************************************
+ */
+
+TEST test_read(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream first, second;
+    unsigned char buf[8];
+    int64_t pos;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, DATADIR, 0, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &first, "missing.txt"));
+
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &first, "alphanum.txt"));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &second, "alphanum.txt"));
+
+    /* Each stream keeps its own position */
+    ASSERT_EAARLIO_SUCCESS(first.read(&first, 5, buf));
+    ASSERT_MEM_EQ("abcde", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(second.seek(&second, 26, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(second.read(&second, 5, buf));
+    ASSERT_MEM_EQ("ABCDE", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(first.read(&first, 5, buf));
+    ASSERT_MEM_EQ("fghij", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(first.tell(&first, &pos));
+    ASSERT_EQ_FMT((int64_t)10, pos, "%" PRIi64);
+
+    /* A read across the end gets what is available */
+    ASSERT_EAARLIO_SUCCESS(second.seek(&second, -3, SEEK_END));
+    memset(buf, 0, sizeof(buf));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, second.read(&second, 8, buf));
+    ASSERT_EQ_FMT(0, buf[3], "%d");
+    ASSERT_EAARLIO_SUCCESS(second.tell(&second, &pos));
+    ASSERT_EAARLIO_SUCCESS(second.seek(&second, 0, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(second.tell(&second, &pos));
+    ASSERT(pos > 0);
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, second.seek(&second, -1, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_INVALID, second.seek(&second, 0, 99));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL, second.write(&second, 1, buf));
+
+    /* Streams outlive the opener */
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_SUCCESS(first.seek(&first, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(first.read(&first, 1, buf));
+    ASSERT_EQ_FMT('a', buf[0], "%c");
+
+    ASSERT_EAARLIO_SUCCESS(first.close(&first));
+    ASSERT_EQ(NULL, first.data);
+    ASSERT_EAARLIO_SUCCESS(second.close(&second));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Files stay open until they are pushed out of the pool. A file that has
+ * been removed can still be read while its descriptor is pooled.
+ */
+TEST test_pool(uint32_t max_open, int expect_pooled)
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream stream, busy;
+    char *fn = util_tempfile();
+    char *other = util_tempfile();
+    char const *name;
+    unsigned char buf[5];
+
+    ASSERT(fn);
+    name = strrchr(fn, '/') + 1;
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "12345"));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, TEMPDIR, max_open, NULL));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &stream, name));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+
+    /* Replaces the temp file in the pool only if there is no room */
+    remove(fn);
+    ASSERT(other);
+    ASSERT_EAARLIO_SUCCESS(util_file_write(other, "other"));
+    ASSERT_EAARLIO_SUCCESS(
+        opener.open_tld(&opener, &busy, strrchr(other, '/') + 1));
+
+    if(expect_pooled) {
+        ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &stream, name));
+        ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+        ASSERT_MEM_EQ("12345", buf, 5);
+        ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    } else {
+        ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+            opener.open_tld(&opener, &stream, name));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(busy.close(&busy));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    remove(other);
+    free(other);
+    free(fn);
+    PASS();
+}
+
+/* A pool of one still serves several files that are in use at once */
+TEST test_pool_busy()
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream first, second;
+    char *fn1 = util_tempfile();
+    char *fn2 = util_tempfile();
+    unsigned char buf[5];
+
+    ASSERT(fn1);
+    ASSERT(fn2);
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn1, "busy1"));
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn2, "busy2"));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, TEMPDIR, 1, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        opener.open_tld(&opener, &first, strrchr(fn1, '/') + 1));
+    ASSERT_EAARLIO_SUCCESS(
+        opener.open_tld(&opener, &second, strrchr(fn2, '/') + 1));
+
+    ASSERT_EAARLIO_SUCCESS(first.read(&first, 5, buf));
+    ASSERT_MEM_EQ("busy1", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(second.read(&second, 5, buf));
+    ASSERT_MEM_EQ("busy2", buf, 5);
+
+    ASSERT_EAARLIO_SUCCESS(first.close(&first));
+    ASSERT_EAARLIO_SUCCESS(second.close(&second));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    remove(fn1);
+    remove(fn2);
+    free(fn1);
+    free(fn2);
+    PASS();
+}
+
+/* A compressed copy is used only when the file itself is missing */
+TEST test_compressed()
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream in, out, stream;
+    char *fn = util_tempfile();
+    char *zfn;
+    char const *name;
+    unsigned char buf[5];
+
+    ASSERT(fn);
+    name = strrchr(fn, '/') + 1;
+    zfn = malloc(strlen(fn) + strlen(EAARLIO_COMPRESSED_SUFFIX) + 1);
+    ASSERT(zfn);
+    strcpy(zfn, fn);
+    strcat(zfn, EAARLIO_COMPRESSED_SUFFIX);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_stream(&in, DATADIR "/alphanum.txt", "r"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&out, zfn, "w"));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_compress_stream(&out, &in, 16, NULL));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, TEMPDIR, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &stream, name));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_MEM_EQ("abcde", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    ASSERT_EAARLIO_SUCCESS(util_file_write(fn, "12345"));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, TEMPDIR, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &stream, name));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_MEM_EQ("12345", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    remove(fn);
+    remove(zfn);
+    free(fn);
+    free(zfn);
+    PASS();
+}
+
+TEST test_alloc_fail(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_stream stream;
+    int limit;
+
+    for(limit = 0; limit < 2; limit++) {
+        mock_memory_reset(mock, limit);
+        ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+            eaarlio_file_shared_tld_opener(&opener, DATADIR, 0, memory));
+        ASSERT_EQ(NULL, opener.opaque);
+        ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    }
+
+    /* Opening a file needs the stream, path, pool array, file, and name */
+    for(limit = 2; limit < 7; limit++) {
+        mock_memory_reset(mock, limit);
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_file_shared_tld_opener(&opener, DATADIR, 0, memory));
+        ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+            opener.open_tld(&opener, &stream, "alphanum.txt"));
+        ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+        ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    }
+
+    mock_memory_reset(mock, 7);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, DATADIR, 0, memory));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &stream, "alphanum.txt"));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_stream)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 100);
+    RUN_TESTp(test_read, &memory, &mock);
+
+    RUN_TESTp(test_pool, 1, 0);
+    RUN_TESTp(test_pool, 2, 1);
+    RUN_TEST(test_pool_busy);
+    RUN_TEST(test_compressed);
+
+    mock_memory_reset(&mock, 0);
+    RUN_TESTp(test_alloc_fail, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_flight
+ *******************************************************************************
+ */
+
+/* Two flights sharing one pool read the same rasters as a normal flight */
+TEST test_flights(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight exp, first, second;
+    struct eaarlio_tld_opener opener, copy;
+    struct eaarlio_raster raster, got;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight(&exp, EDB_FILE, DATADIR, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, DATADIR, 2, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener_share(&copy, &opener));
+    ASSERT_EQ(opener.opaque, copy.opaque);
+    ASSERT_EAARLIO_SUCCESS(open_flight(&first, &opener, memory));
+    ASSERT_EAARLIO_SUCCESS(open_flight(&second, &copy, memory));
+
+    for(i = 1; i <= RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&exp, &raster, NULL, i, 1, 1));
+
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&first, &got, NULL, i, 1, 1));
+        CHECK_CALL(check_raster("first", &raster, &got));
+        eaarlio_raster_free(&got, memory);
+
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_read_raster(
+            &second, &got, NULL, RASTER_COUNT + 1 - i, 1, 1));
+        eaarlio_raster_free(&got, memory);
+
+        eaarlio_raster_free(&raster, NULL);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&first));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&second));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&exp));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+#ifdef EAARLIO_HAVE_PTHREADS
+
+struct worker {
+    pthread_t thread;
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_raster const *expected;
+    int offset;
+    int failures;
+};
+
+/* Read every raster many times, checking each against the expected raster */
+static void *worker_main(void *arg)
+{
+    struct worker *worker = (struct worker *)arg;
+    struct eaarlio_flight flight;
+    struct eaarlio_raster got;
+    struct eaarlio_raster const *exp;
+    int pass;
+    uint32_t i, n;
+
+    if(open_flight(&flight, &worker->opener, NULL) != EAARLIO_SUCCESS) {
+        worker->failures++;
+        return NULL;
+    }
+
+    for(pass = 0; pass < THREAD_PASSES; pass++) {
+        for(i = 0; i < RASTER_COUNT; i++) {
+            n = (i + (uint32_t)worker->offset) % RASTER_COUNT;
+            exp = &worker->expected[n];
+            if(eaarlio_flight_read_raster(&flight, &got, NULL, n + 1, 1, 1)
+                != EAARLIO_SUCCESS) {
+                worker->failures++;
+                continue;
+            }
+            if(got.time_seconds != exp->time_seconds
+                || got.time_fraction != exp->time_fraction
+                || got.pulse_count != exp->pulse_count
+                || (got.pulse_count
+                       && got.pulse[got.pulse_count - 1].time_offset
+                           != exp->pulse[exp->pulse_count - 1].time_offset))
+                worker->failures++;
+            eaarlio_raster_free(&got, NULL);
+        }
+    }
+
+    eaarlio_flight_free(&flight);
+    return NULL;
+}
+
+/* Several threads read through one pool at once */
+TEST test_threads()
+{
+    struct eaarlio_flight exp;
+    struct eaarlio_raster expected[RASTER_COUNT];
+    struct eaarlio_tld_opener opener;
+    struct worker workers[THREAD_COUNT];
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight(&exp, EDB_FILE, DATADIR, NULL));
+    for(i = 0; i < RASTER_COUNT; i++)
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&exp, &expected[i], NULL, i + 1, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&exp));
+
+    /* A pool of one forces files to be opened and closed concurrently */
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_shared_tld_opener(&opener, DATADIR, 1, NULL));
+    for(i = 0; i < THREAD_COUNT; i++) {
+        workers[i].expected = expected;
+        workers[i].offset = (int)i;
+        workers[i].failures = 0;
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_file_shared_tld_opener_share(&workers[i].opener, &opener));
+    }
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    for(i = 0; i < THREAD_COUNT; i++)
+        ASSERT_EQ_FMT(0,
+            pthread_create(
+                &workers[i].thread, NULL, worker_main, &workers[i]),
+            "%d");
+    for(i = 0; i < THREAD_COUNT; i++) {
+        ASSERT_EQ_FMT(0, pthread_join(workers[i].thread, NULL), "%d");
+        ASSERT_EQ_FMT(0, workers[i].failures, "%d");
+    }
+
+    for(i = 0; i < RASTER_COUNT; i++)
+        eaarlio_raster_free(&expected[i], NULL);
+    PASS();
+}
+
+#endif /* EAARLIO_HAVE_PTHREADS */
+
+SUITE(suite_flight)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 20000);
+    RUN_TESTp(test_flights, &memory, &mock);
+    mock_memory_destroy(&memory);
+
+#ifdef EAARLIO_HAVE_PTHREADS
+    RUN_TEST(test_threads);
+#endif
+}
+
+/*******************************************************************************
+ * suite_unavailable
+ *******************************************************************************
+ */
+
+#ifndef EAARLIO_HAVE_PREAD
+
+/* Without positional reads the opener cannot be created */
+TEST test_not_impl()
+{
+    struct eaarlio_tld_opener opener;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL,
+        eaarlio_file_shared_tld_opener(&opener, DATADIR, 0, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    PASS();
+}
+
+TEST test_skipped()
+{
+    SKIPm("positional reads are not available");
+}
+
+SUITE(suite_unavailable)
+{
+    RUN_TEST(test_not_impl);
+    RUN_TEST(test_skipped);
+}
+
+#endif /* EAARLIO_HAVE_PREAD */
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+#ifdef EAARLIO_HAVE_PREAD
+    RUN_SUITE(suite_stream);
+    RUN_SUITE(suite_flight);
+#else
+    RUN_SUITE(suite_unavailable);
+#endif
+
+    GREATEST_MAIN_END();
+}
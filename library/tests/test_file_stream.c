@@ -340,6 +340,43 @@ TEST test_write_read(struct eaarlio_stream *stream, char const *out)
     PASS();
 }
 
+TEST test_write_sync(struct eaarlio_stream *stream, char const *out)
+{
+    unsigned char buf[10];
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(stream, out, "w"));
+    ASSERT_EAARLIO_SUCCESS(stream->write(stream, 10, (unsigned char *)raw));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream_sync(stream));
+
+    /* The data is visible through a second stream before closing */
+    {
+        struct eaarlio_stream other;
+        ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&other, out, "r"));
+        ASSERT_EAARLIO_SUCCESS(other.read(&other, 10, buf));
+        ASSERT_MEM_EQ(raw, buf, 10);
+        ASSERT_EAARLIO_SUCCESS(other.close(&other));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(stream->close(stream));
+    PASS();
+}
+
+TEST test_write_sync_invalid()
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    int data;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_file_stream_sync(NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_file_stream_sync(&stream));
+
+    /* Not a file stream */
+    stream.data = &data;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_file_stream_sync(&stream));
+    PASS();
+}
+
 SUITE(suite_write)
 {
     struct write_data data;
@@ -348,6 +385,8 @@ SUITE(suite_write)
     SET_TEARDOWN(cb_write_teardown, &data);
 
     RUN_TESTp(test_write_read, &data.stream, data.out);
+    RUN_TESTp(test_write_sync, &data.stream, data.out);
+    RUN_TEST(test_write_sync_invalid);
 }
 
 /*******************************************************************************
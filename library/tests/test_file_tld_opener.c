@@ -5,14 +5,18 @@
 #include "greatest.h"
 #include "assert_error.h"
 #include "mock_memory.h"
+#include "util_file.h"
+#include "util_tempfile.h"
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 TEST test_sanity()
 {
     eaarlio_file_tld_opener(NULL, NULL, NULL);
+    eaarlio_file_compressed_tld_opener(NULL, NULL, NULL);
     PASS();
 }
 
@@ -20,6 +24,8 @@ TEST test_null_opener()
 {
     ASSERT_EAARLIO_ERR(
         EAARLIO_NULL, eaarlio_file_tld_opener(NULL, "test", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_compressed_tld_opener(NULL, "test", NULL));
     PASS();
 }
 
@@ -104,6 +110,110 @@ TEST test_open_tld_missing(struct eaarlio_memory *memory,
     PASS();
 }
 
+TEST test_open_tld_direct(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    struct eaarlio_stream *stream)
+{
+    struct eaarlio_tld_opener opener;
+    int64_t position;
+    unsigned char buf[5];
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_direct_tld_opener(&opener, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, stream, "alphanum.txt"));
+
+    ASSERT_EAARLIO_SUCCESS(stream->seek(stream, 26, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream->read(stream, 5, (unsigned char *)buf));
+    ASSERT_MEM_EQ("ABCDE", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(stream->tell(stream, &position));
+    ASSERT_EQ_FMT(31, position, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream->close(stream));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Write a compressed copy of alphanum.txt, or garbage, to fn */
+static eaarlio_error make_compressed(char const *fn, int valid)
+{
+    struct eaarlio_stream in, out;
+    eaarlio_error err;
+
+    err = eaarlio_file_stream(&out, fn, "w");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    if(valid) {
+        err = eaarlio_file_stream(&in, DATADIR "/alphanum.txt", "r");
+        if(err == EAARLIO_SUCCESS) {
+            err = eaarlio_compress_stream(&out, &in, 16, NULL);
+            in.close(&in);
+        }
+    } else {
+        err = out.write(&out, 5, (unsigned char const *)"junk\n");
+    }
+
+    out.close(&out);
+    return err;
+}
+
+TEST test_open_tld_compressed(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    struct eaarlio_stream *stream,
+    int valid)
+{
+    struct eaarlio_tld_opener opener;
+    char *path = util_tempfile();
+    char *fn;
+    unsigned char buf[5];
+
+    ASSERT(path);
+    fn = malloc(strlen(path) + strlen(EAARLIO_COMPRESSED_SUFFIX) + 1);
+    ASSERT(fn);
+    strcpy(fn, path);
+    strcat(fn, EAARLIO_COMPRESSED_SUFFIX);
+    ASSERT_EAARLIO_SUCCESS(make_compressed(fn, valid));
+
+    /* Only the compressed file exists, and the plain opener ignores it */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_tld_opener(&opener, TEMPDIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, stream, strrchr(path, '/') + 1));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    /* The compressed opener finds it by the plain name */
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_compressed_tld_opener(&opener, TEMPDIR, memory));
+    if(valid) {
+        ASSERT_EAARLIO_SUCCESS(
+            opener.open_tld(&opener, stream, strrchr(path, '/') + 1));
+        ASSERT_EAARLIO_SUCCESS(stream->seek(stream, 26, SEEK_SET));
+        ASSERT_EAARLIO_SUCCESS(stream->read(stream, 5, buf));
+        ASSERT_MEM_EQ("ABCDE", buf, 5);
+        ASSERT_EAARLIO_SUCCESS(stream->close(stream));
+    } else {
+        ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+            opener.open_tld(&opener, stream, strrchr(path, '/') + 1));
+    }
+
+    /* Once the file itself exists, it is used instead */
+    ASSERT_EAARLIO_SUCCESS(util_file_write(path, "12345"));
+    ASSERT_EAARLIO_SUCCESS(
+        opener.open_tld(&opener, stream, strrchr(path, '/') + 1));
+    ASSERT_EAARLIO_SUCCESS(stream->read(stream, 5, buf));
+    ASSERT_MEM_EQ("12345", buf, 5);
+    ASSERT_EAARLIO_SUCCESS(stream->close(stream));
+
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    remove(path);
+    remove(fn);
+    free(fn);
+    free(path);
+    PASS();
+}
+
 SUITE(suite_stream)
 {
     struct mock_memory mock;
@@ -121,6 +231,24 @@ SUITE(suite_stream)
     if(stream.close)
         stream.close(&stream);
 
+    stream = eaarlio_stream_empty();
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_open_tld_direct, &memory, &mock, &stream);
+    if(stream.close)
+        stream.close(&stream);
+
+    stream = eaarlio_stream_empty();
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_open_tld_compressed, &memory, &mock, &stream, 1);
+    if(stream.close)
+        stream.close(&stream);
+
+    stream = eaarlio_stream_empty();
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_open_tld_compressed, &memory, &mock, &stream, 0);
+    if(stream.close)
+        stream.close(&stream);
+
     mock_memory_destroy(&memory);
 }
 
@@ -0,0 +1,282 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_raster_log.h"
+#include <stdint.h>
+
+#define EDB_FILE (DATADIR "/flight.idx")
+
+TEST test_sanity()
+{
+    eaarlio_flight_parallel_for(NULL, 0, 0, 0, 0, NULL, NULL);
+    PASS();
+}
+
+TEST test_null_flight()
+{
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_flight_parallel_for(
+            NULL, 1, 1, 0, 1, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_null_fn()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_flight_parallel_for(&flight, 1, 1, 0, 1, NULL, NULL));
+    PASS();
+}
+
+TEST test_bad_flags()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_flight_parallel_for(
+            &flight, 1, 1, 4, 1, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_bad_range()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_flight_parallel_for(
+            &flight, 2, 1, 0, 1, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_uninitialized()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_flight_parallel_for(
+            &flight, 1, 1, 0, 1, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null_flight);
+    RUN_TEST(test_null_fn);
+    RUN_TEST(test_bad_flags);
+    RUN_TEST(test_bad_range);
+    RUN_TEST(test_uninitialized);
+}
+
+/* Does every raster in the range arrive exactly once, matching what
+ * eaarlio_flight_read_raster returns?
+ */
+TEST test_all_rasters(uint32_t nthreads)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1, 10,
+        EAARLIO_FLIGHT_INCLUDE_PULSES | EAARLIO_FLIGHT_INCLUDE_WAVEFORMS,
+        nthreads, &util_raster_log_fn, &log));
+
+    for(i = 0; i < 10; i++) {
+        ASSERT_EQ_FMT(1, log.calls[i], "%u");
+        ASSERT_EQ_FMT(i + 1, log.raster_number[i], "%u");
+        ASSERT(log.has_pulses[i]);
+        ASSERT(log.has_waveforms[i]);
+
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &raster, NULL, i + 1, 1, 1));
+        ASSERT_EQ_FMT(raster.sequence_number, log.sequence_number[i], "%u");
+        ASSERT_EQ_FMT(raster.pulse_count, log.pulse_count[i], "%d");
+        ASSERT_EQ_FMT(raster.pulse[0].rx_len[0], log.rx_len[i], "%d");
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Is only the requested part of the range delivered, with indexes relative
+ * to the start?
+ */
+TEST test_subrange()
+{
+    struct eaarlio_flight flight;
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 3, 7,
+        EAARLIO_FLIGHT_INCLUDE_PULSES, 4, &util_raster_log_fn, &log));
+
+    for(i = 0; i < 10; i++) {
+        if(i < 5) {
+            ASSERT_EQ_FMT(1, log.calls[i], "%u");
+            ASSERT_EQ_FMT(i + 3, log.raster_number[i], "%u");
+            ASSERT_EQ_FMT(i + 3, log.sequence_number[i], "%u");
+            ASSERT(log.has_pulses[i]);
+            ASSERT_FALSE(log.has_waveforms[i]);
+        } else {
+            ASSERT_EQ_FMT(0, log.calls[i], "%u");
+        }
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Is a range outside the EDB rejected before anything is delivered? */
+TEST test_invalid_raster()
+{
+    struct eaarlio_flight flight;
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_flight_parallel_for(
+            &flight, 0, 3, 0, 2, &util_raster_log_fn, &log));
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_flight_parallel_for(
+            &flight, 9, 11, 0, 2, &util_raster_log_fn, &log));
+    for(i = 0; i < 10; i++)
+        ASSERT_EQ_FMT(0, log.calls[i], "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Does an error from the callback reach the caller? */
+TEST test_callback_error(uint32_t nthreads)
+{
+    struct eaarlio_flight flight;
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    log.fail_raster = 5;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_flight_parallel_for(
+            &flight, 1, 10, 0, nthreads, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(1, log.calls[4], "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Does a missing TLD file fail cleanly? */
+TEST test_missing_tld()
+{
+    struct eaarlio_flight flight;
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR "/missing", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_flight_parallel_for(
+            &flight, 1, 10, 0, 3, &util_raster_log_fn, &log));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_parallel)
+{
+    RUN_TESTp(test_all_rasters, 1);
+    RUN_TESTp(test_all_rasters, 2);
+    RUN_TESTp(test_all_rasters, 4);
+    RUN_TESTp(test_all_rasters, 0);
+    RUN_TEST(test_subrange);
+    RUN_TEST(test_invalid_raster);
+    RUN_TESTp(test_callback_error, 1);
+    RUN_TESTp(test_callback_error, 3);
+    RUN_TEST(test_missing_tld);
+}
+
+/* Is everything released, with a memory handler that is only used from one
+ * thread?
+ */
+TEST test_memory(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1, 10,
+        EAARLIO_FLIGHT_INCLUDE_PULSES | EAARLIO_FLIGHT_INCLUDE_WAVEFORMS, 1,
+        &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(1, log.calls[9], "%u");
+
+    log.fail_raster = 2;
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_flight_parallel_for(
+            &flight, 1, 10, 0, 1, &util_raster_log_fn, &log));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_memory)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10000);
+    RUN_TESTp(test_memory, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_parallel);
+    RUN_SUITE(suite_memory);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,268 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_raster_log.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EDB_FILE (DATADIR "/flight.idx")
+
+TEST test_sanity()
+{
+    eaarlio_flight_plan(NULL, NULL, 0, 0, 0, 0, 0, NULL, NULL);
+    PASS();
+}
+
+TEST test_null_flight()
+{
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_flight_plan(NULL, rasters, 1, EAARLIO_FLIGHT_ORDER_DISK, 0, 0,
+            0, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+TEST test_null_fn()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    uint32_t rasters[] = { 1 };
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_flight_plan(&flight, rasters, 1, EAARLIO_FLIGHT_ORDER_DISK, 0,
+            0, 0, NULL, NULL));
+    PASS();
+}
+
+TEST test_bad_order()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    uint32_t rasters[] = { 1 };
+    struct util_raster_log log;
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_flight_plan(
+            &flight, rasters, 1, 2, 0, 0, 0, &util_raster_log_fn, &log));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null_flight);
+    RUN_TEST(test_null_fn);
+    RUN_TEST(test_bad_order);
+}
+
+/* Are scattered rasters delivered in caller order with the right data? */
+TEST test_caller_order(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 10, 1, 5, 3, 8, 2, 5 };
+    uint32_t count = sizeof(rasters) / sizeof(rasters[0]);
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, rasters, count,
+        EAARLIO_FLIGHT_ORDER_CALLER, 0, 1, 1, &util_raster_log_fn, &log));
+
+    ASSERT_EQ_FMT(count, log.count, "%u");
+    for(i = 0; i < count; i++) {
+        ASSERT_EQ_FMT(i, log.order[i], "%u");
+        ASSERT_EQ_FMT(1, log.calls[i], "%u");
+        ASSERT_EQ_FMT(rasters[i], log.raster_number[i], "%u");
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT_EQ_FMT(119, log.pulse_count[i], "%d");
+        ASSERT(log.has_pulses[i]);
+        ASSERT(log.has_waveforms[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Are rasters delivered sorted by file and offset in disk order? */
+TEST test_disk_order(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 10, 1, 5, 3, 8, 2 };
+    uint32_t expected[] = { 1, 2, 3, 5, 8, 10 };
+    uint32_t count = sizeof(rasters) / sizeof(rasters[0]);
+    struct util_raster_log log;
+    uint32_t i, j;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, rasters, count,
+        EAARLIO_FLIGHT_ORDER_DISK, 0, 1, 0, &util_raster_log_fn, &log));
+
+    ASSERT_EQ_FMT(count, log.count, "%u");
+    for(i = 0; i < count; i++) {
+        j = log.order[i];
+        ASSERT_EQ_FMT(expected[i], rasters[j], "%u");
+        ASSERT_EQ_FMT(expected[i], log.raster_number[j], "%u");
+        ASSERT_EQ_FMT(expected[i], log.sequence_number[j], "%u");
+        ASSERT(log.has_pulses[j]);
+        ASSERT_FALSE(log.has_waveforms[j]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Does a small read limit still deliver everything (one read per record)? */
+TEST test_small_reads(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 4, 3, 2, 1 };
+    uint32_t count = sizeof(rasters) / sizeof(rasters[0]);
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, rasters, count,
+        EAARLIO_FLIGHT_ORDER_CALLER, 1, 0, 0, &util_raster_log_fn, &log));
+
+    ASSERT_EQ_FMT(count, log.count, "%u");
+    for(i = 0; i < count; i++) {
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT_FALSE(log.has_pulses[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Are invalid raster numbers rejected before anything is delivered? */
+TEST test_invalid_raster(struct eaarlio_memory *memory,
+    struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 1, 2, 11 };
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_flight_plan(&flight, rasters, 3, EAARLIO_FLIGHT_ORDER_DISK, 0,
+            0, 0, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(0, log.count, "%u");
+
+    rasters[2] = 0;
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_flight_plan(&flight, rasters, 3, EAARLIO_FLIGHT_ORDER_DISK, 0,
+            0, 0, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(0, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Does an error from the callback stop processing without leaking? */
+TEST test_callback_error(struct eaarlio_memory *memory,
+    struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    uint32_t rasters[] = { 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    log.fail_on = 2;
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_flight_plan(&flight, rasters, 9, EAARLIO_FLIGHT_ORDER_CALLER,
+            0, 1, 1, &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(2, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Can the flight still be used normally after planned access? */
+TEST test_then_read(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    uint32_t rasters[] = { 9, 10 };
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, rasters, 2,
+        EAARLIO_FLIGHT_ORDER_DISK, 0, 0, 0, &util_raster_log_fn, &log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 8, 0, 0));
+    ASSERT_EQ_FMT(8, raster.sequence_number, "%u");
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 1, 0, 0));
+    ASSERT_EQ_FMT(1, raster.sequence_number, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_plan)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10000);
+    RUN_TESTp(test_caller_order, &memory, &mock);
+
+    mock_memory_reset(&mock, 10000);
+    RUN_TESTp(test_disk_order, &memory, &mock);
+
+    mock_memory_reset(&mock, 1000);
+    RUN_TESTp(test_small_reads, &memory, &mock);
+
+    mock_memory_reset(&mock, 100);
+    RUN_TESTp(test_invalid_raster, &memory, &mock);
+
+    mock_memory_reset(&mock, 10000);
+    RUN_TESTp(test_callback_error, &memory, &mock);
+
+    mock_memory_reset(&mock, 100);
+    RUN_TESTp(test_then_read, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_plan);
+
+    GREATEST_MAIN_END();
+}
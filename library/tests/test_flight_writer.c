@@ -0,0 +1,307 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/edb_internals.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight_writer.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/tld.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "mock_stream.h"
+#include "util_writer.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EDB_MOCK_SIZE 1000
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_flight_writer_init(NULL, 0, NULL, 0, NULL);
+    eaarlio_flight_writer_open_tld(NULL, NULL, NULL);
+    eaarlio_flight_writer_write_raster(NULL, NULL, NULL);
+    eaarlio_flight_writer_close_tld(NULL);
+    eaarlio_flight_writer_close(NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_flight_writer writer;
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    struct eaarlio_raster raster;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_flight_writer_init(NULL, 0, NULL, 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_init(&writer, 0, NULL, 0, NULL));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_flight_writer_open_tld(NULL, &stream, "a.tld"));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_flight_writer_open_tld(&writer, NULL, "a.tld"));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_flight_writer_open_tld(&writer, &stream, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_flight_writer_open_tld(&writer, &stream, "a.tld"));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_flight_writer_write_raster(&writer, NULL, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_flight_writer_write_raster(&writer, &raster, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close_tld(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close(&writer, NULL));
+    PASS();
+}
+
+TEST test_bad_sync_policy()
+{
+    struct eaarlio_flight_writer writer;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_flight_writer_init(
+            &writer, 0, NULL, EAARLIO_TLD_SYNC_CLOSE, NULL));
+    ASSERT_EQ(NULL, writer.memory);
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_flight_writer_init(&writer, 0, NULL, 3, NULL));
+    ASSERT_EQ(NULL, writer.memory);
+    PASS();
+}
+
+TEST test_filename_too_long()
+{
+    struct eaarlio_flight_writer writer;
+    struct mock_stream *mock = mock_stream_new(10);
+    struct eaarlio_stream *inner = mock_stream_stream_new(mock);
+    struct eaarlio_stream stream;
+    struct util_writer_stream w;
+    char name[EAARLIO_EDB_FILENAME_MAX_LENGTH + 2];
+
+    memset(name, 'a', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    util_writer_stream_init(&stream, &w, inner);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_init(&writer, 0, NULL, 0, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_EDB_FILENAME_TOO_LONG,
+        eaarlio_flight_writer_open_tld(&writer, &stream, name));
+    ASSERT(stream.close);
+    ASSERT_EQ_FMT(0U, writer.edb.file_count, "%" PRIu32);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close(&writer, NULL));
+    ASSERT_EQ_FMT(0, w.closes, "%d");
+
+    mock_stream_stream_destroy(inner);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_bad_sync_policy);
+    RUN_TEST(test_filename_too_long);
+}
+
+/*******************************************************************************
+ * suite_write
+ *******************************************************************************
+ */
+
+/* Write the test rasters across two TLD files. Are the TLD files the same as
+ * eaarlio_tld_write_raster produces, and does the EDB describe them?
+ */
+TEST test_write(struct eaarlio_memory *memory, struct mock_memory *mock_mem)
+{
+    struct eaarlio_raster rasters[UTIL_WRITER_RASTER_COUNT];
+    struct mock_stream *expected = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct mock_stream *tld[2];
+    struct mock_stream *edb_mock = mock_stream_new(EDB_MOCK_SIZE);
+    struct eaarlio_stream *expected_stream = mock_stream_stream_new(expected);
+    struct eaarlio_stream *tld_stream[2];
+    struct eaarlio_stream *edb_stream = mock_stream_stream_new(edb_mock);
+    struct eaarlio_stream stream;
+    struct eaarlio_flight_writer writer;
+    struct eaarlio_edb edb;
+    struct util_writer_stream w[2];
+    uint32_t raster_number;
+    int i, f;
+
+    tld[0] = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    tld[1] = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    tld_stream[0] = mock_stream_stream_new(tld[0]);
+    tld_stream[1] = mock_stream_stream_new(tld[1]);
+
+    memset(rasters, 0, sizeof(rasters));
+    ASSERT_EAARLIO_SUCCESS(util_writer_load_rasters(rasters));
+
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++)
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_write_raster(expected_stream, &rasters[i], NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_init(
+        &writer, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+
+    /* First two rasters in one file, the rest in another */
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++) {
+        if(i == 0 || i == 2) {
+            f = i / 2;
+            util_writer_stream_init(&stream, &w[f], tld_stream[f]);
+            ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_open_tld(
+                &writer, &stream, f ? "b.tld" : "a.tld"));
+            ASSERT_EQ(NULL, stream.close);
+            if(f)
+                ASSERT_EQ_FMT(1, w[0].closes, "%d");
+        }
+        ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_write_raster(
+            &writer, &rasters[i], &raster_number));
+        ASSERT_EQ_FMT((uint32_t)(i + 1), raster_number, "%" PRIu32);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close(&writer, edb_stream));
+    ASSERT_EQ(NULL, writer.memory);
+    ASSERT_EQ_FMT(1, w[0].closes, "%d");
+    ASSERT_EQ_FMT(1, w[1].closes, "%d");
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    ASSERT_EQ_FMT((int64_t)(2 * UTIL_WRITER_RECORD_LEN), tld[0]->offset,
+        "%" PRId64);
+    ASSERT_EQ_FMT((int64_t)(2 * UTIL_WRITER_RECORD_LEN), tld[1]->offset,
+        "%" PRId64);
+    ASSERT_MEM_EQ(expected->data, tld[0]->data, 2 * UTIL_WRITER_RECORD_LEN);
+    ASSERT_MEM_EQ(expected->data + 2 * UTIL_WRITER_RECORD_LEN, tld[1]->data,
+        2 * UTIL_WRITER_RECORD_LEN);
+
+    ASSERT_EAARLIO_SUCCESS(edb_stream->seek(edb_stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_edb_read(edb_stream, &edb, NULL, 1, 1));
+
+    ASSERT_EQ_FMT(
+        (uint32_t)UTIL_WRITER_RASTER_COUNT, edb.record_count, "%" PRIu32);
+    ASSERT_EQ_FMT(2U, edb.file_count, "%" PRIu32);
+    ASSERT_STR_EQ("a.tld", edb.files[0]);
+    ASSERT_STR_EQ("b.tld", edb.files[1]);
+
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++) {
+        ASSERT_EQ_FMT(rasters[i].time_seconds, edb.records[i].time_seconds,
+            "%" PRIu32);
+        ASSERT_EQ_FMT(rasters[i].time_fraction, edb.records[i].time_fraction,
+            "%" PRIu32);
+        ASSERT_EQ_FMT((uint32_t)((i % 2) * UTIL_WRITER_RECORD_LEN),
+            edb.records[i].record_offset, "%" PRIu32);
+        ASSERT_EQ_FMT((uint32_t)UTIL_WRITER_RECORD_LEN,
+            edb.records[i].record_length, "%" PRIu32);
+        ASSERT_EQ_FMT(i / 2 + 1, edb.records[i].file_index, "%d");
+        ASSERT_EQ_FMT(rasters[i].pulse_count, edb.records[i].pulse_count, "%d");
+        ASSERT_EQ_FMT(rasters[i].digitizer, edb.records[i].digitizer, "%d");
+    }
+
+    eaarlio_edb_free(&edb, NULL);
+    util_writer_free_rasters(rasters);
+    for(f = 0; f < 2; f++) {
+        mock_stream_stream_destroy(tld_stream[f]);
+        mock_stream_destroy(tld[f]);
+    }
+    mock_stream_stream_destroy(expected_stream);
+    mock_stream_stream_destroy(edb_stream);
+    mock_stream_destroy(expected);
+    mock_stream_destroy(edb_mock);
+    PASS();
+}
+
+/* Closing without an EDB stream releases everything and writes nothing */
+TEST test_discard(struct eaarlio_memory *memory, struct mock_memory *mock_mem)
+{
+    struct eaarlio_raster rasters[UTIL_WRITER_RASTER_COUNT];
+    struct mock_stream *mock = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct eaarlio_stream *inner = mock_stream_stream_new(mock);
+    struct eaarlio_stream stream;
+    struct eaarlio_flight_writer writer;
+    struct util_writer_stream w;
+
+    memset(rasters, 0, sizeof(rasters));
+    ASSERT_EAARLIO_SUCCESS(util_writer_load_rasters(rasters));
+
+    util_writer_stream_init(&stream, &w, inner);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_init(
+        &writer, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_open_tld(&writer, &stream, "a.tld"));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_writer_write_raster(&writer, &rasters[0], NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close(&writer, NULL));
+    ASSERT_EQ_FMT(1, w.closes, "%d");
+    ASSERT_EQ_FMT((int64_t)UTIL_WRITER_RECORD_LEN, mock->offset, "%" PRId64);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    util_writer_free_rasters(rasters);
+    mock_stream_stream_destroy(inner);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+/* An EDB with no rasters or files is still valid */
+TEST test_empty(struct eaarlio_memory *memory, struct mock_memory *mock_mem)
+{
+    struct mock_stream *edb_mock = mock_stream_new(EDB_MOCK_SIZE);
+    struct eaarlio_stream *edb_stream = mock_stream_stream_new(edb_mock);
+    struct eaarlio_flight_writer writer;
+    struct eaarlio_edb edb;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_init(
+        &writer, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_writer_close(&writer, edb_stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    ASSERT_EAARLIO_SUCCESS(edb_stream->seek(edb_stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_edb_read(edb_stream, &edb, NULL, 1, 1));
+    ASSERT_EQ_FMT(0U, edb.record_count, "%" PRIu32);
+    ASSERT_EQ_FMT(0U, edb.file_count, "%" PRIu32);
+    eaarlio_edb_free(&edb, NULL);
+
+    mock_stream_stream_destroy(edb_stream);
+    mock_stream_destroy(edb_mock);
+    PASS();
+}
+
+SUITE(suite_write)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 20);
+    RUN_TESTp(test_write, &memory, &mock);
+
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_discard, &memory, &mock);
+
+    mock_memory_reset(&mock, 20);
+    RUN_TESTp(test_empty, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_write);
+
+    GREATEST_MAIN_END();
+}
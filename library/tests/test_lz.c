@@ -0,0 +1,203 @@
+#include "eaarlio/error.h"
+#include "eaarlio/lz.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t table[EAARLIO_LZ_HASH_SIZE];
+
+/* Compress and decompress src, checking that the data survives */
+TEST test_roundtrip(char const *msg, unsigned char const *src, uint32_t len)
+{
+    uint32_t bound = EAARLIO_LZ_BOUND(len);
+    unsigned char *packed = malloc(bound);
+    unsigned char *out = malloc(len + 1);
+    uint32_t packed_len = 0;
+
+    ASSERTm(msg, packed);
+    ASSERTm(msg, out);
+
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_lz_compress(packed, bound, src, len, &packed_len, table));
+    ASSERTm(msg, packed_len <= bound);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_lz_decompress(out, len, packed, packed_len));
+    if(len)
+        ASSERT_MEM_EQm(msg, src, out, len);
+
+    /* The exact output size is required */
+    if(packed_len) {
+        ASSERT_EAARLIO_ERRm(msg, EAARLIO_CORRUPT,
+            eaarlio_lz_decompress(out, len + 1, packed, packed_len));
+        if(len)
+            ASSERT_EAARLIO_ERRm(msg, EAARLIO_CORRUPT,
+                eaarlio_lz_decompress(out, len - 1, packed, packed_len));
+    }
+
+    free(packed);
+    free(out);
+    PASS();
+}
+
+TEST test_sanity()
+{
+    eaarlio_lz_compress(NULL, 0, NULL, 0, NULL, NULL);
+    eaarlio_lz_decompress(NULL, 0, NULL, 0);
+    PASS();
+}
+
+TEST test_null()
+{
+    unsigned char buf[4] = { 0 };
+    uint32_t len;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_lz_compress(NULL, 4, buf, 4, &len, table));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_lz_compress(buf, 4, NULL, 4, &len, table));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_lz_compress(buf, 4, buf, 4, NULL, table));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_lz_compress(buf, 4, buf, 4, &len, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_lz_decompress(NULL, 4, buf, 4));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_lz_decompress(buf, 4, NULL, 4));
+    PASS();
+}
+
+TEST test_empty()
+{
+    unsigned char buf[1] = { 0 };
+    uint32_t len = 99;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_lz_compress(buf, 1, buf, 0, &len, table));
+    ASSERT_EQ_FMT(0U, len, "%" PRIu32);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_lz_decompress(buf, 0, buf, 0));
+    PASS();
+}
+
+TEST test_compresses()
+{
+    unsigned char src[10000];
+    unsigned char dst[EAARLIO_LZ_BOUND(10000)];
+    uint32_t len;
+
+    memset(src, 7, sizeof(src));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_lz_compress(dst, sizeof(dst), src, sizeof(src), &len, table));
+    ASSERT(len < 100);
+    PASS();
+}
+
+TEST test_buffer_short()
+{
+    unsigned char src[100];
+    unsigned char dst[100];
+    uint32_t len, i, seed = 1;
+
+    /* Incompressible data does not fit in the same number of bytes */
+    for(i = 0; i < sizeof(src); i++) {
+        seed = seed * 1103515245U + 12345U;
+        src[i] = (unsigned char)(seed >> 16);
+    }
+    ASSERT_EAARLIO_ERR(EAARLIO_BUFFER_SHORT,
+        eaarlio_lz_compress(dst, sizeof(dst), src, sizeof(src), &len, table));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_compresses);
+    RUN_TEST(test_buffer_short);
+}
+
+SUITE(suite_roundtrip)
+{
+    static unsigned char data[200000];
+    FILE *f;
+    size_t got;
+    uint32_t i, seed = 1;
+
+    RUN_TESTp(test_roundtrip, "short", (unsigned char const *)"abc", 3);
+    RUN_TESTp(test_roundtrip, "text",
+        (unsigned char const *)"abcabcabcabcabcabcabcXabcabcabcabc", 34);
+
+    /* Long runs need extra length bytes */
+    memset(data, 'a', sizeof(data));
+    RUN_TESTp(test_roundtrip, "run", data, 100000);
+
+    /* Long literal runs need extra length bytes too */
+    for(i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245U + 12345U;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+    RUN_TESTp(test_roundtrip, "random", data, sizeof(data));
+
+    /* Matches beyond the 64 KiB window must not be used */
+    memcpy(data + 100000, data, 1000);
+    RUN_TESTp(test_roundtrip, "far repeat", data, sizeof(data));
+
+    f = fopen(DATADIR "/010909-014641.tld", "rb");
+    if(f) {
+        got = fread(data, 1, sizeof(data), f);
+        fclose(f);
+        RUN_TESTp(test_roundtrip, "tld", data, (uint32_t)got);
+    }
+}
+
+/* Malformed input must be rejected without writing outside the output */
+TEST test_corrupt()
+{
+    unsigned char out[16];
+    /* Match before the start of the output */
+    unsigned char const far_offset[] = { 0x10, 'a', 0x02, 0x00 };
+    /* Zero offset */
+    unsigned char const zero_offset[] = { 0x10, 'a', 0x00, 0x00 };
+    /* Literals run past the input */
+    unsigned char const long_literal[] = { 0x50, 'a', 'b' };
+    /* Match runs past the output */
+    unsigned char const long_match[] = { 0x1f, 'a', 0x01, 0x00, 0x10 };
+    /* Offset cut short */
+    unsigned char const short_offset[] = { 0x10, 'a', 0x01 };
+    /* Extra length bytes cut short */
+    unsigned char const short_extra[] = { 0xf0, 0xff };
+
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 5, far_offset, sizeof(far_offset)));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 5, zero_offset, sizeof(zero_offset)));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 5, long_literal, sizeof(long_literal)));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 16, long_match, sizeof(long_match)));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 5, short_offset, sizeof(short_offset)));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_lz_decompress(out, 16, short_extra, sizeof(short_extra)));
+    PASS();
+}
+
+SUITE(suite_corrupt)
+{
+    RUN_TEST(test_corrupt);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_roundtrip);
+    RUN_SUITE(suite_corrupt);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,400 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char const raw[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789\n";
+#define raw_len 63
+
+static char const tld_fn[] = DATADIR "/010909-014641.tld";
+#define tld_len 80040
+#define tld_rasters 4
+
+/*******************************************************************************
+ * suite_null
+ *******************************************************************************
+ */
+
+TEST test_null_sanity()
+{
+    eaarlio_memory_stream(NULL, NULL, 0, NULL, NULL);
+    eaarlio_memory_stream_buffer(NULL, NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[1];
+    unsigned char *got;
+    uint64_t len;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream(NULL, buf, 1, "r", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream(&stream, buf, 1, NULL, NULL));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream(&stream, NULL, 1, "r", NULL));
+    ASSERT_EQ(NULL, stream.data);
+
+    stream = eaarlio_stream_empty();
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream_buffer(NULL, &got, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream_buffer(&stream, NULL, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_stream_buffer(&stream, &got, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_memory_stream_buffer(&stream, &got, &len));
+    PASS();
+}
+
+TEST test_bad_mode()
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[1];
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_memory_stream(&stream, buf, 1, "a", NULL));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_memory_stream(&stream, buf, 1, "rb", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_memory_stream(&stream, buf, 1, "w", NULL));
+    ASSERT_EQ(NULL, stream.data);
+    PASS();
+}
+
+TEST test_not_memory_stream()
+{
+    struct eaarlio_stream stream;
+    unsigned char *got;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_stream(&stream, DATADIR "/alphanum.txt", "r"));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+SUITE(suite_null)
+{
+    RUN_TEST(test_null_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_bad_mode);
+    RUN_TEST(test_not_memory_stream);
+}
+
+/*******************************************************************************
+ * suite_read
+ *******************************************************************************
+ */
+
+TEST test_read(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    unsigned char src[raw_len];
+    unsigned char buf[raw_len];
+    unsigned char *got;
+    uint64_t len;
+    int64_t pos;
+
+    memcpy(src, raw, raw_len);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, src, raw_len, "r", memory));
+
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ(raw, buf, 10);
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)10, pos, "%" PRId64);
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -3, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 3, buf));
+    ASSERT_MEM_EQ(raw + raw_len - 3, buf, 3);
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 60, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ(raw + 60, buf, 3);
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)raw_len, pos, "%" PRId64);
+
+    /* Seeking beyond the end succeeds, but there is nothing to read */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 100, SEEK_SET));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, buf));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, stream.seek(&stream, -101, SEEK_CUR));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_INVALID, stream.seek(&stream, 0, 42));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_NOT_IMPL, stream.write(&stream, 1, buf));
+    ASSERT_MEM_EQ(raw, src, raw_len);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EQ(src, got);
+    ASSERT_EQ_FMT((uint64_t)raw_len, len, "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Can TLD data in memory be read the same as from a file? */
+TEST test_read_tld(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream file, stream;
+    struct eaarlio_raster expected, got;
+    unsigned char *data = malloc(tld_len);
+    int i;
+
+    ASSERT(data);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, tld_fn, "r"));
+    ASSERT_EAARLIO_SUCCESS(file.read(&file, tld_len, data));
+    ASSERT_EAARLIO_SUCCESS(file.seek(&file, 0, SEEK_SET));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, data, tld_len, "r", memory));
+
+    for(i = 0; i < tld_rasters; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_read_raster(&file, &expected, NULL, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_read_raster(&stream, &got, NULL, 1, 1));
+        ASSERT_EQ_FMT(
+            expected.sequence_number, got.sequence_number, "%" PRIu32);
+        ASSERT_EQ_FMT(expected.pulse_count, got.pulse_count, "%d");
+        ASSERT_MEM_EQ(expected.pulse[0].rx[0], got.pulse[0].rx[0],
+            expected.pulse[0].rx_len[0]);
+        eaarlio_raster_free(&expected, NULL);
+        eaarlio_raster_free(&got, NULL);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(file.close(&file));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    free(data);
+    PASS();
+}
+
+SUITE(suite_read)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_read, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_read_tld, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_write
+ *******************************************************************************
+ */
+
+TEST test_write_fixed(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream stream;
+    unsigned char dst[10];
+    unsigned char buf[10];
+
+    memset(dst, '.', sizeof(dst));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, dst, sizeof(dst), "r+", memory));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 2, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(
+        stream.write(&stream, 3, (unsigned char const *)raw));
+    ASSERT_MEM_EQ("..abc.....", dst, 10);
+
+    /* Writes past the end are cut short */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 8, SEEK_SET));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_WRITE_SHORT,
+        stream.write(&stream, 3, (unsigned char const *)raw));
+    ASSERT_MEM_EQ("..abc...ab", dst, 10);
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_WRITE_SHORT,
+        stream.write(&stream, 1, (unsigned char const *)raw));
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_MEM_EQ("..abc...ab", buf, 10);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+TEST test_write_grow(struct eaarlio_memory *memory,
+    struct mock_memory *mock,
+    uint64_t capacity)
+{
+    struct eaarlio_stream stream;
+    unsigned char buf[raw_len];
+    unsigned char *got;
+    uint64_t len;
+    int64_t pos;
+    int i;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, NULL, capacity, "w", memory));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EQ_FMT((uint64_t)0, len, "%" PRIu64);
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, buf));
+
+    /* Enough data to outgrow any initial capacity several times */
+    for(i = 0; i < 5000; i++)
+        ASSERT_EAARLIO_SUCCESS(
+            stream.write(&stream, raw_len, (unsigned char const *)raw));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)5000 * raw_len, pos, "%" PRId64);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EQ_FMT((uint64_t)5000 * raw_len, len, "%" PRIu64);
+    for(i = 0; i < 5000; i++)
+        ASSERT_MEM_EQ(raw, got + (size_t)i * raw_len, raw_len);
+
+    /* Overwrite in the middle without changing the size */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, raw_len, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(
+        stream.write(&stream, 3, (unsigned char const *)"XYZ"));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, raw_len, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 4, buf));
+    ASSERT_MEM_EQ("XYZd", buf, 4);
+
+    /* A gap left by seeking past the end reads back as zeroes */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 4, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(
+        stream.write(&stream, 1, (unsigned char const *)"!"));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -5, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_MEM_EQ("\0\0\0\0!", buf, 5);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EQ_FMT((uint64_t)5000 * raw_len + 5, len, "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Does a TLD written to memory match one written to a file? */
+TEST test_write_tld(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream file, stream;
+    struct eaarlio_raster raster;
+    unsigned char *data = malloc(tld_len);
+    unsigned char *got;
+    uint64_t len;
+    int i;
+
+    ASSERT(data);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, tld_fn, "r"));
+    ASSERT_EAARLIO_SUCCESS(file.read(&file, tld_len, data));
+    ASSERT_EAARLIO_SUCCESS(file.seek(&file, 0, SEEK_SET));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, NULL, 0, "w", memory));
+    for(i = 0; i < tld_rasters; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_read_raster(&file, &raster, NULL, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_write_raster(&stream, &raster, NULL));
+        eaarlio_raster_free(&raster, NULL);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&stream, &got, &len));
+    ASSERT_EQ_FMT((uint64_t)tld_len, len, "%" PRIu64);
+    ASSERT_MEM_EQ(data, got, tld_len);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(file.close(&file));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    free(data);
+    PASS();
+}
+
+TEST test_write_alloc_fail()
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+    struct eaarlio_stream stream;
+
+    mock_memory_new(&memory, &mock, 1);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&stream, NULL, 0, "w", &memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        stream.write(&stream, 1, (unsigned char const *)raw));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_reset(&mock, 1);
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        eaarlio_memory_stream(&stream, NULL, 100, "w", &memory));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_destroy(&memory);
+    PASS();
+}
+
+SUITE(suite_write)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_write_fixed, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write_grow, &memory, &mock, 0);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write_grow, &memory, &mock, 1);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write_tld, &memory, &mock);
+
+    RUN_TEST(test_write_alloc_fail);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_null);
+    RUN_SUITE(suite_read);
+    RUN_SUITE(suite_write);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,464 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/memory_tracking.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef EAARLIO_HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define THREAD_COUNT 8
+#define THREAD_PASSES 1000
+
+static eaarlio_error ignore_raster(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    (void)ctx;
+    (void)index;
+    (void)raster_number;
+    (void)raster;
+    (void)time_offset;
+    return EAARLIO_SUCCESS;
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    struct eaarlio_memory memory = eaarlio_memory_empty();
+    eaarlio_memory_tracking(NULL, NULL);
+    eaarlio_memory_tracking_usage(NULL, NULL);
+    eaarlio_memory_tracking_reset(NULL);
+    eaarlio_memory_tracking_free(NULL);
+    eaarlio_memory_tracking_usage(&memory, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_memory_tracking(NULL, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_tracking_usage(NULL, &usage));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_memory_tracking_usage(&tracking, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_memory_tracking_reset(NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_memory_tracking_free(NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Are handlers that aren't tracking handlers rejected? */
+TEST test_invalid(struct eaarlio_memory *other)
+{
+    struct eaarlio_memory memory = eaarlio_memory_empty();
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_memory_tracking(&tracking, &memory));
+    ASSERT_EQ(NULL, tracking.malloc);
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_memory_tracking_usage(other, &usage));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_memory_tracking_reset(other));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_memory_tracking_free(other));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_memory_tracking_free(&memory));
+    PASS();
+}
+
+/* Is the handler's own state allocated through and released to the inner
+ * handler?
+ */
+TEST test_state(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_memory tracking;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, memory));
+    ASSERT_EQ_FMT(1, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EQ(NULL, tracking.malloc);
+    ASSERT_EQ(NULL, tracking.opaque);
+
+    mock_memory_reset(mock, 0);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_ALLOC_FAIL, eaarlio_memory_tracking(&tracking, memory));
+    ASSERT_EQ(NULL, tracking.malloc);
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_invalid, &memory);
+    RUN_TESTp(test_state, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_usage
+ *******************************************************************************
+ */
+
+/* Are live bytes, peak, counts, and the histogram kept for each call? */
+TEST test_usage()
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    unsigned char *a, *b, *c;
+    size_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+
+    a = tracking.malloc(&tracking, 10);
+    ASSERT(a);
+    memset(a, 1, 10);
+    b = tracking.calloc(&tracking, 3, 100);
+    ASSERT(b);
+    for(i = 0; i < 300; i++)
+        ASSERT_EQ_FMT(0, (int)b[i], "%d");
+    c = tracking.realloc(&tracking, NULL, 1);
+    ASSERT(c);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(311, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(311, (int)usage.peak_bytes, "%d");
+    ASSERT_EQ_FMT(3, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(3, (int)usage.allocs, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.reallocs, "%d");
+    ASSERT_EQ_FMT(311, (int)usage.total_bytes, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.histogram[0], "%d");
+    ASSERT_EQ_FMT(1, (int)usage.histogram[4], "%d");
+    ASSERT_EQ_FMT(1, (int)usage.histogram[9], "%d");
+
+    /* Resizing keeps the contents and replaces the old size */
+    a = tracking.realloc(&tracking, a, 1000);
+    ASSERT(a);
+    for(i = 0; i < 10; i++)
+        ASSERT_EQ_FMT(1, (int)a[i], "%d");
+    tracking.free(&tracking, b);
+    tracking.free(&tracking, NULL);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(1001, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(1301, (int)usage.peak_bytes, "%d");
+    ASSERT_EQ_FMT(2, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.reallocs, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.frees, "%d");
+    ASSERT_EQ_FMT(1311, (int)usage.total_bytes, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.histogram[10], "%d");
+
+    /* Resizing to zero keeps a block that must still be freed */
+    c = tracking.realloc(&tracking, c, 0);
+    ASSERT(c);
+    tracking.free(&tracking, c);
+    tracking.free(&tracking, a);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(0, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(3, (int)usage.frees, "%d");
+    ASSERT_EQ_FMT(2, (int)usage.histogram[0], "%d");
+    ASSERT_EQ_FMT(0, (int)usage.failures, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Does the histogram put sizes in the right bins? */
+TEST test_histogram()
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    size_t sizes[6] = { 0, 2, 3, 4, 5, 65536 };
+    int bins[6] = { 0, 1, 2, 2, 3, 16 };
+    void *ptr;
+    int i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    for(i = 0; i < 6; i++) {
+        ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+        ptr = tracking.malloc(&tracking, sizes[i]);
+        ASSERT(ptr);
+        tracking.free(&tracking, ptr);
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_memory_tracking_usage(&tracking, &usage));
+        ASSERT_EQ_FMT(1, (int)usage.histogram[bins[i]], "%d");
+    }
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Are blocks aligned for any basic type? */
+TEST test_alignment()
+{
+    struct eaarlio_memory tracking;
+    void *ptr;
+    size_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    for(i = 1; i < 40; i++) {
+        ptr = tracking.malloc(&tracking, i);
+        ASSERT(ptr);
+        ASSERT_EQ_FMT(0, (int)((uintptr_t)ptr % sizeof(double)), "%d");
+        ASSERT_EQ_FMT(0, (int)((uintptr_t)ptr % sizeof(void *)), "%d");
+        tracking.free(&tracking, ptr);
+    }
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+/* Are failures counted and the old block left alone? */
+TEST test_failures(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    void *a, *b;
+
+    /* One block for the handler's state and one for the caller */
+    mock_memory_reset(mock, 2);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, memory));
+
+    a = tracking.malloc(&tracking, 10);
+    ASSERT(a);
+    b = tracking.malloc(&tracking, 10);
+    ASSERT_EQ(NULL, b);
+    b = tracking.calloc(&tracking, 2, 10);
+    ASSERT_EQ(NULL, b);
+    b = tracking.calloc(&tracking, SIZE_MAX / 2, 4);
+    ASSERT_EQ(NULL, b);
+    b = tracking.malloc(&tracking, SIZE_MAX);
+    ASSERT_EQ(NULL, b);
+    b = tracking.realloc(&tracking, a, SIZE_MAX);
+    ASSERT_EQ(NULL, b);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(5, (int)usage.failures, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.allocs, "%d");
+    ASSERT_EQ_FMT(10, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(10, (int)usage.total_bytes, "%d");
+
+    tracking.free(&tracking, a);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Does reset keep live memory and restart the peak from it? */
+TEST test_reset()
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    void *a, *b;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    a = tracking.malloc(&tracking, 100);
+    b = tracking.malloc(&tracking, 1000);
+    ASSERT(a);
+    ASSERT(b);
+    tracking.free(&tracking, b);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_reset(&tracking));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(100, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(100, (int)usage.peak_bytes, "%d");
+    ASSERT_EQ_FMT(1, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.allocs, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.frees, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.total_bytes, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.histogram[10], "%d");
+
+    /* A copy of the handler shares its state */
+    {
+        struct eaarlio_memory copy = tracking;
+        copy.free(&copy, a);
+    }
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(0, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(100, (int)usage.peak_bytes, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+SUITE(suite_usage)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_usage);
+    RUN_TEST(test_histogram);
+    RUN_TEST(test_alignment);
+    RUN_TEST(test_reset);
+
+    mock_memory_new(&memory, &mock, 2);
+    RUN_TESTp(test_failures, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_flight
+ *******************************************************************************
+ */
+
+/* Is memory used by a flight measured, and all of it released? */
+TEST test_flight(uint32_t nthreads)
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct eaarlio_flight flight;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, &tracking));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1,
+        RASTER_COUNT,
+        EAARLIO_FLIGHT_INCLUDE_PULSES | EAARLIO_FLIGHT_INCLUDE_WAVEFORMS,
+        nthreads, &ignore_raster, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT(usage.live_bytes > 0);
+    ASSERT(usage.peak_bytes > usage.live_bytes);
+    ASSERT(usage.allocs >= RASTER_COUNT);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(0, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(usage.allocs, usage.frees, "%" PRIu64);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+#ifdef EAARLIO_HAVE_PTHREADS
+
+struct worker {
+    pthread_t thread;
+    struct eaarlio_memory *tracking;
+    int failures;
+};
+
+/* Allocate, resize, and release blocks of several sizes */
+static void *worker_main(void *arg)
+{
+    struct worker *worker = (struct worker *)arg;
+    struct eaarlio_memory *tracking = worker->tracking;
+    void *a, *b;
+    int pass;
+
+    for(pass = 0; pass < THREAD_PASSES; pass++) {
+        a = tracking->malloc(tracking, 64);
+        b = tracking->calloc(tracking, 4, 8);
+        if(!a || !b) {
+            worker->failures++;
+            tracking->free(tracking, a);
+            tracking->free(tracking, b);
+            continue;
+        }
+        a = tracking->realloc(tracking, a, 128);
+        if(!a)
+            worker->failures++;
+        tracking->free(tracking, a);
+        tracking->free(tracking, b);
+    }
+    return NULL;
+}
+
+/* Do counts stay exact when several threads share one handler? */
+TEST test_threads()
+{
+    struct eaarlio_memory tracking;
+    struct eaarlio_memory_usage usage;
+    struct worker workers[THREAD_COUNT];
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking(&tracking, NULL));
+
+    for(i = 0; i < THREAD_COUNT; i++) {
+        workers[i].tracking = &tracking;
+        workers[i].failures = 0;
+        ASSERT_EQ_FMT(0,
+            pthread_create(
+                &workers[i].thread, NULL, worker_main, &workers[i]),
+            "%d");
+    }
+    for(i = 0; i < THREAD_COUNT; i++) {
+        ASSERT_EQ_FMT(0, pthread_join(workers[i].thread, NULL), "%d");
+        ASSERT_EQ_FMT(0, workers[i].failures, "%d");
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_usage(&tracking, &usage));
+    ASSERT_EQ_FMT(0, (int)usage.live_bytes, "%d");
+    ASSERT_EQ_FMT(0, (int)usage.live_blocks, "%d");
+    ASSERT_EQ_FMT(2 * THREAD_COUNT * THREAD_PASSES, (int)usage.allocs, "%d");
+    ASSERT_EQ_FMT(THREAD_COUNT * THREAD_PASSES, (int)usage.reallocs, "%d");
+    ASSERT_EQ_FMT(2 * THREAD_COUNT * THREAD_PASSES, (int)usage.frees, "%d");
+    ASSERT_EQ_FMT(224 * THREAD_COUNT * THREAD_PASSES, (int)usage.total_bytes,
+        "%d");
+    ASSERT(usage.peak_bytes >= 160);
+    ASSERT(usage.peak_bytes <= 160 * THREAD_COUNT);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_tracking_free(&tracking));
+    PASS();
+}
+
+#endif /* EAARLIO_HAVE_PTHREADS */
+
+SUITE(suite_flight)
+{
+    RUN_TESTp(test_flight, 1);
+    RUN_TESTp(test_flight, 4);
+
+#ifdef EAARLIO_HAVE_PTHREADS
+    RUN_TEST(test_threads);
+#endif
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_usage);
+    RUN_SUITE(suite_flight);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,415 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/pack.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_tempfile.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_tld.c"
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define TLD_FILE "010909-014641.tld"
+#define TLD_LEN 80040
+#define RASTER_COUNT 10
+#define FILE_COUNT 3
+
+/* Header fields are at fixed positions */
+#define HEADER_FILE_COUNT 12
+#define HEADER_EDB_LENGTH 24
+#define HEADER_TABLE_OFFSET 32
+
+/*******************************************************************************
+ * Helpers
+ *******************************************************************************
+ */
+
+/* Pack the test flight into a newly allocated buffer */
+static eaarlio_error make_pack(unsigned char **data, uint64_t *len)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_stream out;
+    unsigned char *buf;
+    eaarlio_error err;
+
+    err = eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_memory_stream(&out, NULL, 0, "w", NULL);
+    if(err == EAARLIO_SUCCESS) {
+        err = eaarlio_pack_write(&out, &flight.edb, &flight.tld_opener, NULL);
+        if(err == EAARLIO_SUCCESS)
+            err = eaarlio_memory_stream_buffer(&out, &buf, len);
+        if(err == EAARLIO_SUCCESS) {
+            *data = malloc((size_t)*len);
+            if(*data)
+                memcpy(*data, buf, (size_t)*len);
+            else
+                err = EAARLIO_MEMORY_ALLOC_FAIL;
+        }
+        out.close(&out);
+    }
+
+    eaarlio_flight_free(&flight);
+    return err;
+}
+
+/* Read a 64-bit little-endian value from a header field */
+static uint64_t field_uint64(unsigned char const *buf)
+{
+    uint64_t val = 0;
+    int i;
+    for(i = 7; i >= 0; i--)
+        val = val << 8 | buf[i];
+    return val;
+}
+
+/* Compare every raster in flight, which uses memory, with the test flight */
+TEST check_flight(char const *msg,
+    struct eaarlio_flight *flight,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_flight exp;
+    struct eaarlio_raster raster, got;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_file_flight(&exp, EDB_FILE, DATADIR, NULL));
+    ASSERT_EQ_FMTm(msg, (uint32_t)RASTER_COUNT, flight->edb.record_count,
+        "%" PRIu32);
+    ASSERT_EQ_FMTm(
+        msg, (uint32_t)FILE_COUNT, flight->edb.file_count, "%" PRIu32);
+
+    /* Backwards, so that the TLD file changes between reads */
+    for(i = RASTER_COUNT; i > 0; i--) {
+        ASSERT_EAARLIO_SUCCESSm(
+            msg, eaarlio_flight_read_raster(&exp, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESSm(
+            msg, eaarlio_flight_read_raster(flight, &got, NULL, i, 1, 1));
+        CHECK_CALL(check_raster(msg, &raster, &got));
+        eaarlio_raster_free(&raster, NULL);
+        eaarlio_raster_free(&got, memory);
+    }
+
+    ASSERT_EAARLIO_SUCCESSm(msg, eaarlio_flight_free(&exp));
+    PASS();
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_pack_write(NULL, NULL, NULL, NULL);
+    eaarlio_pack_tld_opener(NULL, NULL, NULL);
+    eaarlio_pack_open_flight(NULL, NULL, NULL);
+    eaarlio_file_pack_flight(NULL, NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stream stream;
+    struct eaarlio_edb edb = eaarlio_edb_empty();
+    struct eaarlio_tld_opener opener, pack_opener;
+    struct eaarlio_flight flight;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_tld_opener(&opener, DATADIR, NULL));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_write(NULL, &edb, &opener, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_write(&stream, NULL, &opener, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_write(&stream, &edb, NULL, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_tld_opener(NULL, &stream, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_tld_opener(&pack_opener, NULL, NULL));
+    ASSERT_EQ(NULL, pack_opener.opaque);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_open_flight(NULL, &stream, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_pack_open_flight(&flight, NULL, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_pack_flight(&flight, NULL, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+/* A file missing from the TLD path fails the write */
+TEST test_missing_tld()
+{
+    struct eaarlio_stream out;
+    struct eaarlio_edb edb = eaarlio_edb_empty();
+    struct eaarlio_tld_opener opener;
+    char *files[] = { TLD_FILE, "missing.tld" };
+
+    edb.file_count = 2;
+    edb.files = files;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&out, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_tld_opener(&opener, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_pack_write(&out, &edb, &opener, NULL));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_missing_tld);
+}
+
+/*******************************************************************************
+ * suite_roundtrip
+ *******************************************************************************
+ */
+
+TEST test_roundtrip(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream pack;
+    struct eaarlio_flight flight;
+    unsigned char *data = NULL;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESS(make_pack(&data, &len));
+    ASSERT_EQ_FMT(FILE_COUNT, data[HEADER_FILE_COUNT], "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&pack, data, len, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pack_open_flight(&flight, &pack, memory));
+    ASSERT_EQ(NULL, pack.data);
+
+    CHECK_CALL(check_flight("memory", &flight, memory));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    free(data);
+    PASS();
+}
+
+/* Streams from the opener behave like the TLD file they came from */
+TEST test_opener(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream pack, tld, file;
+    struct eaarlio_tld_opener opener;
+    unsigned char *data = NULL;
+    unsigned char *exp = malloc(TLD_LEN);
+    unsigned char *got = malloc(TLD_LEN + 1);
+    uint64_t len;
+    int64_t pos;
+
+    ASSERT(exp);
+    ASSERT(got);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_stream(&file, DATADIR "/" TLD_FILE, "r"));
+    ASSERT_EAARLIO_SUCCESS(file.read(&file, TLD_LEN, exp));
+    ASSERT_EAARLIO_SUCCESS(file.close(&file));
+
+    ASSERT_EAARLIO_SUCCESS(make_pack(&data, &len));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&pack, data, len, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pack_tld_opener(&opener, &pack, memory));
+    ASSERT_EQ(NULL, pack.data);
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &tld, "missing.tld"));
+
+    ASSERT_EAARLIO_SUCCESS(opener.open_tld(&opener, &tld, TLD_FILE));
+
+    ASSERT_EAARLIO_SUCCESS(tld.seek(&tld, 0, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(tld.tell(&tld, &pos));
+    ASSERT_EQ_FMT((int64_t)TLD_LEN, pos, "%" PRIi64);
+
+    /* Reads stop at the end of the file, not the end of the pack */
+    ASSERT_EAARLIO_SUCCESS(tld.seek(&tld, 0, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, tld.read(&tld, TLD_LEN + 1, got));
+    ASSERT_MEM_EQ(exp, got, TLD_LEN);
+    ASSERT_EAARLIO_SUCCESS(tld.tell(&tld, &pos));
+    ASSERT_EQ_FMT((int64_t)TLD_LEN, pos, "%" PRIi64);
+
+    ASSERT_EAARLIO_SUCCESS(tld.seek(&tld, -10, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(tld.read(&tld, 10, got));
+    ASSERT_MEM_EQ(exp + TLD_LEN - 10, got, 10);
+
+    ASSERT_EAARLIO_SUCCESS(tld.seek(&tld, 100, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(tld.seek(&tld, -50, SEEK_CUR));
+    ASSERT_EAARLIO_SUCCESS(tld.read(&tld, 20, got));
+    ASSERT_MEM_EQ(exp + 50, got, 20);
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, tld.seek(&tld, -1, SEEK_SET));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_SEEK_INVALID, tld.seek(&tld, 0, 99));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL, tld.write(&tld, 1, got));
+
+    ASSERT_EAARLIO_SUCCESS(tld.close(&tld));
+    ASSERT_EQ(NULL, tld.data);
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    free(data);
+    free(exp);
+    free(got);
+    PASS();
+}
+
+TEST test_file(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream out;
+    struct eaarlio_flight flight;
+    char *pack_file = util_tempfile();
+    unsigned char *data = NULL;
+    uint64_t len;
+
+    ASSERT(pack_file);
+    ASSERT_EAARLIO_SUCCESS(make_pack(&data, &len));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&out, pack_file, "w"));
+    ASSERT_EAARLIO_SUCCESS(out.write(&out, len, data));
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_pack_flight(&flight, pack_file, memory));
+    CHECK_CALL(check_flight("file", &flight, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_file_pack_flight(&flight, DATADIR "/missing.pack", memory));
+
+    remove(pack_file);
+    free(pack_file);
+    free(data);
+    PASS();
+}
+
+SUITE(suite_roundtrip)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 20000);
+    RUN_TESTp(test_roundtrip, &memory, &mock);
+
+    mock_memory_reset(&mock, 100);
+    RUN_TESTp(test_opener, &memory, &mock);
+
+    mock_memory_reset(&mock, 20000);
+    RUN_TESTp(test_file, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_corrupt
+ *******************************************************************************
+ */
+
+/* Set a byte in a copy of the test pack, optionally truncate it, and try to
+ * open it. If in_table is set, offset is relative to the start of the file
+ * table.
+ */
+TEST test_corrupt(char const *msg,
+    uint64_t offset,
+    int in_table,
+    unsigned char value,
+    uint64_t truncate,
+    eaarlio_error opener_err)
+{
+    struct eaarlio_stream pack;
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_flight flight;
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+    unsigned char *data = NULL;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESSm(msg, make_pack(&data, &len));
+
+    if(in_table)
+        offset += field_uint64(data + HEADER_TABLE_OFFSET);
+    if(offset < len)
+        data[offset] = value;
+    if(truncate)
+        len = truncate;
+
+    mock_memory_new(&memory, &mock, 100);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream(&pack, data, len, "r", NULL));
+
+    ASSERT_EAARLIO_ERRm(
+        msg, opener_err, eaarlio_pack_tld_opener(&opener, &pack, &memory));
+    if(opener_err == EAARLIO_SUCCESS) {
+        ASSERT_EAARLIO_SUCCESSm(msg, opener.close(&opener));
+        ASSERT_EAARLIO_SUCCESSm(
+            msg, eaarlio_memory_stream(&pack, data, len, "r", NULL));
+    }
+    ASSERT_EAARLIO_ERRm(
+        msg, EAARLIO_CORRUPT, eaarlio_pack_open_flight(&flight, &pack, &memory));
+
+    /* The pack stream is left to the caller */
+    ASSERTm(msg, pack.data);
+    ASSERT_EAARLIO_SUCCESSm(msg, pack.close(&pack));
+    ASSERT_EQ_FMTm(msg, 0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_destroy(&memory);
+    free(data);
+    PASS();
+}
+
+SUITE(suite_corrupt)
+{
+    RUN_TESTp(test_corrupt, "magic", 0, 0, 'X', 0, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "version", 8, 0, 9, 0, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "file count", HEADER_FILE_COUNT + 3, 0, 0x7f, 0,
+        EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "edb length", HEADER_EDB_LENGTH + 3, 0, 0x7f, 0,
+        EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "table offset", HEADER_TABLE_OFFSET + 3, 0, 0x7f,
+        0, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "header only", 0, 0, 'E', 20, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "entry offset", 3, 1, 0x7f, 0, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "entry length", 11, 1, 0x7f, 0, EAARLIO_CORRUPT);
+    RUN_TESTp(test_corrupt, "name length", 17, 1, 0x7f, 0, EAARLIO_CORRUPT);
+    /* The table is fine, but the EDB is cut short */
+    RUN_TESTp(test_corrupt, "edb", HEADER_EDB_LENGTH, 0, 4, 0, EAARLIO_SUCCESS);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_roundtrip);
+    RUN_SUITE(suite_corrupt);
+
+    GREATEST_MAIN_END();
+}
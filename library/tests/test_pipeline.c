@@ -0,0 +1,367 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/pipeline.h"
+#include "eaarlio/raster.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <stdint.h>
+#include <string.h>
+
+#define EDB_FILE (DATADIR "/flight.idx")
+
+/* Requests a fixed list of rasters and records what each stage received.
+ * The work stage only writes to the entry for its slot, which no other
+ * raster uses at the same time.
+ */
+struct pipeline_log {
+    uint32_t const *rasters;
+    uint32_t raster_count;
+    uint32_t next;
+    uint32_t depth;
+    uint32_t worked[64];
+    uint32_t count;
+    uint32_t raster_number[64];
+    uint32_t sequence_number[64];
+    int has_pulses[64];
+    int has_waveforms[64];
+    int work_first[64];
+    /* If non-zero, fail with EAARLIO_CORRUPT at this raster */
+    uint32_t fail_next;
+    uint32_t fail_work;
+    uint32_t fail_output;
+};
+
+static eaarlio_error log_next(void *ctx, uint32_t *raster_number)
+{
+    struct pipeline_log *log = (struct pipeline_log *)ctx;
+
+    if(log->next == log->raster_count) {
+        *raster_number = 0;
+        return EAARLIO_SUCCESS;
+    }
+    *raster_number = log->rasters[log->next++];
+    if(*raster_number == log->fail_next)
+        return EAARLIO_CORRUPT;
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error log_work(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct pipeline_log *log = (struct pipeline_log *)ctx;
+
+    (void)raster;
+    (void)time_offset;
+    if(slot >= log->depth)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    log->worked[slot] = raster_number;
+    if(raster_number == log->fail_work)
+        return EAARLIO_CORRUPT;
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error log_output(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct pipeline_log *log = (struct pipeline_log *)ctx;
+    uint32_t i = log->count++;
+
+    (void)time_offset;
+    if(slot >= log->depth || i >= 64)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    log->raster_number[i] = raster_number;
+    log->sequence_number[i] = raster->sequence_number;
+    log->has_pulses[i] = raster->pulse != NULL;
+    log->has_waveforms[i] = raster->pulse && raster->pulse[0].tx;
+    log->work_first[i] = log->worked[slot] == raster_number;
+
+    if(raster_number == log->fail_output)
+        return EAARLIO_CORRUPT;
+    return EAARLIO_SUCCESS;
+}
+
+/* Set up a pipeline over rasters, logging to log */
+static struct eaarlio_pipeline make_pipeline(struct pipeline_log *log,
+    uint32_t const *rasters,
+    uint32_t raster_count,
+    uint32_t threads,
+    uint32_t depth)
+{
+    struct eaarlio_pipeline pipeline = eaarlio_pipeline_empty();
+
+    memset(log, 0, sizeof(*log));
+    log->rasters = rasters;
+    log->raster_count = raster_count;
+    log->depth = depth ? depth : EAARLIO_PIPELINE_DEPTH;
+
+    pipeline.next = &log_next;
+    pipeline.work = &log_work;
+    pipeline.output = &log_output;
+    pipeline.ctx = log;
+    pipeline.threads = threads;
+    pipeline.depth = depth;
+    pipeline.include_pulses = 1;
+    pipeline.include_waveforms = 1;
+
+    return pipeline;
+}
+
+static uint32_t const rasters[] = { 10, 1, 5, 3, 8, 2, 5, 9, 4, 7, 6, 1, 10,
+    2, 3, 4, 5, 6, 7, 8 };
+#define RASTER_COUNT (sizeof(rasters) / sizeof(rasters[0]))
+
+TEST test_sanity()
+{
+    eaarlio_pipeline_run(NULL, NULL);
+    PASS();
+}
+
+TEST test_null_flight()
+{
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, 1, 0);
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_pipeline_run(NULL, &pipeline));
+    PASS();
+}
+
+TEST test_null_pipeline()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_pipeline_run(&flight, NULL));
+    PASS();
+}
+
+TEST test_null_callbacks()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, 1, 0);
+
+    pipeline.next = NULL;
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_pipeline_run(&flight, &pipeline));
+    pipeline.next = &log_next;
+    pipeline.output = NULL;
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_pipeline_run(&flight, &pipeline));
+    PASS();
+}
+
+TEST test_uninitialized()
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, 1, 0);
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_pipeline_run(&flight, &pipeline));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null_flight);
+    RUN_TEST(test_null_pipeline);
+    RUN_TEST(test_null_callbacks);
+    RUN_TEST(test_uninitialized);
+}
+
+/* Are rasters delivered in the requested order, after the work stage? */
+TEST test_order(uint32_t threads, uint32_t depth)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, threads, depth);
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pipeline_run(&flight, &pipeline));
+
+    ASSERT_EQ_FMT((uint32_t)RASTER_COUNT, log.count, "%u");
+    for(i = 0; i < RASTER_COUNT; i++) {
+        ASSERT_EQ_FMT(rasters[i], log.raster_number[i], "%u");
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT(log.has_pulses[i]);
+        ASSERT(log.has_waveforms[i]);
+        ASSERT(log.work_first[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Does the pipeline work without a work stage or pulse data? */
+TEST test_headers_only(uint32_t threads)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, threads, 2);
+    uint32_t i;
+
+    pipeline.work = NULL;
+    pipeline.include_pulses = 0;
+    pipeline.include_waveforms = 0;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pipeline_run(&flight, &pipeline));
+
+    ASSERT_EQ_FMT((uint32_t)RASTER_COUNT, log.count, "%u");
+    for(i = 0; i < RASTER_COUNT; i++) {
+        ASSERT_EQ_FMT(rasters[i], log.sequence_number[i], "%u");
+        ASSERT_FALSE(log.has_pulses[i]);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Is an empty request list handled? */
+TEST test_empty(uint32_t threads)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, 0, threads, 0);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT_EQ_FMT(0, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Do errors from each stage reach the caller, with output stopping at or
+ * before the failed raster?
+ */
+TEST test_errors(uint32_t threads)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+
+    pipeline = make_pipeline(&log, rasters, RASTER_COUNT, threads, 3);
+    log.fail_next = 9;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_CORRUPT, eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT(log.count <= 7);
+
+    pipeline = make_pipeline(&log, rasters, RASTER_COUNT, threads, 3);
+    log.fail_work = 9;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_CORRUPT, eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT(log.count <= 7);
+
+    pipeline = make_pipeline(&log, rasters, RASTER_COUNT, threads, 3);
+    log.fail_output = 9;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_CORRUPT, eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT_EQ_FMT(8, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Is an invalid raster number reported? */
+TEST test_invalid_raster(uint32_t threads)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    uint32_t bad[] = { 1, 2, 11, 3 };
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, bad, 4, threads, 0);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_FLIGHT_RASTER_INVALID,
+        eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT(log.count <= 2);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+SUITE(suite_pipeline)
+{
+    RUN_TESTp(test_order, 1, 0);
+    RUN_TESTp(test_order, 2, 0);
+    RUN_TESTp(test_order, 4, 1);
+    RUN_TESTp(test_order, 4, 3);
+    RUN_TESTp(test_order, 0, 0);
+    RUN_TESTp(test_headers_only, 1);
+    RUN_TESTp(test_headers_only, 3);
+    RUN_TESTp(test_empty, 1);
+    RUN_TESTp(test_empty, 4);
+    RUN_TESTp(test_errors, 1);
+    RUN_TESTp(test_errors, 4);
+    RUN_TESTp(test_invalid_raster, 1);
+    RUN_TESTp(test_invalid_raster, 4);
+}
+
+/* Is everything released, with a memory handler that is only used from one
+ * thread?
+ */
+TEST test_memory(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    struct pipeline_log log;
+    struct eaarlio_pipeline pipeline =
+        make_pipeline(&log, rasters, RASTER_COUNT, 1, 0);
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_pipeline_run(&flight, &pipeline));
+    ASSERT_EQ_FMT((uint32_t)RASTER_COUNT, log.count, "%u");
+
+    pipeline = make_pipeline(&log, rasters, RASTER_COUNT, 1, 0);
+    log.fail_work = 3;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_CORRUPT, eaarlio_pipeline_run(&flight, &pipeline));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_memory)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 50000);
+    RUN_TESTp(test_memory, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_pipeline);
+    RUN_SUITE(suite_memory);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,737 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/pipeline.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_raster_log.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EDB_FILE (DATADIR "/flight.idx")
+
+#define DATA_LEN 100
+
+/* Stream data; byte i holds the value i */
+static unsigned char data[DATA_LEN];
+
+/* Totals for every raster in the test flight, from reading it without
+ * statistics
+ */
+struct totals {
+    uint32_t rasters;
+    uint64_t pulses;
+    uint64_t waveforms;
+};
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    struct eaarlio_stats_memory wrapper;
+    eaarlio_stats_add(NULL, NULL);
+    eaarlio_stats_stream(NULL, NULL, NULL, NULL);
+    eaarlio_stats_memory_init(&wrapper, NULL, NULL);
+    eaarlio_flight_stats_enable(NULL, 1);
+    eaarlio_flight_stats(NULL, NULL);
+    eaarlio_flight_stats_reset(NULL);
+    PASS();
+}
+
+TEST test_empty()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    ASSERT_EQ_FMT(0, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.waveforms, "%d");
+    ASSERT_EQ_FMT(0.0, stats.free_seconds, "%f");
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stats_memory wrapper;
+    struct eaarlio_stream inner, stream;
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_stats_add(NULL, &stats));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_stats_add(&stats, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stats_stream(NULL, &inner, &stats, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stats_stream(&stream, NULL, &stats, NULL));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stats_stream(&stream, &inner, NULL, NULL));
+    ASSERT(inner.data);
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stats_memory_init(NULL, NULL, &stats));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stats_memory_init(&wrapper, NULL, NULL));
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_flight_stats_enable(NULL, 1));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_flight_stats(NULL, &stats));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_flight_stats(&flight, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_flight_stats_reset(NULL));
+    PASS();
+}
+
+TEST test_invalid()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stats_memory wrapper;
+    struct eaarlio_memory memory = eaarlio_memory_empty();
+    struct eaarlio_stream inner = eaarlio_stream_empty();
+    struct eaarlio_stream stream;
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_stats_stream(&stream, &inner, &stats, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_INVALID,
+        eaarlio_stats_memory_init(&wrapper, &memory, &stats));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_FLIGHT_INVALID, eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_FLIGHT_INVALID, eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_FLIGHT_INVALID, eaarlio_flight_stats_reset(&flight));
+    PASS();
+}
+
+TEST test_add()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stats other = eaarlio_stats_empty();
+
+    other.read_calls = 1;
+    other.bytes_read = 2;
+    other.seek_calls = 3;
+    other.tld_opens = 4;
+    other.allocs = 5;
+    other.alloc_bytes = 6;
+    other.frees = 7;
+    other.rasters = 8;
+    other.pulses = 9;
+    other.waveforms = 10;
+    other.io_seconds = 0.5;
+    other.decode_seconds = 0.25;
+    other.free_seconds = 0.125;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_add(&stats, &other));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_add(&stats, &other));
+
+    ASSERT_EQ_FMT(2, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(4, (int)stats.bytes_read, "%d");
+    ASSERT_EQ_FMT(6, (int)stats.seek_calls, "%d");
+    ASSERT_EQ_FMT(8, (int)stats.tld_opens, "%d");
+    ASSERT_EQ_FMT(10, (int)stats.allocs, "%d");
+    ASSERT_EQ_FMT(12, (int)stats.alloc_bytes, "%d");
+    ASSERT_EQ_FMT(14, (int)stats.frees, "%d");
+    ASSERT_EQ_FMT(16, (int)stats.rasters, "%d");
+    ASSERT_EQ_FMT(18, (int)stats.pulses, "%d");
+    ASSERT_EQ_FMT(20, (int)stats.waveforms, "%d");
+    ASSERT_EQ_FMT(1.0, stats.io_seconds, "%f");
+    ASSERT_EQ_FMT(0.5, stats.decode_seconds, "%f");
+    ASSERT_EQ_FMT(0.25, stats.free_seconds, "%f");
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_null);
+    RUN_TEST(test_invalid);
+    RUN_TEST(test_add);
+}
+
+/*******************************************************************************
+ * suite_stream
+ *******************************************************************************
+ */
+
+/* Are reads and seeks counted, and passed through unchanged? */
+TEST test_stream_counts()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stream inner, stream;
+    unsigned char buf[DATA_LEN];
+    int64_t pos;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_stream(&stream, &inner, &stats, NULL));
+    ASSERT_EQ(NULL, inner.data);
+
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_EQ_FMT(0, (int)buf[0], "%d");
+    ASSERT_EQ_FMT(9, (int)buf[9], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 50, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_EQ_FMT(50, (int)buf[0], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT(55, (int)pos, "%d");
+
+    ASSERT_EQ_FMT(2, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(15, (int)stats.bytes_read, "%d");
+    ASSERT_EQ_FMT(1, (int)stats.seek_calls, "%d");
+    ASSERT(stats.io_seconds >= 0);
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ(NULL, stream.data);
+    PASS();
+}
+
+/* Are failed reads counted as calls but not as bytes? */
+TEST test_stream_short()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stream inner, stream;
+    unsigned char buf[DATA_LEN];
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_stream(&stream, &inner, &stats, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 95, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 10, buf));
+    ASSERT_EQ_FMT(1, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.bytes_read, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+/* Are writes passed through? */
+TEST test_stream_write()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stream inner, stream;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&inner, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_stream(&stream, &inner, &stats, NULL));
+    ASSERT_EAARLIO_SUCCESS(stream.write(&stream, 10, data));
+
+    ASSERT_EQ_FMT(0, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.bytes_read, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+/* Does closing the wrapper release everything, including the inner stream? */
+TEST test_stream_memory(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stream inner, stream;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_stats_stream(&stream, &inner, &stats, memory));
+    ASSERT(mock_memory_count_in_use(mock) > 0);
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    /* On failure, the inner stream is left to the caller */
+    mock_memory_reset(mock, 1);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        eaarlio_stats_stream(&stream, &inner, &stats, memory));
+    ASSERT(inner.data);
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+SUITE(suite_stream)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_stream_counts);
+    RUN_TEST(test_stream_short);
+    RUN_TEST(test_stream_write);
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_stream_memory, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_memory
+ *******************************************************************************
+ */
+
+/* Is each kind of call counted and passed through? */
+TEST test_memory_counts(struct eaarlio_memory *inner, struct mock_memory *mock)
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stats_memory wrapper;
+    struct eaarlio_memory copy;
+    void *a, *b, *c;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_memory_init(&wrapper, inner, &stats));
+
+    a = wrapper.memory.malloc(&wrapper.memory, 10);
+    ASSERT(a);
+    b = wrapper.memory.calloc(&wrapper.memory, 3, 4);
+    ASSERT(b);
+    a = wrapper.memory.realloc(&wrapper.memory, a, 20);
+    ASSERT(a);
+    ASSERT_EQ_FMT(2, mock_memory_count_in_use(mock), "%d");
+
+    /* Copies of the handler count into the same statistics */
+    copy = wrapper.memory;
+    c = copy.malloc(&copy, 5);
+    ASSERT(c);
+
+    ASSERT_EQ_FMT(4, (int)stats.allocs, "%d");
+    ASSERT_EQ_FMT(47, (int)stats.alloc_bytes, "%d");
+
+    wrapper.memory.free(&wrapper.memory, a);
+    wrapper.memory.free(&wrapper.memory, b);
+    copy.free(&copy, c);
+    wrapper.memory.free(&wrapper.memory, NULL);
+    ASSERT_EQ_FMT(3, (int)stats.frees, "%d");
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    PASS();
+}
+
+/* Does a NULL inner handler mean stdlib? */
+TEST test_memory_default()
+{
+    struct eaarlio_stats stats = eaarlio_stats_empty();
+    struct eaarlio_stats_memory wrapper;
+    void *a;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stats_memory_init(&wrapper, NULL, &stats));
+    a = wrapper.memory.malloc(&wrapper.memory, 10);
+    ASSERT(a);
+    wrapper.memory.free(&wrapper.memory, a);
+    ASSERT_EQ_FMT(1, (int)stats.allocs, "%d");
+    ASSERT_EQ_FMT(1, (int)stats.frees, "%d");
+    PASS();
+}
+
+SUITE(suite_memory)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_memory_counts, &memory, &mock);
+    mock_memory_destroy(&memory);
+
+    RUN_TEST(test_memory_default);
+}
+
+/*******************************************************************************
+ * suite_flight
+ *******************************************************************************
+ */
+
+/* Read every raster in the test flight without statistics */
+static int flight_totals(struct totals *totals)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    uint32_t i;
+    uint16_t j;
+
+    memset(totals, 0, sizeof(*totals));
+    if(eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL)
+        != EAARLIO_SUCCESS)
+        return 0;
+
+    totals->rasters = flight.edb.record_count;
+    for(i = 1; i <= totals->rasters; i++) {
+        if(eaarlio_flight_read_raster(&flight, &raster, NULL, i, 1, 1)
+            != EAARLIO_SUCCESS)
+            return 0;
+        totals->pulses += raster.pulse_count;
+        for(j = 0; j < raster.pulse_count; j++)
+            totals->waveforms += 1 + raster.pulse[j].rx_count;
+        eaarlio_raster_free(&raster, NULL);
+    }
+
+    eaarlio_flight_free(&flight);
+    return 1;
+}
+
+/* Is nothing collected until statistics are enabled? */
+TEST test_flight_disabled()
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    struct eaarlio_stats stats;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 1, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(0, (int)stats.rasters, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.read_calls, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.allocs, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Does eaarlio_flight_read_raster count everything it does? */
+TEST test_flight_read_raster()
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    struct eaarlio_stats stats;
+    struct totals totals;
+    uint32_t i;
+
+    ASSERT(flight_totals(&totals));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 1, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+
+    /* The stream opened before enabling is replaced, so its file is counted */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    for(i = 1; i <= totals.rasters; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(totals.rasters, (uint32_t)stats.rasters, "%u");
+    ASSERT_EQ_FMT(totals.pulses, stats.pulses, "%" PRIu64);
+    ASSERT_EQ_FMT(totals.waveforms, stats.waveforms, "%" PRIu64);
+    ASSERT_EQ_FMT(flight.edb.file_count, (uint32_t)stats.tld_opens, "%u");
+    ASSERT(stats.read_calls >= totals.rasters);
+    ASSERT(stats.bytes_read > 0);
+    ASSERT(stats.seek_calls >= totals.rasters);
+    ASSERT(stats.allocs >= totals.rasters);
+    ASSERT(stats.alloc_bytes > 0);
+    ASSERT(stats.io_seconds >= 0);
+    ASSERT(stats.decode_seconds >= 0);
+
+    /* Without waveforms, none are counted */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_reset(&flight));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 1, 1, 0));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(1, (int)stats.rasters, "%d");
+    ASSERT(stats.pulses > 0);
+    ASSERT_EQ_FMT(0, (int)stats.waveforms, "%d");
+
+    /* Disabling keeps what was collected and stops collecting */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 0));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 2, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(1, (int)stats.rasters, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_reset(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(0, (int)stats.rasters, "%d");
+    ASSERT_EQ_FMT(0, (int)stats.tld_opens, "%d");
+    ASSERT_EQ_FMT(0.0, stats.io_seconds, "%f");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Does eaarlio_flight_plan count its rasters and the frees it makes? */
+TEST test_flight_plan()
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_stats stats;
+    struct totals totals;
+    uint32_t raster_numbers[20];
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT(flight_totals(&totals));
+    ASSERT(totals.rasters <= 20);
+    for(i = 0; i < totals.rasters; i++)
+        raster_numbers[i] = i + 1;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, raster_numbers,
+        totals.rasters, EAARLIO_FLIGHT_ORDER_DISK, 0, 1, 1,
+        &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(totals.rasters, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(totals.rasters, (uint32_t)stats.rasters, "%u");
+    ASSERT_EQ_FMT(totals.pulses, stats.pulses, "%" PRIu64);
+    ASSERT_EQ_FMT(totals.waveforms, stats.waveforms, "%" PRIu64);
+    ASSERT_EQ_FMT(flight.edb.file_count, (uint32_t)stats.tld_opens, "%u");
+    ASSERT(stats.bytes_read > 0);
+    ASSERT(stats.frees >= totals.rasters);
+    ASSERT(stats.free_seconds >= 0);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Are the workers' statistics merged into the flight's? */
+TEST test_flight_parallel(uint32_t nthreads)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_stats stats;
+    struct totals totals;
+    struct util_raster_log log;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT(flight_totals(&totals));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1,
+        totals.rasters, EAARLIO_FLIGHT_INCLUDE_PULSES, nthreads,
+        &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(totals.rasters, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(totals.rasters, (uint32_t)stats.rasters, "%u");
+    ASSERT_EQ_FMT(totals.pulses, stats.pulses, "%" PRIu64);
+    ASSERT_EQ_FMT(0, (int)stats.waveforms, "%d");
+    ASSERT(stats.tld_opens >= flight.edb.file_count);
+    ASSERT(stats.bytes_read > 0);
+    ASSERT(stats.allocs > 0);
+    ASSERT(stats.frees > 0);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Pipeline context that hands out rasters 1 through last in order */
+struct pipeline_range {
+    uint32_t next;
+    uint32_t last;
+    uint32_t output_count;
+};
+
+static eaarlio_error range_next(void *ctx, uint32_t *raster_number)
+{
+    struct pipeline_range *range = (struct pipeline_range *)ctx;
+
+    *raster_number = range->next <= range->last ? range->next++ : 0;
+    return EAARLIO_SUCCESS;
+}
+
+static eaarlio_error range_output(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct pipeline_range *range = (struct pipeline_range *)ctx;
+
+    (void)slot;
+    (void)raster_number;
+    (void)raster;
+    (void)time_offset;
+    range->output_count++;
+    return EAARLIO_SUCCESS;
+}
+
+/* Run a pipeline over rasters 1 through last */
+static eaarlio_error run_pipeline(struct eaarlio_flight *flight,
+    uint32_t last,
+    uint32_t threads,
+    uint32_t *output_count)
+{
+    struct eaarlio_pipeline pipeline = eaarlio_pipeline_empty();
+    struct pipeline_range range = { 1, 0, 0 };
+    eaarlio_error err;
+
+    range.last = last;
+    pipeline.next = &range_next;
+    pipeline.output = &range_output;
+    pipeline.ctx = &range;
+    pipeline.threads = threads;
+    pipeline.include_pulses = 1;
+    pipeline.include_waveforms = 1;
+
+    err = eaarlio_pipeline_run(flight, &pipeline);
+    *output_count = range.output_count;
+    return err;
+}
+
+/* Are the decode and output threads' statistics merged into the flight's? */
+TEST test_flight_pipeline(uint32_t threads)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_stats stats;
+    struct totals totals;
+    uint32_t output_count;
+
+    ASSERT(flight_totals(&totals));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(
+        run_pipeline(&flight, totals.rasters, threads, &output_count));
+    ASSERT_EQ_FMT(totals.rasters, output_count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(totals.rasters, (uint32_t)stats.rasters, "%u");
+    ASSERT_EQ_FMT(totals.pulses, stats.pulses, "%" PRIu64);
+    ASSERT_EQ_FMT(totals.waveforms, stats.waveforms, "%" PRIu64);
+    ASSERT_EQ_FMT(flight.edb.file_count, (uint32_t)stats.tld_opens, "%u");
+    ASSERT(stats.bytes_read > 0);
+    ASSERT(stats.allocs >= totals.rasters);
+    ASSERT(stats.frees >= totals.rasters);
+    ASSERT(stats.decode_seconds >= 0);
+    ASSERT(stats.free_seconds >= 0);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    PASS();
+}
+
+/* Are the reads made by each fetch backend counted? */
+TEST test_flight_fetch(int backend)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_stats stats;
+    struct totals totals;
+    uint32_t raster_numbers[20];
+    struct util_raster_log log;
+    uint32_t i;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT(flight_totals(&totals));
+    ASSERT(totals.rasters <= 20);
+    for(i = 0; i < totals.rasters; i++)
+        raster_numbers[i] = i + 1;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight_fetch(&flight, DATADIR,
+        raster_numbers, totals.rasters, backend, 0, 1, 1, &util_raster_log_fn,
+        &log));
+    ASSERT_EQ_FMT(totals.rasters, log.count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(totals.rasters, (uint32_t)stats.rasters, "%u");
+    ASSERT_EQ_FMT(flight.edb.file_count, (uint32_t)stats.tld_opens, "%u");
+    ASSERT(stats.read_calls >= flight.edb.file_count);
+    ASSERT(stats.bytes_read > 0);
+    ASSERT(stats.io_seconds > 0);
+    ASSERT(stats.decode_seconds >= 0);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    util_raster_log_free(&log);
+    PASS();
+}
+
+/* Is everything released when statistics are collected? */
+TEST test_flight_memory(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight flight;
+    struct eaarlio_raster raster;
+    struct eaarlio_stats stats;
+    uint32_t raster_numbers[3] = { 3, 1, 2 };
+    struct util_raster_log log;
+    uint32_t output_count;
+
+    ASSERT_EAARLIO_SUCCESS(util_raster_log_init(&log));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats_enable(&flight, 1));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_flight_read_raster(&flight, &raster, NULL, 5, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_plan(&flight, raster_numbers, 3,
+        EAARLIO_FLIGHT_ORDER_CALLER, 0, 1, 1, &util_raster_log_fn, &log));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_parallel_for(&flight, 1, 10,
+        EAARLIO_FLIGHT_INCLUDE_PULSES | EAARLIO_FLIGHT_INCLUDE_WAVEFORMS, 1,
+        &util_raster_log_fn, &log));
+    ASSERT_EQ_FMT(13, log.count, "%u");
+    ASSERT_EAARLIO_SUCCESS(run_pipeline(&flight, 10, 1, &output_count));
+    ASSERT_EQ_FMT(10, output_count, "%u");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_stats(&flight, &stats));
+    ASSERT_EQ_FMT(24, (int)stats.rasters, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    util_raster_log_free(&log);
+    PASS();
+}
+
+SUITE(suite_flight)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_flight_disabled);
+    RUN_TEST(test_flight_read_raster);
+    RUN_TEST(test_flight_plan);
+    RUN_TESTp(test_flight_parallel, 1);
+    RUN_TESTp(test_flight_parallel, 3);
+    RUN_TESTp(test_flight_pipeline, 1);
+    RUN_TESTp(test_flight_pipeline, 3);
+    if(eaarlio_file_fetch_available(EAARLIO_FETCH_PREAD))
+        RUN_TESTp(test_flight_fetch, EAARLIO_FETCH_PREAD);
+    if(eaarlio_file_fetch_available(EAARLIO_FETCH_IO_URING))
+        RUN_TESTp(test_flight_fetch, EAARLIO_FETCH_IO_URING);
+
+    mock_memory_new(&memory, &mock, 20000);
+    RUN_TESTp(test_flight_memory, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+
+    for(i = 0; i < DATA_LEN; i++)
+        data[i] = (unsigned char)i;
+
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_stream);
+    RUN_SUITE(suite_memory);
+    RUN_SUITE(suite_flight);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,452 @@
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tar.h"
+#include "eaarlio/tld_opener.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "util_tempfile.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_tld.c"
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+#define BLOCK 512
+
+static char const *tld_files[] = { "010909-014641.tld", "010909-014645.tld",
+    "010909-014748.tld" };
+#define TLD_COUNT 3
+
+/*******************************************************************************
+ * Helpers for building archives
+ *******************************************************************************
+ */
+
+/* Write a member header to out. If size_field is NULL, size is written in
+ * octal.
+ */
+static eaarlio_error tar_header(struct eaarlio_stream *out,
+    char const *name,
+    char type,
+    uint64_t size,
+    unsigned char const *size_field)
+{
+    unsigned char block[BLOCK];
+    unsigned int sum = 0;
+    int i;
+
+    memset(block, 0, BLOCK);
+    strncpy((char *)block, name, 100);
+    memcpy(block + 100, "0000644", 8);
+    memcpy(block + 108, "0000000", 8);
+    memcpy(block + 116, "0000000", 8);
+    if(size_field)
+        memcpy(block + 124, size_field, 12);
+    else
+        sprintf((char *)block + 124, "%011" PRIo64, size);
+    memcpy(block + 136, "00000000000", 12);
+    block[156] = (unsigned char)type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+
+    memset(block + 148, ' ', 8);
+    for(i = 0; i < BLOCK; i++)
+        sum += block[i];
+    sprintf((char *)block + 148, "%06o", sum);
+
+    return out->write(out, BLOCK, block);
+}
+
+/* Write member data to out, padded to a whole block */
+static eaarlio_error tar_data(struct eaarlio_stream *out,
+    void const *data,
+    uint64_t len)
+{
+    unsigned char pad[BLOCK];
+    eaarlio_error err;
+
+    err = out->write(out, len, (unsigned char const *)data);
+    if(err != EAARLIO_SUCCESS || len % BLOCK == 0)
+        return err;
+    memset(pad, 0, BLOCK);
+    return out->write(out, BLOCK - len % BLOCK, pad);
+}
+
+/* Write a regular file member */
+static eaarlio_error tar_file(struct eaarlio_stream *out,
+    char const *name,
+    void const *data,
+    uint64_t len)
+{
+    eaarlio_error err = tar_header(out, name, '0', len, NULL);
+    if(err == EAARLIO_SUCCESS)
+        err = tar_data(out, data, len);
+    return err;
+}
+
+/* Write the end-of-archive marker */
+static eaarlio_error tar_end(struct eaarlio_stream *out)
+{
+    unsigned char zero[2 * BLOCK];
+    memset(zero, 0, sizeof(zero));
+    return out->write(out, sizeof(zero), zero);
+}
+
+/* Open a tar opener over a copy of the archive written to out so far */
+static eaarlio_error open_archive(struct eaarlio_tld_opener *opener,
+    struct eaarlio_stream *out,
+    struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream tar;
+    unsigned char *buf;
+    uint64_t len;
+    eaarlio_error err;
+
+    err = eaarlio_memory_stream_buffer(out, &buf, &len);
+    if(err == EAARLIO_SUCCESS)
+        err = eaarlio_memory_stream(&tar, buf, len, "r", NULL);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_tar_tld_opener(opener, &tar, memory);
+    if(err != EAARLIO_SUCCESS)
+        tar.close(&tar);
+    return err;
+}
+
+/*******************************************************************************
+ * Helpers for checking archives
+ *******************************************************************************
+ */
+
+/* Check that opener serves name with the given contents */
+TEST check_member(struct eaarlio_tld_opener *opener,
+    char const *name,
+    char const *exp,
+    uint64_t exp_len)
+{
+    struct eaarlio_stream stream;
+    unsigned char got[BLOCK];
+    int64_t pos;
+
+    assert(exp_len < BLOCK);
+
+    ASSERT_EAARLIO_SUCCESSm(name, opener->open_tld(opener, &stream, name));
+    ASSERT_EAARLIO_SUCCESSm(name, stream.seek(&stream, 0, SEEK_END));
+    ASSERT_EAARLIO_SUCCESSm(name, stream.tell(&stream, &pos));
+    ASSERT_EQ_FMTm(name, (int64_t)exp_len, pos, "%" PRIi64);
+    ASSERT_EAARLIO_SUCCESSm(name, stream.seek(&stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_ERRm(name, EAARLIO_STREAM_READ_SHORT,
+        stream.read(&stream, exp_len + 1, got));
+    ASSERT_MEM_EQm(name, exp, got, exp_len);
+    ASSERT_EAARLIO_SUCCESSm(name, stream.close(&stream));
+    PASS();
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_tar_tld_opener(NULL, NULL, NULL);
+    eaarlio_file_tar_tld_opener(NULL, NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stream stream;
+    struct eaarlio_tld_opener opener;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&stream, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tar_tld_opener(NULL, &stream, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tar_tld_opener(&opener, NULL, NULL));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_file_tar_tld_opener(&opener, NULL, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        eaarlio_file_tar_tld_opener(&opener, DATADIR "/missing.tar", NULL));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    PASS();
+}
+
+/* An empty stream, or just the end marker, is an empty archive */
+TEST test_empty()
+{
+    struct eaarlio_stream out, stream;
+    struct eaarlio_tld_opener opener;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&out, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(open_archive(&opener, &out, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &stream, "a.tld"));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    ASSERT_EAARLIO_SUCCESS(tar_end(&out));
+    ASSERT_EAARLIO_SUCCESS(open_archive(&opener, &out, NULL));
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_empty);
+}
+
+/*******************************************************************************
+ * suite_members
+ *******************************************************************************
+ */
+
+TEST test_members(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream out, stream;
+    struct eaarlio_tld_opener opener;
+    char long_name[300];
+    char pax[200];
+    unsigned char big_size[12];
+    int len;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&out, NULL, 0, "w", NULL));
+
+    /* Plain file, and one in a directory */
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "a.tld", "alpha", 5));
+    ASSERT_EAARLIO_SUCCESS(tar_header(&out, "dir/", '5', 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "dir/b.tld", "bravo!", 6));
+
+    /* Empty file */
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "empty.tld", "", 0));
+
+    /* A link is not a file, and uses no data blocks */
+    ASSERT_EAARLIO_SUCCESS(tar_header(&out, "link.tld", '2', 0, NULL));
+
+    /* GNU long name */
+    memset(long_name, 'd', sizeof(long_name));
+    strcpy(long_name + 200, "/c.tld");
+    ASSERT_EAARLIO_SUCCESS(tar_header(
+        &out, "././@LongLink", 'L', strlen(long_name) + 1, NULL));
+    ASSERT_EAARLIO_SUCCESS(tar_data(&out, long_name, strlen(long_name) + 1));
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "truncated-name", "charlie", 7));
+
+    /* pax path and size, overriding the header's name and size */
+    len = sprintf(pax, "24 path=deep/path/d.tld\n9 size=3\n11 mtime=0\n");
+    ASSERT_EQ_FMT(44, len, "%d");
+    ASSERT_EAARLIO_SUCCESS(
+        tar_header(&out, "PaxHeaders/d.tld", 'x', (uint64_t)len, NULL));
+    ASSERT_EAARLIO_SUCCESS(tar_data(&out, pax, (uint64_t)len));
+    ASSERT_EAARLIO_SUCCESS(tar_header(&out, "d.tld", '0', 0, NULL));
+    ASSERT_EAARLIO_SUCCESS(tar_data(&out, "del", 3));
+
+    /* The extension headers only apply to one member */
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "e.tld", "echo", 4));
+
+    /* Base-256 size */
+    memset(big_size, 0, sizeof(big_size));
+    big_size[0] = 0x80;
+    big_size[11] = 7;
+    ASSERT_EAARLIO_SUCCESS(tar_header(&out, "f.tld", '0', 0, big_size));
+    ASSERT_EAARLIO_SUCCESS(tar_data(&out, "foxtrot", 7));
+
+    /* A later copy replaces an earlier one */
+    ASSERT_EAARLIO_SUCCESS(tar_file(&out, "other/a.tld", "ALPHA!!", 7));
+
+    ASSERT_EAARLIO_SUCCESS(tar_end(&out));
+
+    ASSERT_EAARLIO_SUCCESS(open_archive(&opener, &out, memory));
+
+    CHECK_CALL(check_member(&opener, "a.tld", "ALPHA!!", 7));
+    CHECK_CALL(check_member(&opener, "b.tld", "bravo!", 6));
+    CHECK_CALL(check_member(&opener, "empty.tld", "", 0));
+    CHECK_CALL(check_member(&opener, "c.tld", "charlie", 7));
+    CHECK_CALL(check_member(&opener, "d.tld", "del", 3));
+    CHECK_CALL(check_member(&opener, "e.tld", "echo", 4));
+    CHECK_CALL(check_member(&opener, "f.tld", "foxtrot", 7));
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &stream, "link.tld"));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &stream, "dir"));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &stream, "truncated-name"));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        opener.open_tld(&opener, &stream, "dir/b.tld"));
+
+    ASSERT_EAARLIO_SUCCESS(opener.close(&opener));
+    ASSERT_EQ(NULL, opener.opaque);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+    PASS();
+}
+
+/* Read the test flight with its TLD files in an archive */
+TEST test_flight(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_flight exp, flight;
+    struct eaarlio_stream out, file;
+    struct eaarlio_raster raster, got;
+    unsigned char *buf;
+    char *tar_file_name = util_tempfile();
+    char name[64];
+    int64_t size;
+    uint32_t i;
+    int f;
+
+    ASSERT(tar_file_name);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&out, tar_file_name, "w"));
+    for(f = 0; f < TLD_COUNT; f++) {
+        sprintf(name, "%s/%s", DATADIR, tld_files[f]);
+        ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, name, "r"));
+        ASSERT_EAARLIO_SUCCESS(file.seek(&file, 0, SEEK_END));
+        ASSERT_EAARLIO_SUCCESS(file.tell(&file, &size));
+        ASSERT_EAARLIO_SUCCESS(file.seek(&file, 0, SEEK_SET));
+        buf = malloc((size_t)size);
+        ASSERT(buf);
+        ASSERT_EAARLIO_SUCCESS(file.read(&file, (uint64_t)size, buf));
+        ASSERT_EAARLIO_SUCCESS(file.close(&file));
+
+        sprintf(name, "flight/tld/%s", tld_files[f]);
+        ASSERT_EAARLIO_SUCCESS(tar_file(&out, name, buf, (uint64_t)size));
+        free(buf);
+    }
+    ASSERT_EAARLIO_SUCCESS(tar_end(&out));
+    ASSERT_EAARLIO_SUCCESS(out.close(&out));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_flight(&exp, EDB_FILE, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_stream(&file, EDB_FILE, "r"));
+    flight = eaarlio_flight_empty();
+    ASSERT_EAARLIO_SUCCESS(eaarlio_edb_read(&file, &flight.edb, memory, 1, 1));
+    ASSERT_EAARLIO_SUCCESS(file.close(&file));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_tar_tld_opener(&flight.tld_opener, tar_file_name, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_init(&flight, memory));
+
+    /* Backwards, so that the TLD file changes between reads */
+    for(i = RASTER_COUNT; i > 0; i--) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&exp, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &got, NULL, i, 1, 1));
+        CHECK_CALL(check_raster("tar", &raster, &got));
+        eaarlio_raster_free(&raster, NULL);
+        eaarlio_raster_free(&got, memory);
+    }
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&exp));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    remove(tar_file_name);
+    free(tar_file_name);
+    PASS();
+}
+
+SUITE(suite_members)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 100);
+    RUN_TESTp(test_members, &memory, &mock);
+
+    mock_memory_reset(&mock, 20000);
+    RUN_TESTp(test_flight, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_corrupt
+ *******************************************************************************
+ */
+
+/* Build a small archive, set a byte, optionally truncate it, and try to open
+ * it
+ */
+TEST test_corrupt(char const *msg,
+    uint64_t offset,
+    unsigned char value,
+    uint64_t truncate)
+{
+    struct eaarlio_stream out, tar;
+    struct eaarlio_tld_opener opener;
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+    unsigned char *buf;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream(&out, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESSm(msg, tar_file(&out, "a.tld", "alpha", 5));
+    ASSERT_EAARLIO_SUCCESSm(msg, tar_file(&out, "b.tld", "bravo", 5));
+    ASSERT_EAARLIO_SUCCESSm(msg, tar_end(&out));
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream_buffer(&out, &buf, &len));
+
+    if(offset < len)
+        buf[offset] = value;
+    if(truncate)
+        len = truncate;
+
+    mock_memory_new(&memory, &mock, 100);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_memory_stream(&tar, buf, len, "r", NULL));
+    ASSERT_EAARLIO_ERRm(
+        msg, EAARLIO_CORRUPT, eaarlio_tar_tld_opener(&opener, &tar, &memory));
+
+    /* The archive stream is left to the caller */
+    ASSERTm(msg, tar.data);
+    ASSERT_EAARLIO_SUCCESSm(msg, tar.close(&tar));
+    ASSERT_EQ_FMTm(msg, 0, mock_memory_count_in_use(&mock), "%d");
+
+    mock_memory_destroy(&memory);
+    ASSERT_EAARLIO_SUCCESSm(msg, out.close(&out));
+    PASS();
+}
+
+SUITE(suite_corrupt)
+{
+    RUN_TESTp(test_corrupt, "name", 1, 'X', 0);
+    RUN_TESTp(test_corrupt, "checksum", 150, '7', 0);
+    RUN_TESTp(test_corrupt, "size", 130, '9', 0);
+    RUN_TESTp(test_corrupt, "second header", 2 * BLOCK + 1, 'X', 0);
+    RUN_TESTp(test_corrupt, "partial header", 0, 'a', BLOCK / 2);
+    RUN_TESTp(test_corrupt, "truncated data", 0, 'a', BLOCK + 4);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_members);
+    RUN_SUITE(suite_corrupt);
+
+    GREATEST_MAIN_END();
+}
@@ -5,6 +5,7 @@
 #include "assert_error.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _MSC_VER
 /* Visual Studio complains about initializing structs with references to
@@ -161,6 +162,63 @@ TEST test_raster_values(void *arg)
     PASS();
 }
 
+/*******************************************************************************
+ * eaarlio_tld_pack_raster_into
+ *******************************************************************************
+ */
+
+TEST test_raster_into_sanity()
+{
+    eaarlio_tld_pack_raster_into(NULL, 0, NULL);
+    PASS();
+}
+
+TEST test_raster_into_null()
+{
+    unsigned char buffer[1];
+    struct eaarlio_raster raster = { 0, 0, 0, 1, 0, NULL };
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tld_pack_raster_into(NULL, 1, &raster));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tld_pack_raster_into(buffer, 1, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tld_pack_raster_into(buffer, 1, &raster));
+    PASS();
+}
+
+/* Does packing into a caller's buffer match eaarlio_tld_pack_raster? Is a
+ * buffer that is one byte short rejected?
+ */
+TEST test_raster_into_values(void *arg)
+{
+    unsigned char **got = (unsigned char **)arg;
+    uint32_t got_len;
+    unsigned char into[64];
+    unsigned char p0_tx[] = { 0x30, 0x31 };
+    unsigned char p0_rx0[] = { 0x40, 0x41, 0x42 };
+    struct eaarlio_pulse p0 = {
+        1249809, 1, 0, 0, 0, 0, 0, { 0, 0, 0, 0 }, sizeof(p0_tx),
+        { sizeof(p0_rx0), 0, 0, 0 }, (unsigned char *)&p0_tx,
+        { (unsigned char *)&p0_rx0, NULL, NULL, NULL },
+    };
+    struct eaarlio_raster raster = { 67305985, 0, 7, 1, 0, &p0 };
+
+    *got = NULL;
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_tld_pack_raster(got, &got_len, &raster, NULL));
+    ASSERT(got_len <= sizeof into);
+
+    memset(into, 0xFF, sizeof into);
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_tld_pack_raster_into(into, got_len, &raster));
+    ASSERT_MEM_EQ(*got, into, got_len);
+
+    ASSERT_EAARLIO_ERR(EAARLIO_BUFFER_SHORT,
+        eaarlio_tld_pack_raster_into(into, got_len - 1, &raster));
+
+    PASS();
+}
+
 SUITE(suite_raster)
 {
     RUN_TEST(test_raster_sanity);
@@ -174,6 +232,16 @@ SUITE(suite_raster)
         if(buf)
             free(buf);
     }
+
+    RUN_TEST(test_raster_into_sanity);
+    RUN_TEST(test_raster_into_null);
+
+    {
+        unsigned char *buf = NULL;
+        RUN_TEST1(test_raster_into_values, &buf);
+        if(buf)
+            free(buf);
+    }
 }
 
 /*******************************************************************************
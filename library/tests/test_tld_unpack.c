@@ -533,6 +533,136 @@ SUITE(suite_raster)
     eaarlio_raster_free(&raster, NULL);
 }
 
+/*******************************************************************************
+ * eaarlio_tld_unpack_record
+ *******************************************************************************
+ */
+
+TEST test_record_sanity()
+{
+    eaarlio_tld_unpack_record(NULL, 0, NULL, NULL, NULL, 0, 0);
+    PASS();
+}
+
+TEST test_record_null_buffer()
+{
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster;
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_tld_unpack_record(NULL, 1, &header, &raster, NULL, 0, 0));
+    PASS();
+}
+
+TEST test_record_null_header()
+{
+    unsigned char buffer[1];
+    struct eaarlio_raster raster;
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_tld_unpack_record(
+            (unsigned char *)&buffer, 1, NULL, &raster, NULL, 0, 0));
+    PASS();
+}
+
+/* Can we decode a record header and raster header from one buffer?
+ * Do we ignore bytes that follow the record?
+ */
+TEST test_record_values()
+{
+    unsigned char const buf[] = { /* record header: length 18, type 5 */
+        '\x12', '\x00', '\x00', '\x05',
+        /* seconds */
+        '\x01', '\x02', '\x03', '\x04',
+        /* fractional seconds */
+        '\x00', '\x00', '\x00', '\x00',
+        /* raster number */
+        '\x07', '\x00', '\x00', '\x00',
+        /* bitfield: pulse count and digitizer */
+        '\x00', '\x00',
+
+        /* next record */
+        '\x12', '\x00', '\x00', '\x05'
+    };
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_unpack_record(
+        (unsigned char const *)buf, sizeof buf, &header, &raster, NULL, 1, 1));
+
+    ASSERT_EQ_FMT(18, header.record_length, "%d");
+    ASSERT_EQ_FMT(EAARLIO_TLD_TYPE_RASTER, header.record_type, "%d");
+    ASSERT_EQ_FMT(67305985, raster.time_seconds, "%d");
+    ASSERT_EQ_FMT(7, raster.sequence_number, "%d");
+    ASSERT_EQ_FMT(0, raster.pulse_count, "%d");
+    ASSERT_FALSE(raster.pulse);
+
+    PASS();
+}
+
+/* Is a record that claims more data than the buffer holds rejected? */
+TEST test_record_short()
+{
+    unsigned char const buf[] = { /* record header: length 32, type 5 */
+        '\x20', '\x00', '\x00', '\x05',
+        /* partial raster header */
+        '\x01', '\x02', '\x03', '\x04'
+    };
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+
+    ASSERT_EAARLIO_ERR(EAARLIO_BUFFER_SHORT,
+        eaarlio_tld_unpack_record((unsigned char const *)buf, sizeof buf,
+            &header, &raster, NULL, 1, 1));
+
+    PASS();
+}
+
+/* Is a record with an impossible length rejected? */
+TEST test_record_corrupt()
+{
+    unsigned char const buf[] = { /* record header: length 2, type 5 */
+        '\x02', '\x00', '\x00', '\x05'
+    };
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_tld_unpack_record((unsigned char const *)buf, sizeof buf,
+            &header, &raster, NULL, 1, 1));
+
+    PASS();
+}
+
+/* Are non-raster records skipped without decoding? */
+TEST test_record_other_type()
+{
+    unsigned char const buf[] = { /* record header: length 6, type 9 */
+        '\x06', '\x00', '\x00', '\x09',
+        /* payload */
+        '\xAA', '\xBB'
+    };
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_unpack_record(
+        (unsigned char const *)buf, sizeof buf, &header, &raster, NULL, 1, 1));
+    ASSERT_EQ_FMT(6, header.record_length, "%d");
+    ASSERT_EQ_FMT(9, header.record_type, "%d");
+    ASSERT_FALSE(raster.pulse);
+
+    PASS();
+}
+
+SUITE(suite_record)
+{
+    RUN_TEST(test_record_sanity);
+    RUN_TEST(test_record_null_buffer);
+    RUN_TEST(test_record_null_header);
+    RUN_TEST(test_record_values);
+    RUN_TEST(test_record_short);
+    RUN_TEST(test_record_corrupt);
+    RUN_TEST(test_record_other_type);
+}
+
 /*******************************************************************************
  * Run the tests
  *******************************************************************************
@@ -547,6 +677,7 @@ int main(int argc, char **argv)
     RUN_SUITE(suite_waveforms);
     RUN_SUITE(suite_pulses);
     RUN_SUITE(suite_raster);
+    RUN_SUITE(suite_record);
 
     GREATEST_MAIN_END();
 }
@@ -0,0 +1,357 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/tld_constants.h"
+#include "eaarlio/tld_unpack.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include "mock_stream.h"
+#include "util_writer.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "data_tld.c"
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_tld_writer_init(NULL, NULL, 0, NULL, 0, NULL);
+    eaarlio_tld_writer_write_raster(NULL, NULL, NULL);
+    eaarlio_tld_writer_flush(NULL);
+    eaarlio_tld_writer_close(NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_tld_writer writer;
+    struct eaarlio_raster raster;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_tld_writer_init(NULL, NULL, 0, NULL, 0, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_tld_writer_init(&writer, NULL, 0, NULL, 0, NULL));
+    ASSERT_EQ(NULL, writer.buffer);
+
+    writer = eaarlio_tld_writer_empty();
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_tld_writer_write_raster(&writer, NULL, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_tld_writer_write_raster(&writer, &raster, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_tld_writer_flush(&writer));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_close(&writer));
+    PASS();
+}
+
+TEST test_bad_sync_policy()
+{
+    struct eaarlio_tld_writer writer;
+    struct mock_stream *mock = mock_stream_new(10);
+    struct eaarlio_stream *stream = mock_stream_stream_new(mock);
+
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_tld_writer_init(
+            &writer, stream, 0, NULL, EAARLIO_TLD_SYNC_CLOSE, NULL));
+    ASSERT_EQ(NULL, writer.buffer);
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_tld_writer_init(
+            &writer, stream, 0, &util_writer_stream_sync, 3, NULL));
+    ASSERT_EQ(NULL, writer.buffer);
+
+    mock_stream_stream_destroy(stream);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+TEST test_set_record_type()
+{
+    struct eaarlio_tld_writer writer = eaarlio_tld_writer_empty();
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_tld_writer_set_record_type(NULL, EAARLIO_TLD_TYPE_RASTER));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_tld_writer_set_record_type(&writer, 4));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_set_record_type(
+        &writer, EAARLIO_TLD_TYPE_RASTER_WFPACK));
+    ASSERT_EQ_FMT(EAARLIO_TLD_TYPE_RASTER_WFPACK, writer.record_type, "%d");
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_bad_sync_policy);
+    RUN_TEST(test_set_record_type);
+}
+
+/*******************************************************************************
+ * suite_write
+ *******************************************************************************
+ */
+
+/* Does the writer produce the same bytes as eaarlio_tld_write_raster, with
+ * the expected number of writes and syncs and correct offsets?
+ */
+TEST test_write(struct eaarlio_memory *memory,
+    struct mock_memory *mock_mem,
+    uint32_t block_size,
+    int sync_policy,
+    int expect_writes,
+    int expect_syncs)
+{
+    struct eaarlio_raster rasters[UTIL_WRITER_RASTER_COUNT];
+    struct mock_stream *expected = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct mock_stream *got = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct eaarlio_stream *expected_stream = mock_stream_stream_new(expected);
+    struct eaarlio_stream *got_stream = mock_stream_stream_new(got);
+    struct eaarlio_stream stream;
+    struct eaarlio_tld_writer writer;
+    struct util_writer_stream counts;
+    int64_t offset;
+    int i;
+
+    memset(rasters, 0, sizeof(rasters));
+    ASSERT_EAARLIO_SUCCESS(util_writer_load_rasters(rasters));
+
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++)
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_write_raster(expected_stream, &rasters[i], NULL));
+
+    /* Start partway in to check that offsets are stream positions */
+    ASSERT_EAARLIO_SUCCESS(got_stream->seek(got_stream, 10, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(expected_stream->seek(expected_stream, 0, SEEK_SET));
+
+    util_writer_stream_init(&stream, &counts, got_stream);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_init(&writer, &stream,
+        block_size,
+        sync_policy == EAARLIO_TLD_SYNC_NEVER ? NULL : &util_writer_stream_sync,
+        sync_policy, memory));
+
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_tld_writer_write_raster(&writer, &rasters[i], &offset));
+        ASSERT_EQ_FMT(
+            (int64_t)(10 + i * UTIL_WRITER_RECORD_LEN), offset, "%" PRId64);
+    }
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_close(&writer));
+    ASSERT_EQ(NULL, writer.buffer);
+
+    ASSERT_EQ_FMT(expect_writes, counts.writes, "%d");
+    ASSERT_EQ_FMT(expect_syncs, counts.syncs, "%d");
+    ASSERT_EQ_FMT(
+        (int64_t)(10 + UTIL_WRITER_RASTER_COUNT * UTIL_WRITER_RECORD_LEN),
+        got->offset, "%" PRId64);
+    ASSERT_MEM_EQ(expected->data, got->data + 10,
+        UTIL_WRITER_RASTER_COUNT * UTIL_WRITER_RECORD_LEN);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    util_writer_free_rasters(rasters);
+    mock_stream_stream_destroy(expected_stream);
+    mock_stream_stream_destroy(got_stream);
+    mock_stream_destroy(expected);
+    mock_stream_destroy(got);
+    PASS();
+}
+
+/* Does a write failure propagate and still release the buffer on close? */
+TEST test_write_error(struct eaarlio_memory *memory,
+    struct mock_memory *mock_mem)
+{
+    struct eaarlio_raster rasters[UTIL_WRITER_RASTER_COUNT];
+    struct mock_stream *mock = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct eaarlio_stream *inner = mock_stream_stream_new(mock);
+    struct eaarlio_stream stream;
+    struct eaarlio_tld_writer writer;
+    struct util_writer_stream counts;
+
+    memset(rasters, 0, sizeof(rasters));
+    ASSERT_EAARLIO_SUCCESS(util_writer_load_rasters(rasters));
+
+    util_writer_stream_init(&stream, &counts, inner);
+    counts.fail_writes = 1;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_init(
+        &writer, &stream, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_tld_writer_write_raster(&writer, &rasters[0], NULL));
+    ASSERT_EQ_FMT(0, counts.writes, "%d");
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_WRITE_ERROR, eaarlio_tld_writer_close(&writer));
+    ASSERT_EQ_FMT(1, counts.writes, "%d");
+    ASSERT_EQ(NULL, writer.buffer);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    util_writer_free_rasters(rasters);
+    mock_stream_stream_destroy(inner);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+/* Are rasters written with packed waveforms smaller, and do they read back
+ * the same through both eaarlio_tld_read_raster and eaarlio_tld_unpack_record?
+ */
+TEST test_write_wfpack(struct eaarlio_memory *memory,
+    struct mock_memory *mock_mem)
+{
+    struct eaarlio_raster rasters[UTIL_WRITER_RASTER_COUNT];
+    struct eaarlio_raster got;
+    struct eaarlio_tld_header header;
+    struct mock_stream *mock = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct eaarlio_stream *stream = mock_stream_stream_new(mock);
+    struct eaarlio_tld_writer writer;
+    int64_t offsets[UTIL_WRITER_RASTER_COUNT + 1];
+    int i;
+
+    memset(rasters, 0, sizeof(rasters));
+    ASSERT_EAARLIO_SUCCESS(util_writer_load_rasters(rasters));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_init(
+        &writer, stream, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_set_record_type(
+        &writer, EAARLIO_TLD_TYPE_RASTER_WFPACK));
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++)
+        ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_write_raster(
+            &writer, &rasters[i], &offsets[i]));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_close(&writer));
+    offsets[UTIL_WRITER_RASTER_COUNT] = mock->offset;
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    /* Real waveforms pack to well under half their size */
+    ASSERT(
+        mock->offset < UTIL_WRITER_RASTER_COUNT * UTIL_WRITER_RECORD_LEN / 2);
+
+    ASSERT_EAARLIO_SUCCESS(stream->seek(stream, 0, SEEK_SET));
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(eaarlio_tld_read_record(
+            stream, &header, &got, memory, 1, 1));
+        ASSERT_EQ_FMT(EAARLIO_TLD_TYPE_RASTER_WFPACK, header.record_type, "%d");
+        ASSERT_EQ_FMT((uint32_t)(offsets[i + 1] - offsets[i]),
+            header.record_length, "%" PRIu32);
+        CHECK_CALL(check_raster("read", &rasters[i], &got));
+        eaarlio_raster_free(&got, memory);
+
+        ASSERT_EAARLIO_SUCCESS(eaarlio_tld_unpack_record(
+            mock->data + offsets[i], header.record_length, &header, &got,
+            memory, 1, 1));
+        CHECK_CALL(check_raster("unpack", &rasters[i], &got));
+        eaarlio_raster_free(&got, memory);
+
+        /* Truncated packed data is corrupt */
+        ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+            eaarlio_tld_unpack_raster_wfpack(mock->data + offsets[i]
+                    + EAARLIO_TLD_RECORD_HEADER_SIZE,
+                header.record_length - EAARLIO_TLD_RECORD_HEADER_SIZE - 1,
+                &got, memory, 1, 1));
+        eaarlio_raster_free(&got, memory);
+    }
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    util_writer_free_rasters(rasters);
+    mock_stream_stream_destroy(stream);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+/* A raster whose waveforms do not pack smaller is written plainly */
+TEST test_write_wfpack_noise(struct eaarlio_memory *memory,
+    struct mock_memory *mock_mem)
+{
+    struct mock_stream *mock = mock_stream_new(UTIL_WRITER_MOCK_SIZE);
+    struct eaarlio_stream *stream = mock_stream_stream_new(mock);
+    struct eaarlio_tld_writer writer;
+    struct eaarlio_tld_header header;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    struct eaarlio_raster got;
+    struct eaarlio_pulse pulse = eaarlio_pulse_empty();
+    unsigned char noise[200];
+    uint32_t i, seed = 1;
+
+    for(i = 0; i < sizeof(noise); i++) {
+        seed = seed * 1103515245U + 12345U;
+        noise[i] = (unsigned char)(seed >> 16);
+    }
+    pulse.tx = noise;
+    pulse.tx_len = sizeof(noise);
+    raster.pulse = &pulse;
+    raster.pulse_count = 1;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_init(
+        &writer, stream, 0, NULL, EAARLIO_TLD_SYNC_NEVER, memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_set_record_type(
+        &writer, EAARLIO_TLD_TYPE_RASTER_WFPACK));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_tld_writer_write_raster(&writer, &raster, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_tld_writer_close(&writer));
+
+    ASSERT_EAARLIO_SUCCESS(stream->seek(stream, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_tld_read_record(stream, &header, &got, memory, 1, 1));
+    ASSERT_EQ_FMT(EAARLIO_TLD_TYPE_RASTER, header.record_type, "%d");
+    CHECK_CALL(check_raster("noise", &raster, &got));
+    eaarlio_raster_free(&got, memory);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock_mem), "%d");
+
+    mock_stream_stream_destroy(stream);
+    mock_stream_destroy(mock);
+    PASS();
+}
+
+SUITE(suite_write)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+
+    /* Everything fits in one block: a single write at close */
+    RUN_TESTp(test_write, &memory, &mock, 0, EAARLIO_TLD_SYNC_NEVER, 1, 0);
+
+    /* Two records per block */
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write, &memory, &mock, 2 * UTIL_WRITER_RECORD_LEN,
+        EAARLIO_TLD_SYNC_FLUSH, 2, 2);
+
+    /* Blocks smaller than a record: one write per record */
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(
+        test_write, &memory, &mock, 100, EAARLIO_TLD_SYNC_CLOSE, 4, 1);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write_error, &memory, &mock);
+
+    mock_memory_reset(&mock, 20000);
+    RUN_TESTp(test_write_wfpack, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_write_wfpack_noise, &memory, &mock);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_write);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,580 @@
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/trace.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EDB_FILE (DATADIR "/flight.idx")
+#define RASTER_COUNT 10
+
+#define DATA_LEN 100
+
+/* Stream data; byte i holds the value i */
+static unsigned char data[DATA_LEN];
+
+/* Writes left before failing_write fails */
+static int writes_left;
+
+/* Original write function of the stream behind failing_write */
+static eaarlio_error (*real_write)(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buffer);
+
+/* Write that fails once writes_left runs out */
+static eaarlio_error failing_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buffer)
+{
+    if(writes_left <= 0)
+        return EAARLIO_STREAM_WRITE_ERROR;
+    writes_left--;
+    return real_write(self, len, buffer);
+}
+
+/* Open a stream over the data written to sink so far, and check its header */
+static eaarlio_error open_trace(struct eaarlio_stream *sink,
+    struct eaarlio_stream *in)
+{
+    unsigned char *buf;
+    uint64_t len;
+    eaarlio_error err;
+
+    err = eaarlio_memory_stream_buffer(sink, &buf, &len);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = eaarlio_memory_stream(in, buf, len, "r", NULL);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = eaarlio_trace_read_header(in);
+    if(err != EAARLIO_SUCCESS)
+        in->close(in);
+    return err;
+}
+
+/* Check the next record in a trace */
+TEST check_record(struct eaarlio_stream *in,
+    uint8_t op,
+    eaarlio_error error,
+    uint32_t stream_id,
+    int64_t offset,
+    uint64_t size)
+{
+    struct eaarlio_trace_record record = eaarlio_trace_record_empty();
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_read_record(in, &record));
+    ASSERT_EQ_FMT((int)op, (int)record.op, "%d");
+    ASSERT_EQ_FMT((int)error, (int)record.error, "%d");
+    ASSERT_EQ_FMT(stream_id, record.stream_id, "%u");
+    ASSERT_EQ_FMT((long)offset, (long)record.offset, "%ld");
+    ASSERT_EQ_FMT((unsigned long)size, (unsigned long)record.size, "%lu");
+    PASS();
+}
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_trace_init(NULL, NULL, NULL);
+    eaarlio_trace_free(NULL);
+    eaarlio_stream_trace(NULL, NULL, NULL, NULL);
+    eaarlio_trace_tld_opener(NULL, NULL, NULL, NULL);
+    eaarlio_trace_read_header(NULL);
+    eaarlio_trace_read_record(NULL, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_trace trace = eaarlio_trace_empty();
+    struct eaarlio_trace empty = eaarlio_trace_empty();
+    struct eaarlio_trace_record record;
+    struct eaarlio_stream sink, inner, stream;
+    struct eaarlio_tld_opener opener, inner_opener;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_init(NULL, &sink, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_init(&trace, NULL, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_free(NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&empty));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stream_trace(NULL, &inner, &trace, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stream_trace(&stream, NULL, &trace, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stream_trace(&stream, &inner, NULL, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_stream_trace(&stream, &inner, &empty, NULL));
+    ASSERT(inner.data);
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_tld_opener(&inner_opener, DATADIR, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_trace_tld_opener(NULL, &inner_opener, &trace, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_trace_tld_opener(&opener, NULL, &trace, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL,
+        eaarlio_trace_tld_opener(&opener, &inner_opener, NULL, NULL));
+    ASSERT(inner_opener.open_tld);
+    ASSERT_EAARLIO_SUCCESS(inner_opener.close(&inner_opener));
+
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_read_header(NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_read_record(NULL, &record));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, eaarlio_trace_read_record(&sink, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EQ(NULL, trace.internal);
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+TEST test_invalid()
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_stream sink, stream;
+    struct eaarlio_stream bad = eaarlio_stream_empty();
+    struct eaarlio_tld_opener opener;
+    struct eaarlio_tld_opener bad_opener = eaarlio_tld_opener_empty();
+    struct eaarlio_memory memory = eaarlio_memory_empty();
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_trace_init(&trace, &bad, NULL));
+    ASSERT_EQ(NULL, trace.internal);
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_INVALID, eaarlio_trace_init(&trace, &sink, &memory));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_stream_trace(&stream, &bad, &trace, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_TLD_OPENER_INVALID,
+        eaarlio_trace_tld_opener(&opener, &bad_opener, &trace, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_INVALID, eaarlio_trace_read_header(&bad));
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_invalid);
+}
+
+/*******************************************************************************
+ * suite_stream
+ *******************************************************************************
+ */
+
+/* Is each call recorded with the position it was made at? */
+TEST test_stream_calls()
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_trace_record record;
+    struct eaarlio_stream sink, inner, stream, in;
+    unsigned char buf[DATA_LEN];
+    int64_t pos;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stream_trace(&stream, &inner, &trace, NULL));
+    ASSERT_EQ(NULL, inner.data);
+
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_EQ_FMT(9, (int)buf[9], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 50, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_EQ_FMT(50, (int)buf[0], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -20, SEEK_CUR));
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT(35, (int)pos, "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -10, SEEK_END));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 20, buf));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_OPEN, EAARLIO_SUCCESS, 1, 0, 0));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_READ, EAARLIO_SUCCESS, 1, 0, 10));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_SEEK, EAARLIO_SUCCESS, 1, 50, 0));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_READ, EAARLIO_SUCCESS, 1, 50, 5));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_SEEK, EAARLIO_SUCCESS, 1, 35, 0));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_TELL, EAARLIO_SUCCESS, 1, 35, 0));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_SEEK, EAARLIO_SUCCESS, 1, 90, 0));
+    CHECK_CALL(check_record(
+        &in, EAARLIO_TRACE_READ, EAARLIO_STREAM_READ_SHORT, 1, 90, 20));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_CLOSE, EAARLIO_SUCCESS, 1, 100, 0));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, eaarlio_trace_read_record(&in, &record));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+/* Are the whence and times recorded, and streams numbered in order? */
+TEST test_stream_times()
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_trace_record record;
+    struct eaarlio_stream sink, inner, a, b, in;
+    unsigned char buf[DATA_LEN];
+    uint64_t last = 0;
+    int i;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stream_trace(&a, &inner, &trace, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stream_trace(&b, &inner, &trace, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(b.seek(&b, 10, SEEK_CUR));
+    ASSERT_EAARLIO_SUCCESS(a.read(&a, 1, buf));
+    ASSERT_EAARLIO_SUCCESS(b.read(&b, 1, buf));
+    ASSERT_EQ_FMT(10, (int)buf[0], "%d");
+    ASSERT_EAARLIO_SUCCESS(a.close(&a));
+    ASSERT_EAARLIO_SUCCESS(b.close(&b));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_OPEN, EAARLIO_SUCCESS, 1, 0, 0));
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_OPEN, EAARLIO_SUCCESS, 2, 0, 0));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_read_record(&in, &record));
+    ASSERT_EQ_FMT(EAARLIO_TRACE_SEEK, (int)record.op, "%d");
+    ASSERT_EQ_FMT(SEEK_CUR, (int)record.whence, "%d");
+    ASSERT_EQ_FMT(2, (int)record.stream_id, "%d");
+    ASSERT_EQ_FMT(10, (int)record.offset, "%d");
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_READ, EAARLIO_SUCCESS, 1, 0, 1));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_READ, EAARLIO_SUCCESS, 2, 10, 1));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    /* Start times never go backwards */
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    for(i = 0; i < 7; i++) {
+        ASSERT_EAARLIO_SUCCESS(eaarlio_trace_read_record(&in, &record));
+        ASSERT(record.start_ns >= last);
+        last = record.start_ns;
+    }
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+/* Does a failing sink stop the trace without disturbing the stream? */
+TEST test_stream_sink_error()
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_stream sink, inner, stream, in;
+    unsigned char buf[DATA_LEN];
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    real_write = sink.write;
+    sink.write = &failing_write;
+
+    writes_left = 0;
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_WRITE_ERROR, eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EQ(NULL, trace.internal);
+
+    /* The header and the open are written, but not the reads */
+    writes_left = 2;
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_stream_trace(&stream, &inner, &trace, NULL));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    writes_left = 10;
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 10, buf));
+    ASSERT_EQ_FMT(19, (int)buf[9], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_WRITE_ERROR, eaarlio_trace_free(&trace));
+    ASSERT_EQ_FMT(10, writes_left, "%d");
+
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_OPEN, EAARLIO_SUCCESS, 1, 0, 0));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+/* Is everything released, including on failure? */
+TEST test_stream_memory(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_stream sink, inner, stream;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_stream_trace(&stream, &inner, &trace, memory));
+    ASSERT_EQ_FMT(3, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ_FMT(1, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    /* On failure, the inner stream is left to the caller */
+    mock_memory_reset(mock, 2);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&inner, data, DATA_LEN, "r", memory));
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        eaarlio_stream_trace(&stream, &inner, &trace, memory));
+    ASSERT(inner.data);
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    mock_memory_reset(mock, 0);
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_MEMORY_ALLOC_FAIL, eaarlio_trace_init(&trace, &sink, memory));
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+SUITE(suite_stream)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    RUN_TEST(test_stream_calls);
+    RUN_TEST(test_stream_times);
+    RUN_TEST(test_stream_sink_error);
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_stream_memory, &memory, &mock);
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * suite_read
+ *******************************************************************************
+ */
+
+/* Are traces that are not valid rejected? */
+TEST test_read_corrupt()
+{
+    unsigned char buf[EAARLIO_TRACE_HEADER_SIZE];
+    struct eaarlio_stream sink, in;
+    struct eaarlio_trace trace;
+    unsigned char *written;
+    uint64_t len;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream_buffer(&sink, &written, &len));
+    ASSERT_EQ_FMT(EAARLIO_TRACE_HEADER_SIZE, (int)len, "%d");
+    memcpy(buf, written, EAARLIO_TRACE_HEADER_SIZE);
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+
+    /* Truncated */
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&in, buf, 8, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT, eaarlio_trace_read_header(&in));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    /* Wrong version */
+    buf[8] = 2;
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(
+        &in, buf, EAARLIO_TRACE_HEADER_SIZE, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT, eaarlio_trace_read_header(&in));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    buf[8] = 1;
+
+    /* Wrong record size */
+    buf[12] = 41;
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(
+        &in, buf, EAARLIO_TRACE_HEADER_SIZE, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT, eaarlio_trace_read_header(&in));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    buf[12] = EAARLIO_TRACE_RECORD_SIZE;
+
+    /* Wrong magic */
+    buf[0] = 'X';
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(
+        &in, buf, EAARLIO_TRACE_HEADER_SIZE, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT, eaarlio_trace_read_header(&in));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    PASS();
+}
+
+SUITE(suite_read)
+{
+    RUN_TEST(test_read_corrupt);
+}
+
+/*******************************************************************************
+ * suite_flight
+ *******************************************************************************
+ */
+
+/* Are the TLD files a flight reads traced from open to close? */
+TEST test_flight(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_trace_record record;
+    struct eaarlio_stream sink, in;
+    struct eaarlio_flight flight;
+    struct eaarlio_tld_opener traced;
+    struct eaarlio_raster raster;
+    uint32_t i, opens = 0, closes = 0, reads = 0, file_count;
+    uint64_t bytes = 0;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, memory));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_file_flight(&flight, EDB_FILE, DATADIR, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_trace_tld_opener(&traced, &flight.tld_opener, &trace, memory));
+    ASSERT_EQ(NULL, flight.tld_opener.open_tld);
+    flight.tld_opener = traced;
+    file_count = flight.edb.file_count;
+
+    for(i = 1; i <= RASTER_COUNT; i++) {
+        ASSERT_EAARLIO_SUCCESS(
+            eaarlio_flight_read_raster(&flight, &raster, NULL, i, 1, 1));
+        ASSERT_EAARLIO_SUCCESS(eaarlio_raster_free(&raster, memory));
+    }
+    ASSERT_EAARLIO_SUCCESS(eaarlio_flight_free(&flight));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    while(eaarlio_trace_read_record(&in, &record) == EAARLIO_SUCCESS) {
+        ASSERT_EQ_FMT(EAARLIO_SUCCESS, (int)record.error, "%d");
+        ASSERT(record.stream_id >= 1);
+        ASSERT(record.stream_id <= file_count);
+        switch(record.op) {
+            case EAARLIO_TRACE_OPEN:
+                ASSERT_EQ_FMT(opens + 1, record.stream_id, "%u");
+                opens++;
+                break;
+            case EAARLIO_TRACE_CLOSE:
+                closes++;
+                break;
+            case EAARLIO_TRACE_READ:
+                ASSERT(record.offset >= 0);
+                reads++;
+                bytes += record.size;
+                break;
+        }
+    }
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+    ASSERT_EQ_FMT(file_count, opens, "%u");
+    ASSERT_EQ_FMT(file_count, closes, "%u");
+    ASSERT(reads >= RASTER_COUNT);
+    ASSERT(bytes > 0);
+
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+/* Are failed opens recorded? */
+TEST test_flight_open_error()
+{
+    struct eaarlio_trace trace;
+    struct eaarlio_stream sink, stream, in;
+    struct eaarlio_tld_opener inner, traced;
+
+    ASSERT_EAARLIO_SUCCESS(eaarlio_memory_stream(&sink, NULL, 0, "w", NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_init(&trace, &sink, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_file_tld_opener(&inner, DATADIR, NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_trace_tld_opener(&traced, &inner, &trace, NULL));
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_OPEN_ERROR,
+        traced.open_tld(&traced, &stream, "missing.tld"));
+    ASSERT_EAARLIO_SUCCESS(
+        traced.open_tld(&traced, &stream, "010909-014641.tld"));
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EAARLIO_SUCCESS(traced.close(&traced));
+    ASSERT_EQ(NULL, traced.opaque);
+    ASSERT_EAARLIO_SUCCESS(eaarlio_trace_free(&trace));
+
+    ASSERT_EAARLIO_SUCCESS(open_trace(&sink, &in));
+    CHECK_CALL(check_record(
+        &in, EAARLIO_TRACE_OPEN, EAARLIO_STREAM_OPEN_ERROR, 0, -1, 0));
+    CHECK_CALL(check_record(&in, EAARLIO_TRACE_OPEN, EAARLIO_SUCCESS, 1, 0, 0));
+    CHECK_CALL(
+        check_record(&in, EAARLIO_TRACE_CLOSE, EAARLIO_SUCCESS, 1, 0, 0));
+    ASSERT_EAARLIO_SUCCESS(in.close(&in));
+
+    ASSERT_EAARLIO_SUCCESS(sink.close(&sink));
+    PASS();
+}
+
+SUITE(suite_flight)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10000);
+    RUN_TESTp(test_flight, &memory, &mock);
+    mock_memory_destroy(&memory);
+
+    RUN_TEST(test_flight_open_error);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+
+    for(i = 0; i < DATA_LEN; i++)
+        data[i] = (unsigned char)i;
+
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_stream);
+    RUN_SUITE(suite_read);
+    RUN_SUITE(suite_flight);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,223 @@
+#include "eaarlio/error.h"
+#include "eaarlio/wfpack.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Pack and unpack src with both decoders, checking that the data survives */
+TEST test_roundtrip(char const *msg, unsigned char const *src, uint32_t len)
+{
+    uint32_t bound = EAARLIO_WFPACK_BOUND(len);
+    unsigned char *packed = malloc(bound + 1);
+    unsigned char *out = malloc(len + 1);
+    uint32_t packed_len = 0;
+    uint32_t used = 0;
+
+    ASSERTm(msg, packed);
+    ASSERTm(msg, out);
+
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_wfpack_encode(packed, bound, src, len, &packed_len));
+    ASSERTm(msg, packed_len <= bound);
+
+    /* Trailing bytes are not part of the packed data */
+    packed[packed_len] = 0xff;
+
+    memset(out, 0, len + 1);
+    ASSERT_EAARLIO_SUCCESSm(
+        msg, eaarlio_wfpack_decode(out, len, packed, packed_len + 1, &used));
+    ASSERT_EQ_FMTm(msg, packed_len, used, "%" PRIu32);
+    if(len)
+        ASSERT_MEM_EQm(msg, src, out, len);
+    ASSERT_EQ_FMTm(msg, 0, out[len], "%d");
+
+    memset(out, 0, len + 1);
+    ASSERT_EAARLIO_SUCCESSm(msg,
+        eaarlio_wfpack_decode_generic(out, len, packed, packed_len + 1, &used));
+    ASSERT_EQ_FMTm(msg, packed_len, used, "%" PRIu32);
+    if(len)
+        ASSERT_MEM_EQm(msg, src, out, len);
+    ASSERT_EQ_FMTm(msg, 0, out[len], "%d");
+
+    /* Every byte of the packed data is needed */
+    if(packed_len) {
+        ASSERT_EAARLIO_ERRm(msg, EAARLIO_BUFFER_SHORT,
+            eaarlio_wfpack_decode(out, len, packed, packed_len - 1, &used));
+        ASSERT_EAARLIO_ERRm(msg, EAARLIO_BUFFER_SHORT,
+            eaarlio_wfpack_encode(packed, packed_len - 1, src, len, &used));
+    }
+
+    free(packed);
+    free(out);
+    PASS();
+}
+
+TEST test_sanity()
+{
+    eaarlio_wfpack_encode(NULL, 0, NULL, 0, NULL);
+    eaarlio_wfpack_decode(NULL, 0, NULL, 0, NULL);
+    eaarlio_wfpack_decode_generic(NULL, 0, NULL, 0, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    unsigned char buf[40] = { 0 };
+    uint32_t len;
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_encode(NULL, 40, buf, 4, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_encode(buf, 40, NULL, 4, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_encode(buf, 40, buf, 4, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_decode(NULL, 4, buf, 40, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_decode(buf, 4, NULL, 40, &len));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_wfpack_decode(buf, 4, buf, 40, NULL));
+    PASS();
+}
+
+TEST test_empty()
+{
+    unsigned char buf[1] = { 0 };
+    uint32_t len = 99;
+
+    ASSERT_EQ_FMT(0U, EAARLIO_WFPACK_BOUND(0U), "%u");
+    ASSERT_EAARLIO_SUCCESS(eaarlio_wfpack_encode(buf, 1, buf, 0, &len));
+    ASSERT_EQ_FMT(0U, len, "%" PRIu32);
+    len = 99;
+    ASSERT_EAARLIO_SUCCESS(eaarlio_wfpack_decode(buf, 0, buf, 0, &len));
+    ASSERT_EQ_FMT(0U, len, "%" PRIu32);
+    PASS();
+}
+
+/* A smooth waveform needs only a few bits per sample */
+TEST test_smooth()
+{
+    unsigned char src[240];
+    unsigned char dst[EAARLIO_WFPACK_BOUND(240U)];
+    uint32_t len;
+    int i;
+
+    for(i = 0; i < 240; i++)
+        src[i] = (unsigned char)(20 + (i < 120 ? i / 2 : (240 - i) / 2));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_wfpack_encode(dst, sizeof(dst), src, sizeof(src), &len));
+    /* At most 2 bits per delta: 1 + 8 width bytes + 15 groups * 4 bytes */
+    ASSERT(len <= 69U);
+    PASS();
+}
+
+/* A constant waveform needs only its first sample and widths */
+TEST test_constant()
+{
+    unsigned char src[33];
+    unsigned char dst[EAARLIO_WFPACK_BOUND(33U)];
+    uint32_t len;
+
+    memset(src, 200, sizeof(src));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_wfpack_encode(dst, sizeof(dst), src, sizeof(src), &len));
+    ASSERT_EQ_FMT(2U, len, "%" PRIu32);
+    ASSERT_EQ_FMT(200, dst[0], "%d");
+    ASSERT_EQ_FMT(0, dst[1], "%d");
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_smooth);
+    RUN_TEST(test_constant);
+}
+
+SUITE(suite_roundtrip)
+{
+    static unsigned char data[65535];
+    uint32_t lens[] = { 1, 2, 15, 16, 17, 18, 32, 33, 34, 240, 65535 };
+    uint32_t i, j, step, seed = 1;
+    char msg[64];
+
+    /* Random data needs all 8 bits and wraps around in both directions */
+    for(i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245U + 12345U;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+    for(j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+        sprintf(msg, "random %" PRIu32, lens[j]);
+        RUN_TESTp(test_roundtrip, msg, data, lens[j]);
+    }
+
+    /* Small steps of both signs give every width from 0 to 8 */
+    data[0] = 128;
+    for(i = 1; i < sizeof(data); i++) {
+        seed = seed * 1103515245U + 12345U;
+        step = 1U << ((i / 16) % 8);
+        data[i] = (unsigned char)(data[i - 1] + (seed >> 16) % (2 * step)
+            - step);
+    }
+    for(j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+        sprintf(msg, "steps %" PRIu32, lens[j]);
+        RUN_TESTp(test_roundtrip, msg, data, lens[j]);
+    }
+
+    /* Extremes: alternating 0 and 255 */
+    for(i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)(i & 1 ? 255 : 0);
+    RUN_TESTp(test_roundtrip, "alternating", data, 100);
+}
+
+/* Malformed input must be rejected without writing outside the output */
+TEST test_corrupt()
+{
+    unsigned char out[17];
+    uint32_t len;
+    /* Width of 9 */
+    unsigned char const wide[] = { 0, 0x09, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0 };
+    /* Width byte missing */
+    unsigned char const no_width[] = { 0 };
+    /* Planes cut short */
+    unsigned char const short_planes[] = { 0, 0x02, 0xff, 0xff, 0xff };
+
+    ASSERT_EAARLIO_ERR(EAARLIO_CORRUPT,
+        eaarlio_wfpack_decode(out, 17, wide, sizeof(wide), &len));
+    ASSERT_EAARLIO_ERR(EAARLIO_BUFFER_SHORT,
+        eaarlio_wfpack_decode(out, 17, no_width, sizeof(no_width), &len));
+    ASSERT_EAARLIO_ERR(EAARLIO_BUFFER_SHORT,
+        eaarlio_wfpack_decode(
+            out, 17, short_planes, sizeof(short_planes), &len));
+
+    /* A single sample needs no widths */
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_wfpack_decode(out, 1, no_width, sizeof(no_width), &len));
+    ASSERT_EQ_FMT(1U, len, "%" PRIu32);
+    PASS();
+}
+
+SUITE(suite_corrupt)
+{
+    RUN_TEST(test_corrupt);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_roundtrip);
+    RUN_SUITE(suite_corrupt);
+
+    GREATEST_MAIN_END();
+}
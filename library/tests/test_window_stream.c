@@ -0,0 +1,249 @@
+#include "eaarlio/error.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/window_stream.h"
+#include "greatest.h"
+#include "assert_error.h"
+#include "mock_memory.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DATA_LEN 100
+
+/* Parent data; byte i holds the value i */
+static unsigned char data[DATA_LEN];
+
+/*******************************************************************************
+ * suite_basic
+ *******************************************************************************
+ */
+
+TEST test_sanity()
+{
+    eaarlio_window_stream(NULL, NULL, 0, 0, NULL);
+    PASS();
+}
+
+TEST test_null()
+{
+    struct eaarlio_stream parent, stream;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_window_stream(NULL, &parent, 0, 10, NULL));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_NULL, eaarlio_window_stream(&stream, NULL, 0, 10, NULL));
+    ASSERT_EQ(NULL, stream.data);
+
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+TEST test_invalid()
+{
+    struct eaarlio_stream parent = eaarlio_stream_empty();
+    struct eaarlio_stream stream;
+
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_INVALID,
+        eaarlio_window_stream(&stream, &parent, 0, 10, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_window_stream(&stream, &parent, UINT64_MAX, 0, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_VALUE_OUT_OF_RANGE,
+        eaarlio_window_stream(&stream, &parent, 10, INT64_MAX, NULL));
+    ASSERT_EQ(NULL, stream.data);
+
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+SUITE(suite_basic)
+{
+    RUN_TEST(test_sanity);
+    RUN_TEST(test_null);
+    RUN_TEST(test_invalid);
+}
+
+/*******************************************************************************
+ * suite_window
+ *******************************************************************************
+ */
+
+TEST test_read(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream parent, stream;
+    unsigned char buf[32];
+    int64_t pos;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_window_stream(&stream, &parent, 10, 20, memory));
+
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)0, pos, "%" PRIi64);
+
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 5, buf));
+    ASSERT_EQ_FMT(10, buf[0], "%d");
+    ASSERT_EQ_FMT(14, buf[4], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)5, pos, "%" PRIi64);
+
+    /* Seeks are relative to the window */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 2, SEEK_CUR));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 1, buf));
+    ASSERT_EQ_FMT(17, buf[0], "%d");
+
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, -1, SEEK_END));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 1, buf));
+    ASSERT_EQ_FMT(29, buf[0], "%d");
+
+    /* A read across the end gets what is available */
+    memset(buf, 0, sizeof(buf));
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 15, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 10, buf));
+    ASSERT_EQ_FMT(25, buf[0], "%d");
+    ASSERT_EQ_FMT(29, buf[4], "%d");
+    ASSERT_EQ_FMT(0, buf[5], "%d");
+    ASSERT_EAARLIO_SUCCESS(stream.tell(&stream, &pos));
+    ASSERT_EQ_FMT((int64_t)20, pos, "%" PRIi64);
+
+    /* Seeking past the end is fine, but reading there is not */
+    ASSERT_EAARLIO_SUCCESS(stream.seek(&stream, 50, SEEK_SET));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, stream.read(&stream, 1, buf));
+    ASSERT_EAARLIO_SUCCESS(stream.read(&stream, 0, buf));
+
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, stream.seek(&stream, -1, SEEK_SET));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_ERROR, stream.seek(&stream, INT64_MAX, SEEK_END));
+    ASSERT_EAARLIO_ERR(
+        EAARLIO_STREAM_SEEK_INVALID, stream.seek(&stream, 0, 99));
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_NOT_IMPL, stream.write(&stream, 1, buf));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, stream.read(&stream, 1, NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_NULL, stream.tell(&stream, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(stream.close(&stream));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+
+    /* The parent is still open */
+    ASSERT_EAARLIO_SUCCESS(parent.seek(&parent, 0, SEEK_SET));
+    ASSERT_EAARLIO_SUCCESS(parent.read(&parent, 1, buf));
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+/* Windows sharing a parent keep their own positions */
+TEST test_shared(struct eaarlio_memory *memory, struct mock_memory *mock)
+{
+    struct eaarlio_stream parent, first, second;
+    unsigned char buf[4];
+    int i;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_window_stream(&first, &parent, 0, 50, memory));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_window_stream(&second, &parent, 50, 50, memory));
+
+    for(i = 0; i < 10; i++) {
+        ASSERT_EAARLIO_SUCCESS(first.read(&first, 1, buf));
+        ASSERT_EAARLIO_SUCCESS(parent.seek(&parent, 0, SEEK_END));
+        ASSERT_EAARLIO_SUCCESS(second.read(&second, 2, buf + 1));
+        ASSERT_EQ_FMT(i, buf[0], "%d");
+        ASSERT_EQ_FMT(50 + 2 * i, buf[1], "%d");
+        ASSERT_EQ_FMT(51 + 2 * i, buf[2], "%d");
+    }
+
+    ASSERT_EAARLIO_SUCCESS(first.close(&first));
+    ASSERT_EAARLIO_SUCCESS(second.close(&second));
+    ASSERT_EQ_FMT(0, mock_memory_count_in_use(mock), "%d");
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+/* Windows can nest, and may extend beyond their parent */
+TEST test_nested()
+{
+    struct eaarlio_stream parent, outer, inner;
+    unsigned char buf[8];
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_window_stream(&outer, &parent, 90, 20, NULL));
+    ASSERT_EAARLIO_SUCCESS(eaarlio_window_stream(&inner, &outer, 5, 10, NULL));
+
+    ASSERT_EAARLIO_SUCCESS(inner.read(&inner, 5, buf));
+    ASSERT_EQ_FMT(95, buf[0], "%d");
+    ASSERT_EQ_FMT(99, buf[4], "%d");
+    ASSERT_EAARLIO_ERR(EAARLIO_STREAM_READ_SHORT, inner.read(&inner, 1, buf));
+
+    ASSERT_EAARLIO_SUCCESS(inner.close(&inner));
+    ASSERT_EAARLIO_SUCCESS(outer.close(&outer));
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+TEST test_alloc_fail(struct eaarlio_memory *memory)
+{
+    struct eaarlio_stream parent, stream;
+
+    ASSERT_EAARLIO_SUCCESS(
+        eaarlio_memory_stream(&parent, data, DATA_LEN, "r", NULL));
+    ASSERT_EAARLIO_ERR(EAARLIO_MEMORY_ALLOC_FAIL,
+        eaarlio_window_stream(&stream, &parent, 0, 10, memory));
+    ASSERT_EQ(NULL, stream.data);
+    ASSERT_EAARLIO_SUCCESS(parent.close(&parent));
+    PASS();
+}
+
+SUITE(suite_window)
+{
+    struct mock_memory mock;
+    struct eaarlio_memory memory;
+
+    mock_memory_new(&memory, &mock, 10);
+    RUN_TESTp(test_read, &memory, &mock);
+
+    mock_memory_reset(&mock, 10);
+    RUN_TESTp(test_shared, &memory, &mock);
+
+    RUN_TEST(test_nested);
+
+    mock_memory_reset(&mock, 0);
+    RUN_TESTp(test_alloc_fail, &memory);
+
+    mock_memory_destroy(&memory);
+}
+
+/*******************************************************************************
+ * Run the tests
+ *******************************************************************************
+ */
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv)
+{
+    int i;
+    for(i = 0; i < DATA_LEN; i++)
+        data[i] = (unsigned char)i;
+
+    GREATEST_MAIN_BEGIN();
+
+    RUN_SUITE(suite_basic);
+    RUN_SUITE(suite_window);
+
+    GREATEST_MAIN_END();
+}
@@ -0,0 +1,18 @@
+#include "eaarlio/file.h"
+#include "eaarlio/stream.h"
+#include <string.h>
+
+#include "util_file.h"
+
+eaarlio_error util_file_write(char const *fn, char const *data)
+{
+    struct eaarlio_stream out;
+    eaarlio_error err;
+
+    err = eaarlio_file_stream(&out, fn, "w");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    err = out.write(&out, strlen(data), (unsigned char const *)data);
+    out.close(&out);
+    return err;
+}
@@ -0,0 +1,13 @@
+#ifndef UTIL_FILE_H
+#define UTIL_FILE_H
+
+#include "eaarlio/error.h"
+
+/**
+ * Create or replace the file fn, containing the string data
+ *
+ * The terminating null is not written.
+ */
+eaarlio_error util_file_write(char const *fn, char const *data);
+
+#endif
@@ -0,0 +1,51 @@
+#include "util_raster_log.h"
+#include <string.h>
+
+eaarlio_error util_raster_log_init(struct util_raster_log *log)
+{
+    memset(log, 0, sizeof(*log));
+    return eaarlio_mutex_init(&log->mutex);
+}
+
+void util_raster_log_free(struct util_raster_log *log)
+{
+    eaarlio_mutex_destroy(&log->mutex);
+}
+
+eaarlio_error util_raster_log_fn(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct util_raster_log *log = (struct util_raster_log *)ctx;
+    eaarlio_error err = EAARLIO_SUCCESS;
+
+    (void)time_offset;
+    if(index >= UTIL_RASTER_LOG_MAX)
+        return EAARLIO_VALUE_OUT_OF_RANGE;
+
+    eaarlio_mutex_lock(&log->mutex);
+
+    if(log->count < UTIL_RASTER_LOG_MAX)
+        log->order[log->count] = index;
+    log->count++;
+
+    log->calls[index]++;
+    log->raster_number[index] = raster_number;
+    log->sequence_number[index] = raster->sequence_number;
+    log->pulse_count[index] = raster->pulse_count;
+    log->has_pulses[index] = raster->pulse != NULL;
+    log->has_waveforms[index] = raster->pulse && raster->pulse[0].tx;
+    log->rx_len[index] = 0;
+    if(raster->pulse && raster->pulse[0].rx[0])
+        log->rx_len[index] = raster->pulse[0].rx_len[0];
+
+    if(log->fail_on && log->count == log->fail_on)
+        err = EAARLIO_CORRUPT;
+    if(log->fail_raster && raster_number == log->fail_raster)
+        err = EAARLIO_CORRUPT;
+
+    eaarlio_mutex_unlock(&log->mutex);
+    return err;
+}
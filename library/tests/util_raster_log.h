@@ -0,0 +1,84 @@
+#ifndef UTIL_RASTER_LOG_H
+#define UTIL_RASTER_LOG_H
+
+#include "eaarlio/error.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/thread_support.h"
+#include <stdint.h>
+
+/**
+ * Most rasters a ::util_raster_log can hold, by index
+ */
+#define UTIL_RASTER_LOG_MAX 32
+
+/**
+ * Record of the rasters passed to ::util_raster_log_fn
+ *
+ * Details are kept by the index each raster was delivered with, so they can be
+ * checked regardless of delivery order. Calls are serialized by a mutex, which
+ * allows the log to be shared by the threads of
+ * ::eaarlio_flight_parallel_for.
+ */
+struct util_raster_log {
+    /** Guards everything else */
+    struct eaarlio_mutex mutex;
+
+    /** Number of calls made */
+    uint32_t count;
+
+    /** Index passed to each call, in the order the calls were made */
+    uint32_t order[UTIL_RASTER_LOG_MAX];
+
+    /** Calls made for each index */
+    uint32_t calls[UTIL_RASTER_LOG_MAX];
+
+    /** Raster number passed for each index */
+    uint32_t raster_number[UTIL_RASTER_LOG_MAX];
+
+    /** Sequence number of the raster for each index */
+    uint32_t sequence_number[UTIL_RASTER_LOG_MAX];
+
+    /** Pulse count of the raster for each index */
+    uint16_t pulse_count[UTIL_RASTER_LOG_MAX];
+
+    /** Were pulses decoded for each index? */
+    int has_pulses[UTIL_RASTER_LOG_MAX];
+
+    /** Were waveforms decoded for each index? */
+    int has_waveforms[UTIL_RASTER_LOG_MAX];
+
+    /** Length of the first pulse's first return waveform, if decoded */
+    uint16_t rx_len[UTIL_RASTER_LOG_MAX];
+
+    /** If non-zero, fail with EAARLIO_CORRUPT on this call (one-based) */
+    uint32_t fail_on;
+
+    /** If non-zero, fail with EAARLIO_CORRUPT for this raster number */
+    uint32_t fail_raster;
+};
+
+/**
+ * Initialize an empty log
+ *
+ * util_raster_log_free must be called to release it.
+ */
+eaarlio_error util_raster_log_init(struct util_raster_log *log);
+
+/**
+ * Release a log initialized by util_raster_log_init
+ */
+void util_raster_log_free(struct util_raster_log *log);
+
+/**
+ * Callback for the flight functions that records each raster in the
+ * ::util_raster_log given as @p ctx
+ *
+ * Returns EAARLIO_VALUE_OUT_OF_RANGE for an index the log cannot hold.
+ */
+eaarlio_error util_raster_log_fn(void *ctx,
+    uint32_t index,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset);
+
+#endif
@@ -1,22 +1,41 @@
 /* malloc, srand, rand */
 #include <stdlib.h>
+/* sprintf */
+#include <stdio.h>
 /* time, difftime */
 #include <time.h>
-/* strcpy, memset */
+/* memset, strlen */
 #include <string.h>
 
+#ifdef _WIN32
+/* _getpid */
+#include <process.h>
+#define util_getpid() ((unsigned long)_getpid())
+#else
+/* getpid */
+#include <unistd.h>
+#define util_getpid() ((unsigned long)getpid())
+#endif
+
 #include "util_tempfile.h"
 
-#define TEMPFILE_TEMPLATE (TEMPDIR "/tmp-XXXXXX")
-#define TEMPFILE_MAX (sizeof(TEMPFILE_TEMPLATE))
+/* The process id is written in hex between the prefix and the X characters,
+ * so that tests run in parallel never pick the same name.
+ */
+#define TEMPFILE_PREFIX (TEMPDIR "/tmp-")
+#define TEMPFILE_SUFFIX "-XXXXXX"
+#define TEMPFILE_MAX \
+    (sizeof(TEMPFILE_PREFIX) + 2 * sizeof(unsigned long) + \
+        sizeof(TEMPFILE_SUFFIX))
 
 char *util_tempfile()
 {
     static unsigned long seed = 0;
+    unsigned long pid = util_getpid();
     char *path = malloc(TEMPFILE_MAX);
     if(!path)
         return NULL;
-    strcpy(path, TEMPFILE_TEMPLATE);
+    sprintf(path, "%s%lx%s", TEMPFILE_PREFIX, pid, TEMPFILE_SUFFIX);
 
     /* Only initialize the seed once */
     if(!seed) {
@@ -26,7 +45,7 @@ char *util_tempfile()
          */
         time_t zero, now = time(NULL);
         memset(&zero, 0, sizeof zero);
-        seed = (unsigned long)difftime(now, zero);
+        seed = (unsigned long)difftime(now, zero) ^ (pid << 16);
         /* In the incredibly unlikely event that the above results in seed = 0,
          * force it to 1 to prevent repeatedly calling srand. (This is probably
          * overly paranoid, but the cost is negligible.)
@@ -38,7 +57,7 @@ char *util_tempfile()
     /* Randomize trailing X characters. This isn't the most random or uniform
      * outcome possible, but it's sufficient for portability.
      */
-    size_t i = TEMPFILE_MAX - 2;
+    size_t i = strlen(path) - 1;
     while(path[i] == 'X')
         path[i--] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"[rand() % 26];
 
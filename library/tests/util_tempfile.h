@@ -18,6 +18,9 @@
  * generate the warnings/errors. But for the purposes of our test cases, it
  * should be safe enough.
  *
+ * The path includes the process id, so concurrently running tests do not
+ * collide.
+ *
  * As a side effect, it invokes srand on its first call.
  */
 char *util_tempfile();
@@ -0,0 +1,93 @@
+#include "eaarlio/file.h"
+#include "eaarlio/tld.h"
+#include <string.h>
+
+#include "util_writer.h"
+
+eaarlio_error util_writer_load_rasters(struct eaarlio_raster *rasters)
+{
+    struct eaarlio_stream stream;
+    eaarlio_error err;
+    int i;
+
+    err = eaarlio_file_stream(&stream, UTIL_WRITER_TLD_FILE, "r");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++) {
+        err = eaarlio_tld_read_raster(&stream, &rasters[i], NULL, 1, 1);
+        if(err != EAARLIO_SUCCESS)
+            break;
+    }
+    stream.close(&stream);
+    return err;
+}
+
+void util_writer_free_rasters(struct eaarlio_raster *rasters)
+{
+    int i;
+    for(i = 0; i < UTIL_WRITER_RASTER_COUNT; i++)
+        eaarlio_raster_free(&rasters[i], NULL);
+}
+
+static eaarlio_error _util_writer_stream_write(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char const *buf)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)self->data;
+    w->writes++;
+    if(w->fail_writes)
+        return EAARLIO_STREAM_WRITE_ERROR;
+    return w->inner->write(w->inner, len, buf);
+}
+
+static eaarlio_error _util_writer_stream_read(struct eaarlio_stream *self,
+    uint64_t len,
+    unsigned char *buf)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)self->data;
+    return w->inner->read(w->inner, len, buf);
+}
+
+static eaarlio_error _util_writer_stream_seek(struct eaarlio_stream *self,
+    int64_t offset,
+    int whence)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)self->data;
+    return w->inner->seek(w->inner, offset, whence);
+}
+
+static eaarlio_error _util_writer_stream_tell(struct eaarlio_stream *self,
+    int64_t *position)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)self->data;
+    return w->inner->tell(w->inner, position);
+}
+
+static eaarlio_error _util_writer_stream_close(struct eaarlio_stream *self)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)self->data;
+    w->closes++;
+    *self = eaarlio_stream_empty();
+    return EAARLIO_SUCCESS;
+}
+
+void util_writer_stream_init(struct eaarlio_stream *stream,
+    struct util_writer_stream *wrapper,
+    struct eaarlio_stream *inner)
+{
+    memset(wrapper, 0, sizeof(*wrapper));
+    wrapper->inner = inner;
+    stream->close = &_util_writer_stream_close;
+    stream->read = &_util_writer_stream_read;
+    stream->write = &_util_writer_stream_write;
+    stream->seek = &_util_writer_stream_seek;
+    stream->tell = &_util_writer_stream_tell;
+    stream->data = wrapper;
+}
+
+eaarlio_error util_writer_stream_sync(struct eaarlio_stream *stream)
+{
+    struct util_writer_stream *w = (struct util_writer_stream *)stream->data;
+    w->syncs++;
+    return EAARLIO_SUCCESS;
+}
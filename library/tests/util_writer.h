@@ -0,0 +1,78 @@
+#ifndef UTIL_WRITER_H
+#define UTIL_WRITER_H
+
+#include "eaarlio/error.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+
+/**
+ * TLD file the writer tests take their rasters from
+ */
+#define UTIL_WRITER_TLD_FILE (DATADIR "/010909-014641.tld")
+
+/**
+ * Number of rasters loaded by ::util_writer_load_rasters
+ */
+#define UTIL_WRITER_RASTER_COUNT 4
+
+/**
+ * Length of each of those rasters once written as a TLD record
+ */
+#define UTIL_WRITER_RECORD_LEN 20010
+
+/**
+ * Mock stream size that fits all of those records, with room to spare
+ */
+#define UTIL_WRITER_MOCK_SIZE                                                  \
+    (UTIL_WRITER_RASTER_COUNT * UTIL_WRITER_RECORD_LEN + 100)
+
+/**
+ * Load the first ::UTIL_WRITER_RASTER_COUNT rasters of
+ * ::UTIL_WRITER_TLD_FILE
+ *
+ * @param[out] rasters Rasters to fill; must hold ::UTIL_WRITER_RASTER_COUNT
+ */
+eaarlio_error util_writer_load_rasters(struct eaarlio_raster *rasters);
+
+/**
+ * Free rasters loaded by ::util_writer_load_rasters
+ */
+void util_writer_free_rasters(struct eaarlio_raster *rasters);
+
+/**
+ * Stream wrapper that passes everything through to another stream, counting
+ * the calls the writers make
+ *
+ * Closing the wrapper does not close the inner stream, so a mock stream can be
+ * inspected after a writer has closed it.
+ */
+struct util_writer_stream {
+    /** Stream that calls are passed to */
+    struct eaarlio_stream *inner;
+
+    /** Calls to write */
+    int writes;
+
+    /** Calls to ::util_writer_stream_sync */
+    int syncs;
+
+    /** Calls to close */
+    int closes;
+
+    /** If non-zero, writes fail with ::EAARLIO_STREAM_WRITE_ERROR */
+    int fail_writes;
+};
+
+/**
+ * Set up @p stream to wrap @p inner, counting into @p wrapper
+ */
+void util_writer_stream_init(struct eaarlio_stream *stream,
+    struct util_writer_stream *wrapper,
+    struct eaarlio_stream *inner);
+
+/**
+ * Sync function for a wrapped stream, which only counts the call
+ */
+eaarlio_error util_writer_stream_sync(struct eaarlio_stream *stream);
+
+#endif
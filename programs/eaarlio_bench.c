@@ -0,0 +1,570 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stats.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/version.h"
+
+/* Most rasters kept in memory for the write benchmarks */
+#define WRITE_SAMPLE 1024
+
+/* State shared by the benchmarks
+ */
+struct bench {
+    /* Path to the EDB file */
+    char const *edb_file;
+    /* Path to the TLD files */
+    char const *tld_path;
+    /* Flight opened with the counting memory handler */
+    struct eaarlio_flight flight;
+    /* Counting memory handler */
+    struct eaarlio_memory *memory;
+    /* Wrapper providing memory */
+    struct eaarlio_stats_memory counting;
+    /* Allocations counted by memory */
+    struct eaarlio_stats stats;
+    /* Raster numbers in random order */
+    uint32_t *shuffled;
+    /* Decoded rasters for the write benchmarks */
+    struct eaarlio_raster *rasters;
+    /* Number of entries in rasters */
+    uint32_t raster_count;
+    /* Total TLD bytes of rasters */
+    uint64_t raster_bytes;
+    /* Size of the EDB file */
+    uint64_t edb_bytes;
+};
+
+/* One pass of a benchmark. Sets items to the number of rasters (or EDB
+ * records) processed and bytes to the amount of TLD (or EDB) data they took.
+ */
+typedef eaarlio_error (*bench_fn)(
+    struct bench *bench, uint64_t *items, uint64_t *bytes);
+
+/* Definition of a benchmark
+ */
+struct bench_def {
+    /* Short name */
+    char const *name;
+    /* Description for --list */
+    char const *descr;
+    /* Function to run one pass */
+    bench_fn fn;
+};
+
+/* Benchmark: read the EDB file
+ */
+eaarlio_error bench_edb_read(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    struct eaarlio_edb edb = eaarlio_edb_empty();
+    eaarlio_error err;
+
+    err = eaarlio_file_stream(&stream, bench->edb_file, "r");
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_edb_read(&stream, &edb, bench->memory, 1, 1);
+    stream.close(&stream);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    *items = edb.record_count;
+    *bytes = bench->edb_bytes;
+
+    return eaarlio_edb_free(&edb, bench->memory);
+}
+
+/* Read every raster in TLD file order using eaarlio_tld_read_raster
+ */
+eaarlio_error tld_read_all(struct bench *bench,
+    uint64_t *items,
+    uint64_t *bytes,
+    int include_pulses,
+    int include_waveforms)
+{
+    struct eaarlio_edb const *edb = &bench->flight.edb;
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    eaarlio_error err = EAARLIO_SUCCESS;
+    char path[4096];
+    uint32_t f, i;
+
+    *items = 0;
+    *bytes = 0;
+
+    for(f = 1; f <= edb->file_count && err == EAARLIO_SUCCESS; f++) {
+        snprintf(path, sizeof(path), "%s/%s", bench->tld_path,
+            edb->files[f - 1]);
+        err = eaarlio_file_stream(&stream, path, "r");
+        if(err != EAARLIO_SUCCESS)
+            break;
+
+        for(i = 0; i < edb->record_count; i++) {
+            if(edb->records[i].file_index != (int16_t)f)
+                continue;
+            err = stream.seek(
+                &stream, edb->records[i].record_offset, SEEK_SET);
+            if(err == EAARLIO_SUCCESS)
+                err = eaarlio_tld_read_raster(&stream, &raster,
+                    bench->memory, include_pulses, include_waveforms);
+            if(err != EAARLIO_SUCCESS)
+                break;
+            eaarlio_raster_free(&raster, bench->memory);
+            (*items)++;
+            *bytes += edb->records[i].record_length;
+        }
+
+        stream.close(&stream);
+    }
+
+    return err;
+}
+
+/* Benchmark: read raster headers only from the TLD files
+ */
+eaarlio_error bench_tld_headers(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    return tld_read_all(bench, items, bytes, 0, 0);
+}
+
+/* Benchmark: read rasters and pulses, without waveforms
+ */
+eaarlio_error bench_tld_pulses(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    return tld_read_all(bench, items, bytes, 1, 0);
+}
+
+/* Benchmark: read rasters with pulses and waveforms
+ */
+eaarlio_error bench_tld_waveforms(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    return tld_read_all(bench, items, bytes, 1, 1);
+}
+
+/* Read the given rasters through the flight
+ */
+eaarlio_error flight_read_all(struct bench *bench,
+    uint64_t *items,
+    uint64_t *bytes,
+    uint32_t const *order)
+{
+    struct eaarlio_flight *flight = &bench->flight;
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    eaarlio_error err;
+    int32_t time_offset;
+    uint32_t i, rn;
+
+    *items = 0;
+    *bytes = 0;
+
+    for(i = 0; i < flight->edb.record_count; i++) {
+        rn = order ? order[i] : i + 1;
+        err = eaarlio_flight_read_raster(
+            flight, &raster, &time_offset, rn, 1, 1);
+        if(err != EAARLIO_SUCCESS)
+            return err;
+        eaarlio_raster_free(&raster, bench->memory);
+        (*items)++;
+        *bytes += flight->edb.records[rn - 1].record_length;
+    }
+
+    return EAARLIO_SUCCESS;
+}
+
+/* Benchmark: read every raster through the flight in raster number order
+ */
+eaarlio_error bench_flight_sequential(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    return flight_read_all(bench, items, bytes, NULL);
+}
+
+/* Benchmark: read every raster through the flight in random order
+ */
+eaarlio_error bench_flight_random(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    return flight_read_all(bench, items, bytes, bench->shuffled);
+}
+
+/* Benchmark: encode rasters with eaarlio_tld_write_raster
+ */
+eaarlio_error bench_tld_write(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    eaarlio_error err;
+    uint32_t i;
+
+    err = eaarlio_memory_stream(
+        &stream, NULL, bench->raster_bytes, "w", bench->memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    for(i = 0; i < bench->raster_count; i++) {
+        err = eaarlio_tld_write_raster(
+            &stream, &bench->rasters[i], bench->memory);
+        if(err != EAARLIO_SUCCESS)
+            break;
+    }
+
+    stream.close(&stream);
+
+    *items = bench->raster_count;
+    *bytes = bench->raster_bytes;
+    return err;
+}
+
+/* Benchmark: encode rasters with the buffered eaarlio_tld_writer
+ */
+eaarlio_error bench_tld_writer(
+    struct bench *bench, uint64_t *items, uint64_t *bytes)
+{
+    struct eaarlio_stream stream = eaarlio_stream_empty();
+    struct eaarlio_tld_writer writer = eaarlio_tld_writer_empty();
+    eaarlio_error err;
+    uint32_t i;
+
+    err = eaarlio_memory_stream(
+        &stream, NULL, bench->raster_bytes, "w", bench->memory);
+    if(err != EAARLIO_SUCCESS)
+        return err;
+
+    err = eaarlio_tld_writer_init(&writer, &stream, 0, NULL,
+        EAARLIO_TLD_SYNC_NEVER, bench->memory);
+    for(i = 0; i < bench->raster_count && err == EAARLIO_SUCCESS; i++)
+        err = eaarlio_tld_writer_write_raster(
+            &writer, &bench->rasters[i], NULL);
+    if(writer.buffer) {
+        if(err == EAARLIO_SUCCESS)
+            err = eaarlio_tld_writer_close(&writer);
+        else
+            eaarlio_tld_writer_close(&writer);
+    }
+
+    stream.close(&stream);
+
+    *items = bench->raster_count;
+    *bytes = bench->raster_bytes;
+    return err;
+}
+
+/* All benchmarks, in the order they are run */
+static struct bench_def const benchmarks[] = {
+    { "edb_read", "eaarlio_edb_read of the EDB file; items are records",
+        &bench_edb_read },
+    { "tld_headers", "eaarlio_tld_read_raster, raster headers only",
+        &bench_tld_headers },
+    { "tld_pulses", "eaarlio_tld_read_raster, pulses without waveforms",
+        &bench_tld_pulses },
+    { "tld_waveforms", "eaarlio_tld_read_raster, pulses and waveforms",
+        &bench_tld_waveforms },
+    { "flight_sequential", "eaarlio_flight_read_raster in raster order",
+        &bench_flight_sequential },
+    { "flight_random", "eaarlio_flight_read_raster in random order",
+        &bench_flight_random },
+    { "tld_write", "eaarlio_tld_write_raster to memory",
+        &bench_tld_write },
+    { "tld_writer", "eaarlio_tld_writer to memory", &bench_tld_writer },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* Run a benchmark repeatedly for at least min_time seconds and report it
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int run_benchmark(struct bench *bench,
+    struct bench_def const *def,
+    double min_time,
+    int csv)
+{
+    eaarlio_error err;
+    uint64_t items, bytes;
+    uint64_t total_items = 0, total_bytes = 0;
+    uint32_t passes = 0;
+    double start, elapsed;
+
+    bench->stats = eaarlio_stats_empty();
+
+    start = eaarlio_clock();
+    do {
+        err = def->fn(bench, &items, &bytes);
+        if(err != EAARLIO_SUCCESS) {
+            fprintf(stderr, "ERROR: %s failed: %s\n", def->name,
+                eaarlio_error_message(err));
+            return 1;
+        }
+        total_items += items;
+        total_bytes += bytes;
+        passes++;
+        elapsed = eaarlio_clock() - start;
+    } while(elapsed < min_time && total_items);
+
+    if(elapsed <= 0)
+        elapsed = 1e-9;
+    if(!total_items)
+        total_items = 1;
+
+    printf(csv ? "%s,%" PRIu32 ",%.6f,%.1f,%.2f,%.2f,%.1f\n"
+               : "%-18s %7" PRIu32 " %9.3f %12.1f %9.2f %10.2f %12.1f\n",
+        def->name, passes, elapsed, total_items / elapsed,
+        total_bytes / elapsed / 1048576.0,
+        (double)bench->stats.allocs / total_items,
+        (double)bench->stats.alloc_bytes / total_items);
+    fflush(stdout);
+
+    return 0;
+}
+
+/* Load the flight and the data the benchmarks share
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int bench_init(struct bench *bench, uint32_t seed)
+{
+    struct eaarlio_raster *raster;
+    eaarlio_error err;
+    int32_t time_offset;
+    uint32_t i, j, tmp, count;
+    FILE *f;
+
+    err = eaarlio_stats_memory_init(&bench->counting, NULL, &bench->stats);
+    if(eaarlio_error_check(err, "ERROR: Problem creating memory handler"))
+        return 1;
+    bench->memory = &bench->counting.memory;
+
+    f = fopen(bench->edb_file, "rb");
+    if(f && fseek(f, 0, SEEK_END) == 0)
+        bench->edb_bytes = (uint64_t)ftell(f);
+    if(f)
+        fclose(f);
+
+    err = eaarlio_file_flight(
+        &bench->flight, bench->edb_file, bench->tld_path, bench->memory);
+    if(eaarlio_error_check(err, "ERROR: Problem loading EDB"))
+        return 1;
+
+    count = bench->flight.edb.record_count;
+    if(!count) {
+        fprintf(stderr, "ERROR: EDB has no rasters\n");
+        return 1;
+    }
+
+    // Fisher-Yates shuffle with a fixed linear congruential generator, so
+    // that runs with the same seed are comparable
+    bench->shuffled = malloc(count * sizeof(uint32_t));
+    bench->rasters = calloc(count < WRITE_SAMPLE ? count : WRITE_SAMPLE,
+        sizeof(struct eaarlio_raster));
+    if(!bench->shuffled || !bench->rasters) {
+        fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        return 1;
+    }
+    for(i = 0; i < count; i++)
+        bench->shuffled[i] = i + 1;
+    for(i = count - 1; i > 0; i--) {
+        seed = seed * 1103515245U + 12345U;
+        j = (seed >> 8) % (i + 1);
+        tmp = bench->shuffled[i];
+        bench->shuffled[i] = bench->shuffled[j];
+        bench->shuffled[j] = tmp;
+    }
+
+    for(i = 0; i < count && i < WRITE_SAMPLE; i++) {
+        raster = &bench->rasters[i];
+        err = eaarlio_flight_read_raster(
+            &bench->flight, raster, &time_offset, i + 1, 1, 1);
+        if(eaarlio_error_check(err, "ERROR: Problem reading raster"))
+            return 1;
+        bench->raster_count++;
+        bench->raster_bytes += bench->flight.edb.records[i].record_length;
+    }
+
+    return 0;
+}
+
+/* Release the data loaded by bench_init
+ */
+void bench_free(struct bench *bench)
+{
+    uint32_t i;
+
+    for(i = 0; i < bench->raster_count; i++)
+        eaarlio_raster_free(&bench->rasters[i], bench->memory);
+    free(bench->rasters);
+    free(bench->shuffled);
+    eaarlio_flight_free(&bench->flight);
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0;
+    char progname[] = "eaarlio_bench";
+    char *tld_path = NULL;
+    int tld_path_free = 0;
+    struct bench bench;
+    size_t len;
+    uint32_t i;
+    int found;
+
+    struct arg_lit *help, *version, *list, *csv;
+    struct arg_file *edb, *tld;
+    struct arg_dbl *min_time;
+    struct arg_int *seed;
+    struct arg_str *only;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        list = arg_litn("l", "list", 0, 1, "list the benchmarks and exit"),
+        only = arg_strn("b", "bench", "<name>", 0, 100,
+            "run only this benchmark; may be repeated"),
+        min_time = arg_dbl0("m", "min-time", "<seconds>",
+            "repeat each benchmark for at least this long (default 1)"),
+        seed = arg_int0("s", "seed", "<n>",
+            "seed for the random read order (default 1)"),
+        csv = arg_litn("c", "csv", 0, 1, "write results as CSV"),
+        tld = arg_file0("t", "tld", "<tld path>", "path to the TLD files"),
+        edb = arg_filen(NULL, NULL, "<edb file>", 0, 1, "EDB file for dataset"),
+        end = arg_end(20),
+    };
+
+    memset(&bench, 0, sizeof(bench));
+    bench.flight = eaarlio_flight_empty();
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    min_time->dval[0] = 1.0;
+    seed->ival[0] = 1;
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Measure the throughput of the library's main operations.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "Each benchmark is repeated until it has run for at least the "
+            "minimum time.\n"
+            "For each, the number of passes, the elapsed seconds, rasters "
+            "per second, MB of\n"
+            "TLD data per second, and allocations and bytes allocated per "
+            "raster are\n"
+            "reported. Allocations are those made through the library's "
+            "memory handler.\n"
+            "\n"
+            "The files are read through the operating system's cache like "
+            "any other\n"
+            "program, so results after the first pass generally reflect a "
+            "warm cache.\n");
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(list->count > 0) {
+        for(i = 0; i < BENCHMARK_COUNT; i++)
+            printf("%-18s %s\n", benchmarks[i].name, benchmarks[i].descr);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0 || edb->count == 0) {
+        if(nerrors > 0)
+            arg_print_errors(stderr, end, progname);
+        else
+            fprintf(stderr, "%s: missing <edb file>\n", progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    for(i = 0; i < (uint32_t)only->count; i++) {
+        found = 0;
+        for(len = 0; len < BENCHMARK_COUNT; len++)
+            if(!strcmp(only->sval[i], benchmarks[len].name))
+                found = 1;
+        if(!found) {
+            fprintf(stderr, "%s: unknown benchmark: %s\n", progname,
+                only->sval[i]);
+            exitcode = 1;
+            goto exit;
+        }
+    }
+
+    len = strlen(edb->filename[0]) - strlen(edb->basename[0]);
+    if(tld->count > 0) {
+        tld_path = (char *)tld->filename[0];
+    } else if(len > 0) {
+        tld_path_free = 1;
+        tld_path = calloc(len + 1, sizeof(char));
+        if(!tld_path) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+        memcpy(tld_path, edb->filename[0], len);
+    } else {
+        tld_path = ".";
+    }
+
+    bench.edb_file = edb->filename[0];
+    bench.tld_path = tld_path;
+    exitcode = bench_init(&bench, (uint32_t)seed->ival[0]);
+    if(exitcode)
+        goto exit;
+
+    printf(csv->count ? "benchmark,passes,seconds,rasters_per_s,mb_per_s,"
+                        "allocs_per_raster,bytes_per_raster\n"
+                      : "%-18s %7s %9s %12s %9s %10s %12s\n",
+        "benchmark", "passes", "seconds", "rasters/s", "MB/s", "allocs/r",
+        "bytes/r");
+
+    for(i = 0; i < BENCHMARK_COUNT && !exitcode; i++) {
+        found = only->count == 0;
+        for(len = 0; len < (size_t)only->count; len++)
+            if(!strcmp(only->sval[len], benchmarks[i].name))
+                found = 1;
+        if(found)
+            exitcode = run_benchmark(
+                &bench, &benchmarks[i], min_time->dval[0], csv->count);
+    }
+
+exit:
+    bench_free(&bench);
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    if(tld_path_free && tld_path)
+        free(tld_path);
+    return exitcode;
+}
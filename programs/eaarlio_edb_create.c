@@ -41,6 +41,7 @@ int eaarlio_edb_create(const char *outfile,
     const char **infiles_base,
     int infiles_count,
     uint32_t records_size,
+    int direct,
     int verbose)
 {
     eaarlio_error err = EAARLIO_SUCCESS;
@@ -85,7 +86,11 @@ int eaarlio_edb_create(const char *outfile,
                 infiles[file_index - 1]);
         }
 
-        err = eaarlio_file_stream(&stream, infiles[file_index - 1], "r");
+        if(direct)
+            err = eaarlio_file_direct_stream(
+                &stream, infiles[file_index - 1], 0, NULL);
+        else
+            err = eaarlio_file_stream(&stream, infiles[file_index - 1], "r");
         exitcode = eaarlio_error_check(
             err, "ERROR: Unable to open %s", infiles[file_index - 1]);
         if(exitcode)
@@ -132,7 +137,7 @@ int eaarlio_edb_create(const char *outfile,
                 infiles[file_index - 1], record_offset);
             if(statuscode)
                 break;
-            if(record_header.record_type != EAARLIO_TLD_TYPE_RASTER) {
+            if(!eaarlio_tld_type_is_raster(record_header.record_type)) {
                 if(verbose > 0) {
                     printf("  Skipping record with type %d at offset %lld\n",
                         record_header.record_type, (long long)record_offset);
@@ -209,7 +214,7 @@ int main(int argc, char *argv[])
     int exitcode = 0, nerrors = 0;
     char progname[] = "eaarlio_edb_create";
 
-    struct arg_lit *help, *version, *verbose;
+    struct arg_lit *help, *version, *verbose, *direct;
     struct arg_int *records;
     struct arg_file *outfile, *infiles;
     struct arg_end *end;
@@ -224,6 +229,8 @@ int main(int argc, char *argv[])
         records = arg_int0(NULL, "record-count", NULL,
             "hint on how many records are expected, default is"),
         arg_rem(NULL, "1024 * tld file count"),
+        direct = arg_litn(NULL, "direct", 0, 1,
+            "read TLD files without filling the page cache"),
         outfile = arg_filen("o", "output", "<edb file>", 0, 1,
             "EDB file to create, default is eaarl.idx"),
         infiles = arg_filen(
@@ -268,7 +275,13 @@ int main(int argc, char *argv[])
             "\n"
             "The --record-count options is generally not needed but can be "
             "used to\n"
-            "optimize how the program initially allocates memory.\n");
+            "optimize how the program initially allocates memory.\n"
+            "\n"
+            "The --direct option reads the TLD files with direct I/O where "
+            "available,\n"
+            "bypassing the page cache. This is useful when indexing large "
+            "amounts of data\n"
+            "on a machine that is also used for other work.\n");
 
         exitcode = 0;
         goto exit;
@@ -282,7 +295,8 @@ int main(int argc, char *argv[])
     }
 
     exitcode = eaarlio_edb_create(outfile->filename[0], infiles->filename,
-        infiles->basename, infiles->count, records->ival[0], verbose->count);
+        infiles->basename, infiles->count, records->ival[0], direct->count,
+        verbose->count);
 
 exit:
     arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
@@ -0,0 +1,704 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/arrow.h"
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/pipeline.h"
+#include "eaarlio/pulse.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/units.h"
+#include "eaarlio/version.h"
+
+/* Output formats */
+#define FORMAT_RAW 0
+#define FORMAT_NPY 1
+#define FORMAT_ARROW 2
+#define FORMAT_ARROW_STREAM 3
+
+/* Bytes buffered for each column before it is written */
+#define COLUMN_BUFFER_SIZE 65536
+
+/* Size of the header written at the start of each .npy file
+ *
+ * The header is written before the number of rows is known and rewritten
+ * once it is, so it is always padded out to this size. That leaves ample
+ * room for any row count and keeps the data 64-byte aligned, as the format
+ * recommends.
+ */
+#define NPY_HEADER_SIZE 128
+
+/* Waveforms stored per pulse: the transmit waveform, then each channel */
+#define WAVEFORMS_PER_PULSE (1 + EAARLIO_MAX_RX_COUNT)
+
+/* One output file
+ *
+ * Every column has one row per pulse, except for the waveform pool, which
+ * has one row per sample, and the waveform offsets.
+ */
+struct column {
+    /* Name of the column, which is also the file name without extension */
+    char const *name;
+    /* NumPy type description */
+    char const *descr;
+    /* Number of values per row */
+    uint32_t per_row;
+    /* Output file */
+    FILE *file;
+    /* Number of rows written */
+    uint64_t rows;
+    /* Encoded data not yet written */
+    unsigned char *buffer;
+    /* Number of bytes in buffer */
+    size_t len;
+};
+
+/* Indexes into the columns array */
+enum {
+    COL_RASTER_NUMBER,
+    COL_PULSE_NUMBER,
+    COL_DIGITIZER,
+    COL_TIME,
+    COL_SCAN_ANGLE,
+    COL_TIME_OFFSET,
+    COL_SCAN_ANGLE_COUNTS,
+    COL_RANGE,
+    COL_RX_COUNT,
+    COL_THRESH_TX,
+    COL_THRESH_RX,
+    COL_BIAS_TX,
+    COL_BIAS_RX,
+    COL_WAVEFORMS,
+    COL_WAVEFORM_OFFSETS,
+    COL_COUNT
+};
+
+/* State for an export
+ */
+struct export_job {
+    /* Output columns */
+    struct column columns[COL_COUNT];
+    /* Number of columns in use; the waveform columns are last */
+    int column_count;
+    /* Output stream for the Arrow formats */
+    struct eaarlio_stream stream;
+    /* Writer for the Arrow formats */
+    struct eaarlio_arrow_writer arrow;
+    /* Next raster number to read */
+    uint32_t next;
+    /* Last raster number to read */
+    uint32_t last;
+    /* Waveform samples written so far */
+    uint64_t samples;
+    /* Set if writing to a column failed */
+    int failed;
+};
+
+/* Definitions for each column: name, NumPy type, values per row
+ */
+static struct column const column_defs[COL_COUNT] = {
+    { "raster_number", "<u4", 1, NULL, 0, NULL, 0 },
+    { "pulse_number", "<u2", 1, NULL, 0, NULL, 0 },
+    { "digitizer", "|u1", 1, NULL, 0, NULL, 0 },
+    { "time", "<f8", 1, NULL, 0, NULL, 0 },
+    { "scan_angle", "<f8", 1, NULL, 0, NULL, 0 },
+    { "time_offset", "<u4", 1, NULL, 0, NULL, 0 },
+    { "scan_angle_counts", "<i2", 1, NULL, 0, NULL, 0 },
+    { "range", "<u2", 1, NULL, 0, NULL, 0 },
+    { "rx_count", "|u1", 1, NULL, 0, NULL, 0 },
+    { "thresh_tx", "|u1", 1, NULL, 0, NULL, 0 },
+    { "thresh_rx", "|u1", 1, NULL, 0, NULL, 0 },
+    { "bias_tx", "|u1", 1, NULL, 0, NULL, 0 },
+    { "bias_rx", "|u1", EAARLIO_MAX_RX_COUNT, NULL, 0, NULL, 0 },
+    { "waveforms", "|u1", 1, NULL, 0, NULL, 0 },
+    { "waveform_offsets", "<u8", 1, NULL, 0, NULL, 0 },
+};
+
+/* Write out a column's buffered data. Returns 0 on success, 1 on failure.
+ */
+int column_flush(struct column *column)
+{
+    if(column->len && fwrite(column->buffer, 1, column->len, column->file)
+            != column->len)
+        return 1;
+    column->len = 0;
+    return 0;
+}
+
+/* Append bytes to a column
+ *
+ * The bytes must already be in little-endian order.
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int column_put(struct column *column, void const *data, size_t len)
+{
+    size_t n;
+
+    while(len) {
+        if(column->len == COLUMN_BUFFER_SIZE && column_flush(column))
+            return 1;
+        n = COLUMN_BUFFER_SIZE - column->len;
+        if(n > len)
+            n = len;
+        memcpy(column->buffer + column->len, data, n);
+        column->len += n;
+        data = (unsigned char const *)data + n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Append an unsigned integer of the given width in little-endian order
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int column_put_uint(struct column *column, uint64_t value, int width)
+{
+    unsigned char bytes[8];
+    int i;
+
+    for(i = 0; i < width; i++) {
+        bytes[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+    return column_put(column, bytes, width);
+}
+
+/* Append a double in IEEE 754 little-endian order
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int column_put_double(struct column *column, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return column_put_uint(column, bits, 8);
+}
+
+/* Write a .npy header for a column. Returns 0 on success, 1 on failure.
+ */
+int npy_header(struct column *column)
+{
+    char header[NPY_HEADER_SIZE + 1];
+    int n;
+
+    // Magic string, version 1.0, and the length of the rest of the header
+    memcpy(header, "\x93NUMPY\x01\x00", 8);
+    header[8] = (char)((NPY_HEADER_SIZE - 10) & 0xff);
+    header[9] = (char)((NPY_HEADER_SIZE - 10) >> 8);
+
+    if(column->per_row > 1)
+        n = snprintf(header + 10, NPY_HEADER_SIZE - 9,
+            "{'descr': '%s', 'fortran_order': False, "
+            "'shape': (%" PRIu64 ", %" PRIu32 "), }",
+            column->descr, column->rows, column->per_row);
+    else
+        n = snprintf(header + 10, NPY_HEADER_SIZE - 9,
+            "{'descr': '%s', 'fortran_order': False, "
+            "'shape': (%" PRIu64 ",), }",
+            column->descr, column->rows);
+    if(n < 0 || n > NPY_HEADER_SIZE - 11)
+        return 1;
+
+    // Pad with spaces and end with a newline
+    memset(header + 10 + n, ' ', NPY_HEADER_SIZE - 10 - n);
+    header[NPY_HEADER_SIZE - 1] = '\n';
+
+    if(fseek(column->file, 0, SEEK_SET))
+        return 1;
+    if(fwrite(header, 1, NPY_HEADER_SIZE, column->file) != NPY_HEADER_SIZE)
+        return 1;
+    return 0;
+}
+
+/* Pipeline callback: choose the next raster
+ */
+eaarlio_error export_next(void *ctx, uint32_t *raster_number)
+{
+    struct export_job *job = (struct export_job *)ctx;
+
+    *raster_number = 0;
+    if(job->next && job->next <= job->last) {
+        *raster_number = job->next;
+        job->next = job->next < job->last ? job->next + 1 : 0;
+    }
+    return EAARLIO_SUCCESS;
+}
+
+/* Pipeline callback: append a raster's pulses to the columns
+ *
+ * This is called for each raster in order.
+ */
+eaarlio_error export_output(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct export_job *job = (struct export_job *)ctx;
+    struct column *col = job->columns;
+    struct eaarlio_pulse *pulse;
+    unsigned char *wf;
+    uint16_t wf_len;
+    uint16_t i;
+    int j, failed = 0;
+
+    (void)slot;
+    (void)time_offset;
+
+    if(!raster->pulse)
+        return EAARLIO_SUCCESS;
+
+    for(i = 1; i <= raster->pulse_count; i++) {
+        pulse = &raster->pulse[i - 1];
+
+        failed |= column_put_uint(&col[COL_RASTER_NUMBER], raster_number, 4);
+        failed |= column_put_uint(&col[COL_PULSE_NUMBER], i, 2);
+        failed |= column_put_uint(&col[COL_DIGITIZER], raster->digitizer, 1);
+        failed |= column_put_double(
+            &col[COL_TIME], eaarlio_units_pulse_time(raster, i));
+        failed |= column_put_double(
+            &col[COL_SCAN_ANGLE], eaarlio_units_pulse_scan_angle(pulse));
+        failed |=
+            column_put_uint(&col[COL_TIME_OFFSET], pulse->time_offset, 4);
+        failed |= column_put_uint(&col[COL_SCAN_ANGLE_COUNTS],
+            (uint16_t)pulse->scan_angle_counts, 2);
+        failed |= column_put_uint(&col[COL_RANGE], pulse->range, 2);
+        failed |= column_put_uint(&col[COL_RX_COUNT], pulse->rx_count, 1);
+        failed |= column_put_uint(&col[COL_THRESH_TX], pulse->thresh_tx, 1);
+        failed |= column_put_uint(&col[COL_THRESH_RX], pulse->thresh_rx, 1);
+        failed |= column_put_uint(&col[COL_BIAS_TX], pulse->bias_tx, 1);
+        failed |= column_put(
+            &col[COL_BIAS_RX], pulse->bias_rx, EAARLIO_MAX_RX_COUNT);
+
+        // Waveforms go into the pool back to back. Each one's end offset is
+        // recorded, so waveform k of the whole export spans offsets[k] up to
+        // offsets[k + 1]. Channels beyond rx_count are stored as empty.
+        for(j = 0; j < WAVEFORMS_PER_PULSE && job->column_count == COL_COUNT;
+            j++) {
+            if(j == 0) {
+                wf = pulse->tx;
+                wf_len = pulse->tx_len;
+            } else {
+                wf = j <= pulse->rx_count ? pulse->rx[j - 1] : NULL;
+                wf_len = pulse->rx_len[j - 1];
+            }
+            if(!wf)
+                wf_len = 0;
+            failed |= column_put(&col[COL_WAVEFORMS], wf, wf_len);
+            job->samples += wf_len;
+            failed |= column_put_uint(
+                &col[COL_WAVEFORM_OFFSETS], job->samples, 8);
+        }
+    }
+
+    for(j = 0; j < COL_WAVEFORMS; j++)
+        col[j].rows += raster->pulse_count;
+    if(job->column_count == COL_COUNT) {
+        col[COL_WAVEFORMS].rows = job->samples;
+        col[COL_WAVEFORM_OFFSETS].rows +=
+            (uint64_t)raster->pulse_count * WAVEFORMS_PER_PULSE;
+    }
+
+    if(failed) {
+        job->failed = 1;
+        return EAARLIO_STREAM_WRITE_ERROR;
+    }
+    return EAARLIO_SUCCESS;
+}
+
+/* Pipeline callback: add a raster's pulses to the Arrow writer
+ */
+eaarlio_error export_output_arrow(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct export_job *job = (struct export_job *)ctx;
+
+    (void)slot;
+    (void)time_offset;
+
+    return eaarlio_arrow_writer_write_raster(
+        &job->arrow, raster_number, raster);
+}
+
+/* Open the Arrow output file and write its schema
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int open_arrow(char const *out_dir,
+    struct export_job *job,
+    int format,
+    int include_waveforms)
+{
+    char path[4096];
+    eaarlio_error err;
+
+    snprintf(path, sizeof(path), "%s/pulses.%s", out_dir,
+        format == FORMAT_ARROW ? "arrow" : "arrows");
+    err = eaarlio_file_stream(&job->stream, path, "w");
+    if(err != EAARLIO_SUCCESS) {
+        fprintf(stderr, "ERROR: Unable to create %s\n", path);
+        return 1;
+    }
+
+    err = eaarlio_arrow_writer_init(&job->arrow, &job->stream,
+        format == FORMAT_ARROW ? EAARLIO_ARROW_FILE : EAARLIO_ARROW_STREAM,
+        include_waveforms, 0, NULL);
+    return eaarlio_error_check(err, "ERROR: Problem writing Arrow schema");
+}
+
+/* Write a description of the raw columns, since raw files have no header
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int write_schema(char const *out_dir, struct export_job *job)
+{
+    char path[4096];
+    FILE *f;
+    int i, failed = 0;
+
+    snprintf(path, sizeof(path), "%s/columns.txt", out_dir);
+    f = fopen(path, "w");
+    if(!f) {
+        fprintf(stderr, "ERROR: Unable to create %s\n", path);
+        return 1;
+    }
+
+    fprintf(f, "# name type rows values_per_row\n");
+    for(i = 0; i < job->column_count; i++)
+        fprintf(f, "%s %s %" PRIu64 " %" PRIu32 "\n", job->columns[i].name,
+            job->columns[i].descr, job->columns[i].rows,
+            job->columns[i].per_row);
+
+    failed = ferror(f);
+    if(fclose(f))
+        failed = 1;
+    if(failed)
+        fprintf(stderr, "ERROR: Problem writing %s\n", path);
+    return failed;
+}
+
+/* Export rasters first through last of a flight as columns in out_dir, which
+ * must already exist. format is one of the FORMAT_ values. A last of 0 means
+ * the last raster in the EDB, and threads of 0 means one per CPU.
+ *
+ * Returns 0 on success, 1 on failure.
+ */
+int export_flight(char const *edb_file,
+    char const *tld_path,
+    char const *out_dir,
+    int format,
+    uint32_t first,
+    uint32_t last,
+    int include_waveforms,
+    uint32_t threads)
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct eaarlio_pipeline pipeline = eaarlio_pipeline_empty();
+    struct export_job *job = NULL;
+    struct column *column;
+    char path[4096];
+    eaarlio_error err;
+    int exitcode = 0;
+    int i;
+
+    job = calloc(1, sizeof(struct export_job));
+    if(!job) {
+        fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        return 1;
+    }
+    memcpy(job->columns, column_defs, sizeof(column_defs));
+    if(format == FORMAT_ARROW || format == FORMAT_ARROW_STREAM)
+        job->column_count = 0;
+    else
+        job->column_count = include_waveforms ? COL_COUNT : COL_WAVEFORMS;
+    job->stream = eaarlio_stream_empty();
+    job->arrow = eaarlio_arrow_writer_empty();
+
+    err = eaarlio_file_flight(&flight, edb_file, tld_path, NULL);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem loading EDB");
+    if(exitcode)
+        goto exit;
+
+    if(!last)
+        last = flight.edb.record_count;
+    if(first < 1 || first > last || last > flight.edb.record_count) {
+        fprintf(stderr,
+            "ERROR: rasters %" PRIu32 " to %" PRIu32
+            " are not within the EDB, which has %" PRIu32 " rasters\n",
+            first, last, flight.edb.record_count);
+        exitcode = 1;
+        goto exit;
+    }
+    job->next = first;
+    job->last = last;
+
+    for(i = 0; i < job->column_count; i++) {
+        column = &job->columns[i];
+        snprintf(path, sizeof(path), "%s/%s.%s", out_dir, column->name,
+            format == FORMAT_NPY ? "npy" : "bin");
+        column->file = fopen(path, "wb");
+        column->buffer = malloc(COLUMN_BUFFER_SIZE);
+        if(!column->file || !column->buffer) {
+            fprintf(stderr, "ERROR: Unable to create %s\n", path);
+            exitcode = 1;
+            goto exit;
+        }
+        if(format == FORMAT_NPY && npy_header(column)) {
+            fprintf(stderr, "ERROR: Problem writing %s\n", path);
+            exitcode = 1;
+            goto exit;
+        }
+    }
+
+    if(!job->column_count) {
+        exitcode = open_arrow(out_dir, job, format, include_waveforms);
+        if(exitcode)
+            goto exit;
+    }
+
+    // Offsets start at zero, so there is one more offset than waveforms
+    if(job->column_count == COL_COUNT) {
+        column = &job->columns[COL_WAVEFORM_OFFSETS];
+        column_put_uint(column, 0, 8);
+        column->rows = 1;
+    }
+
+    pipeline.next = &export_next;
+    pipeline.output =
+        job->column_count ? &export_output : &export_output_arrow;
+    pipeline.ctx = job;
+    pipeline.threads = threads;
+    pipeline.include_pulses = 1;
+    pipeline.include_waveforms = include_waveforms;
+
+    err = eaarlio_pipeline_run(&flight, &pipeline);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem exporting rasters");
+    if(exitcode)
+        goto exit;
+
+    for(i = 0; i < job->column_count; i++) {
+        column = &job->columns[i];
+        if(column_flush(column)
+            || (format == FORMAT_NPY && npy_header(column))) {
+            fprintf(stderr, "ERROR: Problem writing %s\n", column->name);
+            exitcode = 1;
+            goto exit;
+        }
+    }
+
+    if(job->arrow.internal) {
+        err = eaarlio_arrow_writer_close(&job->arrow);
+        exitcode = eaarlio_error_check(err, "ERROR: Problem writing Arrow");
+        if(exitcode)
+            goto exit;
+    }
+
+    if(format == FORMAT_RAW)
+        exitcode = write_schema(out_dir, job);
+
+exit:
+    if(job->arrow.internal)
+        eaarlio_arrow_writer_close(&job->arrow);
+    if(job->stream.close && job->stream.close(&job->stream) && !exitcode) {
+        fprintf(stderr, "ERROR: Problem closing Arrow output\n");
+        exitcode = 1;
+    }
+    for(i = 0; i < job->column_count; i++) {
+        column = &job->columns[i];
+        if(column->file && fclose(column->file) && !exitcode) {
+            fprintf(stderr, "ERROR: Problem closing %s\n", column->name);
+            exitcode = 1;
+        }
+        free(column->buffer);
+    }
+    free(job);
+    eaarlio_flight_free(&flight);
+    return exitcode;
+}
+
+/* Parse a raster range of the form first:last
+ *
+ * Returns 0 on success, 1 if the text is not a valid range.
+ */
+int parse_range(char const *text, uint32_t *first, uint32_t *last)
+{
+    unsigned long value;
+    char *end;
+
+    if(*text < '0' || *text > '9')
+        return 1;
+    errno = 0;
+    value = strtoul(text, &end, 10);
+    if(errno || value < 1 || value > UINT32_MAX || *end != ':')
+        return 1;
+    *first = (uint32_t)value;
+
+    text = end + 1;
+    if(*text < '0' || *text > '9')
+        return 1;
+    value = strtoul(text, &end, 10);
+    if(errno || value < *first || value > UINT32_MAX || *end)
+        return 1;
+    *last = (uint32_t)value;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0;
+    char progname[] = "eaarlio_export";
+    char *tld_path = NULL;
+    int tld_path_free = 0;
+    int format = FORMAT_RAW;
+    uint32_t first = 1, last = 0;
+    size_t len;
+
+    struct arg_lit *help, *version, *nowf;
+    struct arg_file *edb, *tld, *outdir;
+    struct arg_str *fmt, *range;
+    struct arg_int *threads;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        fmt = arg_str0("f", "format", "<raw|npy|arrow|arrows>",
+            "write raw little-endian columns (default), NumPy .npy files, "
+            "or an Arrow IPC file or stream"),
+        range = arg_str0("r", "range", "<first:last>",
+            "export only these rasters (default: all)"),
+        nowf = arg_litn(
+            "W", "no-waveforms", 0, 1, "do not export waveform data"),
+        threads = arg_int0("j", "threads", "<n>",
+            "decode rasters on n threads (default 0, one per CPU)"),
+        tld = arg_file0("t", "tld", "<tld path>", "path to the TLD files"),
+        edb = arg_filen(NULL, NULL, "<edb file>", 1, 1, "EDB file for dataset"),
+        outdir = arg_filen(NULL, NULL, "<output dir>", 1, 1,
+            "existing directory to write the columns to"),
+        end = arg_end(20),
+    };
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    threads->ival[0] = 0;
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Export pulses as binary columns.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "Each pulse field is written to its own file of fixed-width "
+            "values, one per\n"
+            "pulse, in raster and pulse order. These can be memory-mapped or "
+            "loaded directly\n"
+            "by other tools. Raw files are little-endian and are described "
+            "by columns.txt.\n"
+            "\n"
+            "Waveform samples are written back to back to the waveforms "
+            "file. Each pulse\n"
+            "has five waveforms (the transmit waveform, then four return "
+            "channels), and the\n"
+            "waveform_offsets file holds one more offset than there are "
+            "waveforms, so that\n"
+            "waveform k spans samples waveform_offsets[k] up to "
+            "waveform_offsets[k + 1].\n"
+            "\n"
+            "The arrow and arrows formats instead write a single file, "
+            "pulses.arrow or\n"
+            "pulses.arrows, with one row per pulse and the waveforms in "
+            "list columns.\n"
+            "\n"
+            "Existing files in the output directory are overwritten.\n");
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0) {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(fmt->count > 0) {
+        if(!strcmp(fmt->sval[0], "npy")) {
+            format = FORMAT_NPY;
+        } else if(!strcmp(fmt->sval[0], "arrow")) {
+            format = FORMAT_ARROW;
+        } else if(!strcmp(fmt->sval[0], "arrows")) {
+            format = FORMAT_ARROW_STREAM;
+        } else if(strcmp(fmt->sval[0], "raw")) {
+            fprintf(stderr, "%s: unknown format: %s\n", progname,
+                fmt->sval[0]);
+            exitcode = 1;
+            goto exit;
+        }
+    }
+
+    if(range->count > 0 && parse_range(range->sval[0], &first, &last)) {
+        fprintf(stderr, "%s: invalid range: %s\n", progname, range->sval[0]);
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(threads->ival[0] < 0) {
+        fprintf(stderr, "%s: thread count must not be negative\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    len = strlen(edb->filename[0]) - strlen(edb->basename[0]);
+    if(tld->count > 0) {
+        tld_path = (char *)tld->filename[0];
+    } else if(len > 0) {
+        tld_path_free = 1;
+        tld_path = calloc(len + 1, sizeof(char));
+        if(!tld_path) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+        memcpy(tld_path, edb->filename[0], len);
+    } else {
+        tld_path = ".";
+    }
+
+    exitcode = export_flight(edb->filename[0], tld_path, outdir->filename[0],
+        format, first, last, nowf->count == 0, (uint32_t)threads->ival[0]);
+
+exit:
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    if(tld_path_free && tld_path)
+        free(tld_path);
+    return exitcode;
+}
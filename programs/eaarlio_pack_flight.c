@@ -0,0 +1,209 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/pack.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/version.h"
+
+/**
+ * Check if a file exists
+ *
+ * @param[in] fn Path to the file
+ *
+ * @returns 1 if @p fn can be opened for reading, 0 otherwise
+ */
+int file_exists(char const *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    if(!f)
+        return 0;
+    fclose(f);
+    return 1;
+}
+
+/**
+ * Write a flight pack from an EDB file and its TLD files
+ *
+ * @param[in] edb_file Path to the EDB file
+ * @param[in] tld_path Path to the TLD files
+ * @param[in] pack_file Path to the pack file to create
+ * @param[in] verbose Report the size of the pack?
+ *
+ * @returns 0 on success, 1 on failure
+ */
+int pack_flight(char const *edb_file,
+    char const *tld_path,
+    char const *pack_file,
+    int verbose)
+{
+    struct eaarlio_edb edb = eaarlio_edb_empty();
+    struct eaarlio_tld_opener opener = eaarlio_tld_opener_empty();
+    struct eaarlio_stream in = eaarlio_stream_empty();
+    struct eaarlio_stream out = eaarlio_stream_empty();
+    eaarlio_error err;
+    int64_t size;
+    int exitcode = 0;
+
+    err = eaarlio_file_stream(&in, edb_file, "r");
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to open %s", edb_file);
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_edb_read(&in, &edb, NULL, 1, 1);
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to read %s", edb_file);
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_file_tld_opener(&opener, tld_path, NULL);
+    exitcode = eaarlio_error_check(
+        err, "ERROR: Unable to use TLD path %s", tld_path);
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_file_stream(&out, pack_file, "w");
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to open %s", pack_file);
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_pack_write(&out, &edb, &opener, NULL);
+    exitcode =
+        eaarlio_error_check(err, "ERROR: Problem writing %s", pack_file);
+    if(exitcode)
+        goto exit;
+
+    if(verbose) {
+        err = out.tell(&out, &size);
+        if(err == EAARLIO_SUCCESS)
+            printf("%s: %" PRIu32 " TLD files, %" PRIu32
+                   " rasters, %" PRIi64 " bytes\n",
+                pack_file, edb.file_count, edb.record_count, size);
+    }
+
+    err = out.close(&out);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem closing %s", pack_file);
+    if(exitcode)
+        goto exit;
+
+exit:
+    if(in.close)
+        in.close(&in);
+    if(out.close) {
+        out.close(&out);
+        remove(pack_file);
+    }
+    if(opener.close)
+        opener.close(&opener);
+    eaarlio_edb_free(&edb, NULL);
+    return exitcode;
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0;
+    char progname[] = "eaarlio_pack_flight";
+    char *tld_path = NULL;
+    int tld_path_free = 0;
+    size_t len;
+
+    struct arg_lit *help, *version, *verbose, *force;
+    struct arg_file *edb, *tld, *outfile;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        verbose =
+            arg_litn("v", "verbose", 0, 1, "display the size of the pack"),
+        force = arg_litn("f", "force", 0, 1, "overwrite an existing pack"),
+        tld = arg_file0("t", "tld", "<tld path>", "path to the TLD files"),
+        edb = arg_filen(NULL, NULL, "<edb file>", 1, 1, "EDB file for dataset"),
+        outfile = arg_filen(NULL, NULL, "<pack file>", 1, 1, "pack to create"),
+        end = arg_end(20),
+    };
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Pack an EAARL flight into a single file.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "The EDB file and every TLD file it refers to are stored together "
+            "in one pack\n"
+            "file, which can then be opened in place of the EDB file. Reading "
+            "a pack needs\n"
+            "only a single open file, which is much faster on network "
+            "filesystems and\n"
+            "object stores than opening each TLD file separately.\n"
+            "\n"
+            "The TLD files are looked up in the directory of the EDB file "
+            "unless --tld is\n"
+            "given. Compressed TLD files are stored uncompressed.\n");
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0) {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(!force->count && file_exists(outfile->filename[0])) {
+        fprintf(stderr,
+            "ERROR: %s already exists, use --force to overwrite it\n",
+            outfile->filename[0]);
+        exitcode = 1;
+        goto exit;
+    }
+
+    len = strlen(edb->filename[0]) - strlen(edb->basename[0]);
+    if(tld->count > 0) {
+        tld_path = (char *)tld->filename[0];
+    } else if(len > 0) {
+        tld_path_free = 1;
+        tld_path = calloc(len + 1, sizeof(char));
+        if(!tld_path) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+        memcpy(tld_path, edb->filename[0], len);
+    } else {
+        tld_path = ".";
+    }
+
+    exitcode = pack_flight(
+        edb->filename[0], tld_path, outfile->filename[0], verbose->count);
+
+exit:
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    if(tld_path_free && tld_path)
+        free(tld_path);
+    return exitcode;
+}
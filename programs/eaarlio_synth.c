@@ -0,0 +1,547 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight_writer.h"
+#include "eaarlio/pulse.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/tld.h"
+#include "eaarlio/units.h"
+#include "eaarlio/version.h"
+
+/** Largest return waveform length accepted */
+#define MAX_RX_LEN 16000
+
+/** Largest TLD file size accepted, in MiB; the EDB uses 32-bit offsets */
+#define MAX_FILE_SIZE 4095
+
+/**
+ * Parameters for the synthetic flight
+ */
+struct synth {
+    /** Number of rasters to generate */
+    uint32_t raster_count;
+    /** Pulses per raster */
+    uint16_t pulse_count;
+    /** Return waveforms per pulse */
+    uint8_t rx_count;
+    /** Transmit waveform length */
+    uint8_t tx_len;
+    /** Shortest return waveform length */
+    uint16_t rx_min;
+    /** Longest return waveform length */
+    uint16_t rx_max;
+    /** Size at which to start a new TLD file, in bytes */
+    uint64_t file_size;
+    /** Time of the first raster, in seconds of the epoch */
+    uint32_t start;
+    /** Rasters per second */
+    double rate;
+    /** Seconds added to the EDB times, as eaarlio_edb_offset would */
+    int32_t time_offset;
+    /** Write waveform-packed records? */
+    int wfpack;
+    /** Report each TLD file as it is finished? */
+    int verbose;
+    /** State of the random number generator */
+    uint32_t seed;
+};
+
+/**
+ * Check if a file exists
+ *
+ * @param[in] fn Path to the file
+ *
+ * @returns 1 if @p fn can be opened for reading, 0 otherwise
+ */
+int file_exists(char const *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    if(!f)
+        return 0;
+    fclose(f);
+    return 1;
+}
+
+/**
+ * Returns the next value from a linear congruential generator
+ *
+ * This is not a good generator, but it is fast, and it gives the same flight
+ * for the same seed on every platform.
+ */
+uint32_t synth_random(struct synth *synth)
+{
+    synth->seed = synth->seed * 1103515245U + 12345U;
+    return synth->seed >> 8;
+}
+
+/**
+ * Parse a length or range of lengths
+ *
+ * @param[in] text Either "len" or "min:max"
+ * @param[out] min Shortest length
+ * @param[out] max Longest length
+ *
+ * @returns 1 on success, 0 if @p text is not valid
+ */
+int parse_len(char const *text, uint32_t *min, uint32_t *max)
+{
+    char *end;
+    unsigned long a, b;
+
+    a = strtoul(text, &end, 10);
+    if(end == text)
+        return 0;
+    b = a;
+    if(*end == ':') {
+        text = end + 1;
+        b = strtoul(text, &end, 10);
+        if(end == text)
+            return 0;
+    }
+    if(*end || a > b || b > MAX_RX_LEN)
+        return 0;
+
+    *min = (uint32_t)a;
+    *max = (uint32_t)b;
+    return 1;
+}
+
+/**
+ * Allocate a raster large enough for any the flight will contain
+ *
+ * The waveform buffers are allocated once at their largest sizes and reused
+ * for every raster.
+ *
+ * @returns 0 on success, 1 on failure
+ */
+int synth_raster_alloc(struct synth *synth, struct eaarlio_raster *raster)
+{
+    struct eaarlio_pulse *pulse;
+    uint16_t i;
+    uint8_t j;
+
+    raster->pulse = calloc(synth->pulse_count, sizeof(struct eaarlio_pulse));
+    if(!raster->pulse)
+        return 1;
+    raster->pulse_count = synth->pulse_count;
+
+    for(i = 0; i < synth->pulse_count; i++) {
+        pulse = &raster->pulse[i];
+        // The encoder requires buffers even for empty waveforms
+        pulse->tx = malloc(synth->tx_len ? synth->tx_len : 1);
+        if(!pulse->tx)
+            return 1;
+        for(j = 0; j < synth->rx_count; j++) {
+            pulse->rx[j] = malloc(synth->rx_max ? synth->rx_max : 1);
+            if(!pulse->rx[j])
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Release a raster from synth_raster_alloc
+ */
+void synth_raster_free(struct eaarlio_raster *raster)
+{
+    uint16_t i;
+    uint8_t j;
+
+    if(!raster->pulse)
+        return;
+    for(i = 0; i < raster->pulse_count; i++) {
+        free(raster->pulse[i].tx);
+        for(j = 0; j < EAARLIO_MAX_RX_COUNT; j++)
+            free(raster->pulse[i].rx[j]);
+    }
+    free(raster->pulse);
+    raster->pulse = NULL;
+}
+
+/**
+ * Fill a waveform with a noisy baseline and a single return
+ *
+ * EAARL waveforms are inverted: the baseline sits near 255 and a return is a
+ * dip below it.
+ */
+void synth_waveform(struct synth *synth,
+    unsigned char *wf,
+    uint16_t len,
+    uint16_t peak,
+    uint8_t depth)
+{
+    uint16_t i, dist;
+    int value;
+
+    for(i = 0; i < len; i++) {
+        value = 245 + (int)(synth_random(synth) % 5);
+        dist = i > peak ? i - peak : peak - i;
+        if(dist < 4)
+            value -= depth >> dist;
+        wf[i] = (unsigned char)(value < 0 ? 0 : value);
+    }
+}
+
+/**
+ * Fill a raster with synthetic data
+ *
+ * The scanner sweeps from -26.55 to 26.55 degrees across each raster, with
+ * the pulses evenly spaced over the raster's period.
+ */
+void synth_raster_fill(
+    struct synth *synth, struct eaarlio_raster *raster, uint32_t index)
+{
+    struct eaarlio_pulse *pulse;
+    double t, period;
+    uint16_t i, rx_len, peak;
+    uint8_t j, depth;
+
+    t = index / synth->rate;
+    period = 1.0 / synth->rate;
+
+    raster->time_seconds = synth->start + (uint32_t)t;
+    raster->time_fraction = (uint32_t)(
+        (t - (uint32_t)t) / EAARLIO_UNITS_TIME_FRACTION_SECONDS);
+    raster->sequence_number = index + 1;
+    raster->digitizer = index % 2;
+
+    for(i = 0; i < raster->pulse_count; i++) {
+        pulse = &raster->pulse[i];
+
+        pulse->time_offset = (uint32_t)(period * i / raster->pulse_count
+            / EAARLIO_UNITS_TIME_FRACTION_SECONDS);
+        pulse->rx_count = synth->rx_count;
+        pulse->scan_angle_counts = (int16_t)(raster->pulse_count > 1
+                ? -590 + 1180 * i / (raster->pulse_count - 1)
+                : 0);
+        pulse->range = (uint16_t)(1800 + synth_random(synth) % 400);
+        pulse->thresh_tx = 0;
+        pulse->thresh_rx = synth_random(synth) % 64 == 0;
+        pulse->bias_tx = 0;
+
+        pulse->tx_len = synth->tx_len;
+        if(pulse->tx_len)
+            synth_waveform(synth, pulse->tx, pulse->tx_len,
+                pulse->tx_len / 3, 200);
+
+        rx_len = synth->rx_min;
+        if(synth->rx_max > synth->rx_min)
+            rx_len += synth_random(synth) % (synth->rx_max - synth->rx_min + 1);
+        peak = rx_len ? (uint16_t)(synth_random(synth) % rx_len) : 0;
+        depth = (uint8_t)(40 + synth_random(synth) % 160);
+
+        for(j = 0; j < EAARLIO_MAX_RX_COUNT; j++) {
+            pulse->bias_rx[j] = 0;
+            pulse->rx_len[j] = j < pulse->rx_count ? rx_len : 0;
+            if(pulse->rx_len[j])
+                synth_waveform(synth, pulse->rx[j], rx_len, peak, depth);
+            // Each channel is less sensitive than the one before
+            depth >>= 1;
+        }
+    }
+}
+
+/**
+ * Generate the name of a TLD file from the time of its first raster
+ *
+ * The names follow the EAARL convention of YYMMDD-HHMMSS.tld in UTC.
+ */
+void synth_tld_name(char *name, size_t len, uint32_t time_seconds)
+{
+    time_t t = (time_t)time_seconds;
+    struct tm *tm = gmtime(&t);
+
+    if(!tm || !strftime(name, len, "%y%m%d-%H%M%S.tld", tm))
+        snprintf(name, len, "%" PRIu32 ".tld", time_seconds);
+}
+
+/**
+ * Generate a synthetic flight
+ *
+ * @param[in] synth Parameters for the flight
+ * @param[in] edb_file Path of the EDB file to create
+ * @param[in] tld_path Directory to create the TLD files in
+ *
+ * @returns 0 on success, 1 on failure
+ */
+int synth_flight(
+    struct synth *synth, char const *edb_file, char const *tld_path)
+{
+    struct eaarlio_flight_writer writer = eaarlio_flight_writer_empty();
+    struct eaarlio_raster raster = eaarlio_raster_empty();
+    struct eaarlio_edb_record *record;
+    eaarlio_error err;
+    uint64_t file_bytes = 0, total_bytes = 0;
+    uint32_t i, raster_number, name_seconds = 0;
+    char name[32];
+    int exitcode = 0, open = 0;
+
+    if(synth_raster_alloc(synth, &raster)) {
+        fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    err = eaarlio_flight_writer_init(
+        &writer, 0, NULL, EAARLIO_TLD_SYNC_NEVER, NULL);
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to start writing");
+    if(exitcode)
+        goto exit;
+    open = 1;
+
+    if(synth->wfpack) {
+        err = eaarlio_flight_writer_set_record_type(
+            &writer, EAARLIO_TLD_TYPE_RASTER_WFPACK);
+        exitcode = eaarlio_error_check(err, "ERROR: Unable to use wfpack");
+        if(exitcode)
+            goto exit;
+    }
+
+    for(i = 0; i < synth->raster_count; i++) {
+        synth_raster_fill(synth, &raster, i);
+
+        if(i == 0 || file_bytes >= synth->file_size) {
+            if(i > 0 && synth->verbose)
+                printf("%s: %" PRIu64 " bytes\n", name, file_bytes);
+
+            // Files started within the same second still need unique names
+            if(i > 0 && raster.time_seconds <= name_seconds)
+                name_seconds++;
+            else
+                name_seconds = raster.time_seconds;
+            synth_tld_name(name, sizeof(name), name_seconds);
+
+            err = eaarlio_file_flight_writer_open_tld(&writer, tld_path, name);
+            exitcode = eaarlio_error_check(
+                err, "ERROR: Unable to create %s/%s", tld_path, name);
+            if(exitcode)
+                goto exit;
+            file_bytes = 0;
+        }
+
+        err = eaarlio_flight_writer_write_raster(
+            &writer, &raster, &raster_number);
+        exitcode = eaarlio_error_check(
+            err, "ERROR: Unable to write raster %" PRIu32, i + 1);
+        if(exitcode)
+            goto exit;
+
+        // The EDB times carry the offset, but the TLD times do not; this is
+        // the situation eaarlio_edb_offset is used to detect and correct
+        record = &writer.edb.records[raster_number - 1];
+        record->time_seconds += synth->time_offset;
+        file_bytes = (uint64_t)record->record_offset + record->record_length;
+        total_bytes += record->record_length;
+    }
+
+    if(synth->verbose && synth->raster_count)
+        printf("%s: %" PRIu64 " bytes\n", name, file_bytes);
+
+    open = 0;
+    err = eaarlio_file_flight_writer_close(&writer, edb_file);
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to write %s", edb_file);
+    if(exitcode)
+        goto exit;
+
+    if(synth->verbose)
+        printf("%s: %" PRIu32 " rasters, %" PRIu64 " bytes of TLD data\n",
+            edb_file, synth->raster_count, total_bytes);
+
+exit:
+    if(open)
+        eaarlio_flight_writer_close(&writer, NULL);
+    synth_raster_free(&raster);
+    return exitcode;
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0;
+    char progname[] = "eaarlio_synth";
+    char *tld_path = NULL;
+    int tld_path_free = 0;
+    struct synth synth;
+    uint32_t min, max;
+    size_t len;
+
+    struct arg_lit *help, *version, *verbose, *force, *wfpack;
+    struct arg_int *rasters, *pulses, *rx_count, *tx_len, *file_size;
+    struct arg_int *start, *time_offset, *seed;
+    struct arg_dbl *rate;
+    struct arg_str *rx_len;
+    struct arg_file *edb, *tld;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        verbose = arg_litn(
+            "v", "verbose", 0, 1, "display each file as it is written"),
+        force = arg_litn("f", "force", 0, 1, "overwrite an existing EDB file"),
+        rasters = arg_int0("n", "rasters", "<n>",
+            "number of rasters to generate (default 10000)"),
+        pulses =
+            arg_int0("p", "pulses", "<n>", "pulses per raster (default 119)"),
+        rx_count = arg_int0(
+            "x", "rx-count", "<n>", "return waveforms per pulse (default 4)"),
+        tx_len = arg_int0(
+            NULL, "tx-len", "<len>", "transmit waveform length (default 12)"),
+        rx_len = arg_str0(NULL, "rx-len", "<min[:max]>",
+            "return waveform length or range of lengths (default 40:120)"),
+        file_size = arg_int0("F", "file-size", "<MiB>",
+            "start a new TLD file after this many MiB (default 256)"),
+        start = arg_int0("T", "start", "<seconds>",
+            "time of the first raster, in seconds of the epoch"),
+        rate = arg_dbl0(
+            "r", "rate", "<hz>", "rasters per second (default 20)"),
+        time_offset = arg_int0("o", "time-offset", "<seconds>",
+            "offset of the EDB times from the TLD times (default 0)"),
+        wfpack = arg_litn("P", "wfpack", 0, 1,
+            "write waveform-packed raster records"),
+        seed = arg_int0(
+            "s", "seed", "<n>", "seed for the generated data (default 1)"),
+        tld = arg_file0("t", "tld", "<tld path>",
+            "directory to write the TLD files to"),
+        edb = arg_filen(NULL, NULL, "<edb file>", 1, 1, "EDB file to create"),
+        end = arg_end(20),
+    };
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    rasters->ival[0] = 10000;
+    pulses->ival[0] = 119;
+    rx_count->ival[0] = 4;
+    tx_len->ival[0] = 12;
+    rx_len->sval[0] = "40:120";
+    file_size->ival[0] = 256;
+    start->ival[0] = 1000000000;
+    rate->dval[0] = 20.0;
+    time_offset->ival[0] = 0;
+    seed->ival[0] = 1;
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Generate a synthetic EAARL flight.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "Writes TLD files filled with synthetic rasters, and the EDB file "
+            "that indexes\n"
+            "them. The data is not meaningful, but it has the structure and "
+            "size of real\n"
+            "data, which makes it suitable for benchmarks and for testing "
+            "with flights of\n"
+            "any size. The same options and seed always give the same "
+            "flight.\n"
+            "\n"
+            "The TLD files are named for the time of their first raster and "
+            "are written to\n"
+            "the directory of the EDB file unless --tld is given. TLD files "
+            "with the same\n"
+            "names are overwritten. With the defaults, each raster is about "
+            "42 KB of TLD\n"
+            "data.\n");
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0) {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    memset(&synth, 0, sizeof(synth));
+    exitcode = 1;
+    if(rasters->ival[0] < 0) {
+        fprintf(stderr, "ERROR: Raster count must not be negative\n");
+    } else if(pulses->ival[0] < 0 || pulses->ival[0] > 32767) {
+        fprintf(stderr, "ERROR: Pulse count must be between 0 and 32767\n");
+    } else if(rx_count->ival[0] < 0
+        || rx_count->ival[0] > EAARLIO_MAX_RX_COUNT) {
+        fprintf(stderr, "ERROR: Return count must be between 0 and %d\n",
+            EAARLIO_MAX_RX_COUNT);
+    } else if(tx_len->ival[0] < 0 || tx_len->ival[0] > 255) {
+        fprintf(stderr, "ERROR: Transmit length must be between 0 and 255\n");
+    } else if(!parse_len(rx_len->sval[0], &min, &max)) {
+        fprintf(stderr,
+            "ERROR: Invalid return length: %s (lengths must be at most %d)\n",
+            rx_len->sval[0], MAX_RX_LEN);
+    } else if(file_size->ival[0] < 1 || file_size->ival[0] > MAX_FILE_SIZE) {
+        fprintf(stderr, "ERROR: File size must be between 1 and %d MiB\n",
+            MAX_FILE_SIZE);
+    } else if(!(rate->dval[0] >= 1.0)) {
+        fprintf(stderr, "ERROR: Rate must be at least 1 raster per second\n");
+    } else if(!force->count && file_exists(edb->filename[0])) {
+        fprintf(stderr,
+            "ERROR: %s already exists, use --force to overwrite it\n",
+            edb->filename[0]);
+    } else {
+        exitcode = 0;
+    }
+    if(exitcode)
+        goto exit;
+
+    synth.raster_count = (uint32_t)rasters->ival[0];
+    synth.pulse_count = (uint16_t)pulses->ival[0];
+    synth.rx_count = (uint8_t)rx_count->ival[0];
+    synth.tx_len = (uint8_t)tx_len->ival[0];
+    synth.rx_min = (uint16_t)min;
+    synth.rx_max = (uint16_t)max;
+    synth.file_size = (uint64_t)file_size->ival[0] * 1048576;
+    synth.start = (uint32_t)start->ival[0];
+    synth.rate = rate->dval[0];
+    synth.time_offset = time_offset->ival[0];
+    synth.wfpack = wfpack->count;
+    synth.verbose = verbose->count;
+    synth.seed = (uint32_t)seed->ival[0];
+
+    len = strlen(edb->filename[0]) - strlen(edb->basename[0]);
+    if(tld->count > 0) {
+        tld_path = (char *)tld->filename[0];
+    } else if(len > 0) {
+        tld_path_free = 1;
+        tld_path = calloc(len + 1, sizeof(char));
+        if(!tld_path) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+        memcpy(tld_path, edb->filename[0], len);
+    } else {
+        tld_path = ".";
+    }
+
+    exitcode = synth_flight(&synth, edb->filename[0], tld_path);
+
+exit:
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    if(tld_path_free && tld_path)
+        free(tld_path);
+    return exitcode;
+}
@@ -0,0 +1,313 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/compressed_stream.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/version.h"
+
+/** Size of the buffer used to copy data when decompressing */
+#define COPY_BUFFER_SIZE 1048576
+
+/**
+ * Check if a file exists
+ *
+ * @param[in] fn Path to the file
+ *
+ * @returns 1 if @p fn can be opened for reading, 0 otherwise
+ */
+int file_exists(char const *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    if(!f)
+        return 0;
+    fclose(f);
+    return 1;
+}
+
+/**
+ * Determine the output file name for an input file
+ *
+ * @param[in] infile Input file name
+ * @param[in] decompress Is the input compressed?
+ *
+ * @returns A newly allocated file name, or @c NULL if @p infile does not have
+ *      the compressed suffix when decompressing or memory cannot be allocated
+ */
+char *output_name(char const *infile, int decompress)
+{
+    size_t len = strlen(infile);
+    size_t suffix_len = strlen(EAARLIO_COMPRESSED_SUFFIX);
+    char *outfile;
+
+    if(decompress) {
+        if(len <= suffix_len
+            || strcmp(infile + len - suffix_len, EAARLIO_COMPRESSED_SUFFIX))
+            return NULL;
+        outfile = malloc(len - suffix_len + 1);
+        if(!outfile)
+            return NULL;
+        memcpy(outfile, infile, len - suffix_len);
+        outfile[len - suffix_len] = '\0';
+    } else {
+        outfile = malloc(len + suffix_len + 1);
+        if(!outfile)
+            return NULL;
+        strcpy(outfile, infile);
+        strcat(outfile, EAARLIO_COMPRESSED_SUFFIX);
+    }
+
+    return outfile;
+}
+
+/**
+ * Copy the uncompressed contents of a compressed stream to another stream
+ *
+ * @param[in,out] out Destination stream
+ * @param[in,out] in Compressed stream, from ::eaarlio_compressed_stream
+ * @param[in] buffer Work buffer of ::COPY_BUFFER_SIZE bytes
+ *
+ * @returns_eaarlio_error
+ */
+eaarlio_error decompress_stream(struct eaarlio_stream *out,
+    struct eaarlio_stream *in,
+    unsigned char *buffer)
+{
+    eaarlio_error err;
+    int64_t size, pos = 0;
+    uint64_t len;
+
+    err = in->seek(in, 0, SEEK_END);
+    if(err == EAARLIO_SUCCESS)
+        err = in->tell(in, &size);
+    if(err == EAARLIO_SUCCESS)
+        err = in->seek(in, 0, SEEK_SET);
+
+    while(err == EAARLIO_SUCCESS && pos < size) {
+        len = (uint64_t)(size - pos);
+        if(len > COPY_BUFFER_SIZE)
+            len = COPY_BUFFER_SIZE;
+        err = in->read(in, len, buffer);
+        if(err == EAARLIO_SUCCESS)
+            err = out->write(out, len, buffer);
+        pos += (int64_t)len;
+    }
+
+    return err;
+}
+
+/**
+ * Compress or decompress a single file
+ *
+ * @returns 0 on success, 1 on failure
+ */
+int process_file(char const *infile,
+    uint32_t block_size,
+    int decompress,
+    int force,
+    unsigned char *buffer,
+    int verbose)
+{
+    struct eaarlio_stream in = eaarlio_stream_empty();
+    struct eaarlio_stream out = eaarlio_stream_empty();
+    struct eaarlio_stream compressed = eaarlio_stream_empty();
+    eaarlio_error err;
+    char *outfile = NULL;
+    int64_t in_size = 0, out_size = 0;
+    int exitcode = 0;
+
+    outfile = output_name(infile, decompress);
+    if(!outfile) {
+        if(decompress)
+            fprintf(stderr, "ERROR: %s does not end with %s\n", infile,
+                EAARLIO_COMPRESSED_SUFFIX);
+        else
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(!force && file_exists(outfile)) {
+        fprintf(stderr,
+            "ERROR: %s already exists, use --force to overwrite it\n",
+            outfile);
+        exitcode = 1;
+        goto exit;
+    }
+
+    err = eaarlio_file_stream(&in, infile, "r");
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to open %s", infile);
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_file_stream(&out, outfile, "w");
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to open %s", outfile);
+    if(exitcode)
+        goto exit;
+
+    if(decompress) {
+        err = eaarlio_compressed_stream(&compressed, &in, NULL);
+        exitcode = eaarlio_error_check(
+            err, "ERROR: %s is not a valid compressed file", infile);
+        if(exitcode)
+            goto exit;
+        err = decompress_stream(&out, &compressed, buffer);
+    } else {
+        err = eaarlio_compress_stream(&out, &in, block_size, NULL);
+    }
+    exitcode = eaarlio_error_check(
+        err, "ERROR: Problem writing %s from %s", outfile, infile);
+    if(exitcode)
+        goto exit;
+
+    if(verbose) {
+        if(decompress)
+            err = compressed.tell(&compressed, &in_size);
+        else
+            err = in.tell(&in, &in_size);
+        if(err == EAARLIO_SUCCESS)
+            err = out.tell(&out, &out_size);
+        if(err == EAARLIO_SUCCESS)
+            printf("%s: %" PRIi64 " -> %" PRIi64 " bytes (%.1f%%)\n", infile,
+                in_size, out_size,
+                in_size ? 100.0 * (double)out_size / (double)in_size : 100.0);
+    }
+
+    err = out.close(&out);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem closing %s", outfile);
+    if(exitcode)
+        goto exit;
+
+exit:
+    if(compressed.close)
+        compressed.close(&compressed);
+    if(in.close)
+        in.close(&in);
+    if(out.close) {
+        out.close(&out);
+        remove(outfile);
+    }
+    if(outfile)
+        free(outfile);
+    return exitcode;
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0, i;
+    char progname[] = "eaarlio_tld_compress";
+    unsigned char *buffer = NULL;
+
+    struct arg_lit *help, *version, *verbose, *decompress, *force;
+    struct arg_int *block_size;
+    struct arg_file *infiles;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        verbose = arg_litn("v", "verbose", 0, 1,
+            "display the size of each file processed"),
+        decompress = arg_litn("d", "decompress", 0, 1,
+            "restore the original files from compressed files"),
+        force = arg_litn("f", "force", 0, 1, "overwrite existing output files"),
+        block_size = arg_int0("b", "block-size", "<bytes>",
+            "uncompressed size of each block, default is 65536"),
+        infiles = arg_filen(
+            NULL, NULL, "<tld file>", 1, 1000, "TLD files to process"),
+        end = arg_end(20),
+    };
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    /* Defaults */
+    block_size->ival[0] = EAARLIO_COMPRESSED_BLOCK_SIZE;
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0 || infiles->count == 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Compress EAARL TLD files for random access.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "Each TLD file is compressed to a file of the same name with "
+            "\"" EAARLIO_COMPRESSED_SUFFIX "\" appended.\n"
+            "The original files are left in place.\n"
+            "\n"
+            "The compressed files store the data in independently compressed "
+            "blocks, so\n"
+            "any raster can be read without decompressing the whole file. "
+            "A flight whose\n"
+            "TLD files are opened with eaarlio_file_compressed_tld_opener "
+            "uses a compressed\n"
+            "file in place of a missing TLD file, and the existing EDB file "
+            "remains valid.\n"
+            "The original TLD files can then be removed.\n"
+            "\n"
+            "Smaller blocks make reading individual rasters faster; larger "
+            "blocks compress\n"
+            "slightly better. The block size may be at most %u bytes.\n"
+            "\n"
+            "With --decompress, the arguments are compressed files and the "
+            "original TLD\n"
+            "files are restored from them.\n",
+            EAARLIO_COMPRESSED_BLOCK_SIZE_MAX);
+
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0) {
+        arg_print_errors(stdout, end, progname);
+        printf("Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(block_size->ival[0] < 1
+        || (uint32_t)block_size->ival[0] > EAARLIO_COMPRESSED_BLOCK_SIZE_MAX) {
+        fprintf(stderr, "ERROR: Block size must be between 1 and %u\n",
+            EAARLIO_COMPRESSED_BLOCK_SIZE_MAX);
+        exitcode = 1;
+        goto exit;
+    }
+
+    buffer = malloc(COPY_BUFFER_SIZE);
+    if(!buffer) {
+        fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    for(i = 0; i < infiles->count; i++) {
+        if(process_file(infiles->filename[i], (uint32_t)block_size->ival[0],
+               decompress->count, force->count, buffer, verbose->count))
+            exitcode = 1;
+    }
+
+exit:
+    if(buffer)
+        free(buffer);
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    return exitcode;
+}
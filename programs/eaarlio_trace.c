@@ -0,0 +1,652 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "argtable3.h"
+
+#include "eaarlio/edb.h"
+#include "eaarlio/error.h"
+#include "eaarlio/file.h"
+#include "eaarlio/flight.h"
+#include "eaarlio/memory_stream.h"
+#include "eaarlio/raster.h"
+#include "eaarlio/stream.h"
+#include "eaarlio/tld_opener.h"
+#include "eaarlio/trace.h"
+#include "eaarlio/version.h"
+
+/* Number of size and distance histogram bins; bin i holds values up to 2^i */
+#define BINS 48
+
+/* Number of trace operations, counting from EAARLIO_TRACE_OPEN */
+#define OP_COUNT 5
+
+/* Number of intervals to use for throughput over time by default */
+#define DEFAULT_INTERVALS 10
+
+/* Names of the trace operations */
+static char const *const op_names[OP_COUNT] = { "open", "read", "seek", "tell",
+    "close" };
+
+/* Totals for one kind of call
+ */
+struct op_summary {
+    /* Calls made */
+    uint64_t count;
+    /* Calls that failed */
+    uint64_t errors;
+    /* Total latency */
+    uint64_t latency_ns;
+    /* Longest latency */
+    uint64_t max_latency_ns;
+};
+
+/* Summary of a trace
+ */
+struct summary {
+    /* Totals for each operation */
+    struct op_summary ops[OP_COUNT];
+    /* Bytes requested by reads */
+    uint64_t bytes;
+    /* Reads by size */
+    uint64_t size_count[BINS];
+    /* Bytes requested by the reads in each of size_count */
+    uint64_t size_bytes[BINS];
+    /* Reads starting where the stream's previous read ended */
+    uint64_t sequential;
+    /* Reads skipping forward, by distance skipped */
+    uint64_t forward[BINS];
+    /* Reads going backward, by distance */
+    uint64_t backward[BINS];
+    /* Reads whose distance from the previous read is not known */
+    uint64_t unknown;
+    /* Streams in the trace */
+    uint32_t streams;
+    /* End of each stream's previous read, or -1; indexed by stream */
+    int64_t *next;
+    /* Allocated length of next */
+    uint32_t next_len;
+    /* Earliest start of a call */
+    uint64_t first_ns;
+    /* Latest end of a call */
+    uint64_t last_ns;
+    /* Successful reads */
+    uint64_t good_reads;
+    /* Latest start of a successful read */
+    uint64_t last_read_ns;
+    /* Records that were not understood */
+    uint64_t invalid;
+};
+
+/* Smallest bin holding value */
+int bin_of(uint64_t value)
+{
+    int bin = 0;
+    while(bin < BINS - 1 && ((uint64_t)1 << bin) < value)
+        bin++;
+    return bin;
+}
+
+/* Format a number of bytes using binary prefixes */
+void format_bytes(char *buf, size_t len, uint64_t bytes)
+{
+    char const *const units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB" };
+    int unit = 0;
+
+    while(unit < 5 && bytes >= 1024 && bytes % 1024 == 0) {
+        bytes /= 1024;
+        unit++;
+    }
+    snprintf(buf, len, "%" PRIu64 " %s", bytes, units[unit]);
+}
+
+/* Open a stream over a trace and check its header */
+int open_trace(struct eaarlio_stream *in,
+    char const *trace_file,
+    struct eaarlio_stream *sink)
+{
+    eaarlio_error err;
+    unsigned char *buf;
+    uint64_t len;
+
+    if(trace_file) {
+        err = eaarlio_file_stream(in, trace_file, "r");
+    } else {
+        err = eaarlio_memory_stream_buffer(sink, &buf, &len);
+        if(!err)
+            err = eaarlio_memory_stream(in, buf, len, "r", NULL);
+    }
+    if(eaarlio_error_check(err, "ERROR: Unable to open trace"))
+        return 1;
+
+    err = eaarlio_trace_read_header(in);
+    if(eaarlio_error_check(err, "ERROR: Not a valid trace")) {
+        in->close(in);
+        return 1;
+    }
+    return 0;
+}
+
+/* Add a record to the summary */
+int summarize_record(struct summary *summary,
+    struct eaarlio_trace_record const *record)
+{
+    struct op_summary *op;
+    int64_t *next;
+    uint64_t end, distance;
+    uint32_t len;
+
+    if(record->op < EAARLIO_TRACE_OPEN || record->op > EAARLIO_TRACE_CLOSE) {
+        summary->invalid++;
+        return 0;
+    }
+
+    op = &summary->ops[record->op - EAARLIO_TRACE_OPEN];
+    op->count++;
+    if(record->error)
+        op->errors++;
+    op->latency_ns += record->latency_ns;
+    if(record->latency_ns > op->max_latency_ns)
+        op->max_latency_ns = record->latency_ns;
+
+    end = record->start_ns + record->latency_ns;
+    if(record->start_ns < summary->first_ns)
+        summary->first_ns = record->start_ns;
+    if(end > summary->last_ns)
+        summary->last_ns = end;
+
+    if(record->stream_id > summary->streams)
+        summary->streams = record->stream_id;
+
+    if(record->stream_id >= summary->next_len) {
+        len = summary->next_len ? summary->next_len : 64;
+        while(len <= record->stream_id && len < UINT32_MAX / 2)
+            len *= 2;
+        if(len <= record->stream_id)
+            return 1;
+        next = realloc(summary->next, len * sizeof(int64_t));
+        if(!next)
+            return 1;
+        while(summary->next_len < len)
+            next[summary->next_len++] = -1;
+        summary->next = next;
+    }
+    next = &summary->next[record->stream_id];
+
+    if(record->op == EAARLIO_TRACE_OPEN) {
+        *next = record->offset;
+        return 0;
+    }
+    if(record->op != EAARLIO_TRACE_READ)
+        return 0;
+
+    if(!record->error) {
+        summary->good_reads++;
+        if(record->start_ns > summary->last_read_ns)
+            summary->last_read_ns = record->start_ns;
+    }
+
+    summary->bytes += record->size;
+    summary->size_count[bin_of(record->size)]++;
+    summary->size_bytes[bin_of(record->size)] += record->size;
+
+    if(*next < 0 || record->offset < 0) {
+        summary->unknown++;
+    } else if(record->offset == *next) {
+        summary->sequential++;
+    } else if(record->offset > *next) {
+        distance = (uint64_t)(record->offset - *next);
+        summary->forward[bin_of(distance)]++;
+    } else {
+        distance = (uint64_t)(*next - record->offset);
+        summary->backward[bin_of(distance)]++;
+    }
+
+    if(record->error || record->offset < 0)
+        *next = -1;
+    else
+        *next = record->offset + (int64_t)record->size;
+
+    return 0;
+}
+
+/* Print the totals for each operation */
+void print_ops(struct summary const *summary)
+{
+    struct op_summary const *op;
+    double seconds;
+    int i;
+
+    printf("%-6s %10s %8s %12s %12s %12s\n", "call", "count", "errors",
+        "total ms", "mean us", "max us");
+    for(i = 0; i < OP_COUNT; i++) {
+        op = &summary->ops[i];
+        if(!op->count)
+            continue;
+        printf("%-6s %10" PRIu64 " %8" PRIu64 " %12.3f %12.3f %12.3f\n",
+            op_names[i], op->count, op->errors, op->latency_ns / 1e6,
+            op->latency_ns / 1e3 / op->count, op->max_latency_ns / 1e3);
+    }
+
+    op = &summary->ops[EAARLIO_TRACE_READ - EAARLIO_TRACE_OPEN];
+    if(op->count) {
+        seconds = op->latency_ns / 1e9;
+        printf("\nread %" PRIu64 " bytes, %.1f bytes per read", summary->bytes,
+            (double)summary->bytes / op->count);
+        if(seconds > 0)
+            printf(", %.2f MB/s while reading", summary->bytes / 1e6 / seconds);
+        printf("\n");
+    }
+}
+
+/* Print the read size histogram */
+void print_sizes(struct summary const *summary)
+{
+    char label[32];
+    int i;
+
+    printf("\n%-14s %10s %14s\n", "read size", "reads", "bytes");
+    for(i = 0; i < BINS; i++) {
+        if(!summary->size_count[i])
+            continue;
+        format_bytes(label, sizeof(label), (uint64_t)1 << i);
+        printf("<= %-11s %10" PRIu64 " %14" PRIu64 "\n", label,
+            summary->size_count[i], summary->size_bytes[i]);
+    }
+}
+
+/* Print the distances between consecutive reads */
+void print_distances(struct summary const *summary)
+{
+    char label[32];
+    int i;
+
+    printf("\n%-24s %10s\n", "distance from last read", "reads");
+    printf("%-24s %10" PRIu64 "\n", "sequential", summary->sequential);
+    for(i = 0; i < BINS; i++) {
+        if(!summary->forward[i])
+            continue;
+        format_bytes(label, sizeof(label), (uint64_t)1 << i);
+        printf("forward  <= %-12s %10" PRIu64 "\n", label,
+            summary->forward[i]);
+    }
+    for(i = 0; i < BINS; i++) {
+        if(!summary->backward[i])
+            continue;
+        format_bytes(label, sizeof(label), (uint64_t)1 << i);
+        printf("backward <= %-12s %10" PRIu64 "\n", label,
+            summary->backward[i]);
+    }
+    if(summary->unknown)
+        printf("%-24s %10" PRIu64 "\n", "unknown", summary->unknown);
+}
+
+/* Print read throughput over time, by reading the trace a second time */
+int print_timeline(struct eaarlio_stream *in,
+    struct summary const *summary,
+    double interval)
+{
+    struct eaarlio_trace_record record;
+    uint64_t *reads = NULL, *bytes = NULL;
+    uint64_t interval_ns, duration;
+    uint64_t count, i;
+    eaarlio_error err;
+
+    if(!summary->good_reads)
+        return 0;
+
+    /* The timeline ends with the bucket holding the last read, rather than
+     * at the end of the trace, so it has no empty bucket at the end
+     */
+    duration = summary->last_read_ns - summary->first_ns;
+    if(interval > 0)
+        interval_ns = (uint64_t)(interval * 1e9);
+    else
+        interval_ns = duration / DEFAULT_INTERVALS;
+    if(interval_ns == 0)
+        interval_ns = 1;
+    count = duration / interval_ns + 1;
+    if(count > 100000) {
+        fprintf(stderr, "ERROR: Interval is too short for the trace\n");
+        return 1;
+    }
+
+    reads = calloc((size_t)count, sizeof(uint64_t));
+    bytes = calloc((size_t)count, sizeof(uint64_t));
+    if(!reads || !bytes) {
+        fprintf(stderr, "ERROR: Unable to allocate memory\n");
+        free(reads);
+        free(bytes);
+        return 1;
+    }
+
+    err = in->seek(in, 0, SEEK_SET);
+    if(!err)
+        err = eaarlio_trace_read_header(in);
+    while(!err) {
+        err = eaarlio_trace_read_record(in, &record);
+        if(err)
+            break;
+        if(record.op != EAARLIO_TRACE_READ || record.error)
+            continue;
+        i = (record.start_ns - summary->first_ns) / interval_ns;
+        reads[i]++;
+        bytes[i] += record.size;
+    }
+    if(err == EAARLIO_STREAM_READ_SHORT)
+        err = EAARLIO_SUCCESS;
+    if(eaarlio_error_check(err, "ERROR: Problem reading trace")) {
+        free(reads);
+        free(bytes);
+        return 1;
+    }
+
+    printf("\n%12s %10s %12s %10s\n", "start s", "reads", "MB", "MB/s");
+    for(i = 0; i < count; i++)
+        printf("%12.6f %10" PRIu64 " %12.3f %10.2f\n", i * interval_ns / 1e9,
+            reads[i], bytes[i] / 1e6, bytes[i] / 1e6 / (interval_ns / 1e9));
+
+    free(reads);
+    free(bytes);
+    return 0;
+}
+
+/* Read and print a summary of a trace */
+int summarize(char const *trace_file,
+    struct eaarlio_stream *sink,
+    double interval)
+{
+    struct eaarlio_stream in = eaarlio_stream_empty();
+    struct eaarlio_trace_record record;
+    struct summary summary;
+    eaarlio_error err;
+    uint64_t records = 0;
+    int exitcode = 0;
+
+    memset(&summary, 0, sizeof(summary));
+    summary.first_ns = UINT64_MAX;
+
+    if(open_trace(&in, trace_file, sink))
+        return 1;
+
+    while((err = eaarlio_trace_read_record(&in, &record)) == EAARLIO_SUCCESS) {
+        records++;
+        if(summarize_record(&summary, &record)) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+    }
+    if(err != EAARLIO_STREAM_READ_SHORT) {
+        exitcode = eaarlio_error_check(err, "ERROR: Problem reading trace");
+        goto exit;
+    }
+
+    if(!records) {
+        printf("trace is empty\n");
+        goto exit;
+    }
+
+    printf("%" PRIu64 " calls on %" PRIu32 " streams over %.6f seconds\n\n",
+        records, summary.streams,
+        (summary.last_ns - summary.first_ns) / 1e9);
+    if(summary.invalid)
+        printf("%" PRIu64 " records were not understood\n\n", summary.invalid);
+
+    print_ops(&summary);
+    if(summary.ops[EAARLIO_TRACE_READ - EAARLIO_TRACE_OPEN].count) {
+        print_sizes(&summary);
+        print_distances(&summary);
+        exitcode = print_timeline(&in, &summary, interval);
+    }
+
+exit:
+    free(summary.next);
+    in.close(&in);
+    return exitcode;
+}
+
+/* Read rasters from a flight, tracing its TLD files to sink */
+int record_trace(char const *edb_file,
+    char const *tld_path,
+    struct eaarlio_stream *sink,
+    uint32_t first,
+    uint32_t last,
+    int include_pulses,
+    int include_waveforms)
+{
+    struct eaarlio_flight flight = eaarlio_flight_empty();
+    struct eaarlio_trace trace = eaarlio_trace_empty();
+    struct eaarlio_tld_opener traced;
+    struct eaarlio_raster raster;
+    eaarlio_error err;
+    int exitcode;
+    uint32_t i;
+
+    err = eaarlio_file_flight(&flight, edb_file, tld_path, NULL);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem loading EDB");
+    if(exitcode)
+        return exitcode;
+
+    if(!last)
+        last = flight.edb.record_count;
+    if(first < 1 || first > last || last > flight.edb.record_count) {
+        fprintf(stderr,
+            "ERROR: rasters %" PRIu32 " to %" PRIu32
+            " are not within the EDB, which has %" PRIu32 " rasters\n",
+            first, last, flight.edb.record_count);
+        exitcode = 1;
+        goto exit;
+    }
+
+    err = eaarlio_trace_init(&trace, sink, NULL);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem starting trace");
+    if(exitcode)
+        goto exit;
+
+    err = eaarlio_trace_tld_opener(&traced, &flight.tld_opener, &trace, NULL);
+    exitcode = eaarlio_error_check(err, "ERROR: Problem starting trace");
+    if(exitcode)
+        goto exit;
+    flight.tld_opener = traced;
+
+    for(i = first; i <= last; i++) {
+        err = eaarlio_flight_read_raster(
+            &flight, &raster, NULL, i, include_pulses, include_waveforms);
+        if(err != EAARLIO_SUCCESS) {
+            fprintf(stderr, "ERROR: Problem reading raster %" PRIu32 "\n", i);
+            exitcode = eaarlio_error_check(err, NULL);
+            goto exit;
+        }
+        eaarlio_raster_free(&raster, NULL);
+    }
+
+exit:
+    eaarlio_flight_free(&flight);
+    err = eaarlio_trace_free(&trace);
+    if(!exitcode)
+        exitcode = eaarlio_error_check(err, "ERROR: Problem writing trace");
+    return exitcode;
+}
+
+/* Parse a raster range of the form first:last
+ *
+ * Returns 0 on success, 1 if the text is not a valid range.
+ */
+int parse_range(char const *text, uint32_t *first, uint32_t *last)
+{
+    unsigned long value;
+    char *end;
+
+    if(*text < '0' || *text > '9')
+        return 1;
+    errno = 0;
+    value = strtoul(text, &end, 10);
+    if(errno || value < 1 || value > UINT32_MAX || *end != ':')
+        return 1;
+    *first = (uint32_t)value;
+
+    text = end + 1;
+    if(*text < '0' || *text > '9')
+        return 1;
+    value = strtoul(text, &end, 10);
+    if(errno || value < *first || value > UINT32_MAX || *end)
+        return 1;
+    *last = (uint32_t)value;
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int exitcode = 0, nerrors = 0;
+    char progname[] = "eaarlio_trace";
+    char *tld_path = NULL;
+    int tld_path_free = 0;
+    uint32_t first = 1, last = 0;
+    struct eaarlio_stream sink = eaarlio_stream_empty();
+    char const *trace_file = NULL;
+    eaarlio_error err;
+    size_t len;
+
+    struct arg_lit *help, *version, *summary, *nopulse, *nowf;
+    struct arg_file *input, *tld, *outfile;
+    struct arg_str *range;
+    struct arg_dbl *interval;
+    struct arg_end *end;
+
+    void *argtable[] = {
+        help = arg_litn("h", "help", 0, 1, "display this help and exit"),
+        version =
+            arg_litn("V", "version", 0, 1, "display library version and exit"),
+        summary = arg_litn("s", "summary", 0, 1,
+            "summarize an existing trace file instead of reading a flight"),
+        outfile = arg_filen("o", "output", "<trace file>", 0, 1,
+            "keep the trace in this file"),
+        range = arg_str0("r", "range", "<first:last>",
+            "read only these rasters (default all)"),
+        nopulse = arg_litn(
+            "P", "no-pulses", 0, 1, "do not decode pulse data while reading"),
+        nowf = arg_litn(
+            "W", "no-waveforms", 0, 1, "do not decode waveforms while reading"),
+        interval = arg_dbl0("i", "interval", "<seconds>",
+            "interval for throughput over time (default a tenth of the trace)"),
+        tld = arg_file0("t", "tld", "<tld path>", "path to the TLD files"),
+        input = arg_filen(NULL, NULL, "<edb file|trace file>", 1, 1,
+            "EDB file for dataset, or trace file with --summary"),
+        end = arg_end(20),
+    };
+
+    if(arg_nullcheck(argtable) != 0) {
+        printf("error: insufficient memory\n");
+        exitcode = 1;
+        goto exit;
+    }
+
+    nerrors = arg_parse(argc, argv, argtable);
+
+    if(version->count > 0) {
+        printf("%s\n", EAARLIO_VERSION);
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(help->count > 0) {
+        printf("Usage: %s", progname);
+        arg_print_syntax(stdout, argtable, "\n");
+        printf("Trace the TLD file access made while reading a flight, and "
+               "summarize it.\n\n");
+        arg_print_glossary(stdout, argtable, "  %-25s %s\n");
+        printf(
+            "\n"
+            "Rasters are read in order with eaarlio_flight_read_raster, "
+            "recording every\n"
+            "open, read, seek, tell, and close made on the TLD files. The "
+            "summary shows\n"
+            "the latency of each kind of call, a histogram of read sizes, "
+            "how far each\n"
+            "read was from where the previous read on the same file ended, "
+            "and read\n"
+            "throughput over time.\n"
+            "\n"
+            "With --output, the trace is also written to a file in the "
+            "format described\n"
+            "in the library documentation. With --summary, an existing trace "
+            "file, such\n"
+            "as one recorded by another program through eaarlio_trace_init, "
+            "is summarized\n"
+            "instead.\n");
+        exitcode = 0;
+        goto exit;
+    }
+
+    if(nerrors > 0) {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        exitcode = 1;
+        goto exit;
+    }
+
+    if(summary->count > 0) {
+        exitcode = summarize(input->filename[0], NULL, interval->dval[0]);
+        goto exit;
+    }
+
+    if(range->count > 0 && parse_range(range->sval[0], &first, &last)) {
+        fprintf(stderr, "%s: invalid range: %s\n", progname, range->sval[0]);
+        exitcode = 1;
+        goto exit;
+    }
+
+    len = strlen(input->filename[0]) - strlen(input->basename[0]);
+    if(tld->count > 0) {
+        tld_path = (char *)tld->filename[0];
+    } else if(len > 0) {
+        tld_path_free = 1;
+        tld_path = calloc(len + 1, sizeof(char));
+        if(!tld_path) {
+            fprintf(stderr, "ERROR: Unable to allocate memory\n");
+            exitcode = 1;
+            goto exit;
+        }
+        memcpy(tld_path, input->filename[0], len);
+    } else {
+        tld_path = ".";
+    }
+
+    if(outfile->count > 0) {
+        trace_file = outfile->filename[0];
+        err = eaarlio_file_stream(&sink, trace_file, "w");
+    } else {
+        err = eaarlio_memory_stream(&sink, NULL, 0, "w", NULL);
+    }
+    exitcode = eaarlio_error_check(err, "ERROR: Unable to create trace");
+    if(exitcode)
+        goto exit;
+
+    exitcode = record_trace(input->filename[0], tld_path, &sink, first, last,
+        nopulse->count == 0, nopulse->count == 0 && nowf->count == 0);
+    if(exitcode)
+        goto exit;
+
+    if(trace_file) {
+        err = sink.close(&sink);
+        sink = eaarlio_stream_empty();
+        exitcode = eaarlio_error_check(err, "ERROR: Problem writing trace");
+        if(exitcode)
+            goto exit;
+    }
+
+    exitcode = summarize(trace_file, &sink, interval->dval[0]);
+
+exit:
+    if(sink.close)
+        sink.close(&sink);
+    arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+    if(tld_path_free && tld_path)
+        free(tld_path);
+    return exitcode;
+}
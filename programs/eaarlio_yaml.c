@@ -1,9 +1,11 @@
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "argtable3.h"
 
@@ -11,11 +13,121 @@
 #include "eaarlio/error.h"
 #include "eaarlio/file.h"
 #include "eaarlio/flight.h"
+#include "eaarlio/pipeline.h"
 #include "eaarlio/pulse.h"
 #include "eaarlio/raster.h"
 #include "eaarlio/units.h"
 #include "eaarlio/version.h"
 
+/* Output text for one raster. Formatting into memory and writing each raster
+ * with a single fwrite is much faster than calling fprintf for every value,
+ * and lets several threads format rasters at once.
+ */
+struct yaml_buf {
+    char *data; // Text formatted so far
+    size_t len; // Number of bytes of data in use
+    size_t cap; // Allocated size of data
+    int failed; // Set if memory could not be allocated
+};
+
+/* Make room for at least n more bytes. Returns 0 on success, 1 on failure.
+ */
+int yaml_buf_reserve(struct yaml_buf *buf, size_t n)
+{
+    size_t cap = buf->cap ? buf->cap : 4096;
+    char *data;
+
+    if(buf->failed)
+        return 1;
+    if(buf->len + n <= buf->cap)
+        return 0;
+
+    while(cap < buf->len + n)
+        cap *= 2;
+    data = realloc(buf->data, cap);
+    if(!data) {
+        buf->failed = 1;
+        return 1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+/* Append a string
+ */
+void yaml_str(struct yaml_buf *buf, const char *str)
+{
+    size_t n = strlen(str);
+    if(yaml_buf_reserve(buf, n))
+        return;
+    memcpy(buf->data + buf->len, str, n);
+    buf->len += n;
+}
+
+/* Append an unsigned integer in decimal, like printf's %u
+ */
+void yaml_uint(struct yaml_buf *buf, uint32_t value)
+{
+    // Digits are generated backwards, then copied out in the right order
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value);
+
+    if(yaml_buf_reserve(buf, n))
+        return;
+    while(n)
+        buf->data[buf->len++] = digits[--n];
+}
+
+/* Append a signed integer in decimal, like printf's %d
+ */
+void yaml_int(struct yaml_buf *buf, int32_t value)
+{
+    if(value < 0) {
+        yaml_str(buf, "-");
+        yaml_uint(buf, (uint32_t)0 - (uint32_t)value);
+    } else {
+        yaml_uint(buf, (uint32_t)value);
+    }
+}
+
+/* Append a floating point value with a fixed number of decimal places. These
+ * are rare enough that snprintf is fine.
+ */
+void yaml_fixed(struct yaml_buf *buf, double value, int places)
+{
+    char text[64];
+    int n = snprintf(text, sizeof(text), "%.*f", places, value);
+    if(n < 0 || (size_t)n >= sizeof(text))
+        n = 0;
+    text[n] = 0;
+    yaml_str(buf, text);
+}
+
+/* Text for each possible waveform sample, written as " %3d" would, so every
+ * sample takes exactly four characters. Filled in by yaml_wf_init.
+ */
+static char yaml_sample_text[256][4];
+
+/* Prepare yaml_sample_text. This must be called before yaml_wf, and before
+ * any threads are started.
+ */
+void yaml_wf_init(void)
+{
+    int i;
+    for(i = 0; i < 256; i++) {
+        yaml_sample_text[i][0] = ' ';
+        yaml_sample_text[i][1] = i < 100 ? ' ' : (char)('0' + i / 100);
+        yaml_sample_text[i][2] = i < 10 ? ' ' : (char)('0' + i / 10 % 10);
+        yaml_sample_text[i][3] = (char)('0' + i % 10);
+    }
+}
+
 /* Writes out a waveform as a list of integers. To improve readability,the
  * integers are written out using inline list format (i.e., in brackets) rather
  * than block list format (i.e., one value per line). Long lines are wrapped to
@@ -29,46 +141,64 @@
  *          100, 100, 100, 100, 100, 100, 100
  *      ]
  */
-void yaml_wf(FILE *out, // Output filehandle
+void yaml_wf(struct yaml_buf *buf, // Output buffer
     unsigned char *wf, // Waveform to write
     uint16_t wf_len) // Length of the waveform
 {
+    // Line break and indentation written before every 12 values
+    static const char wrap[] = "\n            ";
+
     // Current index into the wf array
     uint16_t i = 0;
 
+    // Position in the output
+    char *pos;
+
     // Special handling for an empty waveform
     if(!wf || wf_len < 1) {
-        fprintf(out, "[]");
+        yaml_str(buf, "[]");
         return;
     }
 
+    // Reserve the worst case: the brackets, one wrap per 12 values, and five
+    // characters per value including its comma
+    if(yaml_buf_reserve(buf,
+           16 + (wf_len / 12 + 1) * (sizeof(wrap) - 1) + (size_t)wf_len * 5))
+        return;
+    pos = buf->data + buf->len;
+
     // The list opens with a bracket
-    fprintf(out, "[");
+    *pos++ = '[';
 
     for(i = 0; i < wf_len; i++) {
         // 12 values per line. Each line is indented.
-        if(i % 12 == 0)
-            fprintf(out, "\n            ");
+        if(i % 12 == 0) {
+            memcpy(pos, wrap, sizeof(wrap) - 1);
+            pos += sizeof(wrap) - 1;
+        }
 
         // Write out the current value. If it's not the last, add a comma
-        fprintf(out, " %3d", wf[i]);
+        memcpy(pos, yaml_sample_text[wf[i]], 4);
+        pos += 4;
         if(i + 1 < wf_len)
-            fprintf(out, ",");
+            *pos++ = ',';
     }
 
+    buf->len = pos - buf->data;
+
     // The list closes with an indented bracket
-    fprintf(out, "\n          ]\n");
+    yaml_str(buf, "\n          ]\n");
 }
 
 /* Write the data for a pulse
  */
-void yaml_pulse(FILE *out, // Output filehandle
+void yaml_pulse(struct yaml_buf *buf, // Output buffer
     struct eaarlio_raster *raster, // The raster's data
     uint16_t pulse_number, // Pulse number to write
     int include_waveforms) // Output waveforms? 1 = yes, 0 = no
 {
     // Sanity checks
-    assert(out);
+    assert(buf);
     assert(raster);
     assert(raster->pulse);
 
@@ -85,54 +215,64 @@ void yaml_pulse(FILE *out, // Output filehandle
 
     // Each pulse is an entry in a list, so the first line has to get the
     // hyphen prefix.
-    fprintf(out, "    - pulse_number: %" PRIu16 "\n", pulse_number);
+    yaml_str(buf, "    - pulse_number: ");
+    yaml_uint(buf, pulse_number);
 
     // Time and scan angle are stored in hardware-specific formats. We include
     // the values converted into normal units as well.
-    fprintf(out, "      time: %.6f\n",
-        eaarlio_units_pulse_time(raster, pulse_number));
-    fprintf(
-        out, "      scan_angle: %.3f\n", eaarlio_units_pulse_scan_angle(pulse));
+    yaml_str(buf, "\n      time: ");
+    yaml_fixed(buf, eaarlio_units_pulse_time(raster, pulse_number), 6);
+    yaml_str(buf, "\n      scan_angle: ");
+    yaml_fixed(buf, eaarlio_units_pulse_scan_angle(pulse), 3);
 
     // Values directly from the struct
-    fprintf(out, "      time_offset: %" PRIu32 "\n", pulse->time_offset);
-    fprintf(out, "      scan_angle_counts: %" PRIi16 "\n",
-        pulse->scan_angle_counts);
-    fprintf(out, "      range: %" PRIu16 "\n", pulse->range);
-    fprintf(out, "      rx_count: %" PRIu8 "\n", pulse->rx_count);
-    fprintf(out, "      thresh_tx: %" PRIu8 "\n", pulse->thresh_tx);
-    fprintf(out, "      thresh_rx: %" PRIu8 "\n", pulse->thresh_rx);
-    fprintf(out, "      bias_tx: %" PRIu8 "\n", pulse->bias_tx);
+    yaml_str(buf, "\n      time_offset: ");
+    yaml_uint(buf, pulse->time_offset);
+    yaml_str(buf, "\n      scan_angle_counts: ");
+    yaml_int(buf, pulse->scan_angle_counts);
+    yaml_str(buf, "\n      range: ");
+    yaml_uint(buf, pulse->range);
+    yaml_str(buf, "\n      rx_count: ");
+    yaml_uint(buf, pulse->rx_count);
+    yaml_str(buf, "\n      thresh_tx: ");
+    yaml_uint(buf, pulse->thresh_tx);
+    yaml_str(buf, "\n      thresh_rx: ");
+    yaml_uint(buf, pulse->thresh_rx);
+    yaml_str(buf, "\n      bias_tx: ");
+    yaml_uint(buf, pulse->bias_tx);
 
     // The bias_rx field always has four values, regardless of rx_count
-    fprintf(out,
-        "      bias_rx: [%" PRIu8 ", %" PRIu8 ", %" PRIu8 ", %" PRIu8 "]\n",
-        pulse->bias_rx[0], pulse->bias_rx[1], pulse->bias_rx[2],
-        pulse->bias_rx[3]);
+    yaml_str(buf, "\n      bias_rx: [");
+    for(i = 0; i < 4; i++) {
+        if(i > 0)
+            yaml_str(buf, ", ");
+        yaml_uint(buf, pulse->bias_rx[i]);
+    }
+    yaml_str(buf, "]\n");
 
     // If we don't want waveforms, we're done
     if(!include_waveforms)
         return;
 
     // Output the transmit waveform
-    fprintf(out, "      tx: ");
-    yaml_wf(out, pulse->tx, pulse->tx_len);
+    yaml_str(buf, "      tx: ");
+    yaml_wf(buf, pulse->tx, pulse->tx_len);
 
     // Output the return waveforms, if there are any
-    if(!pulse->rx || pulse->rx_count < 1) {
-        fprintf(out, "      rx: []\n");
+    if(pulse->rx_count < 1) {
+        yaml_str(buf, "      rx: []\n");
     } else {
-        fprintf(out, "      rx:\n");
+        yaml_str(buf, "      rx:\n");
         for(i = 0; i < channels; i++) {
-            fprintf(out, "        - ");
-            yaml_wf(out, pulse->rx[i], pulse->rx_len[i]);
+            yaml_str(buf, "        - ");
+            yaml_wf(buf, pulse->rx[i], pulse->rx_len[i]);
         }
     }
 }
 
 /* Write the data for a pulse
  */
-void yaml_raster(FILE *out, // Output filehandle
+void yaml_raster(struct yaml_buf *buf, // Output buffer
     int raster_number, // Raster number for this raster
     struct eaarlio_raster *raster, // The raster number for this raster
     int32_t time_offset, // Time offset from EDB data
@@ -140,7 +280,7 @@ void yaml_raster(FILE *out, // Output filehandle
     int include_waveforms) // Output waveforms? 1 = yes, 0 = no
 {
     // Sanity
-    assert(out);
+    assert(buf);
     assert(raster);
 
     // Loop variable for pulses
@@ -148,21 +288,30 @@ void yaml_raster(FILE *out, // Output filehandle
 
     // Each raster is an entry in a list, so the first line has to get the
     // hyphen prefix.
-    fprintf(out, "- raster_number: %d\n", raster_number);
+    yaml_str(buf, "- raster_number: ");
+    yaml_int(buf, raster_number);
 
     // Time is stored in a hardware-specific format. We include the time in
     // normal units as well.
-    fprintf(out, "  time: %.6f\n", eaarlio_units_raster_time(raster));
+    yaml_str(buf, "\n  time: ");
+    yaml_fixed(buf, eaarlio_units_raster_time(raster), 6);
 
     // Time offset supplied by the EDB file.
-    fprintf(out, "  edb_time_offset: %" PRIi32 "\n", time_offset);
+    yaml_str(buf, "\n  edb_time_offset: ");
+    yaml_int(buf, time_offset);
 
     // Values directly from the struct
-    fprintf(out, "  time_seconds: %" PRIu32 "\n", raster->time_seconds);
-    fprintf(out, "  time_fraction: %" PRIu32 "\n", raster->time_fraction);
-    fprintf(out, "  sequence_number: %" PRIu32 "\n", raster->sequence_number);
-    fprintf(out, "  digitizer: %" PRIu8 "\n", raster->digitizer);
-    fprintf(out, "  pulse_count: %" PRIu16 "\n", raster->pulse_count);
+    yaml_str(buf, "\n  time_seconds: ");
+    yaml_uint(buf, raster->time_seconds);
+    yaml_str(buf, "\n  time_fraction: ");
+    yaml_uint(buf, raster->time_fraction);
+    yaml_str(buf, "\n  sequence_number: ");
+    yaml_uint(buf, raster->sequence_number);
+    yaml_str(buf, "\n  digitizer: ");
+    yaml_uint(buf, raster->digitizer);
+    yaml_str(buf, "\n  pulse_count: ");
+    yaml_uint(buf, raster->pulse_count);
+    yaml_str(buf, "\n");
 
     // If we don't want pulses, we're done
     if(!include_pulses)
@@ -170,93 +319,221 @@ void yaml_raster(FILE *out, // Output filehandle
 
     // Output the pulses, if there are any
     if(!raster->pulse || raster->pulse_count < 1) {
-        fprintf(out, "  pulses: []\n");
+        yaml_str(buf, "  pulses: []\n");
     } else {
-        fprintf(out, "  pulses:\n");
+        yaml_str(buf, "  pulses:\n");
         for(pulse_number = 1; pulse_number <= raster->pulse_count;
             pulse_number++) {
             // Put a blank line before every pulse except the first, for
             // readability
             if(pulse_number > 1)
-                fprintf(out, "\n");
-            yaml_pulse(out, raster, pulse_number, include_waveforms);
+                yaml_str(buf, "\n");
+            yaml_pulse(buf, raster, pulse_number, include_waveforms);
         }
     }
 }
 
-/* Precheck requested raster numbers against EDB. Drop bad rasters and return
- * the number of rasters kept.
+/* A selection of rasters: every step-th raster number from first through
+ * last. A span with first greater than last selects nothing.
  *
- * The raster numbers are prechecked to remove invalid or problematic rasters
- * using the following criteria:
+ * A time window is parsed before the EDB is loaded, so it starts out with
+ * by_time set and is converted to raster numbers by resolve_time_span.
+ */
+struct yaml_span {
+    uint32_t first; // First raster number
+    uint32_t last; // Last raster number (inclusive)
+    uint32_t step; // Distance between selected raster numbers
+    int by_time; // Is this a time window still to be resolved? 1 = yes
+    double time_start; // Start of the time window, in seconds of the epoch
+    double time_end; // End of the time window (inclusive)
+};
+
+/* Check that a raster number can be exported. Returns 1 if so. Otherwise,
+ * writes a warning to stderr and returns 0.
+ *
+ * The raster number is checked using the following criteria:
  *  - Raster numbers must be between 1 and the maximum raster number from the
  *    EDB
  *  - The EDB record must reference a valid TLD file (i.e, its file index must
  *    be between 1 and the maximum file index from the EDB)
  *
- * If problems are encountered, warnings are written to stderr. The
- * raster_numbers array is updated in-place to remove raster numbers with
- * problems. The number of raster numbers that passed the checks is returned.
+ * This is cheap enough to do for each raster as it is requested, so large
+ * selections never need to be expanded into lists.
  */
-int precheck_rasters(struct eaarlio_edb *edb, // EDB data to reference
-    int *raster_numbers, // Raster numbers requested
-    int raster_numbers_count) // Size of raster_numbers
+int check_raster(struct eaarlio_edb *edb, // EDB data to reference
+    uint32_t raster_number) // Raster number requested
 {
     // Sanity
     assert(edb);
-    assert(raster_numbers);
 
-    // Index into raster_numbers for the raster being checked
-    int src = 0;
+    // Current file index
+    int file_index;
 
-    // Index into raster_numbers where the next valid raster goes
-    int dst = 0;
+    // Bounds check on raster number
+    if(raster_number < 1) {
+        fprintf(stderr, "WARNING: rasters must be >= 1, skipping: %" PRIu32
+            "\n", raster_number);
+        return 0;
+    }
+    if(raster_number > edb->record_count) {
+        fprintf(stderr,
+            "WARNING: raster number beyond end of EDB, skipping: %" PRIu32
+            "\n", raster_number);
+        return 0;
+    }
 
-    // Current raster number
-    int raster_number;
+    // Bounds check on file_index
+    file_index = edb->records[raster_number - 1].file_index;
+    if(file_index < 1) {
+        fprintf(stderr,
+            "WARNING: EDB for raster %" PRIu32 " references negative "
+            "file_index of %d\n",
+            raster_number, file_index);
+        return 0;
+    }
+    if((unsigned int)file_index > edb->file_count) {
+        fprintf(stderr,
+            "WARNING: EDB for raster %" PRIu32 " references file_index of %d, "
+            "max is %" PRIu32 "\n",
+            raster_number, file_index, edb->file_count);
+        return 0;
+    }
 
-    // Current file index
-    int file_index;
+    return 1;
+}
 
-    for(src = 0; src < raster_numbers_count; src++) {
-        // Bounds check on raster number
-        raster_number = raster_numbers[src];
-        if(raster_number < 1) {
-            fprintf(stderr, "WARNING: rasters must be >= 1, skipping: %d\n",
-                raster_number);
-            continue;
-        }
-        if((unsigned int)raster_number > edb->record_count) {
-            fprintf(stderr,
-                "WARNING: raster number beyond end of EDB, skipping: %d\n",
-                raster_number);
-            continue;
-        }
+/* Convert a time window to the span of rasters whose EDB times fall within
+ * it. EDB records are in time order, so both ends are found by binary search.
+ */
+void resolve_time_span(struct eaarlio_edb *edb, // EDB data to search
+    struct yaml_span *span) // Span to resolve
+{
+    // Sanity
+    assert(edb);
+    assert(span);
+
+    // Search bounds, as zero-based record indexes
+    uint32_t lo, hi, mid;
+
+    // First record at or after the start of the window
+    lo = 0;
+    hi = edb->record_count;
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(eaarlio_units_edb_time(&edb->records[mid]) < span->time_start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    span->first = lo + 1;
+
+    // First record after the end of the window; the one before it is the
+    // last record in the window
+    hi = edb->record_count;
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(eaarlio_units_edb_time(&edb->records[mid]) <= span->time_end)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    span->last = lo;
 
-        // Bounds check on file_index
-        file_index = edb->records[raster_number - 1].file_index;
-        if(file_index < 1) {
-            fprintf(stderr,
-                "WARNING: EDB for raster %d references negative file_index of "
-                "%d\n",
-                raster_number, file_index);
-            continue;
-        }
-        if((unsigned int)file_index > edb->file_count) {
-            fprintf(stderr,
-                "WARNING: EDB for raster %d references file_index of %d, max "
-                "is %d\n",
-                raster_number, file_index, edb->file_count);
-            continue;
+    span->step = 1;
+    span->by_time = 0;
+}
+
+/* State shared by the pipeline callbacks
+ */
+struct yaml_job {
+    FILE *out; // Output filehandle
+    struct eaarlio_edb *edb; // EDB data, for checking raster numbers
+    struct yaml_span *spans; // Rasters to export
+    int span_count; // Length of spans
+    int span; // Index into spans of the span being read
+    uint32_t next; // Next raster number to read from the current span
+    int written; // Number of rasters written so far
+    int include_pulses; // Output pulses? 1 = yes, 0 = no
+    int include_waveforms; // Output waveforms? 1 = yes, 0 = no
+    struct yaml_buf bufs[EAARLIO_PIPELINE_DEPTH]; // One per pipeline slot
+};
+
+/* Pipeline callback: choose the next raster to read
+ */
+eaarlio_error yaml_next(void *ctx, uint32_t *raster_number)
+{
+    struct yaml_job *job = (struct yaml_job *)ctx;
+    struct yaml_span *span;
+    uint32_t candidate;
+
+    while(job->span < job->span_count) {
+        span = &job->spans[job->span];
+        candidate = job->next;
+
+        // Move on to the next span once this one is used up. This is checked
+        // without adding to candidate so that a span can end at UINT32_MAX.
+        if(candidate > span->last || span->last - candidate < span->step) {
+            job->span++;
+            if(job->span < job->span_count)
+                job->next = job->spans[job->span].first;
+        } else {
+            job->next += span->step;
         }
 
-        // Keep the raster if the checks passed
-        raster_numbers[dst] = raster_number;
-        dst++;
+        if(candidate <= span->last && check_raster(job->edb, candidate)) {
+            *raster_number = candidate;
+            return EAARLIO_SUCCESS;
+        }
     }
 
-    // Return the number of rasters kept
-    return dst;
+    *raster_number = 0;
+    return EAARLIO_SUCCESS;
+}
+
+/* Pipeline callback: format a raster into its slot's buffer. This runs on the
+ * decode threads.
+ */
+eaarlio_error yaml_work(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct yaml_job *job = (struct yaml_job *)ctx;
+    struct yaml_buf *buf = &job->bufs[slot];
+
+    buf->len = 0;
+    yaml_raster(buf, raster_number, raster, time_offset, job->include_pulses,
+        job->include_waveforms);
+
+    return buf->failed ? EAARLIO_MEMORY_ALLOC_FAIL : EAARLIO_SUCCESS;
+}
+
+/* Pipeline callback: write a formatted raster. This is called in raster
+ * order.
+ */
+eaarlio_error yaml_output(void *ctx,
+    uint32_t slot,
+    uint32_t raster_number,
+    struct eaarlio_raster *raster,
+    int32_t time_offset)
+{
+    struct yaml_job *job = (struct yaml_job *)ctx;
+    struct yaml_buf *buf = &job->bufs[slot];
+
+    (void)raster_number;
+    (void)raster;
+    (void)time_offset;
+
+    // Start the YAML document with the first raster. Put a blank line before
+    // every other raster, for readability.
+    if(fputs(job->written > 0 ? "\n" : "---\n", job->out) == EOF)
+        return EAARLIO_STREAM_WRITE_ERROR;
+    job->written++;
+
+    if(fwrite(buf->data, 1, buf->len, job->out) != buf->len)
+        return EAARLIO_STREAM_WRITE_ERROR;
+    return EAARLIO_SUCCESS;
 }
 
 /* Outputs YAML for the rasters requested. Returns 0 on success, 1 on failure.
@@ -265,14 +542,15 @@ int eaarlio_yaml(
     const char *out_file, /* Output YAML file to create; NULL for stdout */
     const char *edb_file, /* EDB file to load for the flight */
     const char *tld_path, /* Path to the TLD files */
-    int *raster_numbers, /* Array of raster numbers to read */
-    int raster_numbers_count, /* Length of raster_numbers array */
+    struct yaml_span *spans, /* Rasters to read */
+    int span_count, /* Length of spans array */
     int include_pulses, /* Output pulse data? 1 = yes, 0 = no */
-    int include_waveforms) /* Output waveform data? 1 = yes, 0 = no */
+    int include_waveforms, /* Output waveform data? 1 = yes, 0 = no */
+    int threads) /* Threads for decoding and formatting; 0 = one per CPU */
 {
     // Sanity
     assert(edb_file);
-    assert(raster_numbers);
+    assert(spans);
 
     // Return value from eaarlio functions
     eaarlio_error err;
@@ -283,21 +561,26 @@ int eaarlio_yaml(
     // Flight for the EDB
     struct eaarlio_flight flight = eaarlio_flight_empty();
 
-    // Current raster data
-    struct eaarlio_raster raster = eaarlio_raster_empty();
-
-    // Time offset applied in the EDB data
-    int32_t time_offset = 0;
+    // Pipeline that reads, decodes, and formats the rasters
+    struct eaarlio_pipeline pipeline = eaarlio_pipeline_empty();
 
-    // Current raster number
-    int raster_number = 0;
+    // State for the pipeline callbacks. This holds a buffer per slot, so it
+    // is too large to put on the stack.
+    struct yaml_job *job = NULL;
 
     // Loop variable
-    int i = 0;
+    uint32_t i = 0;
 
     // Output filehandle; defaults to stdout
     FILE *out = stdout;
 
+    job = calloc(1, sizeof(struct yaml_job));
+    if(!job) {
+        fprintf(stderr, "ERROR: Memory allocation failure\n");
+        failed = 1;
+        goto exit;
+    }
+
     // Open the output file if the user provided one
     if(out_file) {
         out = fopen(out_file, "w");
@@ -314,45 +597,63 @@ int eaarlio_yaml(
     if(failed)
         goto exit;
 
-    // Check for and remove problematic raster numbers
-    raster_numbers_count =
-        precheck_rasters(&flight.edb, raster_numbers, raster_numbers_count);
-    if(raster_numbers_count < 1) {
-        fprintf(stderr, "WARNING: no valid rasters were detected\n");
-        goto exit;
-    }
-
-    // Start the YAML document
-    fprintf(out, "---\n");
-
-    for(i = 0; i < raster_numbers_count; i++) {
-        // Put a blank line before every raster except the first, for
-        // readability
-        if(i > 0)
-            fprintf(out, "\n");
+    // Convert time windows to raster numbers and keep ranges within the EDB
+    for(i = 0; i < (uint32_t)span_count; i++) {
+        if(spans[i].by_time)
+            resolve_time_span(&flight.edb, &spans[i]);
 
-        raster_number = raster_numbers[i];
-
-        err = eaarlio_flight_read_raster(&flight, &raster, &time_offset,
-            raster_number, include_pulses, include_waveforms);
-        failed = eaarlio_error_check(
-            err, "ERROR: Problem reading raster %d", raster_number);
-        if(failed)
-            goto exit;
-
-        // Generate the YAML for the raster
-        yaml_raster(out, raster_number, &raster, time_offset, include_pulses,
-            include_waveforms);
+        // A single raster number is left for check_raster to report
+        if(spans[i].first >= spans[i].last
+            || spans[i].last <= flight.edb.record_count)
+            continue;
 
-        err = eaarlio_raster_free(&raster, NULL);
-        failed = eaarlio_error_check(
-            err, "ERROR: Problem releasing memory for raster");
-        if(failed)
-            goto exit;
+        if(spans[i].first > flight.edb.record_count) {
+            fprintf(stderr,
+                "WARNING: range beyond end of EDB, skipping: %" PRIu32
+                ":%" PRIu32 "\n",
+                spans[i].first, spans[i].last);
+            spans[i].first = 1;
+            spans[i].last = 0;
+        } else {
+            fprintf(stderr,
+                "WARNING: range beyond end of EDB, stopping at raster "
+                "%" PRIu32 "\n",
+                flight.edb.record_count);
+            spans[i].last = flight.edb.record_count;
+        }
     }
 
-    // End the YAML document
-    fprintf(out, "...\n");
+    yaml_wf_init();
+
+    job->out = out;
+    job->edb = &flight.edb;
+    job->spans = spans;
+    job->span_count = span_count;
+    job->next = span_count > 0 ? spans[0].first : 0;
+    job->include_pulses = include_pulses;
+    job->include_waveforms = include_waveforms;
+
+    pipeline.next = &yaml_next;
+    pipeline.work = &yaml_work;
+    pipeline.output = &yaml_output;
+    pipeline.ctx = job;
+    pipeline.threads = threads;
+    pipeline.depth = EAARLIO_PIPELINE_DEPTH;
+    pipeline.include_pulses = include_pulses;
+    pipeline.include_waveforms = include_waveforms;
+
+    // Generate the YAML for the rasters. The document is started when the
+    // first raster is written.
+    err = eaarlio_pipeline_run(&flight, &pipeline);
+    failed = eaarlio_error_check(err, "ERROR: Problem exporting rasters");
+    if(failed)
+        goto exit;
+
+    // End the YAML document, if one was started
+    if(job->written > 0)
+        fprintf(out, "...\n");
+    else
+        fprintf(stderr, "WARNING: no valid rasters were detected\n");
 
     // Close the output file (but don't close stdout)
     if(out_file) {
@@ -374,14 +675,78 @@ int eaarlio_yaml(
 exit:
     // Cleanup. Make sure files are closed and memory released.
     eaarlio_flight_free(&flight);
-    eaarlio_raster_free(&raster, NULL);
     if(out && out_file) {
         fclose(out);
     }
+    if(job) {
+        for(i = 0; i < EAARLIO_PIPELINE_DEPTH; i++)
+            free(job->bufs[i].data);
+        free(job);
+    }
 
     return failed;
 }
 
+/* Parse a raster range of the form A:B or A:B:step. Returns 0 on success, 1
+ * if the text is not a valid range.
+ */
+int parse_range(const char *text, // Text to parse
+    struct yaml_span *span) // Span to populate
+{
+    // Values parsed so far: first, last, and step
+    unsigned long values[3] = { 0, 0, 1 };
+    int count = 0;
+    char *end;
+
+    for(;;) {
+        if(*text < '0' || *text > '9')
+            return 1;
+        errno = 0;
+        values[count++] = strtoul(text, &end, 10);
+        if(errno || values[count - 1] > UINT32_MAX)
+            return 1;
+        if(!*end)
+            break;
+        if(*end != ':' || count == 3)
+            return 1;
+        text = end + 1;
+    }
+
+    if(count < 2 || values[0] < 1 || values[1] < values[0] || values[2] < 1)
+        return 1;
+
+    span->first = (uint32_t)values[0];
+    span->last = (uint32_t)values[1];
+    span->step = (uint32_t)values[2];
+    span->by_time = 0;
+    return 0;
+}
+
+/* Parse a time window of the form T0:T1, in seconds of the epoch. Returns 0
+ * on success, 1 if the text is not a valid time window.
+ */
+int parse_time(const char *text, // Text to parse
+    struct yaml_span *span) // Span to populate
+{
+    char *end;
+
+    span->time_start = strtod(text, &end);
+    if(end == text || *end != ':')
+        return 1;
+    text = end + 1;
+    span->time_end = strtod(text, &end);
+    if(end == text || *end)
+        return 1;
+    if(span->time_end < span->time_start)
+        return 1;
+
+    span->first = 1;
+    span->last = 0;
+    span->step = 1;
+    span->by_time = 1;
+    return 0;
+}
+
 /* The main function handles command line arguments. It defines the command
  * line arguments accepted and parses them. It either shows an error, shows
  * usage informatino, or invokes eaarlio_yaml to do the real work.
@@ -392,10 +757,14 @@ int main(int argc, char *argv[])
     char progname[] = "eaarlio_yaml";
     char *tld_path = NULL;
     int tld_path_free = 0;
+    struct yaml_span *spans = NULL;
+    int span_count = 0;
+    int i;
 
     struct arg_lit *help, *version, *nopulse, *nowf;
     struct arg_file *outfile, *edb, *tld;
-    struct arg_int *rasters;
+    struct arg_int *rasters, *threads;
+    struct arg_str *ranges, *times;
     struct arg_end *end;
 
     void *argtable[] = {
@@ -409,9 +778,16 @@ int main(int argc, char *argv[])
         nowf = arg_litn("W", "no-waveforms", 0, 1,
             "do not include waveform data in the output"),
         tld = arg_file0("t", "tld", "<tld path>", "path to the TLD files"),
+        threads = arg_int0("j", "threads", "<n>",
+            "decode and format rasters on n threads (0 for one per CPU)"),
         edb = arg_filen(NULL, NULL, "<edb file>", 1, 1, "EDB file for dataset"),
+        ranges = arg_strn("r", "range", "<first:last[:step]>", 0, 100,
+            "export every step-th raster from first through last"),
+        times = arg_strn("T", "time", "<start:end>", 0, 100,
+            "export the rasters whose EDB times (seconds of the epoch) fall "
+            "between start and end"),
         rasters = arg_intn(
-            NULL, NULL, "<raster number>", 1, 1000, "raster numbers to export"),
+            NULL, NULL, "<raster number>", 0, 1000, "raster numbers to export"),
         end = arg_end(20),
     };
 
@@ -424,6 +800,9 @@ int main(int argc, char *argv[])
     // Output filename defaults to NULL for stdout
     outfile->filename[0] = NULL;
 
+    // Rasters are decoded and formatted in the calling thread by default
+    threads->ival[0] = 1;
+
     // Parse the command line
     nerrors = arg_parse(argc, argv, argtable);
 
@@ -442,7 +821,10 @@ int main(int argc, char *argv[])
         arg_print_glossary(stdout, argtable, "  %-25s %s\n");
         printf(
             "\n"
-            "Exports the rasters in YAML format as requested...\n");
+            "Exports the rasters in YAML format as requested. Rasters can be\n"
+            "selected by number, by range, and by time window, in any\n"
+            "combination. Listed raster numbers are exported first, then\n"
+            "ranges, then time windows, each in the order given.\n");
         failed = 0;
         goto exit;
     }
@@ -455,13 +837,64 @@ int main(int argc, char *argv[])
         goto exit;
     }
 
+    if(threads->ival[0] < 0) {
+        fprintf(stderr, "%s: thread count must not be negative\n", progname);
+        failed = 1;
+        goto exit;
+    }
+
+    if(rasters->count + ranges->count + times->count < 1) {
+        fprintf(stderr, "%s: no rasters were selected\n", progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+        failed = 1;
+        goto exit;
+    }
+
+    // Collect the selections in the order they will be exported
+    spans = calloc(rasters->count + ranges->count + times->count,
+        sizeof(struct yaml_span));
+    if(!spans) {
+        fprintf(stderr, "Memory allocation failure\n");
+        failed = 1;
+        goto exit;
+    }
+    for(i = 0; i < rasters->count; i++) {
+        if(rasters->ival[i] < 1) {
+            fprintf(stderr, "WARNING: rasters must be >= 1, skipping: %d\n",
+                rasters->ival[i]);
+            continue;
+        }
+        spans[span_count].first = (uint32_t)rasters->ival[i];
+        spans[span_count].last = (uint32_t)rasters->ival[i];
+        spans[span_count].step = 1;
+        span_count++;
+    }
+    for(i = 0; i < ranges->count; i++) {
+        if(parse_range(ranges->sval[i], &spans[span_count])) {
+            fprintf(stderr, "%s: invalid range: %s\n", progname,
+                ranges->sval[i]);
+            failed = 1;
+            goto exit;
+        }
+        span_count++;
+    }
+    for(i = 0; i < times->count; i++) {
+        if(parse_time(times->sval[i], &spans[span_count])) {
+            fprintf(stderr, "%s: invalid time window: %s\n", progname,
+                times->sval[i]);
+            failed = 1;
+            goto exit;
+        }
+        span_count++;
+    }
+
     assert(strlen(edb->filename[0]) > 0);
 
     if(tld->count > 0) {
         tld_path = (char *)tld->filename[0];
     } else if(strlen(edb->basename[0]) < strlen(edb->filename[0])) {
         tld_path_free = 1;
-        tld_path = calloc(strlen(edb->filename[0] + 1), sizeof(char));
+        tld_path = calloc(strlen(edb->filename[0]) + 1, sizeof(char));
         if(!tld_path) {
             fprintf(stderr, "Memory allocation failure\n");
             failed = 1;
@@ -475,13 +908,15 @@ int main(int argc, char *argv[])
 
     // Pass the parsed args to @ref eaarlio_yaml to do the real work
     failed = eaarlio_yaml(outfile->filename[0], edb->filename[0], tld_path,
-        rasters->ival, rasters->count, nopulse->count == 0, nowf->count == 0);
+        spans, span_count, nopulse->count == 0, nowf->count == 0,
+        threads->ival[0]);
 
 exit:
     // Cleanup: release memory
     arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
     if(tld_path_free && tld_path)
         free(tld_path);
+    free(spans);
 
     return failed;
 }